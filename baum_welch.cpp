@@ -17,32 +17,47 @@
 #include <iostream>
 #include <fstream>
 #include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
 
 #include <maikel/hmm/algorithm.h>
 #include <maikel/hmm/io.h>
+#include <maikel/perf_counters.h>
 
 using namespace std;
 using namespace maikel;
-using row_vector = hmm::hidden_markov_model<double>::row_vector;
+using sequence_type = hmm::packed_sequence<>;
 
-double calculate_alpha(vector<uint8_t> const& sequence, hmm::hidden_markov_model<double> const& hmm,
-    vector<double>& scaling, vector<row_vector>& alphas)
+enum Exit_Error_Codes {
+  exit_success = 0,
+  exit_not_enough_arguments = 1,
+  exit_io_error = 2,
+  exit_argument_error = 3
+};
+
+template <class T>
+hmm::accumulator_t<T> calculate_alpha(sequence_type const& sequence, hmm::hidden_markov_model<T> const& hmm,
+    vector<T>& scaling, vector<typename hmm::hidden_markov_model<T>::row_vector>& alphas)
 {
-  double logprob = 0;
+  using row_vector = typename hmm::hidden_markov_model<T>::row_vector;
+  hmm::accumulator_t<T> logprob = 0;
   size_t count = 0;
-  for (pair<double, row_vector> const& sal
+  for (pair<T, row_vector> const& sal
       : hmm::forward(begin(sequence), end(sequence), hmm)) {
     scaling[count] = sal.first;
     alphas[count]  = sal.second;
-    logprob += log(sal.first);
+    logprob += log(static_cast<hmm::accumulator_t<T>>(sal.first));
     ++count;
   }
   return logprob;
 }
 
-void calculate_beta(vector<uint8_t> const& sequence, hmm::hidden_markov_model<double> const& hmm,
-    vector<double> const& scaling, vector<row_vector>& betas)
+template <class T>
+void calculate_beta(sequence_type const& sequence, hmm::hidden_markov_model<T> const& hmm,
+    vector<T> const& scaling, vector<typename hmm::hidden_markov_model<T>::row_vector>& betas)
 {
+  using row_vector = typename hmm::hidden_markov_model<T>::row_vector;
   size_t count = 0;
   for (row_vector const& beta
       : hmm::backward(sequence.rbegin(), sequence.rend(), scaling.rbegin(), hmm)) {
@@ -51,47 +66,52 @@ void calculate_beta(vector<uint8_t> const& sequence, hmm::hidden_markov_model<do
   }
 }
 
-template <class Update>
+template <class Update, class T>
 void update_hmm(
     Update& update,
-    vector<uint8_t>& sequence,
-    vector<row_vector>& alphas,
-    vector<row_vector>& betas,
-    vector<double>& scaling,
-    row_vector& pi,
-    hmm::hidden_markov_model<double>& hmm)
+    sequence_type const& sequence,
+    vector<typename hmm::hidden_markov_model<T>::row_vector>& alphas,
+    vector<typename hmm::hidden_markov_model<T>::row_vector>& betas,
+    vector<T>& scaling,
+    typename hmm::hidden_markov_model<T>::row_vector& pi,
+    hmm::hidden_markov_model<T>& hmm)
 {
+  MAIKEL_KERNEL_PROFILER(work, "baum_welch::update_matrices");
   auto matrices = update(begin(sequence), end(sequence), begin(alphas), begin(betas), scaling.back(), hmm);
+  // per step three multiplications and two additions for every pair of states
+  double states = static_cast<double>(hmm.states());
+  double symbols = static_cast<double>(sequence.size());
+  work.add_work(5.0*states*states*symbols, sizeof(T)*(3.0*states*states + 4.0*states)*symbols, sequence.size());
   pi = alphas[0].cwiseProduct(betas[0]) / scaling[0];
   //    cout << "step #" << step << " log P(O|lambda): " << -logprob << "\n";
   //    cout << matrices.first.format(Eigen::IOFormat(5)) << endl;
-  hmm = hmm::hidden_markov_model<double>(matrices.first, matrices.second, pi);
+  // the expected counts come in the accumulator type
+  hmm = hmm::hidden_markov_model<T>(
+      matrices.first.template cast<T>(), matrices.second.template cast<T>(), pi);
 }
 
-int main(int argc, char** argv)
+/**
+ * Re-estimates the model until the log-likelihood converges. Its parameters
+ * and coefficients are stored in T, a float model runs in mixed precision.
+ */
+template <class T>
+void train(hmm::hidden_markov_model<T> hmm, sequence_type const& sequence)
 {
-  if (argc < 3) {
-    cerr << "Usage: " << argv[0] << " <model.dat> <sequence.dat>\n";
-    return 1;
-  }
-
-  // read data
-  ifstream model_input(argv[1]);
-  auto hmm = hmm::read_hidden_markov_model<double>(model_input);
-  ifstream sequence_input(argv[2]);
-  vector<uint8_t> sequence = hmm::read_sequence<uint8_t>(sequence_input);
-  vector<double> scaling(sequence.size());
+  using row_vector = typename hmm::hidden_markov_model<T>::row_vector;
+  vector<T> scaling(sequence.size());
   vector<row_vector> alphas(sequence.size());
   vector<row_vector> betas(sequence.size());
   row_vector pi(hmm.states());
 
   size_t step = 0;
-  double logprob_old = 0, logprob = 0;
+  hmm::accumulator_t<T> logprob_old = 0, logprob = 0;
+  // rounding the model to T moves log P by a few epsilon per symbol, see precision.h
+  hmm::accumulator_t<T> resolution = numeric_limits<T>::epsilon() * sequence.size();
   auto update = hmm::update_matrices<
-      decltype(sequence)::iterator,
-        decltype(alphas)::iterator,
-         decltype(betas)::iterator,
-                            double>(hmm.states(), hmm.symbols());
+      sequence_type::const_iterator,
+      typename vector<row_vector>::iterator,
+      typename vector<row_vector>::iterator,
+                                          T>(hmm.states(), hmm.symbols());
 
   cout.flags(ios_base::fixed);
   do {
@@ -104,7 +124,45 @@ int main(int argc, char** argv)
     calculate_beta(sequence, hmm, scaling, betas);
 
     update_hmm(update, sequence, alphas, betas, scaling, pi, hmm);
-  } while (!almost_equal<double,100>(logprob, logprob_old));
+  } while (!almost_equal<hmm::accumulator_t<T>,100>(logprob, logprob_old)
+      && std::abs(logprob - logprob_old) >= resolution);
 
   cout << "steps: " << step << ", A:\n" << hmm.transition_matrix() << endl;
 }
+
+void print_usage(char const* program)
+{
+  cerr << "Usage: " << program << " [--mixed] <model.dat> <sequence.dat>\n"
+       << "With --mixed the model and the coefficients are kept in float and the\n"
+       << "expected counts and the log-likelihood are summed in double.\n";
+}
+
+int main(int argc, char** argv)
+{
+  bool mixed = false;
+  vector<string> arguments;
+  for (int i = 1; i < argc; ++i) {
+    string argument(argv[i]);
+    if (argument == "--mixed")
+      mixed = true;
+    else
+      arguments.push_back(argument);
+  }
+  if (arguments.size() < 2) {
+    print_usage(argv[0]);
+    return exit_not_enough_arguments;
+  }
+
+  // read data
+  ifstream model_input(arguments[0]);
+  auto hmm = hmm::read_hidden_markov_model<double>(model_input);
+  ifstream sequence_input(arguments[1]);
+  sequence_type sequence = hmm::read_packed_sequence(sequence_input);
+
+  if (mixed)
+    train(hmm::precision_cast<float>(hmm), sequence);
+  else
+    train(hmm, sequence);
+  kernel_counters::print_statistics(cerr);
+  return exit_success;
+}
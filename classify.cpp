@@ -0,0 +1,118 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "maikel/hmm/model_bank.h"
+#include "maikel/hmm/symbol_reader.h"
+#include "maikel/hmm/algorithm/multi_forward.h"
+#include "maikel/hmm/algorithm/early_abandon.h"
+#include "maikel/hmm/packed_sequence.h"
+
+enum Exit_Error_Codes {
+  exit_success = 0,
+  exit_not_enough_arguments = 1,
+  exit_io_error = 2,
+  exit_argument_error = 3
+};
+
+void print_usage(char const* program)
+{
+  std::cerr << "Usage: " << program << " [--all | --early [--top <k>]] <models.bank> <sequence.dat|->\n"
+            << "Prints the model with the highest likelihood or, with --all, the\n"
+            << "log-likelihoods of all models. --early stops scoring models which\n"
+            << "can no longer be among the best k and keeps the sequence in memory.\n";
+}
+
+int main(int argc, char *argv[])
+{
+  using float_type = double;
+
+  bool all = false;
+  bool early = false;
+  std::size_t top = 1;
+  std::vector<std::string> arguments;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+    if (argument == "--all")
+      all = true;
+    else if (argument == "--early")
+      early = true;
+    else if (argument == "--top" && i+1 < argc)
+      top = std::stoul(argv[++i]);
+    else
+      arguments.push_back(argument);
+  }
+  if (arguments.size() < 2 || (all && early) || top == 0) {
+    print_usage(argv[0]);
+    return exit_not_enough_arguments;
+  }
+
+  try {
+    maikel::hmm::model_bank<float_type> bank(arguments[0]);
+    if (bank.empty()) {
+      std::cerr << "The model bank is empty.\n";
+      return exit_argument_error;
+    }
+    maikel::hmm::symbol_reader reader(arguments[1]);
+    std::vector<maikel::hmm::packed_symbol> chunk(std::size_t{1} << 16);
+
+    if (early) {
+      std::vector<maikel::hmm::hidden_markov_model<float_type> const*> models;
+      std::size_t symbols = 0;
+      for (std::size_t i = 0; i < bank.size(); ++i) {
+        models.push_back(&bank[i]);
+        symbols = i ? std::min(symbols, bank.symbols(i)) : bank.symbols(i);
+      }
+      if (reader.symbols() > symbols) {
+        std::cerr << "The sequence has more symbols than some of the models.\n";
+        return exit_argument_error;
+      }
+      maikel::hmm::packed_sequence<> sequence(symbols);
+      while (std::size_t n = reader.read(chunk.data(), chunk.size()))
+        for (std::size_t t = 0; t < n; ++t)
+          sequence.push_back(chunk[t]);
+      auto result = maikel::hmm::early_abandon_scores(sequence.begin(), sequence.end(), models, top);
+      for (std::size_t k : result.ranking)
+        std::cout << bank.name(k) << '\t' << result.log_likelihoods[k] << '\n';
+      return exit_success;
+    }
+
+    maikel::hmm::multi_forward_scorer<float_type> scorer(bank);
+    if (reader.symbols() > scorer.symbols()) {
+      std::cerr << "The sequence has more symbols than some of the models.\n";
+      return exit_argument_error;
+    }
+    while (std::size_t n = reader.read(chunk.data(), chunk.size()))
+      scorer.push(chunk.begin(), chunk.begin() + n);
+
+    if (all) {
+      std::vector<float_type> logprobs = scorer.log_likelihoods();
+      for (std::size_t i = 0; i < bank.size(); ++i)
+        std::cout << bank.name(i) << '\t' << logprobs[i] << '\n';
+    } else {
+      std::size_t best = scorer.best();
+      std::cout << bank.name(best) << '\t' << scorer.log_likelihood(best) << '\n';
+    }
+  } catch (std::exception const& error) {
+    std::cerr << error.what() << "\n";
+    return exit_io_error;
+  }
+  return exit_success;
+}
@@ -15,6 +15,9 @@
 #include "maikel/hmm/algorithm.h"
 #include "maikel/hmm/io.h"
 #include "maikel/function_profiler.h"
+#include "maikel/perf_counters.h"
+#include "maikel/hmm/symbol_reader.h"
+#include "maikel/iterator/mapped_coefficients.h"
 
 
 enum Exit_Error_Codes {
@@ -38,7 +41,7 @@ template <class float_type, class index_type>
     std::size_t datalen = sizeof(float_type)*states;
     { MAIKEL_PROFILER;
       std::ostreambuf_iterator<char> out(alphas);
-      for (auto&& scaled_alpha : maikel::hmm::forward(sequence, model)) {
+      for (auto&& scaled_alpha : maikel::hmm::forward(begin(sequence), end(sequence), model)) {
         logprob += std::log(scaled_alpha.first);
         std::copy_n(reinterpret_cast<const char*>(scaled_alpha.second.data()), datalen, out);
       }
@@ -47,17 +50,116 @@ template <class float_type, class index_type>
   }
 
 template <class T>
-void read_alphas_from_bin(const maikel::hmm::hidden_markov_model<T>& hmm)
+T read_alphas_from_bin(const maikel::hmm::hidden_markov_model<T>& hmm)
 {
   MAIKEL_PROFILER;
-  std::ifstream alphas("alphas.bin", std::ifstream::binary);
-  Eigen::Matrix<T, 1, Eigen::Dynamic> alpha(hmm.states());
-  std::size_t data_len = sizeof(T)*alpha.size();
-  std::istreambuf_iterator<char> in(alphas), end;
-  while (in != end) {
-    std::copy_n(in, data_len, reinterpret_cast<char*>(alpha.data()));
-    std::advance(in, data_len+1);
+  maikel::mapped_coefficients<T> alphas("alphas.bin", hmm.states(), false);
+  T checksum = 0;
+  for (auto&& alpha : alphas)
+    checksum += alpha.second.sum();
+  return checksum;
+}
+
+/// Multiply-adds of alpha A, the product with B and the normalization per symbol.
+double forward_flops_per_symbol(std::size_t states)
+{
+  return 2.0*states*states + 3.0*states;
+}
+
+/// A, the column of B and alpha are read, the next alpha is written.
+double forward_bytes_per_symbol(std::size_t states, std::size_t size)
+{
+  return static_cast<double>(size)*(states*states + 3.0*states);
+}
+
+/**
+ * Scores the sequence while it is read, so that memory stays in the order of
+ * the number of states. Prints the log-likelihood after every `every`
+ * symbols if `every` is positive and at the end.
+ */
+template <class float_type>
+  int stream_log_likelihood(
+      std::string const& path, std::uint64_t every,
+      maikel::hmm::hidden_markov_model<float_type> const& model)
+  {
+    MAIKEL_PROFILER;
+    maikel::hmm::symbol_reader reader(path);
+    if (reader.symbols() > static_cast<std::size_t>(model.symbols())) {
+      std::cerr << "The sequence has more symbols than the model.\n";
+      return exit_argument_error;
+    }
+    maikel::hmm::forward_scorer<float_type> scorer(model);
+    std::vector<maikel::hmm::packed_symbol> chunk(std::size_t{1} << 16);
+    std::uint64_t next_report = every;
+    MAIKEL_KERNEL_PROFILER(work, "forward_scorer::push");
+    while (std::size_t n = reader.read(chunk.data(), chunk.size())) {
+      auto first = chunk.begin();
+      auto last = chunk.begin() + n;
+      while (every && scorer.length() + (last - first) >= next_report) {
+        auto split = first + (next_report - scorer.length());
+        scorer.push(first, split);
+        std::cout << scorer.length() << '\t' << scorer.log_likelihood() << '\n';
+        first = split;
+        next_report += every;
+      }
+      scorer.push(first, last);
+    }
+    std::size_t states = static_cast<std::size_t>(model.states());
+    work.add_work(forward_flops_per_symbol(states)*scorer.length(),
+        forward_bytes_per_symbol(states, sizeof(float_type))*scorer.length(), scorer.length());
+    std::cout << scorer.log_likelihood() << std::endl;
+    return exit_success;
+  }
+
+/**
+ * Prints the position, the log-likelihood of the last `window` symbols and
+ * the alarm, if any, for every symbol of the sequence while it is read.
+ */
+template <class float_type>
+  int stream_window_log_likelihood(
+      std::string const& path, std::size_t window,
+      maikel::hmm::window_alarm_options<float_type> const& alarms,
+      maikel::hmm::hidden_markov_model<float_type> const& model)
+  {
+    MAIKEL_PROFILER;
+    maikel::hmm::symbol_reader reader(path);
+    if (reader.symbols() > static_cast<std::size_t>(model.symbols())) {
+      std::cerr << "The sequence has more symbols than the model.\n";
+      return exit_argument_error;
+    }
+    maikel::hmm::sliding_window_scorer<float_type> scorer(model, window);
+    maikel::hmm::window_alarm_monitor<float_type> monitor(alarms);
+    std::vector<maikel::hmm::packed_symbol> chunk(std::size_t{1} << 16);
+    while (std::size_t n = reader.read(chunk.data(), chunk.size())) {
+      for (std::size_t t = 0; t < n; ++t) {
+        float_type logprob = scorer.push(chunk[t]);
+        std::cout << scorer.position() << '\t' << logprob;
+        if (scorer.full()) {
+          maikel::hmm::window_alarm alarm = monitor.update(logprob, scorer.size());
+          if (alarm == maikel::hmm::window_alarm::threshold)
+            std::cout << "\tthreshold";
+          else if (alarm == maikel::hmm::window_alarm::cusum)
+            std::cout << "\tcusum";
+        }
+        std::cout << '\n';
+      }
+    }
+    return exit_success;
   }
+
+void print_usage(char const* program)
+{
+  std::cerr << "Usage: " << program << " [--stream] [--mixed] [--block] [--every <n>] <model.dat> <sequence.dat|->\n"
+            << "       " << program << " --window <w> [--threshold <x>] [--cusum <target> <limit>]\n"
+            << "           <model.dat> <sequence.dat|->\n"
+            << "With --window the log-likelihood of the last w symbols is printed after\n"
+            << "every symbol. Full windows whose mean log-likelihood per symbol is below\n"
+            << "the threshold, or whose cumulative shortfall below the target exceeds\n"
+            << "the limit, are marked. --mixed streams the sequence through a float\n"
+            << "copy of the model and sums the log-likelihood in double. --block scores\n"
+            << "with block transfer tables instead, which hold at least M N x N matrices\n"
+            << "and take at least M N^3 operations to build, so they only pay off for\n"
+            << "small models and alphabets.\n";
 }
 
 int main(int argc, char *argv[])
@@ -65,31 +167,88 @@ int main(int argc, char *argv[])
   using namespace std;
   using namespace maikel::hmm;
 
-  if (argc < 3) {
-    cerr << "Usage: " << argv[0] << " <model.dat> <sequence.dat>\n";
+  bool stream = false;
+  bool mixed = false;
+  bool block = false;
+  uint64_t every = 0;
+  size_t window = 0;
+  window_alarm_options<double> alarms;
+  vector<string> arguments;
+  for (int i = 1; i < argc; ++i) {
+    string argument(argv[i]);
+    if (argument == "--stream")
+      stream = true;
+    else if (argument == "--mixed")
+      mixed = true;
+    else if (argument == "--block")
+      block = true;
+    else if (argument == "--every" && i+1 < argc)
+      every = static_cast<uint64_t>(stod(argv[++i]));
+    else if (argument == "--window" && i+1 < argc)
+      window = static_cast<size_t>(stod(argv[++i]));
+    else if (argument == "--threshold" && i+1 < argc)
+      alarms.threshold = stod(argv[++i]);
+    else if (argument == "--cusum" && i+2 < argc) {
+      alarms.cusum_target = stod(argv[++i]);
+      alarms.cusum_limit = stod(argv[++i]);
+    }
+    else
+      arguments.push_back(argument);
+  }
+  if (arguments.size() < 2) {
+    print_usage(argv[0]);
     return exit_not_enough_arguments;
   }
+  if (block && (stream || mixed || every || window || arguments[1] == "-")) {
+    cerr << "--block scores a whole sequence file and cannot be combined with\n"
+         << "--stream, --mixed, --every, --window or a sequence from stdin.\n";
+    return exit_argument_error;
+  }
   using float_type = double;
   using index_type = uint8_t;
 
   // read model
-  ifstream model_input(argv[1]);
+  ifstream model_input(arguments[0]);
   auto model = read_hidden_markov_model<float_type>(model_input);
 
+  if (window) {
+    int result = stream_window_log_likelihood(arguments[1], window, alarms, model);
+    maikel::function_profiler::print_statistics(cerr);
+    maikel::kernel_counters::print_statistics(cerr);
+    return result;
+  }
+
+  if (stream || mixed || arguments[1] == "-" || every) {
+    int result = mixed
+        ? stream_log_likelihood(arguments[1], every, precision_cast<float>(model))
+        : stream_log_likelihood(arguments[1], every, model);
+    maikel::function_profiler::print_statistics(cerr);
+    maikel::kernel_counters::print_statistics(cerr);
+    return result;
+  }
+
   vector<int> symbols { 0,1 };
   map<int,index_type> symbol_to_index = maikel::map_from_symbols<index_type>(symbols);
-  ifstream sequence_input(argv[2]);
+  ifstream sequence_input(arguments[1]);
   vector<index_type> sequence = read_sequence(sequence_input, symbol_to_index);
 
-  {
-    MAIKEL_NAMED_PROFILER("v2::forward");
+  if (block) {
+    MAIKEL_NAMED_PROFILER("v3::block_forward");
+    block_transfer_table<float_type> table(model);
+    cout << block_log_likelihood(begin(sequence), end(sequence), table, model) << endl;
+  } else {
+    MAIKEL_KERNEL_PROFILER(work, "v2::forward");
     float_type scaling = 0;
     for (auto&& alpha : forward(begin(sequence), end(sequence), model)) {
       scaling += log(alpha.first);
     }
+    size_t states = static_cast<size_t>(model.states());
+    work.add_work(forward_flops_per_symbol(states)*sequence.size(),
+        forward_bytes_per_symbol(states, sizeof(float_type))*sequence.size(), sequence.size());
     cout << -scaling << endl;
   }
   maikel::function_profiler::print_statistics(cout);
+  maikel::kernel_counters::print_statistics(cout);
 
   return exit_success;
 }
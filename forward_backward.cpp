@@ -17,100 +17,156 @@
 #include <maikel/hmm/hidden_markov_model.h>
 #include <maikel/hmm/algorithm.h>
 #include <maikel/hmm/io.h>
+#include <maikel/hmm/binary_sequence.h>
+#include <maikel/iterator/async_binary_writer.h>
+#include <maikel/iterator/bfloat16_coefficients.h>
+#include <maikel/iterator/reverse_block_reader.h>
+#include <maikel/mapped_file.h>
+#include <maikel/perf_counters.h>
 
 #include <gsl_util.h>
 
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <string>
 
 using namespace maikel;
 using namespace std;
 using namespace gsl;
 using model = maikel::hmm::hidden_markov_model<double>;
+using sequence_type = maikel::hmm::packed_sequence<>;
 
-pair<model, vector<uint8_t>>
-read_model_and_sequence(
-    string const& model_path,
-    string const& seq_path,
-    vector<int> const& symbols)
+model read_model(string const& model_path)
 {
   MAIKEL_PROFILER;
   ifstream model_in(model_path);
-  auto hmm = hmm::read_hidden_markov_model<double>(model_in);
-  map<int,uint8_t> symbol_to_index = map_from_symbols<uint8_t>(symbols);
-  ifstream seq_in(seq_path);
-  cout << "Read sequence ...\n";
-  vector<uint8_t> sequence = hmm::read_sequence(seq_in, symbol_to_index);
-  return {hmm, sequence};
+  return hmm::read_hidden_markov_model<double>(model_in);
 }
 
-void
-calculate_forward_coeff(
-    vector<uint8_t> const& seq, model const& hmm, ofstream& alphas, ofstream& scaling)
+sequence_type
+read_text_sequence(string const& seq_path, vector<int> const& symbols)
 {
   MAIKEL_PROFILER;
-  cout << "Calculate and Write data for forward coefficients ...\n";
-  for (auto&& coeff : hmm::forward(begin(seq), end(seq), hmm)) {
-    double factor = coeff.first;
-    model::row_vector const& alpha = coeff.second;
-    scaling.write(reinterpret_cast<char*>(&factor), sizeof(factor));
-    alphas.write(reinterpret_cast<const char*>(alpha.data()), sizeof(double)*hmm.states());
-  }
+  map<int,hmm::packed_symbol> symbol_to_index = map_from_symbols<hmm::packed_symbol>(symbols);
+  ifstream seq_in(seq_path);
+  cout << "Read sequence ...\n";
+  return hmm::read_packed_sequence(seq_in, symbol_to_index);
 }
 
-void
-calculate_backward_coeff(
-    vector<uint8_t> const& seq, model const& hmm, vector<double>& scaling, ofstream& betas)
+bool is_binary_sequence(string const& seq_path)
 {
-  MAIKEL_PROFILER;
-  cout << "Calculate and Write data for backward coefficients ...\n";
-  for (auto&& coeff : hmm::backward(begin(seq), begin(seq)+scaling.size(), scaling.rbegin(), hmm)) {
-    betas.write(reinterpret_cast<const char*>(coeff.data()), sizeof(double)*hmm.states());
-  }
+  ifstream seq_in(seq_path, ifstream::binary);
+  return hmm::is_packed_sequence(seq_in);
 }
 
-vector<double>
-get_reversed_chunk(ifstream& scaling, streamoff offset, streamsize max)
-{
-  MAIKEL_PROFILER;
-  scaling.clear();
-  scaling.seekg(0, ios::end);
-  streamsize length = narrow<streamsize>(scaling.tellg());
-  streamsize off = min(narrow<streamsize>(offset+max), length);
-  off /= sizeof(double);
-  off *= sizeof(double);
-  scaling.clear();
-  scaling.seekg(-off, ios::end);
-  cout << "Reading scaling factors from negative offset: " << -off << endl;
-  vector<double> factors(narrow<vector<double>::size_type>(off)/sizeof(double));
-  copy(istreambuf_iterator<char>(scaling), istreambuf_iterator<char>(), reinterpret_cast<char*>(factors.data()));
-  return factors;
-}
+/**
+ * The coefficients are written through AlphaOut, which is
+ * async_binary_output_iterator<double> for full records or
+ * async_bfloat16_output_iterator<double> for the compact spill format.
+ * The scaling factors are always written in double.
+ */
+template <class AlphaOut, class SequenceIter>
+  void
+  calculate_forward_coeff(
+      SequenceIter first, SequenceIter last, model const& hmm,
+      async_binary_writer& alphas, async_binary_writer& scaling)
+  {
+    MAIKEL_KERNEL_PROFILER(work, "calculate_forward_coeff");
+    cout << "Calculate and Write data for forward coefficients ...\n";
+    AlphaOut alpha_out(alphas);
+    async_binary_output_iterator<double> scaling_out(scaling);
+    std::uint64_t length = 0;
+    for (auto&& coeff : hmm::forward(first, last, hmm)) {
+      *scaling_out++ = coeff.first;
+      *alpha_out++ = coeff.second;
+      ++length;
+    }
+    // alpha A, the product with B and the normalization, A and B are read and alpha is written
+    double N = static_cast<double>(hmm.states());
+    work.add_work((2*N*N + 3*N)*length, sizeof(double)*(N*N + 4*N + 1)*length, length);
+  }
+
+/**
+ * Expects the sequence in reversed order. The scaling factors are read
+ * backwards from scaling.dat, so only one block of them is in memory.
+ */
+template <class BetaOut, class ReversedSequenceIter>
+  void
+  calculate_backward_coeff(
+      ReversedSequenceIter rfirst, ReversedSequenceIter rlast, model const& hmm,
+      async_binary_writer& betas)
+  {
+    MAIKEL_KERNEL_PROFILER(work, "calculate_backward_coeff");
+    cout << "Calculate and Write data for backward coefficients ...\n";
+    reverse_binary_reader<double> scaling("scaling.dat");
+    BetaOut beta_out(betas);
+    std::uint64_t length = 0;
+    for (auto&& coeff : hmm::backward(rfirst, rlast, scaling.begin(), hmm)) {
+      *beta_out++ = coeff;
+      ++length;
+    }
+    double N = static_cast<double>(hmm.states());
+    work.add_work((2*N*N + 2*N)*length, sizeof(double)*(N*N + 4*N + 1)*length, length);
+  }
+
+template <class CoefficientOut>
+  void
+  calculate_coefficients(model const& hmm, char const* seq_path, char const* suffix)
+  {
+    string alphas_path = string("alphas") + suffix;
+    string betas_path = string("betas") + suffix;
+    if (is_binary_sequence(seq_path)) {
+      // packed binary input is streamed in both directions and never loaded as a whole
+      ifstream seq_in(seq_path, ifstream::binary);
+      hmm::packed_sequence_header header = hmm::read_packed_sequence_header(seq_in);
+      mapped_file file(seq_path, mapped_file::access_pattern::sequential);
+      if (file.size() < sizeof(header) + hmm::packed_words(header)*sizeof(std::uint64_t))
+        throw hmm::binary_sequence_error("Packed sequence is shorter than its header claims.");
+      hmm::packed_sequence_view<> sequence(
+          reinterpret_cast<std::uint64_t const*>(file.data() + sizeof(header)),
+          header.bits, narrow<std::size_t>(header.length));
+      {
+        async_binary_writer alphas(alphas_path);
+        async_binary_writer scaling("scaling.dat");
+        calculate_forward_coeff<CoefficientOut>(begin(sequence), end(sequence), hmm, alphas, scaling);
+      }
+      {
+        async_binary_writer betas(betas_path);
+        reverse_packed_sequence_reader reversed(seq_path);
+        calculate_backward_coeff<CoefficientOut>(reversed.begin(), reversed.end(), hmm, betas);
+      }
+    } else {
+      sequence_type sequence = read_text_sequence(seq_path, {0, 1});
+      {
+        async_binary_writer alphas(alphas_path);
+        async_binary_writer scaling("scaling.dat");
+        calculate_forward_coeff<CoefficientOut>(begin(sequence), end(sequence), hmm, alphas, scaling);
+      }
+      {
+        async_binary_writer betas(betas_path);
+        calculate_backward_coeff<CoefficientOut>(sequence.rbegin(), sequence.rend(), hmm, betas);
+      }
+    }
+  }
 
 int main(int argc, char** argv)
 {
-  if (argc < 3) {
-    std::cerr << "Not enough arguments. Usage: " << argv[0] << " <model.hmm> <sequence.dat>\n";
+  // --bfloat16 writes alphas.bf16 and betas.bf16 instead of alphas.dat and betas.dat
+  bool bfloat16 = argc > 1 && string(argv[1]) == "--bfloat16";
+  int first = bfloat16 ? 2 : 1;
+  if (argc < first + 2) {
+    std::cerr << "Not enough arguments. Usage: " << argv[0] << " [--bfloat16] <model.hmm> <sequence.dat>\n";
     std::terminate();
   }
 
-  const streamsize gigabyte = 1024*1024*1024;
-
-  auto parameter = read_model_and_sequence(argv[1], argv[2], {0, 1});
-  model& hmm = parameter.first;
-  vector<uint8_t>& sequence = parameter.second;
+  model hmm = read_model(argv[first]);
 
-  {
-    ofstream alphas("alphas.dat", ofstream::binary);
-    ofstream scaling("scaling.dat", ofstream::binary);
-    calculate_forward_coeff(sequence, hmm, alphas, scaling);
-  }
-  {
-    ifstream scaling("scaling.dat", ifstream::binary);
-    ofstream betas("betas.dat", ofstream::binary);
-    vector<double> chunk = get_reversed_chunk(scaling, 0, gigabyte);
-    calculate_backward_coeff(sequence, hmm, chunk, betas);
-  }
+  if (bfloat16)
+    calculate_coefficients<async_bfloat16_output_iterator<double>>(hmm, argv[first + 1], ".bf16");
+  else
+    calculate_coefficients<async_binary_output_iterator<double>>(hmm, argv[first + 1], ".dat");
 
   function_profiler::print_statistics(cout);
+  kernel_counters::print_statistics(cout);
 }
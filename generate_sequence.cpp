@@ -14,14 +14,25 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
 
-#include <boost/iterator/function_input_iterator.hpp>
 #include <boost/iterator/counting_iterator.hpp>
 
 #include "maikel/hmm/hidden_markov_model.h"
 #include "maikel/hmm/sequence_generator.h"
+#include "maikel/hmm/binary_sequence.h"
 #include "maikel/hmm/io.h"
 
 enum Exit_Error_Codes {
@@ -31,36 +42,124 @@ enum Exit_Error_Codes {
   exit_argument_error = 3
 };
 
+void print_usage(char const* program)
+{
+  std::cerr << "Usage: " << program << " [--binary] [--states <states-file>]"
+            << " <model.dat> <sequence-length> [seed]\n";
+}
+
+/// Parses a decimal length which fills the whole argument. Returns 0, which is no valid length, otherwise.
+std::size_t parse_length(std::string const& text)
+{
+  if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0])))
+    return 0;
+  errno = 0;
+  char* end = nullptr;
+  unsigned long long length = std::strtoull(text.c_str(), &end, 10);
+  if (errno == ERANGE || *end != '\0' || length > std::numeric_limits<std::size_t>::max())
+    return 0;
+  return static_cast<std::size_t>(length);
+}
+
+template <class Index>
+void write_text_header(std::ostream& out, Index symbols, std::size_t length)
+{
+  std::copy(boost::make_counting_iterator<Index>(0),
+            boost::make_counting_iterator<Index>(symbols),
+            std::ostream_iterator<Index>(out, " "));
+  out << "\n" << length << "\n";
+}
+
 int main(int argc, char *argv[])
 {
-  if (argc < 3) {
-    std::cerr << "Usage: " << argv[0] << " <model.dat> <sequence-length>\n";
+  bool binary = false;
+  std::string states_path;
+  std::vector<std::string> arguments;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+    if (argument == "--binary")
+      binary = true;
+    else if (argument == "--states" && i+1 < argc)
+      states_path = argv[++i];
+    else
+      arguments.push_back(argument);
+  }
+  if (arguments.size() < 2) {
+    print_usage(argv[0]);
     return exit_not_enough_arguments;
   }
-  std::ifstream input(argv[1]);
+
+  // Try to read the HMM-model that will be used to generate a random sequence.
+  std::ifstream input(arguments[0]);
   input.exceptions(std::ifstream::failbit | std::ifstream::badbit);
   auto model = maikel::hmm::read_hidden_markov_model<float>(input);
   input.close();
 
-  // Try to read the HMM-model that will be used to generate a random sequence.
-
-  std::istringstream obslen_converter(argv[2]);
-  std::size_t obslen;
-  if (!(obslen_converter >> obslen) || obslen == 0) {
+  std::size_t obslen = parse_length(arguments[1]);
+  if (obslen == 0) {
     std::cerr << "Could not convert sequence length to std::size_t.\n";
     return exit_argument_error;
   }
 
+  std::uint64_t seed = std::random_device()();
+  if (arguments.size() > 2) {
+    std::istringstream seed_converter(arguments[2]);
+    if (!(seed_converter >> seed)) {
+      std::cerr << "Could not convert seed to an unsigned integer.\n";
+      return exit_argument_error;
+    }
+  }
+
+  std::ofstream states_output;
+  if (!states_path.empty()) {
+    states_output.open(states_path, binary ? std::ofstream::binary : std::ofstream::out);
+    if (!states_output) {
+      std::cerr << "Could not open " << states_path << " for writing.\n";
+      return exit_io_error;
+    }
+  }
+  bool with_states = states_output.is_open();
+
   using Index = decltype(model)::size_type;
-  std::copy(boost::make_counting_iterator<Index>(0),
-            boost::make_counting_iterator<Index>(model.symbols()),
-            std::ostream_iterator<Index>(std::cout, " "));
-  std::cout << "\n" << obslen << "\n";
-  std::function<Index()> generator = maikel::hmm::make_sequence_generator(model);
-  std::copy(boost::make_function_input_iterator(generator, std::size_t{0}),
-            boost::make_function_input_iterator(generator, obslen),
-            std::ostream_iterator<Index>(std::cout, " "));
+  auto generator = maikel::hmm::make_sequence_generator(model, seed);
+  const std::size_t batch_length = std::size_t{1} << 22;
+  std::vector<std::uint32_t> symbols(std::min(obslen, batch_length));
+  std::vector<std::uint32_t> states(symbols.size());
+
+  if (binary) {
+    std::ios_base::sync_with_stdio(false);
+    maikel::hmm::binary_sequence_writer symbol_writer(std::cout, model.symbols(), obslen);
+    std::unique_ptr<maikel::hmm::binary_sequence_writer> state_writer;
+    if (with_states)
+      state_writer.reset(new maikel::hmm::binary_sequence_writer(states_output, model.states(), obslen));
+    for (std::size_t generated = 0; generated < obslen; ) {
+      std::size_t n = std::min(batch_length, obslen - generated);
+      generator.generate_into(n, symbols.data(), states.data());
+      symbol_writer.write(symbols.begin(), symbols.begin() + n);
+      if (state_writer)
+        state_writer->write(states.begin(), states.begin() + n);
+      generated += n;
+    }
+    symbol_writer.close();
+    if (state_writer)
+      state_writer->close();
+    return exit_success;
+  }
+
+  write_text_header<Index>(std::cout, model.symbols(), obslen);
+  if (with_states)
+    write_text_header<Index>(states_output, model.states(), obslen);
+  for (std::size_t generated = 0; generated < obslen; ) {
+    std::size_t n = std::min(batch_length, obslen - generated);
+    generator.generate_into(n, symbols.data(), states.data());
+    std::copy(symbols.begin(), symbols.begin() + n, std::ostream_iterator<std::uint32_t>(std::cout, " "));
+    if (with_states)
+      std::copy(states.begin(), states.begin() + n, std::ostream_iterator<std::uint32_t>(states_output, " "));
+    generated += n;
+  }
   std::cout << std::endl;
+  if (with_states)
+    states_output << std::endl;
 
   return exit_success;
 }
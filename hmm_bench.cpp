@@ -0,0 +1,377 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/algorithm.h"
+#include "maikel/hmm/io.h"
+#include "maikel/hmm/isa_kernels.h"
+#include "maikel/hmm/sequence_generator.h"
+
+enum Exit_Error_Codes {
+  exit_success = 0,
+  exit_not_enough_arguments = 1,
+  exit_io_error = 2,
+  exit_argument_error = 3
+};
+
+using clock_type = std::chrono::steady_clock;
+
+volatile double sink;
+
+struct bench_options {
+    std::vector<std::size_t> states { 2, 8, 32 };
+    std::vector<std::size_t> symbols { 2, 16 };
+    std::vector<std::size_t> lengths { 10000, 100000 };
+    std::vector<std::string> algorithms { "forward", "backward", "baum_welch", "generate", "parse" };
+    std::vector<std::string> precisions { "double" };
+    unsigned warmup = 1;
+    unsigned repetitions = 5;
+    std::uint64_t seed = 1;
+    std::size_t max_coefficient_bytes = std::size_t{1} << 30;
+};
+
+/// Work of one run per symbol. Bytes are those touched by the kernel, caches included.
+struct work_model {
+    double flops;
+    double bytes;
+};
+
+struct bench_result {
+    std::string algorithm;
+    std::string precision;
+    std::size_t float_bytes;
+    std::size_t states;
+    std::size_t symbols;
+    std::size_t length;
+    std::vector<double> ns_per_symbol;   // one per repetition
+    work_model work;
+};
+
+struct summary {
+    double median, mean, stddev, min, max;
+};
+
+summary summarize(std::vector<double> samples)
+{
+  std::sort(samples.begin(), samples.end());
+  std::size_t n = samples.size();
+  summary s;
+  s.median = n % 2 ? samples[n/2] : (samples[n/2 - 1] + samples[n/2]) / 2;
+  s.min = samples.front();
+  s.max = samples.back();
+  double sum = 0;
+  for (double x : samples)
+    sum += x;
+  s.mean = sum / n;
+  double squares = 0;
+  for (double x : samples)
+    squares += (x - s.mean)*(x - s.mean);
+  s.stddev = n > 1 ? std::sqrt(squares / (n - 1)) : 0.0;
+  return s;
+}
+
+struct bench_case {
+    std::function<void()> run;
+    work_model work;
+};
+
+std::vector<double> measure(bench_case const& c, std::size_t length, bench_options const& options)
+{
+  std::vector<double> samples;
+  for (unsigned r = 0; r < options.warmup + options.repetitions; ++r) {
+    clock_type::time_point start = clock_type::now();
+    c.run();
+    double ns = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+    if (r >= options.warmup)
+      samples.push_back(ns / static_cast<double>(length));
+  }
+  return samples;
+}
+
+std::string text_sequence(std::vector<std::uint32_t> const& sequence, std::size_t symbols)
+{
+  std::ostringstream out;
+  for (std::size_t o = 0; o < symbols; ++o)
+    out << o << ' ';
+  out << '\n' << sequence.size() << '\n';
+  for (std::uint32_t o : sequence)
+    out << o << ' ';
+  out << '\n';
+  return out.str();
+}
+
+/// Mixes the sizes into the seed with one splitmix step per size, so different sizes get unrelated inputs.
+std::uint64_t size_seed(std::uint64_t seed, std::size_t N, std::size_t M, std::size_t T)
+{
+  for (std::uint64_t size : { std::uint64_t{N}, std::uint64_t{M}, std::uint64_t{T} })
+    seed = maikel::counter_based_engine(seed).at(size);
+  return seed;
+}
+
+/**
+ * Runs all algorithms with models and coefficients in float_type, which is
+ * double or, for the mixed precision path, float. The models and sequences
+ * are drawn in double, so both precisions see the same data.
+ */
+template <class float_type>
+void run_sweep(bench_options const& options, std::string const& precision, std::vector<bench_result>& results)
+{
+  using namespace maikel::hmm;
+  using model = hidden_markov_model<float_type>;
+  using row_vector = typename model::row_vector;
+  for (std::size_t N : options.states)
+    for (std::size_t M : options.symbols)
+      for (std::size_t T : options.lengths) {
+        // the seed of every model and sequence only depends on its size
+        std::uint64_t seed = size_seed(options.seed, N, M, T);
+        hidden_markov_model<double> drawn = random_hidden_markov_model<double>(
+            static_cast<hidden_markov_model<double>::size_type>(N),
+            static_cast<hidden_markov_model<double>::size_type>(M), seed);
+        auto generator = make_sequence_generator(drawn, seed);
+        std::vector<std::uint32_t> sequence(T), states(T);
+        generator.generate_into(T, sequence.data(), states.data(), 1);
+        model hmm = precision_cast<float_type>(drawn);
+
+        std::vector<float_type> scaling(T);
+        std::vector<row_vector> alphas, betas;
+        double n = static_cast<double>(N);
+        double size = sizeof(float_type);
+
+        for (std::string const& algorithm : options.algorithms) {
+          bench_case c;
+          if (algorithm == "forward") {
+            c.run = [&] {
+              accumulator_t<float_type> logprob = 0;
+              for (auto&& alpha : forward(sequence.begin(), sequence.end(), hmm))
+                logprob += std::log(static_cast<accumulator_t<float_type>>(alpha.first));
+              sink = logprob;
+            };
+            c.work = { 2*n*n + 3*n, size*(n*n + 3*n) };
+          } else if (algorithm == "backward") {
+            std::size_t t = 0;
+            for (auto&& alpha : forward(sequence.begin(), sequence.end(), hmm))
+              scaling[t++] = alpha.first;
+            c.run = [&] {
+              float_type checksum = 0;
+              for (auto&& beta : backward(sequence.rbegin(), sequence.rend(), scaling.rbegin(), hmm))
+                checksum += beta(0);
+              sink = checksum;
+            };
+            c.work = { 2*n*n + 2*n, size*(n*n + 3*n) };
+          } else if (algorithm == "baum_welch") {
+            if (2*T*N*sizeof(float_type) > options.max_coefficient_bytes) {
+              std::cerr << "Skipping baum_welch for N=" << N << " T=" << T << ", its coefficients do not fit.\n";
+              continue;
+            }
+            alphas.assign(T, row_vector(N));
+            betas.assign(T, row_vector(N));
+            std::size_t t = 0;
+            for (auto&& alpha : forward(sequence.begin(), sequence.end(), hmm)) {
+              scaling[t] = alpha.first;
+              alphas[t++] = alpha.second;
+            }
+            t = 0;
+            for (auto&& beta : backward(sequence.rbegin(), sequence.rend(), scaling.rbegin(), hmm))
+              betas[T - 1 - t++] = beta;
+            auto update = update_matrices<
+                std::vector<std::uint32_t>::const_iterator,
+                typename std::vector<row_vector>::const_iterator,
+                typename std::vector<row_vector>::const_iterator, float_type>(N, M);
+            c.run = [&, update] () mutable {
+              std::vector<std::uint32_t> const& seq = sequence;
+              std::vector<row_vector> const& a = alphas;
+              std::vector<row_vector> const& b = betas;
+              auto matrices = update(seq.begin(), seq.end(), a.begin(), b.begin(), scaling.back(), hmm);
+              sink = matrices.first(0, 0);
+            };
+            c.work = { 5*n*n, size*(3*n*n + 4*n) };
+          } else if (algorithm == "generate") {
+            std::vector<std::uint32_t> symbols_out(T), states_out(T);
+            c.run = [&, symbols_out, states_out] () mutable {
+              auto bench_generator = make_sequence_generator(hmm, seed);
+              bench_generator.generate_into(T, symbols_out.data(), states_out.data(), 1);
+              sink = symbols_out.back();
+            };
+            // two alias table lookups of a threshold and an alias each and two outputs
+            c.work = { 0, 2*(8.0 + 4.0) + 8.0 };
+          } else if (algorithm == "parse") {
+            std::string text = text_sequence(sequence, M);
+            c.run = [text] {
+              std::istringstream in(text);
+              packed_sequence<> parsed = read_packed_sequence(in);
+              sink = static_cast<double>(parsed.size());
+            };
+            c.work = { 0, static_cast<double>(text.size()) / static_cast<double>(T) };
+          } else {
+            std::cerr << "Unknown algorithm " << algorithm << ".\n";
+            continue;
+          }
+          results.push_back(bench_result{algorithm, precision, sizeof(float_type), N, M, T,
+              measure(c, T, options), c.work});
+          bench_result const& r = results.back();
+          summary s = summarize(r.ns_per_symbol);
+          std::cerr << std::setw(12) << algorithm << std::setw(10) << precision << std::setw(6) << N << std::setw(6) << M
+                    << std::setw(11) << T << std::fixed << std::setprecision(2)
+                    << std::setw(12) << s.median << " ns/symbol  +-" << std::setw(6) << s.stddev
+                    << std::setw(9) << (s.median > 0 ? r.work.flops / s.median : 0.0) << " GFLOP/s"
+                    << std::setw(10) << std::setprecision(1) << r.work.bytes << " bytes/symbol\n";
+        }
+      }
+}
+
+/// Instruction set of the dispatched kernels, "generic" if the headers' loops are used.
+char const* kernel_isa()
+{
+  return maikel::hmm::dispatched_kernels<double>()
+      ? maikel::hmm::isa_name(maikel::hmm::active_kernels().level) : "generic";
+}
+
+void write_json(std::ostream& out, bench_options const& options, std::vector<bench_result> const& results)
+{
+  out << "{\"isa\":\"" << kernel_isa() << "\",\"warmup\":" << options.warmup << ",\"repetitions\":" << options.repetitions
+      << ",\"seed\":" << options.seed << ",\n\"results\":[";
+  out << std::setprecision(6);
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    bench_result const& r = results[i];
+    summary s = summarize(r.ns_per_symbol);
+    out << (i ? ",\n" : "\n")
+        << "{\"algorithm\":\"" << r.algorithm << "\",\"precision\":\"" << r.precision
+        << "\",\"float_bytes\":" << r.float_bytes << ",\"states\":" << r.states << ",\"symbols\":" << r.symbols
+        << ",\"length\":" << r.length
+        << ",\"ns_per_symbol\":{\"median\":" << s.median << ",\"mean\":" << s.mean << ",\"stddev\":" << s.stddev
+        << ",\"min\":" << s.min << ",\"max\":" << s.max << "}"
+        << ",\"gflops\":" << (s.median > 0 ? r.work.flops / s.median : 0.0)
+        << ",\"bytes_per_symbol\":" << r.work.bytes << "}";
+  }
+  out << "\n]}\n";
+}
+
+template <class T>
+  bool parse_list(std::string const& argument, std::vector<T>& list)
+  {
+    list.clear();
+    std::istringstream in(argument);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+      std::istringstream number(item);
+      double value;
+      if (!(number >> value) || value < 1)
+        return false;
+      list.push_back(static_cast<T>(value));
+    }
+    return !list.empty();
+  }
+
+void print_usage(char const* program)
+{
+  std::cerr << "Usage: " << program << " [--states <n,...>] [--symbols <m,...>] [--length <t,...>]\n"
+            << "           [--algorithms <forward,backward,baum_welch,generate,parse>]\n"
+            << "           [--precision <double,mixed>]\n"
+            << "           [--warmup <runs>] [--repetitions <runs>] [--seed <seed>] [--json <file>]\n"
+            << "Runs every algorithm on random models and sequences of every size, which\n"
+            << "only depend on the seed and the size. Prints the median time per symbol,\n"
+            << "its standard deviation, GFLOP/s and the bytes touched per symbol, and\n"
+            << "writes the statistics of all repetitions as JSON to the file if given.\n"
+            << "Mixed precision keeps models and coefficients in float and sums in double.\n";
+}
+
+int main(int argc, char *argv[])
+{
+  bench_options options;
+  std::string json_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+    bool ok = true;
+    if (argument == "--states" && i+1 < argc)
+      ok = parse_list(argv[++i], options.states);
+    else if (argument == "--symbols" && i+1 < argc)
+      ok = parse_list(argv[++i], options.symbols);
+    else if (argument == "--length" && i+1 < argc)
+      ok = parse_list(argv[++i], options.lengths);
+    else if (argument == "--algorithms" && i+1 < argc) {
+      options.algorithms.clear();
+      std::istringstream in(argv[++i]);
+      std::string name;
+      while (std::getline(in, name, ','))
+        options.algorithms.push_back(name);
+    }
+    else if (argument == "--precision" && i+1 < argc) {
+      options.precisions.clear();
+      std::istringstream in(argv[++i]);
+      std::string name;
+      while (std::getline(in, name, ',')) {
+        if (name != "double" && name != "mixed") {
+          std::cerr << "Unknown precision " << name << ".\n";
+          return exit_argument_error;
+        }
+        options.precisions.push_back(name);
+      }
+    }
+    else if (argument == "--warmup" && i+1 < argc)
+      options.warmup = static_cast<unsigned>(std::stoul(argv[++i]));
+    else if (argument == "--repetitions" && i+1 < argc)
+      options.repetitions = static_cast<unsigned>(std::stoul(argv[++i]));
+    else if (argument == "--seed" && i+1 < argc)
+      options.seed = std::stoull(argv[++i]);
+    else if (argument == "--json" && i+1 < argc)
+      json_path = argv[++i];
+    else {
+      print_usage(argv[0]);
+      return exit_argument_error;
+    }
+    if (!ok) {
+      std::cerr << "Could not read the list " << argv[i] << ".\n";
+      return exit_argument_error;
+    }
+  }
+  if (options.repetitions == 0) {
+    std::cerr << "At least one repetition is needed.\n";
+    return exit_argument_error;
+  }
+
+  char const* isa = kernel_isa();
+  std::cerr << "Kernels: " << isa << "\n"
+            << "   algorithm precision     N     M          T\n";
+  std::vector<bench_result> results;
+  for (std::string const& precision : options.precisions)
+    if (precision == "mixed")
+      run_sweep<float>(options, precision, results);
+    else
+      run_sweep<double>(options, precision, results);
+
+  if (!json_path.empty()) {
+    std::ofstream json(json_path);
+    if (!json) {
+      std::cerr << "Could not open " << json_path << " for writing.\n";
+      return exit_io_error;
+    }
+    write_json(json, options, results);
+  }
+  return exit_success;
+}
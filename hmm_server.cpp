@@ -0,0 +1,258 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "maikel/hmm/scoring_service.h"
+
+enum Exit_Error_Codes {
+  exit_success = 0,
+  exit_not_enough_arguments = 1,
+  exit_io_error = 2,
+  exit_argument_error = 3
+};
+
+namespace {
+
+  volatile std::sig_atomic_t stop_requested = 0;
+  volatile std::sig_atomic_t reload_requested = 0;
+
+  extern "C" void on_stop(int) { stop_requested = 1; }
+  extern "C" void on_reload(int) { reload_requested = 1; }
+
+  /// Reads lines from a socket and writes the answers back.
+  class connection_reader {
+    public:
+      explicit connection_reader(int fd): fd_{fd} {}
+
+      bool next_line(std::string& line)
+      {
+        while (true) {
+          std::string::size_type end = buffer_.find('\n', start_);
+          if (end != std::string::npos) {
+            line.assign(buffer_, start_, end - start_);
+            start_ = end + 1;
+            if (!line.empty() && line.back() == '\r')
+              line.pop_back();
+            return true;
+          }
+          buffer_.erase(0, start_);
+          start_ = 0;
+          char chunk[1 << 16];
+          ssize_t n = ::read(fd_, chunk, sizeof(chunk));
+          if (n < 0 && errno == EINTR)
+            continue;
+          if (n <= 0)
+            return false;
+          buffer_.append(chunk, static_cast<std::size_t>(n));
+        }
+      }
+
+      bool write_line(std::string text)
+      {
+        text += '\n';
+        char const* data = text.data();
+        std::size_t left = text.size();
+        while (left) {
+          ssize_t n = ::send(fd_, data, left, MSG_NOSIGNAL);
+          if (n < 0 && errno == EINTR)
+            continue;
+          if (n <= 0)
+            return false;
+          data += n;
+          left -= static_cast<std::size_t>(n);
+        }
+        return true;
+      }
+
+    private:
+      int fd_;
+      std::string buffer_;
+      std::string::size_type start_ = 0;
+  };
+
+  /// Open client connections, so that they can be shut down on exit.
+  struct connections {
+      std::mutex mutex;
+      std::condition_variable closed;
+      std::set<int> open;
+  };
+
+  void serve(int fd, maikel::hmm::scoring_service<double>& service, connections& clients)
+  {
+    connection_reader connection(fd);
+    std::string line;
+    while (connection.next_line(line))
+      if (!connection.write_line(service.handle(line)))
+        break;
+    std::lock_guard<std::mutex> lock(clients.mutex);
+    clients.open.erase(fd);
+    ::close(fd);
+    clients.closed.notify_all();
+  }
+
+  sockaddr_un socket_address(std::string const& path)
+  {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+      throw std::runtime_error("The socket path " + path + " is too long.");
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+  }
+
+  /// Sends the lines of stdin to a running server and prints the answers.
+  int query(std::string const& path)
+  {
+    sockaddr_un address = socket_address(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+      std::cerr << "Could not connect to " << path << ": " << std::strerror(errno) << "\n";
+      return exit_io_error;
+    }
+    connection_reader connection(fd);
+    std::string line, answer;
+    while (std::getline(std::cin, line)) {
+      if (!connection.write_line(line) || !connection.next_line(answer)) {
+        std::cerr << "The server closed the connection.\n";
+        ::close(fd);
+        return exit_io_error;
+      }
+      std::cout << answer << '\n';
+    }
+    ::close(fd);
+    return exit_success;
+  }
+
+}
+
+void print_usage(char const* program)
+{
+  std::cerr << "Usage: " << program << " [--batch <n>] [--delay <us>] [--workers <n>]\n"
+            << "           [--cache <MiB>] [--checkpoint <n>] <models.bank> <socket>\n"
+            << "       " << program << " --query <socket>\n"
+            << "Serves likelihood, decode and posterior requests for the models of a\n"
+            << "bank on a unix domain socket, one request per line. SIGHUP or a\n"
+            << "\"reload\" request loads the bank again. Likelihoods are cached, and\n"
+            << "the forward coefficients of every <n>-th symbol too, so that sequences\n"
+            << "with a common prefix resume from it; --cache 0 disables the cache.\n"
+            << "With --query the lines of stdin are sent to a running server.\n";
+}
+
+int main(int argc, char *argv[])
+{
+  maikel::hmm::scoring_service_options options;
+  std::vector<std::string> arguments;
+  bool client = false;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string argument(argv[i]);
+      if (argument == "--batch" && i+1 < argc)
+        options.max_batch = std::stoul(argv[++i]);
+      else if (argument == "--delay" && i+1 < argc)
+        options.max_delay = std::chrono::microseconds(std::stoul(argv[++i]));
+      else if (argument == "--workers" && i+1 < argc)
+        options.workers = std::stoul(argv[++i]);
+      else if (argument == "--cache" && i+1 < argc)
+        options.cache_bytes = std::stoul(argv[++i]) << 20;
+      else if (argument == "--checkpoint" && i+1 < argc)
+        options.checkpoint_every = std::stoul(argv[++i]);
+      else if (argument == "--query")
+        client = true;
+      else
+        arguments.push_back(argument);
+    }
+  } catch (std::exception const&) {
+    print_usage(argv[0]);
+    return exit_argument_error;
+  }
+  if (client && arguments.size() == 1)
+    return query(arguments[0]);
+  if (client || arguments.size() < 2) {
+    print_usage(argv[0]);
+    return exit_not_enough_arguments;
+  }
+
+  try {
+    maikel::hmm::scoring_service<double> service(arguments[0], options);
+    std::string const& path = arguments[1];
+    sockaddr_un address = socket_address(path);
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ::unlink(path.c_str());
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || ::listen(listener, SOMAXCONN) < 0) {
+      std::cerr << "Could not listen on " << path << ": " << std::strerror(errno) << "\n";
+      return exit_io_error;
+    }
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop;
+    ::sigaction(SIGINT, &action, nullptr);
+    ::sigaction(SIGTERM, &action, nullptr);
+    action.sa_handler = on_reload;
+    ::sigaction(SIGHUP, &action, nullptr);
+    std::cerr << "Serving " << service.bank()->size() << " models on " << path << "\n";
+
+    connections clients;
+    while (!stop_requested) {
+      if (reload_requested) {
+        reload_requested = 0;
+        try {
+          std::cerr << "Reloaded " << service.reload() << " models\n";
+        } catch (std::exception const& error) {
+          std::cerr << "Reload failed: " << error.what() << "\n";
+        }
+      }
+      pollfd ready { listener, POLLIN, 0 };
+      if (::poll(&ready, 1, 200) <= 0)
+        continue;
+      int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0)
+        continue;
+      std::lock_guard<std::mutex> lock(clients.mutex);
+      clients.open.insert(fd);
+      std::thread(serve, fd, std::ref(service), std::ref(clients)).detach();
+    }
+
+    ::close(listener);
+    ::unlink(path.c_str());
+    std::unique_lock<std::mutex> lock(clients.mutex);
+    for (int fd : clients.open)
+      ::shutdown(fd, SHUT_RDWR);
+    clients.closed.wait(lock, [&clients] { return clients.open.empty(); });
+    std::cerr << service.statistics() << "\n";
+  } catch (std::exception const& error) {
+    std::cerr << error.what() << "\n";
+    return exit_io_error;
+  }
+  return exit_success;
+}
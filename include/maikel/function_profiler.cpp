@@ -16,75 +16,815 @@
 
 
 #include "maikel/function_profiler.h"
+#include "maikel/latency_histogram.h"
 
-#include <range/v3/algorithm/max.hpp>
-#include <range/v3/action/insert.hpp>
-#include <range/v3/view/zip.hpp>
-#include <range/v3/view/map.hpp>
-#include <range/v3/view/reverse.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
 #include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
 #include <utility>
 
 namespace maikel {
 
-  std::map<std::string, function_profiler::clock::duration> function_profiler::time_table;
-  bool function_profiler::is_active = false;
-  function_profiler::clock::duration function_profiler::total_duration = function_profiler::clock::duration::zero();
+  namespace {
 
+    struct site_info {
+        std::string name;
+        std::string file;
+        int line;
+    };
+
+    // Sites are only ever added, a deque keeps references to them valid.
+    std::mutex sites_mutex;
+    std::deque<site_info> sites;
+    std::map<std::pair<std::string, std::string>, std::uint32_t> sites_by_name;
+
+    std::uint32_t intern_site(std::string name, std::string file, int line)
+    {
+      std::lock_guard<std::mutex> lock(sites_mutex);
+      sites.push_back(site_info{std::move(name), std::move(file), line});
+      return static_cast<std::uint32_t>(sites.size() - 1);
+    }
+
+    site_info site(std::uint32_t id)
+    {
+      std::lock_guard<std::mutex> lock(sites_mutex);
+      return sites[id];
+    }
+
+    const std::uint32_t no_node = std::numeric_limits<std::uint32_t>::max();
+    const unsigned chunk_bits = 12;
+    const std::uint32_t chunk_size = std::uint32_t{1} << chunk_bits;
+    const std::size_t max_chunks = 256;
+    const std::uint32_t max_sites = 4096;   // sites with a latency histogram
+
+    /**
+     * Node of the call tree of one thread. The owning thread is the only
+     * writer. The counters are atomics so that reports can read them at any
+     * time, but the owner updates them with plain loads and stores.
+     */
+    struct thread_node {
+        std::uint32_t site;
+        std::uint32_t parent;
+        std::uint32_t first_child = 0;    // owner only, 0 means none
+        std::uint32_t next_sibling = 0;   // owner only
+        std::atomic<std::uint64_t> calls{0};
+        std::atomic<std::uint64_t> inclusive{0};
+        std::atomic<std::uint64_t> children{0};
+        std::atomic<std::uint64_t> allocations{0};
+        std::atomic<std::uint64_t> allocated_bytes{0};
+        std::atomic<std::uint64_t> peak_bytes{0};
+    };
+
+    struct trace_event {
+        std::uint32_t site;
+        std::uint32_t depth;
+        std::uint64_t start;
+        std::uint64_t duration;
+    };
+
+    std::atomic<std::uint64_t> generation{1};
+    std::atomic<std::size_t> trace_capacity{0};
+
+    void add(std::atomic<std::uint64_t>& counter, std::uint64_t value) noexcept
+    {
+      counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    class thread_profile {
+      public:
+        explicit thread_profile(std::uint32_t tid): tid_{tid}
+        {
+          stack_.reserve(64);
+          for (auto& histogram : histograms_)
+            histogram.store(nullptr, std::memory_order_relaxed);
+        }
+
+        ~thread_profile()
+        {
+          for (auto& histogram : histograms_)
+            delete histogram.load(std::memory_order_relaxed);
+        }
+
+        std::uint32_t tid() const noexcept { return tid_; }
+        std::uint64_t generation() const noexcept { return generation_.load(std::memory_order_acquire); }
+        std::size_t depth() const noexcept { return depth_.load(std::memory_order_relaxed); }
+        bool finished() const noexcept { return finished_.load(std::memory_order_relaxed); }
+        void finish() noexcept { finished_.store(true, std::memory_order_relaxed); }
+
+        std::uint32_t size() const noexcept { return size_.load(std::memory_order_acquire); }
+        thread_node const& node(std::uint32_t i) const noexcept { return chunks_[i >> chunk_bits][i & (chunk_size - 1)]; }
+        std::size_t events() const noexcept { return event_count_.load(std::memory_order_acquire); }
+        trace_event const& event(std::size_t i) const noexcept { return events_[i]; }
+
+        /// Durations of the calls of a site in ticks, or nullptr.
+        latency_histogram const* histogram(std::uint32_t site) const noexcept
+        {
+          return site < max_sites ? histograms_[site].load(std::memory_order_acquire) : nullptr;
+        }
+
+        void enter(std::uint32_t site) noexcept
+        {
+          busy_ = true;
+          if (stack_.empty()) {
+            std::uint64_t current = maikel::generation.load(std::memory_order_acquire);
+            if (generation_.load(std::memory_order_relaxed) != current)
+              restart(current);
+          }
+          std::uint32_t child = no_node;
+          if (current_ != no_node) {
+            for (std::uint32_t c = node(current_).first_child; c; c = node(c).next_sibling)
+              if (node(c).site == site) {
+                child = c;
+                break;
+              }
+            if (child == no_node)
+              child = add_node(site, current_);
+          }
+          stack_.push_back(frame{child, site, live_, live_, function_profiler::ticks()});
+          if (child != no_node)
+            current_ = child;
+          depth_.store(stack_.size(), std::memory_order_relaxed);
+          busy_ = false;
+        }
+
+        void leave() noexcept
+        {
+          if (stack_.empty())
+            return;
+          std::uint64_t end = function_profiler::ticks();
+          busy_ = true;
+          frame f = stack_.back();
+          stack_.pop_back();
+          depth_.store(stack_.size(), std::memory_order_relaxed);
+          if (!stack_.empty())
+            stack_.back().peak = std::max(stack_.back().peak, f.peak);
+          std::uint64_t duration = end - f.start;
+          if (f.site < max_sites) {
+            latency_histogram* histogram = histograms_[f.site].load(std::memory_order_relaxed);
+            if (!histogram) {
+              histogram = new (std::nothrow) latency_histogram;
+              histograms_[f.site].store(histogram, std::memory_order_release);
+            }
+            if (histogram)
+              histogram->record_exclusive(duration);
+          }
+          busy_ = false;
+          if (f.node == no_node)
+            return;
+          thread_node& n = mutable_node(f.node);
+          add(n.calls, 1);
+          add(n.inclusive, duration);
+          std::uint64_t peak = static_cast<std::uint64_t>(f.peak - f.live_at_entry);
+          if (peak > n.peak_bytes.load(std::memory_order_relaxed))
+            n.peak_bytes.store(peak, std::memory_order_relaxed);
+          add(mutable_node(n.parent).children, duration);
+          current_ = n.parent;
+          std::size_t count = event_count_.load(std::memory_order_relaxed);
+          if (count < events_.size()) {
+            events_[count] = trace_event{f.site, static_cast<std::uint32_t>(stack_.size()), f.start, duration};
+            event_count_.store(count + 1, std::memory_order_release);
+          }
+        }
+
+        /// Called by the allocation hooks. Allocations of the profiler itself are not booked.
+        void allocated(std::uint64_t bytes) noexcept
+        {
+          if (busy_)
+            return;
+          live_ += static_cast<std::int64_t>(bytes);
+          if (stack_.empty())
+            return;
+          frame& f = stack_.back();
+          f.peak = std::max(f.peak, live_);
+          if (f.node != no_node) {
+            thread_node& n = mutable_node(f.node);
+            add(n.allocations, 1);
+            add(n.allocated_bytes, bytes);
+          }
+        }
+
+        void freed(std::uint64_t bytes) noexcept
+        {
+          if (!busy_)
+            live_ -= static_cast<std::int64_t>(bytes);
+        }
+
+        /// Sets whether allocations are the profiler's own and returns the previous value.
+        bool busy(bool busy) noexcept
+        {
+          bool was = busy_;
+          busy_ = busy;
+          return was;
+        }
+
+      private:
+        struct frame {
+            std::uint32_t node;
+            std::uint32_t site;
+            std::int64_t live_at_entry;
+            std::int64_t peak;
+            std::uint64_t start;
+        };
+
+        std::uint32_t tid_;
+        std::atomic<std::uint64_t> generation_{0};
+        std::atomic<std::size_t> depth_{0};
+        std::atomic<bool> finished_{false};
+        std::unique_ptr<thread_node[]> chunks_[max_chunks];
+        std::atomic<std::uint32_t> size_{0};
+        std::vector<frame> stack_;
+        std::uint32_t current_ = no_node;
+        std::vector<trace_event> events_;
+        std::atomic<std::size_t> event_count_{0};
+        std::atomic<latency_histogram*> histograms_[max_sites];
+        std::int64_t live_ = 0;   // bytes allocated minus bytes freed by this thread
+        bool busy_ = false;       // inside enter() or leave()
+
+        thread_node& mutable_node(std::uint32_t i) noexcept { return chunks_[i >> chunk_bits][i & (chunk_size - 1)]; }
+
+        // Returns no_node when the tree is full, calls below are not booked then.
+        std::uint32_t add_node(std::uint32_t site, std::uint32_t parent) noexcept
+        {
+          std::uint32_t i = size_.load(std::memory_order_relaxed);
+          if ((i >> chunk_bits) >= max_chunks)
+            return no_node;
+          if (!chunks_[i >> chunk_bits]) {
+            chunks_[i >> chunk_bits].reset(new (std::nothrow) thread_node[chunk_size]);
+            if (!chunks_[i >> chunk_bits])
+              return no_node;
+          }
+          thread_node& n = mutable_node(i);
+          n.site = site;
+          n.parent = parent;
+          n.first_child = 0;
+          n.next_sibling = 0;
+          n.calls.store(0, std::memory_order_relaxed);
+          n.inclusive.store(0, std::memory_order_relaxed);
+          n.children.store(0, std::memory_order_relaxed);
+          n.allocations.store(0, std::memory_order_relaxed);
+          n.allocated_bytes.store(0, std::memory_order_relaxed);
+          n.peak_bytes.store(0, std::memory_order_relaxed);
+          if (i != parent) {
+            n.next_sibling = mutable_node(parent).first_child;
+            mutable_node(parent).first_child = i;
+          }
+          size_.store(i + 1, std::memory_order_release);
+          return i;
+        }
+
+        // Starts over after a reset. Reports skip this thread until the new
+        // generation is published at the end.
+        void restart(std::uint64_t current) noexcept
+        {
+          size_.store(0, std::memory_order_relaxed);
+          event_count_.store(0, std::memory_order_relaxed);
+          try {
+            events_.assign(trace_capacity.load(std::memory_order_relaxed), trace_event{});
+          } catch (...) {
+            events_.clear();
+          }
+          for (auto& histogram : histograms_)
+            if (latency_histogram* h = histogram.load(std::memory_order_relaxed))
+              h->reset();
+          current_ = add_node(no_node, 0);
+          generation_.store(current, std::memory_order_release);
+        }
+    };
+
+    std::mutex threads_mutex;
+    std::vector<std::unique_ptr<thread_profile>> threads;
+
+    // The profile for the allocation hooks. Unlike this_thread it has no
+    // destructor, so reading it never registers one, which could allocate.
+    thread_local thread_profile* allocating_profile = nullptr;
+
+    /// Marks the profile of a thread as finished when the thread exits.
+    struct thread_handle {
+        thread_profile* profile = nullptr;
+        ~thread_handle()
+        {
+          allocating_profile = nullptr;
+          if (profile)
+            profile->finish();
+        }
+    };
+
+    thread_local thread_handle this_thread;
+
+    /// Keeps the allocations of the profiler's bookkeeping out of the scope of the calling thread.
+    class bookkeeping {
+      public:
+        bookkeeping() noexcept: profile_{allocating_profile}, was_{profile_ && profile_->busy(true)} {}
+        ~bookkeeping() { if (profile_) profile_->busy(was_); }
+
+        bookkeeping(bookkeeping const&) = delete;
+        bookkeeping& operator=(bookkeeping const&) = delete;
+
+      private:
+        thread_profile* profile_;
+        bool was_;
+    };
+
+    thread_profile* this_thread_profile() noexcept
+    {
+      if (!this_thread.profile) {
+        try {
+          std::lock_guard<std::mutex> lock(threads_mutex);
+          threads.emplace_back(new thread_profile(static_cast<std::uint32_t>(threads.size())));
+          this_thread.profile = threads.back().get();
+          allocating_profile = this_thread.profile;
+        } catch (...) {
+          return nullptr;
+        }
+      }
+      return this_thread.profile;
+    }
+
+    std::pair<std::uint64_t, std::chrono::steady_clock::time_point> const calibration_start {
+      function_profiler::ticks(), std::chrono::steady_clock::now()
+    };
+
+    /// Nanoseconds per tick, measured against steady_clock when the tick is the TSC.
+    double nanoseconds_per_tick()
+    {
+#if defined(MAIKEL_PROFILER_TSC) && (defined(__x86_64__) || defined(__i386__))
+      std::uint64_t ticks = function_profiler::ticks() - calibration_start.first;
+      auto elapsed = std::chrono::steady_clock::now() - calibration_start.second;
+      double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+      return ticks ? ns / static_cast<double>(ticks) : 1.0;
+#else
+      return 1.0;
+#endif
+    }
+
+    // serializes the reports against reset()
+    std::mutex reports_mutex;
+
+    template <class Function>
+      void for_each_current_thread(Function f)
+      {
+        std::uint64_t current = generation.load(std::memory_order_acquire);
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (std::unique_ptr<thread_profile> const& profile : threads)
+          if (profile->generation() == current)
+            f(*profile);
+      }
+
+    std::string path_of(std::vector<profile_node> const& tree, std::size_t i)
+    {
+      if (i == 0)
+        return {};
+      std::string prefix = path_of(tree, tree[i].parent);
+      return prefix.empty() ? tree[i].name : prefix + ";" + tree[i].name;
+    }
+
+    void write_json_string(std::ostream& out, std::string const& s)
+    {
+      out << '"';
+      for (char c : s) {
+        if (c == '"' || c == '\\')
+          out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+          out << ' ';
+        else
+          out << c;
+      }
+      out << '"';
+    }
+
+    void print_node(std::ostream& out, std::vector<profile_node> const& tree, std::size_t i,
+        int depth, double total_ns)
+    {
+      profile_node const& n = tree[i];
+      out << std::setw(8) << std::fixed << std::setprecision(2)
+          << (total_ns > 0 ? 100.0 * static_cast<double>(n.inclusive_ns) / total_ns : 0.0) << "% "
+          << std::setw(12) << std::setprecision(3) << static_cast<double>(n.inclusive_ns) / 1e6 << "ms "
+          << std::setw(12) << static_cast<double>(n.exclusive_ns) / 1e6 << "ms "
+          << std::setw(10) << n.calls << "  ";
+      if (function_profiler::tracks_allocations())
+        out << std::setw(10) << n.allocations << ' '
+            << std::setw(10) << std::setprecision(1) << static_cast<double>(n.allocated_bytes) / 1e3 << "kB "
+            << std::setw(10) << static_cast<double>(n.peak_bytes) / 1e3 << "kB  ";
+      out << std::string(static_cast<std::size_t>(2*depth), ' ') << n.name
+          << " (" << n.file << ':' << n.line << ")\n";
+      std::vector<std::size_t> children = n.children;
+      std::sort(children.begin(), children.end(), [&tree] (std::size_t a, std::size_t b) {
+        return tree[a].inclusive_ns > tree[b].inclusive_ns;
+      });
+      for (std::size_t child : children)
+        print_node(out, tree, child, depth + 1, total_ns);
+    }
+
+    // lays the children of node i out one after another, starting at `start`
+    void write_synthetic_events(std::ostream& out, std::vector<profile_node> const& tree,
+        std::size_t i, double start, bool& first)
+    {
+      for (std::size_t child : tree[i].children) {
+        profile_node const& n = tree[child];
+        out << (first ? "\n" : ",\n") << "{\"name\":";
+        write_json_string(out, n.name);
+        out << ",\"cat\":";
+        write_json_string(out, n.file);
+        out << ",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":" << start / 1e3
+            << ",\"dur\":" << static_cast<double>(n.inclusive_ns) / 1e3
+            << ",\"args\":{\"calls\":" << n.calls << "}}";
+        first = false;
+        write_synthetic_events(out, tree, child, start, first);
+        start += static_cast<double>(n.inclusive_ns);
+      }
+    }
+
+  } // namespace
+
+  profiler_site::profiler_site(char const* name, char const* file, int line)
+  {
+    bookkeeping guard;
+    id_ = intern_site(name, file, line);
+  }
 
   function_profiler::function_profiler(std::string function_name, std::string file_name) noexcept
-  : is_top_level(!is_active)
   {
-    is_active = true;
-    std::string func_id(function_name + "::" + file_name);
-    std::tie(function_iterator, std::ignore) =
-        time_table.insert(std::make_pair(func_id, clock::duration::zero()));
+    std::uint32_t id = no_node;
+    try {
+      bookkeeping guard;
+      std::lock_guard<std::mutex> lock(sites_mutex);
+      auto key = std::make_pair(std::move(function_name), std::move(file_name));
+      auto found = sites_by_name.find(key);
+      if (found == sites_by_name.end()) {
+        sites.push_back(site_info{key.first, key.second, 0});
+        found = sites_by_name.emplace(std::move(key), static_cast<std::uint32_t>(sites.size() - 1)).first;
+      }
+      id = found->second;
+    } catch (...) {
+    }
+    enter(id);
+  }
+
+  bool function_profiler::tracks_allocations() noexcept
+  {
+#ifdef MAIKEL_PROFILE_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void function_profiler::enter(std::uint32_t site) noexcept
+  {
+    if (thread_profile* profile = this_thread_profile())
+      profile->enter(site);
+  }
+
+  void function_profiler::leave() noexcept
+  {
+    if (thread_profile* profile = this_thread.profile)
+      profile->leave();
   }
 
-  function_profiler::~function_profiler() noexcept
+  std::vector<profile_node> function_profiler::call_tree()
   {
-    auto diff = clock::now()-start;
-    function_iterator->second += diff;
-    if (is_top_level) {
-      total_duration += diff;
-      is_active = false;
+    std::lock_guard<std::mutex> lock(reports_mutex);
+    double scale = nanoseconds_per_tick();
+    std::vector<profile_node> tree(1);
+    tree[0].name = "[total]";
+    std::vector<std::uint32_t> sites_of(1, no_node);
+    std::vector<std::uint64_t> children_ticks(1, 0);
+    std::vector<std::uint64_t> inclusive_ticks(1, 0);
+
+    for_each_current_thread([&] (thread_profile const& profile) {
+      std::uint32_t size = profile.size();
+      std::vector<std::size_t> merged(size, 0);
+      for (std::uint32_t i = 0; i < size; ++i) {
+        thread_node const& n = profile.node(i);
+        if (i == 0) {
+          std::uint64_t top = n.children.load(std::memory_order_relaxed);
+          children_ticks[0] += top;
+          inclusive_ticks[0] += top;
+          continue;
+        }
+        std::size_t parent = merged[n.parent];
+        std::size_t target = 0;
+        for (std::size_t c : tree[parent].children)
+          if (sites_of[c] == n.site) {
+            target = c;
+            break;
+          }
+        if (!target) {
+          target = tree.size();
+          tree.emplace_back();
+          tree[target].parent = parent;
+          tree[parent].children.push_back(target);
+          sites_of.push_back(n.site);
+          children_ticks.push_back(0);
+          inclusive_ticks.push_back(0);
+        }
+        merged[i] = target;
+        tree[target].calls += n.calls.load(std::memory_order_relaxed);
+        tree[target].allocations += n.allocations.load(std::memory_order_relaxed);
+        tree[target].allocated_bytes += n.allocated_bytes.load(std::memory_order_relaxed);
+        tree[target].peak_bytes = std::max(tree[target].peak_bytes, n.peak_bytes.load(std::memory_order_relaxed));
+        inclusive_ticks[target] += n.inclusive.load(std::memory_order_relaxed);
+        children_ticks[target] += n.children.load(std::memory_order_relaxed);
+      }
+    });
+
+    for (std::size_t i = 0; i < tree.size(); ++i) {
+      if (i) {
+        site_info info = sites_of[i] == no_node ? site_info{"[unknown]", "", 0} : site(sites_of[i]);
+        tree[i].name = std::move(info.name);
+        tree[i].file = std::move(info.file);
+        tree[i].line = info.line;
+      }
+      std::uint64_t exclusive = inclusive_ticks[i] > children_ticks[i] ? inclusive_ticks[i] - children_ticks[i] : 0;
+      tree[i].inclusive_ns = static_cast<std::uint64_t>(static_cast<double>(inclusive_ticks[i]) * scale);
+      tree[i].exclusive_ns = static_cast<std::uint64_t>(static_cast<double>(exclusive) * scale);
+    }
+    return tree;
+  }
+
+  std::vector<profile_site_statistics> function_profiler::site_statistics()
+  {
+    std::vector<std::unique_ptr<latency_histogram>> merged;
+    double scale;
+    {
+      std::lock_guard<std::mutex> lock(reports_mutex);
+      scale = nanoseconds_per_tick();
+      for_each_current_thread([&merged] (thread_profile const& profile) {
+        for (std::uint32_t s = 0; s < max_sites; ++s) {
+          latency_histogram const* histogram = profile.histogram(s);
+          if (!histogram || !histogram->count())
+            continue;
+          if (merged.size() <= s)
+            merged.resize(s + 1);
+          if (!merged[s])
+            merged[s].reset(new latency_histogram);
+          merged[s]->merge(*histogram);
+        }
+      });
+    }
+
+    auto ns = [scale] (std::uint64_t ticks) {
+      return static_cast<std::uint64_t>(static_cast<double>(ticks) * scale);
+    };
+    std::vector<profile_site_statistics> statistics;
+    for (std::uint32_t s = 0; s < merged.size(); ++s) {
+      if (!merged[s])
+        continue;
+      latency_histogram const& h = *merged[s];
+      site_info info = site(s);
+      profile_site_statistics stats;
+      stats.name = info.name;
+      stats.file = info.file;
+      stats.line = info.line;
+      stats.calls = h.count();
+      stats.total_ns = ns(h.sum());
+      stats.min_ns = ns(h.min());
+      stats.max_ns = ns(h.max());
+      stats.p50_ns = ns(h.percentile(0.5));
+      stats.p90_ns = ns(h.percentile(0.9));
+      stats.p99_ns = ns(h.percentile(0.99));
+      stats.p999_ns = ns(h.percentile(0.999));
+      statistics.push_back(std::move(stats));
     }
+    std::sort(statistics.begin(), statistics.end(),
+        [] (profile_site_statistics const& a, profile_site_statistics const& b) {
+          return a.total_ns > b.total_ns;
+        });
+    return statistics;
   }
 
   void function_profiler::print_statistics(std::ostream& out)
   {
-    if (time_table.empty())
+    std::vector<profile_node> tree = call_tree();
+    if (tree.size() == 1)
       return;
+    double total_ns = static_cast<double>(tree[0].inclusive_ns);
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "Total traced execution time: " << total_ns / 1e6 << "ms.\n";
+    out << "Printing call tree of traced functions:\n";
+    out << "   total     inclusive    exclusive       calls  ";
+    if (tracks_allocations())
+      out << "    allocs        bytes         peak  ";
+    out << "function\n";
+    std::vector<std::size_t> roots = tree[0].children;
+    std::sort(roots.begin(), roots.end(), [&tree] (std::size_t a, std::size_t b) {
+      return tree[a].inclusive_ns > tree[b].inclusive_ns;
+    });
+    for (std::size_t root : roots)
+      print_node(out, tree, root, 0, total_ns);
 
-    std::multimap<clock::duration, std::string> functions_sorted_by_duration;
-    ranges::insert(functions_sorted_by_duration,
-            ranges::view::zip( time_table | ranges::view::values,
-                               time_table | ranges::view::keys    ));
-    std::size_t max_name_length =
-        ranges::max(time_table | ranges::view::keys
-                               | ranges::view::transform(ranges::size));
-    std::string name;
-    clock::duration time;
-    auto total_ms = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(total_duration);
-    out << "Total traced execution time: " << total_ms.count() << "ms.\n";
-    out << "Printing time table of traced functions:\n";
-    for (auto const& function_info : ranges::view::reverse(functions_sorted_by_duration)) {
-      std::tie(time, name) = function_info;
-      out << std::setw(10) << time.count()*100/total_duration.count() << "% ";
-      out << std::setw(10);
-      auto time_ms = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(time);
-      out << time_ms.count() << "ms ";
-      out << std::setw(max_name_length + 2) << name << "\n";
+    out << "Latencies of traced functions in microseconds:\n";
+    out << "     calls        min        p50        p90        p99      p99.9        max  function\n";
+    auto us = [] (std::uint64_t ns) { return static_cast<double>(ns) / 1e3; };
+    out << std::fixed << std::setprecision(2);
+    for (profile_site_statistics const& s : site_statistics())
+      out << std::setw(10) << s.calls << ' '
+          << std::setw(10) << us(s.min_ns) << ' ' << std::setw(10) << us(s.p50_ns) << ' '
+          << std::setw(10) << us(s.p90_ns) << ' ' << std::setw(10) << us(s.p99_ns) << ' '
+          << std::setw(10) << us(s.p999_ns) << ' ' << std::setw(10) << us(s.max_ns) << "  "
+          << s.name << " (" << s.file << ':' << s.line << ")\n";
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+  void function_profiler::write_json(std::ostream& out)
+  {
+    std::vector<profile_node> tree = call_tree();
+    out << "{\"total_ns\":" << tree[0].inclusive_ns << ",\n\"call_tree\":[";
+    for (std::size_t i = 0; i < tree.size(); ++i) {
+      profile_node const& n = tree[i];
+      out << (i ? ",\n" : "\n") << "{\"id\":" << i << ",\"parent\":" << n.parent << ",\"name\":";
+      write_json_string(out, n.name);
+      out << ",\"file\":";
+      write_json_string(out, n.file);
+      out << ",\"line\":" << n.line << ",\"calls\":" << n.calls
+          << ",\"inclusive_ns\":" << n.inclusive_ns << ",\"exclusive_ns\":" << n.exclusive_ns
+          << ",\"allocations\":" << n.allocations << ",\"allocated_bytes\":" << n.allocated_bytes
+          << ",\"peak_bytes\":" << n.peak_bytes << "}";
+    }
+    out << "\n],\n\"sites\":[";
+    bool first = true;
+    for (profile_site_statistics const& s : site_statistics()) {
+      out << (first ? "\n" : ",\n") << "{\"name\":";
+      write_json_string(out, s.name);
+      out << ",\"file\":";
+      write_json_string(out, s.file);
+      out << ",\"line\":" << s.line << ",\"calls\":" << s.calls << ",\"total_ns\":" << s.total_ns
+          << ",\"min_ns\":" << s.min_ns << ",\"p50_ns\":" << s.p50_ns << ",\"p90_ns\":" << s.p90_ns
+          << ",\"p99_ns\":" << s.p99_ns << ",\"p999_ns\":" << s.p999_ns << ",\"max_ns\":" << s.max_ns << "}";
+      first = false;
     }
+    out << "\n]}\n";
+  }
+
+  void function_profiler::write_folded_stacks(std::ostream& out)
+  {
+    std::vector<profile_node> tree = call_tree();
+    for (std::size_t i = 1; i < tree.size(); ++i)
+      if (tree[i].exclusive_ns >= 1000)
+        out << path_of(tree, i) << ' ' << tree[i].exclusive_ns / 1000 << '\n';
+  }
+
+  void function_profiler::write_chrome_trace(std::ostream& out)
+  {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    {
+      std::lock_guard<std::mutex> lock(reports_mutex);
+      double scale = nanoseconds_per_tick();
+      std::uint64_t origin = std::numeric_limits<std::uint64_t>::max();
+      for_each_current_thread([&origin] (thread_profile const& profile) {
+        for (std::size_t e = 0, events = profile.events(); e < events; ++e)
+          origin = std::min(origin, profile.event(e).start);
+      });
+      for_each_current_thread([&] (thread_profile const& profile) {
+        std::size_t events = profile.events();
+        for (std::size_t e = 0; e < events; ++e) {
+          trace_event const& event = profile.event(e);
+          site_info info = event.site == no_node ? site_info{"[unknown]", "", 0} : site(event.site);
+          out << (first ? "\n" : ",\n") << "{\"name\":";
+          write_json_string(out, info.name);
+          out << ",\"cat\":";
+          write_json_string(out, info.file);
+          out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << profile.tid()
+              << ",\"ts\":" << static_cast<double>(event.start - std::min(origin, event.start)) * scale / 1e3
+              << ",\"dur\":" << static_cast<double>(event.duration) * scale / 1e3 << "}";
+          first = false;
+        }
+      });
+    }
+    if (first) {
+      std::vector<profile_node> tree = call_tree();
+      write_synthetic_events(out, tree, 0, 0.0, first);
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+  void function_profiler::enable_trace(std::size_t events_per_thread)
+  {
+    trace_capacity.store(events_per_thread, std::memory_order_relaxed);
+    reset();
   }
 
   void function_profiler::reset()
   {
-    if (is_active)
+    if (this_thread.profile && this_thread.profile->depth())
       throw timer_is_currently_active();
-
-    time_table.clear();
-    total_duration = clock::duration::zero();
+    std::lock_guard<std::mutex> reports(reports_mutex);
+    generation.fetch_add(1, std::memory_order_acq_rel);
+    // profiles of threads which have exited are not needed anymore
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    threads.erase(std::remove_if(threads.begin(), threads.end(),
+        [] (std::unique_ptr<thread_profile> const& profile) { return profile->finished(); }), threads.end());
   }
 
 } // namespace maikel
+
+#ifdef MAIKEL_PROFILE_ALLOCATIONS
+
+#ifndef __GLIBC__
+#error "MAIKEL_PROFILE_ALLOCATIONS replaces the allocator of glibc"
+#endif
+
+#include <cerrno>
+#include <malloc.h>
+
+extern "C" {
+  void* __libc_malloc(std::size_t size);
+  void* __libc_calloc(std::size_t count, std::size_t size);
+  void* __libc_realloc(void* pointer, std::size_t size);
+  void* __libc_memalign(std::size_t alignment, std::size_t size);
+  void __libc_free(void* pointer);
+}
+
+namespace {
+
+  void book_allocation(void* pointer) noexcept
+  {
+    if (pointer)
+      if (maikel::thread_profile* profile = maikel::allocating_profile)
+        profile->allocated(malloc_usable_size(pointer));
+  }
+
+  void book_free(void* pointer) noexcept
+  {
+    if (pointer)
+      if (maikel::thread_profile* profile = maikel::allocating_profile)
+        profile->freed(malloc_usable_size(pointer));
+  }
+
+}
+
+extern "C" {
+
+  void* malloc(std::size_t size)
+  {
+    void* pointer = __libc_malloc(size);
+    book_allocation(pointer);
+    return pointer;
+  }
+
+  void* calloc(std::size_t count, std::size_t size)
+  {
+    void* pointer = __libc_calloc(count, size);
+    book_allocation(pointer);
+    return pointer;
+  }
+
+  void* realloc(void* pointer, std::size_t size)
+  {
+    std::size_t old_size = pointer ? malloc_usable_size(pointer) : 0;
+    void* moved = __libc_realloc(pointer, size);
+    if (moved || size == 0) {
+      if (maikel::thread_profile* profile = maikel::allocating_profile)
+        profile->freed(old_size);
+      book_allocation(moved);
+    }
+    return moved;
+  }
+
+  void* memalign(std::size_t alignment, std::size_t size)
+  {
+    void* pointer = __libc_memalign(alignment, size);
+    book_allocation(pointer);
+    return pointer;
+  }
+
+  void* aligned_alloc(std::size_t alignment, std::size_t size)
+  {
+    return memalign(alignment, size);
+  }
+
+  int posix_memalign(void** result, std::size_t alignment, std::size_t size)
+  {
+    if (alignment % sizeof(void*) || (alignment & (alignment - 1)))
+      return EINVAL;
+    void* pointer = memalign(alignment, size);
+    if (!pointer && size)
+      return ENOMEM;
+    *result = pointer;
+    return 0;
+  }
+
+  void free(void* pointer)
+  {
+    book_free(pointer);
+    __libc_free(pointer);
+  }
+
+}
+
+#endif /* MAIKEL_PROFILE_ALLOCATIONS */
@@ -18,18 +18,30 @@
 #define INCLUDE_FUNCTION_PROFILER_H_
 
 #include <chrono>
-#include <map>
+#include <cstdint>
+#include <iosfwd>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(MAIKEL_PROFILER_TSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+#define MAIKEL_PROFILER_CONCAT_(a, b) a##b
+#define MAIKEL_PROFILER_CONCAT(a, b) MAIKEL_PROFILER_CONCAT_(a, b)
 
 #ifndef MAIKEL_PROFILE_FUNCTIONS
 #define MAIKEL_PROFILER
-#define MAIKEL_NAMED_PROFILER
+#define MAIKEL_NAMED_PROFILER(x)
 #else
-#define MAIKEL_PROFILER ::maikel::function_profiler __maikel_function_profiler(__func__, __FILE__)
-#define MAIKEL_NAMED_PROFILER(x) ::maikel::function_profiler __maikel_function_profiler(x, __FILE__)
+#define MAIKEL_NAMED_PROFILER(x) \
+  static ::maikel::profiler_site const MAIKEL_PROFILER_CONCAT(__maikel_profiler_site_, __LINE__)(x, __FILE__, __LINE__); \
+  ::maikel::function_profiler MAIKEL_PROFILER_CONCAT(__maikel_function_profiler_, __LINE__)( \
+      MAIKEL_PROFILER_CONCAT(__maikel_profiler_site_, __LINE__))
+#define MAIKEL_PROFILER MAIKEL_NAMED_PROFILER(__func__)
 #endif
 
-
-
 namespace maikel {
 
   struct timer_is_currently_active: public std::runtime_error {
@@ -38,14 +50,78 @@ namespace maikel {
   };
 
   /**
-   * Tag functions and sum times for each execution. Im using this to make fast
-   * and dirty profiling for my functions.
+   * A place in the code which is profiled. The macros create one static
+   * site per place, so its id is looked up once and every later call only
+   * passes the id on.
+   */
+  class profiler_site {
+    public:
+      profiler_site(char const* name, char const* file, int line);
+      std::uint32_t id() const noexcept { return id_; }
+
+    private:
+      std::uint32_t id_;
+  };
+
+  /// One node of the call tree which is merged over all threads.
+  struct profile_node {
+      std::string name;
+      std::string file;
+      int line = 0;
+      std::size_t parent = 0;            // the root is its own parent
+      std::vector<std::size_t> children;
+      std::uint64_t calls = 0;
+      std::uint64_t inclusive_ns = 0;    // including the time of the children
+      std::uint64_t exclusive_ns = 0;
+      std::uint64_t allocations = 0;     // made in the scope itself, see MAIKEL_PROFILE_ALLOCATIONS
+      std::uint64_t allocated_bytes = 0;
+      std::uint64_t peak_bytes = 0;      // most bytes live at once above the level at entry, children included
+  };
+
+  /// Latency distribution of all calls of one site, over all threads and call paths.
+  struct profile_site_statistics {
+      std::string name;
+      std::string file;
+      int line = 0;
+      std::uint64_t calls = 0;
+      std::uint64_t total_ns = 0;
+      std::uint64_t min_ns = 0;
+      std::uint64_t max_ns = 0;
+      std::uint64_t p50_ns = 0;
+      std::uint64_t p90_ns = 0;
+      std::uint64_t p99_ns = 0;
+      std::uint64_t p999_ns = 0;
+  };
+
+  /**
+   * Measures the time from its construction to its destruction and books it
+   * to the call tree of the current thread. Every thread owns its tree and
+   * only writes to it, so entering and leaving a profiled scope takes no lock
+   * and no atomic read-modify-write. The trees of all threads are merged by
+   * the reports, which may run while other threads are profiling.
+   *
+   * Besides the call tree every thread keeps a latency_histogram per site,
+   * so the reports show how the durations of the calls are distributed and
+   * not only their sum.
+   *
+   * Time stamps come from std::chrono::steady_clock, or from the time stamp
+   * counter if MAIKEL_PROFILER_TSC is defined on x86.
+   *
+   * If function_profiler.cpp is compiled with MAIKEL_PROFILE_ALLOCATIONS it
+   * replaces malloc, calloc, realloc, free and the aligned allocations of
+   * glibc, which operator new and Eigen's aligned_malloc both end up in, and
+   * books the number of allocations, their bytes and the peak of live bytes
+   * to the innermost profiled scope of the allocating thread. Memory freed
+   * by another thread than the one which allocated it lowers the live bytes
+   * of the freeing thread. function_profiler.cpp has to be linked into the
+   * executable then and not into a shared library, whose thread local
+   * storage may itself be allocated by malloc.
    *
    * Example:
    *
    *     void foo_function()
    *     {
-   *        maikel::function_profiler profiler("name","group");
+   *        MAIKEL_PROFILER;
    *
    *        // heavy code blah blah ...
    *     }
@@ -58,24 +134,59 @@ namespace maikel {
    */
   class function_profiler {
     public:
-      using clock = std::chrono::high_resolution_clock;
-
-    private:
-      static std::map<std::string, clock::duration> time_table;
-      static bool is_active;
-      static clock::duration total_duration;
+      using clock = std::chrono::steady_clock;
 
-      decltype(time_table)::iterator function_iterator;
-      clock::time_point start = clock::now();
-      bool is_top_level = false;
+      explicit function_profiler(profiler_site const& site) noexcept { enter(site.id()); }
 
-    public:
+      /// Looks the site up by its names on every call, which is slower than a profiler_site.
       function_profiler(std::string function_name, std::string file_name) noexcept;
-      ~function_profiler() noexcept;
+
+      ~function_profiler() noexcept { leave(); }
+
+      function_profiler(function_profiler const&) = delete;
+      function_profiler& operator=(function_profiler const&) = delete;
+
+      /// True if compiled with MAIKEL_PROFILE_ALLOCATIONS.
+      static bool tracks_allocations() noexcept;
+
+      /// Call tree of all threads. Node 0 is the root whose inclusive time is the total.
+      static std::vector<profile_node> call_tree();
+
+      /// Latency statistics per site, sorted by their total time.
+      static std::vector<profile_site_statistics> site_statistics();
+
+      /// Prints the call tree and the latency percentiles of every site.
       static void print_statistics(std::ostream& out);
+
+      /// Writes the call tree and the site statistics as one JSON object.
+      static void write_json(std::ostream& out);
+
+      /// Writes the trace events, or the call tree laid out in time if no trace was recorded.
+      static void write_chrome_trace(std::ostream& out);
+
+      /// Writes one line per call path with its exclusive time in microseconds.
+      static void write_folded_stacks(std::ostream& out);
+
+      /// Records up to `events_per_thread` calls per thread for the chrome trace and resets.
+      static void enable_trace(std::size_t events_per_thread);
+
+      /// Forgets all measurements. Throws if the calling thread is inside a profiled scope.
       static void reset();
-  };
 
+      static std::uint64_t ticks() noexcept
+      {
+#if defined(MAIKEL_PROFILER_TSC) && (defined(__x86_64__) || defined(__i386__))
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count());
+#endif
+      }
+
+    private:
+      static void enter(std::uint32_t site) noexcept;
+      static void leave() noexcept;
+  };
 
 }
 
@@ -27,6 +27,14 @@
 #include "maikel/hmm/algorithm/forward.h"
 #include "maikel/hmm/algorithm/backward.h"
 #include "maikel/hmm/algorithm/baum_welch.h"
+#include "maikel/hmm/algorithm/block_forward.h"
+#include "maikel/hmm/algorithm/forward_scorer.h"
+#include "maikel/hmm/algorithm/multi_forward.h"
+#include "maikel/hmm/algorithm/early_abandon.h"
+#include "maikel/hmm/algorithm/batch_forward.h"
+#include "maikel/hmm/algorithm/posterior.h"
+#include "maikel/hmm/algorithm/viterbi.h"
+#include "maikel/hmm/algorithm/sliding_window.h"
 
 namespace maikel {
 
@@ -16,6 +16,7 @@
 
 #include <iostream>
 #include <gsl_assert.h>
+#include "maikel/hmm/isa_kernels.h"
 
 #ifndef HMM_ALGORITHM_BACKWARD_H_
 #define HMM_ALGORITHM_BACKWARD_H_
@@ -34,7 +35,7 @@ template <class I, class J, class T>
 
         backward_range_fn(I seq_it, I seq_end, J scaling_it, model const& hmm)
         :  hmm_{&hmm}, seq_it_{seq_it}, seq_end_{seq_end}, scaling_it_{scaling_it},
-          beta_(hmm.states()), next_beta_(hmm.states())
+          beta_(hmm.states()), next_beta_(hmm.states()), weighted_(hmm.states())
         {
           if (seq_it != seq_end)
             initial_coefficients(*scaling_it);
@@ -95,6 +96,7 @@ template <class I, class J, class T>
         J scaling_it_;
         row_vector beta_;
         row_vector next_beta_;
+        row_vector weighted_; // B(., o) .* next_beta_ for the kernels
 
         void initial_coefficients(T scaling) noexcept
         {
@@ -119,6 +121,11 @@ template <class I, class J, class T>
           Expects(0 <= ob && ob < B.cols());
 
           // recursion formula
+          if (kernel_table<T> const* kernels = dispatched_kernels<T>()) {
+            kernels->backward_step(A.data(), B.col(ob).data(), next_beta_.data(), scaling,
+                beta_.data(), weighted_.data(), states);
+            return;
+          }
           for (size_type i = 0; i < states; ++i) {
             beta_(i) = 0.0;
             for (size_type j = 0; j < states; ++j)
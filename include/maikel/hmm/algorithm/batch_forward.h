@@ -0,0 +1,116 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_ALGORITHM_BATCH_FORWARD_H_
+#define HMM_ALGORITHM_BATCH_FORWARD_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <gsl_assert.h>
+#include <gsl_util.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+
+namespace maikel { namespace hmm {
+
+  /**
+   * Log-likelihoods of many sequences under one model. The forward
+   * coefficients of all sequences are the rows of one matrix, so every step
+   * is a single matrix product with A followed by a row wise product with
+   * the columns of B which belong to the symbols of the sequences.
+   *
+   * The sequences are advanced longest first, so the sequences which are
+   * still running are always the top rows of the matrix.
+   *
+   * Example:
+   *
+   *     std::vector<std::vector<int>> sequences = ...;
+   *     std::vector<double> logprobs = batch_log_likelihoods(sequences, hmm);
+   */
+  template <class Sequence, class T>
+    std::vector<T>
+    batch_log_likelihoods(std::vector<Sequence> const& sequences, hidden_markov_model<T> const& hmm)
+    {
+      using size_type = typename hidden_markov_model<T>::size_type;
+      using lanes     = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+      using matrix    = typename hidden_markov_model<T>::matrix;
+
+      std::vector<T> result(sequences.size(), T{0});
+      std::vector<std::size_t> order(sequences.size());
+      std::iota(order.begin(), order.end(), std::size_t{0});
+      std::stable_sort(order.begin(), order.end(), [&sequences] (std::size_t i, std::size_t j) {
+        return sequences[i].size() > sequences[j].size();
+      });
+      while (!order.empty() && sequences[order.back()].size() == 0)
+        order.pop_back();
+      if (order.empty())
+        return result;
+
+      size_type N = hmm.states();
+      size_type K = gsl::narrow<size_type>(order.size());
+      matrix const& A = hmm.transition_matrix();
+      matrix BT = hmm.symbol_probabilities().transpose();
+      lanes alpha(K, N), next(K, N);
+      std::vector<T> log(order.size(), T{0});
+
+      auto symbol = [&] (size_type k, std::size_t t) {
+        size_type o = gsl::narrow<size_type>(sequences[order[k]][t]);
+        Expects(0 <= o && o < BT.rows());
+        return o;
+      };
+      auto normalize = [&] (size_type active) {
+        for (size_type k = 0; k < active; ++k) {
+          T c = next.row(k).sum();
+          if (c > 0) {
+            next.row(k) /= c;
+            log[k] += std::log(c);
+          } else {
+            log[k] = -std::numeric_limits<T>::infinity();
+          }
+        }
+        alpha.topRows(active).swap(next.topRows(active));
+      };
+
+      for (size_type k = 0; k < K; ++k)
+        next.row(k) = hmm.initial_distribution().cwiseProduct(BT.row(symbol(k, 0)));
+      normalize(K);
+
+      size_type active = K;
+      for (std::size_t t = 1; ; ++t) {
+        while (active > 0 && sequences[order[active-1]].size() <= t)
+          --active;
+        if (active == 0)
+          break;
+        next.topRows(active).noalias() = alpha.topRows(active) * A;
+        for (size_type k = 0; k < active; ++k)
+          next.row(k) = next.row(k).cwiseProduct(BT.row(symbol(k, t)));
+        normalize(active);
+      }
+
+      for (std::size_t k = 0; k < order.size(); ++k)
+        result[order[k]] = log[k];
+      return result;
+    }
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_ALGORITHM_BATCH_FORWARD_H_ */
@@ -24,22 +24,38 @@
 #define HMM_ALGORITHM_BAUM_WELCH_H_
 
 #include <cstddef>
+#include <type_traits>
 #include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/isa_kernels.h"
+#include "maikel/hmm/precision.h"
 
 namespace maikel { namespace hmm {
 
   namespace detail { namespace baum_welch {
 
+    /**
+     * The expected counts are summed over the whole sequence, so they and
+     * the returned matrices are of the accumulator type, double for a model
+     * in float. The kernels then add the transition counts of up to
+     * fold_interval symbols in float, which keeps the traffic on the N x N
+     * counts at float width, before they are added to the double counts.
+     */
     template <class SeqI, class AlphaI, class BetaI, class T>
     class update_matrices_fn {
       public:
-        using matrix = typename hidden_markov_model<T>::matrix;
-        using row_vector = typename hidden_markov_model<T>::row_vector;
+        using accumulator = accumulator_t<T>;
+        using matrix = typename hidden_markov_model<accumulator>::matrix;
+        using row_vector = typename hidden_markov_model<accumulator>::row_vector;
+        using model_matrix = typename hidden_markov_model<T>::matrix;
+        using model_row_vector = typename hidden_markov_model<T>::row_vector;
+
+        static constexpr size_t fold_interval = 32;
 
         update_matrices_fn() = delete;
         update_matrices_fn(size_t states, size_t symbols)
         : states_{states}, symbols_{symbols},
-          xi_(states, states), B_(states, symbols), gamma_(states), gamma_sum_(states) {}
+          xi_(states, states), B_(states, symbols), gamma_(states), gamma_sum_(states),
+          alpha_(states), weighted_(states), partial_xi_(mixed() ? states : 0, mixed() ? states : 0) {}
 
         std::pair<matrix const&, matrix const&> operator()(
             SeqI seq_it, SeqI seq_end,
@@ -47,30 +63,51 @@ namespace maikel { namespace hmm {
         {
           Expects(seq_it != seq_end);
           size_t t_max = std::distance(seq_it, seq_end);
-          matrix const& A = hmm.transition_matrix();
-          matrix const& B = hmm.symbol_probabilities();
+          model_matrix const& A = hmm.transition_matrix();
+          model_matrix const& B = hmm.symbol_probabilities();
           xi_.setZero();
           B_.setZero();
           gamma_sum_.setZero();
+          kernel_table<T> const* kernels = dispatched_kernels<T>();
+          // without mixed precision the kernel adds straight into xi_ and the cast changes nothing
+          T* xi_counts = mixed() ? partial_xi_.data() : reinterpret_cast<T*>(xi_.data());
+          partial_xi_.setZero();
           for (size_t t = 0; t < t_max-1; ++t) {
             gamma_.setZero();
-            for (size_t i = 0; i < states_; ++i)
-              for (size_t j = 0; j < states_; ++j) {
-                T xi_t = alphas[t](i)*A(i,j)*B(j,seq_it[t+1])*betas[t+1](j);
-                xi_(i,j) += xi_t;
-                gamma_(i) += xi_t;
-              }
+            if (kernels) {
+              // the coefficients may come from any random access range, the kernel needs them contiguous
+              alpha_ = alphas[t];
+              weighted_ = B.col(seq_it[t+1]).transpose().cwiseProduct(betas[t+1]);
+              kernels->xi_accumulate(A.data(), alpha_.data(), weighted_.data(), xi_counts, gamma_.data(),
+                  static_cast<std::ptrdiff_t>(states_));
+              if (mixed() && (t+1) % fold_interval == 0)
+                fold_partial_xi();
+            } else {
+              for (size_t i = 0; i < states_; ++i)
+                for (size_t j = 0; j < states_; ++j) {
+                  T xi_t = alphas[t](i)*A(i,j)*B(j,seq_it[t+1])*betas[t+1](j);
+                  xi_(i,j) += xi_t;
+                  gamma_(i) += xi_t;
+                }
+            }
             for (size_t j = 0; j < states_; ++j) {
               B_(j,seq_it[t]) += gamma_(j);
               gamma_sum_(j) += gamma_(j);
             }
           }
-          for (size_t j = 0; j < states_; ++j)
+          if (mixed()) {
+            fold_partial_xi();
+            // the float counts of xi and gamma were rounded differently
             for (size_t i = 0; i < states_; ++i)
-              xi_(i,j) /= gamma_sum_(i);
+              xi_.row(i) /= xi_.row(i).sum();
+          } else {
+            for (size_t j = 0; j < states_; ++j)
+              for (size_t i = 0; i < states_; ++i)
+                xi_(i,j) /= gamma_sum_(i);
+          }
 
           for (size_t i = 0; i < states_; ++i) {
-            T entry = alphas[t_max-1](i)*betas[t_max-1](i) / scaling;
+            accumulator entry = alphas[t_max-1](i)*betas[t_max-1](i) / scaling;
             B_(i,seq_it[t_max-1]) += entry;
             gamma_sum_(i) += entry;
           }
@@ -85,9 +122,26 @@ namespace maikel { namespace hmm {
         size_t states_, symbols_;
         matrix xi_;
         matrix B_;
-        row_vector gamma_;
+        model_row_vector gamma_;
         row_vector gamma_sum_;
+        model_row_vector alpha_;
+        model_row_vector weighted_; // B(., o) .* beta for the kernels
+        model_matrix partial_xi_;   // counts of the last symbols in mixed precision
+
+        static constexpr bool mixed() noexcept
+        {
+          return !std::is_same<T, accumulator>::value;
+        }
+
+        void fold_partial_xi()
+        {
+          xi_ += partial_xi_.template cast<accumulator>();
+          partial_xi_.setZero();
+        }
     };
+
+    template <class SeqI, class AlphaI, class BetaI, class T>
+    constexpr size_t update_matrices_fn<SeqI, AlphaI, BetaI, T>::fold_interval;
   }}
 
   template <class SeqI, class AlphaI, class BetaI, class T>
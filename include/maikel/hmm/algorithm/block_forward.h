@@ -0,0 +1,538 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Forward algorithm which advances k symbols per step. For small alphabets
+ * there are only M^k different blocks of k symbols, so the product
+ *
+ *     A diag(B(:,o_1)) * A diag(B(:,o_2)) * ... * A diag(B(:,o_k))
+ *
+ * can be tabulated for every block in advance. One vector-matrix product
+ * with the tabulated transfer matrix then replaces k forward recursions.
+ * The backward recursion multiplies the same products from the other
+ * side, beta_t^T = P(o_{t+1} ... o_{t+k}) beta_{t+k}^T, so one table
+ * serves both directions.
+ */
+
+#ifndef HMM_ALGORITHM_BLOCK_FORWARD_H_
+#define HMM_ALGORITHM_BLOCK_FORWARD_H_
+
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <boost/iterator/iterator_facade.hpp>
+#include <gsl_assert.h>
+#include <gsl_util.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/algorithm/forward.h"
+
+namespace maikel { namespace hmm {
+
+  /**
+   * Normalized transfer matrices for every block of k symbols. The block
+   * o_0 o_1 ... o_{k-1} is stored at index o_0 + o_1*M + ... + o_{k-1}*M^{k-1}.
+   * Every matrix is divided by its largest row sum to stay away from
+   * underflows and the logarithm of that factor is kept next to it.
+   */
+  template <class T>
+    class block_transfer_table {
+      public:
+        using model      = hidden_markov_model<T>;
+        using matrix     = typename model::matrix;
+        using row_vector = typename model::row_vector;
+        using size_type  = typename model::size_type;
+
+        static const std::size_t default_cache_bytes = std::size_t{1} << 20;
+        static const std::size_t max_block_length = 16;
+
+        /**
+         * Returns the largest block length k such that all M^k transfer
+         * matrices of size N x N fit into `cache_bytes`, but at least one.
+         */
+        static std::size_t
+        choose_block_length(size_type states, size_type symbols, std::size_t cache_bytes)
+        {
+          Expects(states > 0 && symbols > 0);
+          std::size_t bytes_per_block = sizeof(T)*states*states;
+          std::size_t blocks = symbols;
+          std::size_t k = 1;
+          while (k < max_block_length && blocks*symbols*bytes_per_block <= cache_bytes) {
+            blocks *= symbols;
+            ++k;
+          }
+          return k;
+        }
+
+        explicit block_transfer_table(model const& hmm)
+        : block_transfer_table(hmm,
+            choose_block_length(hmm.states(), hmm.symbols(), default_cache_bytes))
+        {}
+
+        block_transfer_table(model const& hmm, std::size_t block_length)
+        : states_{hmm.states()}, symbols_{hmm.symbols()}, block_length_{block_length}
+        {
+          Expects(block_length_ > 0);
+          matrix const& A = hmm.transition_matrix();
+          matrix const& B = hmm.symbol_probabilities();
+
+          // blocks of length one are A * diag(B(:,o))
+          matrix single(states_, states_*symbols_);
+          row_vector single_log(symbols_);
+          for (size_type o = 0; o < symbols_; ++o) {
+            single.middleCols(o*states_, states_) = A * B.col(o).asDiagonal();
+            single_log(o) = normalize(single.middleCols(o*states_, states_));
+          }
+
+          // extend every block of length l by one symbol at its end
+          table_ = single;
+          log_norm_ = single_log;
+          size_type blocks = symbols_;
+          for (std::size_t l = 1; l < block_length_; ++l) {
+            matrix next(states_, states_*blocks*symbols_);
+            row_vector next_log(blocks*symbols_);
+            for (size_type o = 0; o < symbols_; ++o)
+              for (size_type w = 0; w < blocks; ++w) {
+                size_type index = w + o*blocks;
+                next.middleCols(index*states_, states_).noalias() =
+                    table_.middleCols(w*states_, states_) * single.middleCols(o*states_, states_);
+                next_log(index) = log_norm_(w) + single_log(o) +
+                    normalize(next.middleCols(index*states_, states_));
+              }
+            table_.swap(next);
+            log_norm_.swap(next_log);
+            blocks *= symbols_;
+          }
+          blocks_ = blocks;
+        }
+
+        std::size_t block_length() const noexcept { return block_length_; }
+        size_type blocks() const noexcept { return blocks_; }
+        size_type states() const noexcept { return states_; }
+        size_type symbols() const noexcept { return symbols_; }
+
+        typename matrix::ConstColsBlockXpr transfer(size_type index) const
+        {
+          Expects(0 <= index && index < blocks_);
+          return table_.middleCols(index*states_, states_);
+        }
+
+        T log_norm(size_type index) const
+        {
+          Expects(0 <= index && index < blocks_);
+          return log_norm_(index);
+        }
+
+        /**
+         * Computes the table index of the block_length() symbols starting at
+         * `first`.
+         */
+        template <class Iter>
+          size_type block_index(Iter first) const
+          {
+            size_type index = 0;
+            size_type radix = 1;
+            for (std::size_t s = 0; s < block_length_; ++s, ++first) {
+              size_type ob = gsl::narrow<size_type>(*first);
+              Expects(0 <= ob && ob < symbols_);
+              index += ob*radix;
+              radix *= symbols_;
+            }
+            return index;
+          }
+
+        /**
+         * Computes the table index of the block_length() symbols which end
+         * at `last` when read backwards, i.e. `last` is a reverse iterator
+         * onto the last symbol of the block.
+         */
+        template <class ReverseIter>
+          size_type reversed_block_index(ReverseIter last) const
+          {
+            size_type index = 0;
+            for (std::size_t s = 0; s < block_length_; ++s, ++last) {
+              size_type ob = gsl::narrow<size_type>(*last);
+              Expects(0 <= ob && ob < symbols_);
+              index = index*symbols_ + ob;
+            }
+            return index;
+          }
+
+      private:
+        size_type states_;
+        size_type symbols_;
+        std::size_t block_length_;
+        size_type blocks_ = 0;
+        matrix table_;
+        row_vector log_norm_;
+
+        template <class Block>
+          static T normalize(Block&& block)
+          {
+            T max_row_sum = block.rowwise().sum().maxCoeff();
+            if (max_row_sum <= 0)
+              return 0;
+            block /= max_row_sum;
+            return std::log(max_row_sum);
+          }
+    };
+
+  /**
+   * Range of forward coefficients at block boundaries. Dereferencing yields
+   * the scaled alpha after the last consumed symbol together with the
+   * logarithm of the normalization constant of the consumed symbols, i.e.
+   * log P(O|lambda) is the sum of all first members. Note that this differs
+   * from forward() which yields the scaling factor itself.
+   *
+   * The first element covers the first symbol only. Afterwards the range
+   * advances by block_length() symbols at once and falls back to single
+   * symbol steps for the tail. expand() recomputes the per symbol forward
+   * coefficients of the latest step if they are needed after all.
+   */
+  template <class ForwardIter, class T>
+    class block_forward_range_fn {
+      public:
+        using model       = hidden_markov_model<T>;
+        using row_vector  = typename model::row_vector;
+        using matrix      = typename model::matrix;
+        using size_type   = typename model::size_type;
+        using symbol_type = typename std::iterator_traits<ForwardIter>::value_type;
+
+        block_forward_range_fn() = delete;
+
+        block_forward_range_fn(ForwardIter seq_it, ForwardIter seq_end,
+            block_transfer_table<T> const& table, model const& hmm)
+        : hmm_{&hmm}, table_{&table}, seq_it_{seq_it}, step_begin_{seq_it},
+          seq_end_{seq_end}, alpha_{0, row_vector(hmm.states())},
+          prev_alpha_(hmm.states()), step_length_{1}
+        {
+          Expects(table.states() == hmm.states() && table.symbols() == hmm.symbols());
+          if (seq_it != seq_end) {
+            T scaling = detail::forward_initial(*hmm_, *seq_it, alpha_.second);
+            alpha_.first = log_of_inverse(scaling);
+            remaining_ = std::distance(seq_it, seq_end) - 1;
+          }
+        }
+
+        class iterator
+        : public boost::iterator_facade<
+              iterator, std::pair<T, row_vector>, std::input_iterator_tag,
+              std::pair<T, row_vector> const&
+         > {
+          public:
+            iterator() = default;
+          private:
+            friend class block_forward_range_fn;
+            friend class boost::iterator_core_access;
+
+            iterator(block_forward_range_fn& parent)
+            : parent_{parent ? &parent : nullptr} {}
+
+            block_forward_range_fn* parent_ = nullptr;
+
+            std::pair<T, row_vector> const& dereference() const
+            {
+              Expects(parent_ && *parent_);
+              return parent_->alpha_;
+            }
+
+            void increment()
+            {
+              Expects(parent_ && *parent_);
+              if (!parent_->next())
+                parent_ = nullptr;
+            }
+
+            bool equal(iterator other) const noexcept
+            {
+              return parent_ == other.parent_;
+            }
+        };
+
+        operator bool() const noexcept
+        {
+          return seq_it_ != seq_end_;
+        }
+
+        iterator begin() noexcept
+        {
+          return {*this};
+        }
+
+        iterator end() noexcept
+        {
+          return {};
+        }
+
+        /**
+         * Number of symbols consumed by the latest step.
+         */
+        std::size_t step_length() const noexcept
+        {
+          return step_length_;
+        }
+
+        /**
+         * Writes the (scaling, alpha) pairs of forward() for every symbol of
+         * the latest step into `out`.
+         */
+        template <class OutputIter>
+          OutputIter expand(OutputIter out) const
+          {
+            Expects(*this);
+            ForwardIter it = step_begin_;
+            std::pair<T, row_vector> coeff {0, row_vector(hmm_->states())};
+            row_vector prev = prev_alpha_;
+            if (is_first_) {
+              coeff.first = detail::forward_initial(*hmm_, *it, coeff.second);
+              *out++ = coeff;
+              return out;
+            }
+            for (std::size_t s = 0; s < step_length_; ++s, ++it) {
+              coeff.first = detail::forward_recursion(*hmm_, prev, *it, coeff.second);
+              *out++ = coeff;
+              prev = coeff.second;
+            }
+            return out;
+          }
+
+      private:
+        model const* hmm_; // not owning
+        block_transfer_table<T> const* table_; // not owning
+        ForwardIter seq_it_, step_begin_, seq_end_;
+        std::pair<T, row_vector> alpha_;
+        row_vector prev_alpha_;
+        std::size_t step_length_;
+        std::size_t remaining_ = 0;
+        bool is_first_ = true;
+
+        static T log_of_inverse(T scaling)
+        {
+          return scaling ? -std::log(scaling) : -std::numeric_limits<T>::infinity();
+        }
+
+        bool next()
+        {
+          Expects(*this);
+          if (remaining_ == 0) {
+            seq_it_ = seq_end_;
+            return false;
+          }
+          is_first_ = false;
+          step_begin_ = std::next(seq_it_);
+          prev_alpha_ = alpha_.second;
+          std::size_t k = table_->block_length();
+          if (remaining_ >= k) {
+            size_type index = table_->block_index(step_begin_);
+            alpha_.second.noalias() = prev_alpha_ * table_->transfer(index);
+            T sum = alpha_.second.sum();
+            if (sum > 0) {
+              alpha_.second /= sum;
+              alpha_.first = std::log(sum) + table_->log_norm(index);
+            } else {
+              alpha_.second.setZero();
+              alpha_.first = -std::numeric_limits<T>::infinity();
+            }
+            step_length_ = k;
+          } else {
+            T scaling = detail::forward_recursion(*hmm_, prev_alpha_, *step_begin_, alpha_.second);
+            alpha_.first = log_of_inverse(scaling);
+            step_length_ = 1;
+          }
+          std::advance(seq_it_, step_length_);
+          remaining_ -= step_length_;
+          return true;
+        }
+    };
+
+  template <class ForwardIter, class T>
+    block_forward_range_fn<ForwardIter, T>
+    block_forward(ForwardIter begin, ForwardIter end,
+        block_transfer_table<T> const& table, hidden_markov_model<T> const& hmm)
+    {
+      return {begin, end, table, hmm};
+    }
+
+  /**
+   * Range of backward coefficients at block boundaries, from the last symbol
+   * to the first. It takes the sequence reversed, like backward(), but needs
+   * no scaling factors of a forward pass. Dereferencing yields beta scaled
+   * to sum one together with the logarithm of the factor which was divided
+   * out, such that the unscaled beta_t is the scaled one times the exp of
+   * the sum of all first members up to t. Hence
+   *
+   *     log P(O|lambda) = log(pi .* B(:,o_0) . beta_0) + sum of all first members
+   *
+   * The first element is beta_{T-1}. Afterwards the range steps back by
+   * block_length() symbols at once with the transposed transfer matrices
+   * and falls back to single symbol steps for the head of the sequence.
+   */
+  template <class ReverseIter, class T>
+    class block_backward_range_fn {
+      public:
+        using model       = hidden_markov_model<T>;
+        using row_vector  = typename model::row_vector;
+        using matrix      = typename model::matrix;
+        using size_type   = typename model::size_type;
+        using symbol_type = typename std::iterator_traits<ReverseIter>::value_type;
+
+        block_backward_range_fn() = delete;
+
+        block_backward_range_fn(ReverseIter seq_it, ReverseIter seq_end,
+            block_transfer_table<T> const& table, model const& hmm)
+        : hmm_{&hmm}, table_{&table}, seq_it_{seq_it}, seq_end_{seq_end},
+          beta_{0, row_vector(hmm.states())}, weighted_(hmm.states()), step_length_{1}
+        {
+          Expects(table.states() == hmm.states() && table.symbols() == hmm.symbols());
+          if (seq_it != seq_end) {
+            beta_.second.fill(T(1) / hmm.states());
+            beta_.first = std::log(static_cast<T>(hmm.states()));
+            remaining_ = std::distance(seq_it, seq_end) - 1;
+          }
+        }
+
+        class iterator
+        : public boost::iterator_facade<
+              iterator, std::pair<T, row_vector>, std::input_iterator_tag,
+              std::pair<T, row_vector> const&
+         > {
+          public:
+            iterator() = default;
+          private:
+            friend class block_backward_range_fn;
+            friend class boost::iterator_core_access;
+
+            iterator(block_backward_range_fn& parent)
+            : parent_{parent ? &parent : nullptr} {}
+
+            block_backward_range_fn* parent_ = nullptr;
+
+            std::pair<T, row_vector> const& dereference() const
+            {
+              Expects(parent_ && *parent_);
+              return parent_->beta_;
+            }
+
+            void increment()
+            {
+              Expects(parent_ && *parent_);
+              if (!parent_->next())
+                parent_ = nullptr;
+            }
+
+            bool equal(iterator other) const noexcept
+            {
+              return parent_ == other.parent_;
+            }
+        };
+
+        operator bool() const noexcept
+        {
+          return seq_it_ != seq_end_;
+        }
+
+        iterator begin() noexcept
+        {
+          return {*this};
+        }
+
+        iterator end() noexcept
+        {
+          return {};
+        }
+
+        /**
+         * Number of symbols stepped back by the latest step.
+         */
+        std::size_t step_length() const noexcept
+        {
+          return step_length_;
+        }
+
+      private:
+        model const* hmm_; // not owning
+        block_transfer_table<T> const* table_; // not owning
+        ReverseIter seq_it_, seq_end_;
+        std::pair<T, row_vector> beta_;
+        row_vector weighted_;
+        std::size_t step_length_;
+        std::size_t remaining_ = 0;
+
+        void normalize(T log_norm)
+        {
+          T sum = beta_.second.sum();
+          if (sum > 0) {
+            beta_.second /= sum;
+            beta_.first = std::log(sum) + log_norm;
+          } else {
+            beta_.second.setZero();
+            beta_.first = -std::numeric_limits<T>::infinity();
+          }
+        }
+
+        bool next()
+        {
+          Expects(*this);
+          if (remaining_ == 0) {
+            seq_it_ = seq_end_;
+            return false;
+          }
+          std::size_t k = table_->block_length();
+          weighted_ = beta_.second;
+          if (remaining_ >= k) {
+            // seq_it_ is the last symbol of the block which ends at t + k
+            size_type index = table_->reversed_block_index(seq_it_);
+            beta_.second.noalias() = weighted_ * table_->transfer(index).transpose();
+            normalize(table_->log_norm(index));
+            step_length_ = k;
+          } else {
+            size_type ob = gsl::narrow<size_type>(*seq_it_);
+            Expects(0 <= ob && ob < hmm_->symbols());
+            weighted_.array() *= hmm_->symbol_probabilities().col(ob).transpose().array();
+            beta_.second.noalias() = weighted_ * hmm_->transition_matrix().transpose();
+            normalize(0);
+            step_length_ = 1;
+          }
+          std::advance(seq_it_, step_length_);
+          remaining_ -= step_length_;
+          return true;
+        }
+    };
+
+  template <class ReverseIter, class T>
+    block_backward_range_fn<ReverseIter, T>
+    block_backward(ReverseIter rbegin, ReverseIter rend,
+        block_transfer_table<T> const& table, hidden_markov_model<T> const& hmm)
+    {
+      return {rbegin, rend, table, hmm};
+    }
+
+  /**
+   * Returns log P(O|lambda) by advancing block_length() symbols per step.
+   */
+  template <class ForwardIter, class T>
+    T block_log_likelihood(ForwardIter begin, ForwardIter end,
+        block_transfer_table<T> const& table, hidden_markov_model<T> const& hmm)
+    {
+      T logprob = 0;
+      for (auto&& coeff : block_forward(begin, end, table, hmm))
+        logprob += coeff.first;
+      return logprob;
+    }
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_ALGORITHM_BLOCK_FORWARD_H_ */
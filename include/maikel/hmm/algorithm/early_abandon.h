@@ -0,0 +1,222 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_ALGORITHM_EARLY_ABANDON_H_
+#define HMM_ALGORITHM_EARLY_ABANDON_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <gsl_assert.h>
+#include <gsl_util.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/algorithm/forward.h"
+
+namespace maikel { namespace hmm {
+
+  /**
+   * Upper bounds for the logarithm of the per-symbol normalizer c_t of the
+   * forward algorithm. With normalized alpha
+   *
+   *     c_1 = sum_j pi_j B(j,o)            <= max_j B(j,o)
+   *     c_t = sum_i alpha_i (A B)(i,o)     <= max_i (A B)(i,o)
+   *
+   * so the log-likelihood of the symbols still to come is bounded by the
+   * number of remaining occurrences of every symbol times its bound. A
+   * symbol outside of the alphabet of the model has probability 0.
+   */
+  template <class T>
+    struct likelihood_bounds {
+        std::vector<T> first;
+        std::vector<T> rest;
+
+        explicit likelihood_bounds(hidden_markov_model<T> const& hmm)
+        {
+          using matrix = typename hidden_markov_model<T>::matrix;
+          matrix const& B = hmm.symbol_probabilities();
+          matrix AB = hmm.transition_matrix() * B;
+          for (typename matrix::Index o = 0; o < B.cols(); ++o) {
+            first.push_back(std::log(B.col(o).maxCoeff()));
+            rest.push_back(std::log(AB.col(o).maxCoeff()));
+          }
+        }
+
+        /// Bound for the first symbol o.
+        T initial(std::size_t o) const
+        {
+          return o < first.size() ? first[o] : -std::numeric_limits<T>::infinity();
+        }
+
+        /// Bound for the counts of `size` symbols. Symbols which do not occur add nothing.
+        T operator()(std::uint64_t const* counts, std::size_t size) const
+        {
+          T bound = 0;
+          for (std::size_t o = 0; o < size; ++o)
+            if (counts[o]) {
+              if (o >= rest.size())
+                return -std::numeric_limits<T>::infinity();
+              bound += static_cast<T>(counts[o]) * rest[o];
+            }
+          return bound;
+        }
+    };
+
+  template <class T>
+    struct early_abandon_result {
+        std::vector<std::size_t> ranking; // the best complete models, best first
+        std::vector<T> log_likelihoods;   // exact if complete, else an upper bound
+        std::vector<bool> complete;
+        std::uint64_t steps = 0;          // forward steps over all models
+    };
+
+  /**
+   * Scores a sequence against many models and returns the `top` best ones
+   * exactly, but stops scoring a model as soon as its log-likelihood so far
+   * plus the bound for the rest of the sequence falls below the `top`-th
+   * best complete model or below `threshold`. Models are scored in the
+   * order of their bounds for the whole sequence, so the likely winner runs
+   * first and makes the cut-off tight early.
+   *
+   * The sequence has to be a multi-pass range. Bounds are checked every
+   * `check_every` symbols. A model whose alphabet does not contain every
+   * symbol of the sequence is abandoned with a log-likelihood of -infinity.
+   */
+  template <class ForwardIter, class T>
+    early_abandon_result<T>
+    early_abandon_scores(
+        ForwardIter first, ForwardIter last,
+        std::vector<hidden_markov_model<T> const*> const& models,
+        std::size_t top = 1,
+        T threshold = -std::numeric_limits<T>::infinity(),
+        std::size_t check_every = 256)
+    {
+      Expects(top > 0 && check_every > 0);
+      using row_vector = typename hidden_markov_model<T>::row_vector;
+
+      early_abandon_result<T> result;
+      result.log_likelihoods.assign(models.size(), T{0});
+      result.complete.assign(models.size(), true);
+      std::size_t length = gsl::narrow<std::size_t>(std::distance(first, last));
+      if (models.empty() || length == 0) {
+        result.ranking.resize(std::min(top, models.size()));
+        std::iota(result.ranking.begin(), result.ranking.end(), std::size_t{0});
+        return result;
+      }
+
+      // remaining symbol counts at the start of every chunk of steps, the
+      // last of the `stride` counts is for symbols outside of every alphabet
+      std::size_t symbols = 0;
+      for (auto hmm : models)
+        symbols = std::max(symbols, gsl::narrow<std::size_t>(hmm->symbols()));
+      std::size_t stride = symbols + 1;
+      std::size_t chunks = (length - 1 + check_every - 1) / check_every;
+      std::vector<std::uint64_t> remaining((chunks + 1)*stride, 0);
+      {
+        // counts per chunk first, then summed up from the back
+        ForwardIter it = first;
+        ++it;
+        for (std::size_t t = 1; t < length; ++t, ++it) {
+          std::size_t o = std::min(gsl::narrow<std::size_t>(*it), symbols);
+          ++remaining[(t-1)/check_every*stride + o];
+        }
+        for (std::size_t c = chunks; c-- > 0; )
+          for (std::size_t o = 0; o < stride; ++o)
+            remaining[c*stride + o] += remaining[(c+1)*stride + o];
+      }
+      std::size_t first_symbol = gsl::narrow<std::size_t>(*first);
+
+      std::vector<likelihood_bounds<T>> bounds;
+      std::vector<T> total_bound;
+      for (auto hmm : models) {
+        bounds.emplace_back(*hmm);
+        total_bound.push_back(bounds.back().initial(first_symbol) + bounds.back()(remaining.data(), stride));
+      }
+      std::vector<std::size_t> order(models.size());
+      std::iota(order.begin(), order.end(), std::size_t{0});
+      std::stable_sort(order.begin(), order.end(), [&total_bound] (std::size_t i, std::size_t j) {
+        return total_bound[i] > total_bound[j];
+      });
+
+      // the `top` best complete log-likelihoods, smallest first
+      std::vector<T> best;
+      auto cutoff = [&] {
+        T cut = best.size() < top ? threshold : std::max(threshold, best.front());
+        return cut - T(1e-9)*std::max(T{1}, std::abs(cut));
+      };
+
+      for (std::size_t k : order) {
+        hidden_markov_model<T> const& hmm = *models[k];
+        // the cut-off can be -infinity itself, a model which can not emit the sequence is never scored
+        if (total_bound[k] == -std::numeric_limits<T>::infinity() || total_bound[k] < cutoff()) {
+          result.log_likelihoods[k] = total_bound[k];
+          result.complete[k] = false;
+          continue;
+        }
+        row_vector alpha(hmm.states()), prev_alpha(hmm.states());
+        ForwardIter it = first;
+        T scaling = detail::forward_initial(hmm, *it++, alpha);
+        T logprob = scaling ? -std::log(scaling) : -std::numeric_limits<T>::infinity();
+        result.steps += 1;
+        for (std::size_t c = 0; c < chunks; ++c) {
+          std::size_t end = std::min(length, 1 + (c+1)*check_every);
+          for (std::size_t t = 1 + c*check_every; t < end; ++t) {
+            prev_alpha.swap(alpha);
+            scaling = detail::forward_recursion(hmm, prev_alpha, *it++, alpha);
+            logprob += scaling ? -std::log(scaling) : -std::numeric_limits<T>::infinity();
+          }
+          result.steps += end - 1 - c*check_every;
+          if (c + 1 < chunks) {
+            T bound = logprob + bounds[k](remaining.data() + (c+1)*stride, stride);
+            if (bound < cutoff()) {
+              logprob = bound;
+              result.complete[k] = false;
+              break;
+            }
+          }
+        }
+        result.log_likelihoods[k] = logprob;
+        if (result.complete[k] && logprob >= threshold) {
+          best.push_back(logprob);
+          std::push_heap(best.begin(), best.end(), std::greater<T>());
+          if (best.size() > top) {
+            std::pop_heap(best.begin(), best.end(), std::greater<T>());
+            best.pop_back();
+          }
+        }
+      }
+
+      for (std::size_t k = 0; k < models.size(); ++k)
+        if (result.complete[k] && result.log_likelihoods[k] >= threshold)
+          result.ranking.push_back(k);
+      std::stable_sort(result.ranking.begin(), result.ranking.end(), [&result] (std::size_t i, std::size_t j) {
+        return result.log_likelihoods[i] > result.log_likelihoods[j];
+      });
+      if (result.ranking.size() > top)
+        result.ranking.resize(top);
+      return result;
+    }
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_ALGORITHM_EARLY_ABANDON_H_ */
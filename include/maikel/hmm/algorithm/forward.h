@@ -22,9 +22,98 @@
 #include <gsl_assert.h>
 
 #include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/isa_kernels.h"
+#include "maikel/hmm/precision.h"
 
 namespace maikel { namespace hmm {
 
+  namespace detail {
+
+    /**
+     * Writes the scaled initial forward coefficients for the first symbol `s`
+     * into `alpha` and returns the scaling factor.
+     */
+    template <class T, class Symbol>
+      T forward_initial(
+          hidden_markov_model<T> const& hmm, Symbol s,
+          typename hidden_markov_model<T>::row_vector& alpha)
+      {
+        using size_type  = typename hidden_markov_model<T>::size_type;
+        using matrix     = typename hidden_markov_model<T>::matrix;
+        using row_vector = typename hidden_markov_model<T>::row_vector;
+        matrix const& B  = hmm.symbol_probabilities();
+        row_vector const& pi = hmm.initial_distribution();
+
+        // check pre conditions
+        size_type states = pi.size();
+        size_type ob = gsl::narrow<size_type>(s);
+        Expects(B.rows() == states);
+        Expects(0 <= ob && ob < B.cols());
+        Expects(alpha.size() == states);
+
+        // initial formula
+        accumulator_t<T> sum = 0.0;
+        for (size_type i = 0; i < states; ++i) {
+          alpha(i) = pi(i)*B(i,ob);
+          sum += alpha(i);
+        }
+        T scaling = sum ? static_cast<T>(1/sum) : 0;
+        alpha *= scaling;
+
+        // check post conditions
+        Ensures((!scaling && almost_equal<T>(alpha.sum(), 0.0)) ||
+                ( scaling && is_probability_array(alpha.array()))   );
+        return scaling;
+      }
+
+    /**
+     * Advances the scaled forward coefficients `prev_alpha` by the symbol `s`
+     * into `alpha` and returns the scaling factor.
+     */
+    template <class T, class Symbol>
+      T forward_recursion(
+          hidden_markov_model<T> const& hmm,
+          typename hidden_markov_model<T>::row_vector const& prev_alpha, Symbol s,
+          typename hidden_markov_model<T>::row_vector& alpha)
+      {
+        using size_type = typename hidden_markov_model<T>::size_type;
+        using matrix    = typename hidden_markov_model<T>::matrix;
+        matrix const& A = hmm.transition_matrix();
+        matrix const& B = hmm.symbol_probabilities();
+
+        // check pre conditions
+        size_type states = A.rows();
+        Expects(A.cols() == states);
+        Expects(B.rows() == states);
+        Expects(prev_alpha.size() == states);
+        Expects(alpha.size() == states);
+        size_type ob = gsl::narrow<size_type>(s);
+        Expects(0 <= ob && ob < B.cols());
+
+        // recursion formula
+        accumulator_t<T> sum = 0.0;
+        if (kernel_table<T> const* kernels = dispatched_kernels<T>()) {
+          sum = kernels->forward_step(A.data(), prev_alpha.data(), B.col(ob).data(), alpha.data(), states);
+        } else {
+          for (size_type j = 0; j < states; ++j) {
+            alpha(j) = 0.0;
+            for (size_type i = 0; i < states; ++i)
+              alpha(j) += prev_alpha(i)*A(i,j);
+            alpha(j) *= B(j, ob);
+            sum += alpha(j);
+          }
+        }
+        T scaling = sum ? static_cast<T>(1/sum) : 0;
+        alpha *= scaling;
+
+        // post conditions
+        Ensures((!scaling && almost_equal<T>(alpha.sum(), 0.0)) ||
+                ( scaling && is_probability_array(alpha.array()))   );
+        return scaling;
+      }
+
+  } // namespace detail
+
   template <class InputIter, class T>
     class forward_range_fn {
       public:
@@ -101,65 +190,13 @@ namespace maikel { namespace hmm {
 
         void initial_coefficients(symbol_type s)
         {
-          using size_type = typename hidden_markov_model<T>::size_type;
-          matrix const& B  = hmm_->symbol_probabilities();
-          row_vector const& pi = hmm_->initial_distribution();
-
-          // check pre conditions
-          size_type states = pi.size();
-          size_type ob = gsl::narrow<size_type>(s);
-          Expects(B.rows() == states);
-          Expects(0 <= ob && ob < B.cols());
-          Expects(alpha_.second.size() == states);
-
-          // initial formula
-          T& scaling = alpha_.first;
-          row_vector& alpha = alpha_.second;
-          scaling = 0.0;
-          for (size_type i = 0; i < states; ++i) {
-            alpha(i) = pi(i)*B(i,ob);
-            scaling += alpha(i);
-          }
-          scaling = scaling ? 1/scaling : 0;
-          alpha *= scaling;
-
-          // check post conditions
-          Ensures((!scaling && almost_equal<T>(alpha.sum(), 0.0)) ||
-                  ( scaling && almost_equal<T>(alpha.sum(), 1.0))    );
+          alpha_.first = detail::forward_initial(*hmm_, s, alpha_.second);
         }
 
         void recursion_advance(symbol_type s)
         {
-          using size_type = typename hidden_markov_model<T>::size_type;
-          matrix const& A = hmm_->transition_matrix();
-          matrix const& B = hmm_->symbol_probabilities();
           prev_alpha_.swap(alpha_.second);
-
-          // check pre conditions
-          size_type states = A.rows();
-          Expects(A.cols() == states);
-          Expects(B.rows() == states);
-          Expects(prev_alpha_.size() == states);
-          size_type ob = gsl::narrow<size_type>(s);
-          Expects(0 <= ob && ob < B.cols());
-
-          // recursion formula
-          T& scaling = alpha_.first;
-          row_vector& alpha = alpha_.second;
-          scaling = 0.0;
-          for (size_type j = 0; j < states; ++j) {
-            alpha(j) = 0.0;
-            for (size_type i = 0; i < states; ++i)
-              alpha(j) += prev_alpha_(i)*A(i,j);
-            alpha(j) *= B(j, ob);
-            scaling += alpha(j);
-          }
-          scaling = scaling ? 1/scaling : 0;
-          alpha *= scaling;
-
-          // post conditions
-          Ensures((!scaling && almost_equal<T>(alpha.sum(), 0.0)) ||
-                  ( scaling && almost_equal<T>(alpha.sum(), 1.0))    );
+          alpha_.first = detail::forward_recursion(*hmm_, prev_alpha_, s, alpha_.second);
         }
 
         bool next()
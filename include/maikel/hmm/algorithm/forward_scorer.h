@@ -0,0 +1,98 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_ALGORITHM_FORWARD_SCORER_H_
+#define HMM_ALGORITHM_FORWARD_SCORER_H_
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/precision.h"
+#include "maikel/hmm/algorithm/forward.h"
+
+namespace maikel { namespace hmm {
+
+  /**
+   * Forward algorithm which is fed with symbols piece by piece. Only the
+   * latest scaled forward coefficients are kept, so the memory does not
+   * depend on the length of the sequence.
+   *
+   * Example:
+   *
+   *     forward_scorer<double> scorer(hmm);
+   *     while (std::size_t n = reader.read(chunk.data(), chunk.size()))
+   *       scorer.push(chunk.begin(), chunk.begin() + n);
+   *     std::cout << scorer.log_likelihood() << '\n';
+   */
+  template <class T>
+    class forward_scorer {
+      public:
+        using model      = hidden_markov_model<T>;
+        using row_vector = typename model::row_vector;
+        using accumulator = accumulator_t<T>;
+
+        explicit forward_scorer(model const& hmm)
+        : hmm_{&hmm}, alpha_(hmm.states()), prev_alpha_(hmm.states()) {}
+
+        template <class Symbol>
+          void push(Symbol s)
+          {
+            T scaling = length_ == 0
+                ? detail::forward_initial(*hmm_, s, alpha_)
+                : detail::forward_recursion(*hmm_, prev_alpha_, s, alpha_);
+            prev_alpha_.swap(alpha_);
+            ++length_;
+            if (scaling)
+              log_likelihood_ -= std::log(static_cast<accumulator>(scaling));
+            else
+              log_likelihood_ = -std::numeric_limits<accumulator>::infinity();
+          }
+
+        template <class InputIter>
+          void push(InputIter first, InputIter last)
+          {
+            for (; first != last; ++first)
+              push(*first);
+          }
+
+        /// Logarithm of the probability of all symbols pushed so far.
+        accumulator log_likelihood() const noexcept { return log_likelihood_; }
+
+        std::uint64_t length() const noexcept { return length_; }
+
+        /// Scaled forward coefficients of the last symbol.
+        row_vector const& alpha() const noexcept { return prev_alpha_; }
+
+        void reset() noexcept
+        {
+          length_ = 0;
+          log_likelihood_ = 0;
+        }
+
+      private:
+        model const* hmm_; // not owning
+        row_vector alpha_;
+        row_vector prev_alpha_;
+        std::uint64_t length_ = 0;
+        accumulator log_likelihood_ = 0;
+    };
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_ALGORITHM_FORWARD_SCORER_H_ */
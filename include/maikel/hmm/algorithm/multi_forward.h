@@ -0,0 +1,272 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_ALGORITHM_MULTI_FORWARD_H_
+#define HMM_ALGORITHM_MULTI_FORWARD_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <gsl_assert.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/model_bank.h"
+
+namespace maikel { namespace hmm {
+
+  /**
+   * Runs the forward algorithm of many models in lockstep over one sequence.
+   * Models with the same number of states and symbols form a group whose
+   * parameters are interleaved, so that lane k of every column belongs to
+   * the k-th model of the group:
+   *
+   *     alpha(k, i)        forward coefficient of state i
+   *     A(k, i*N + j)      transition probability from i to j
+   *     B(k, o*N + j)      probability of symbol o in state j
+   *
+   * One step of the recursion is then N*N multiply-adds over contiguous
+   * columns of K lanes, which Eigen vectorizes, and the sequence is read
+   * once for all models.
+   *
+   * Example:
+   *
+   *     maikel::hmm::multi_forward_scorer<double> scorer(bank);
+   *     scorer.push(begin(sequence), end(sequence));
+   *     std::cout << bank.name(scorer.best()) << '\n';
+   */
+  template <class T>
+    class multi_forward_scorer {
+      public:
+        using model     = hidden_markov_model<T>;
+        using size_type = std::size_t;
+
+        explicit multi_forward_scorer(std::vector<model const*> const& models)
+        {
+          for (model const* hmm : models) {
+            Expects(hmm);
+            add_model(hmm->transition_matrix(), hmm->symbol_probabilities(), hmm->initial_distribution());
+          }
+          finish();
+        }
+
+        /// Scores against all models of the bank without materializing them.
+        explicit multi_forward_scorer(model_bank<T> const& bank)
+        {
+          for (size_type i = 0; i < bank.size(); ++i) {
+            auto p = bank.parameters(i);
+            add_model(p.A, p.B, p.pi);
+          }
+          finish();
+        }
+
+        multi_forward_scorer(model_bank<T> const& bank, std::vector<size_type> const& indices)
+        {
+          for (size_type i : indices) {
+            auto p = bank.parameters(i);
+            add_model(p.A, p.B, p.pi);
+          }
+          finish();
+        }
+
+        size_type size() const noexcept { return lane_of_.size(); }
+        std::uint64_t length() const noexcept { return length_; }
+
+        /// Smallest number of symbols over all models.
+        size_type symbols() const noexcept { return symbols_; }
+
+        template <class Symbol>
+          void push(Symbol s)
+          {
+            size_type o = gsl::narrow<size_type>(s);
+            Expects(o < symbols_);
+            for (group& g : groups_)
+              advance(g, o);
+            ++length_;
+          }
+
+        template <class InputIter>
+          void push(InputIter first, InputIter last)
+          {
+            for (; first != last; ++first)
+              push(*first);
+          }
+
+        /// Log-likelihood of the sequence so far under the i-th model.
+        T log_likelihood(size_type i) const
+        {
+          Expects(i < size());
+          group const& g = groups_[lane_of_[i].first];
+          size_type k = lane_of_[i].second;
+          return g.log(k) + std::log(g.product(k));
+        }
+
+        std::vector<T> log_likelihoods() const
+        {
+          std::vector<T> result(size());
+          for (size_type i = 0; i < size(); ++i)
+            result[i] = log_likelihood(i);
+          return result;
+        }
+
+        /// Index of the model with the highest log-likelihood.
+        size_type best() const
+        {
+          Expects(size() > 0);
+          std::vector<T> all = log_likelihoods();
+          return static_cast<size_type>(std::max_element(all.begin(), all.end()) - all.begin());
+        }
+
+        void reset() noexcept
+        {
+          length_ = 0;
+          for (group& g : groups_) {
+            g.log.setZero();
+            g.product.setOnes();
+          }
+        }
+
+      private:
+        using array        = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>;
+        using column_array = Eigen::Array<T, Eigen::Dynamic, 1>;
+
+        struct group {
+            size_type states;
+            size_type symbols;
+            std::vector<size_type> models; // original model indices
+            array A, B, pi, alpha, next;
+            column_array log, product, scaling;
+        };
+
+        std::vector<group> groups_;
+        std::vector<std::pair<size_type, size_type>> lane_of_; // model -> (group, lane)
+        std::map<std::pair<size_type, size_type>, size_type> group_of_shape_;
+        std::vector<typename model::matrix> pending_A_, pending_B_;
+        std::vector<typename model::row_vector> pending_pi_;
+        size_type symbols_ = std::numeric_limits<size_type>::max();
+        std::uint64_t length_ = 0;
+
+        template <class MatrixA, class MatrixB, class VectorPi>
+          void add_model(MatrixA const& A, MatrixB const& B, VectorPi const& pi)
+          {
+            std::pair<size_type, size_type> shape(B.rows(), B.cols());
+            auto found = group_of_shape_.find(shape);
+            if (found == group_of_shape_.end()) {
+              found = group_of_shape_.emplace(shape, groups_.size()).first;
+              groups_.emplace_back();
+              groups_.back().states = shape.first;
+              groups_.back().symbols = shape.second;
+            }
+            group& g = groups_[found->second];
+            lane_of_.emplace_back(found->second, g.models.size());
+            g.models.push_back(lane_of_.size() - 1);
+            pending_A_.push_back(A);
+            pending_B_.push_back(B);
+            pending_pi_.push_back(pi);
+            symbols_ = std::min(symbols_, shape.second);
+          }
+
+        // interleaves the parameters of every group once all models are known
+        void finish()
+        {
+          for (group& g : groups_) {
+            size_type K = g.models.size(), N = g.states, M = g.symbols;
+            g.A.resize(K, N*N);
+            g.B.resize(K, M*N);
+            g.pi.resize(K, N);
+            for (size_type k = 0; k < K; ++k) {
+              size_type m = g.models[k];
+              for (size_type i = 0; i < N; ++i) {
+                g.pi(k, i) = pending_pi_[m](i);
+                for (size_type j = 0; j < N; ++j)
+                  g.A(k, i*N + j) = pending_A_[m](i, j);
+                for (size_type o = 0; o < M; ++o)
+                  g.B(k, o*N + i) = pending_B_[m](i, o);
+              }
+            }
+            g.alpha.resize(K, N);
+            g.next.resize(K, N);
+            g.log = column_array::Zero(K);
+            g.product = column_array::Ones(K);
+            g.scaling.resize(K);
+          }
+          pending_A_.clear();
+          pending_B_.clear();
+          pending_pi_.clear();
+          if (lane_of_.empty())
+            symbols_ = 0;
+        }
+
+        void advance(group& g, size_type o)
+        {
+          size_type N = g.states;
+          if (length_ == 0) {
+            g.next = g.pi * g.B.middleCols(o*N, N);
+          } else {
+            for (size_type j = 0; j < N; ++j) {
+              g.next.col(j) = g.alpha.col(0) * g.A.col(j);
+              for (size_type i = 1; i < N; ++i)
+                g.next.col(j) += g.alpha.col(i) * g.A.col(i*N + j);
+              g.next.col(j) *= g.B.col(o*N + j);
+            }
+          }
+          g.scaling = g.next.rowwise().sum();
+          fold_scaling(g);
+          g.next.colwise() *= g.scaling;
+          g.alpha.swap(g.next);
+        }
+
+        // Turns the sums of the lanes into the factors which scale them to
+        // one. The sums are multiplied up and only turned into a logarithm
+        // before the product would underflow, which keeps std::log out of
+        // the common path.
+        void fold_scaling(group& g)
+        {
+          static const T tiny = std::sqrt(std::numeric_limits<T>::min());
+          if ((g.scaling < tiny).any()) {
+            for (typename array::Index k = 0; k < g.scaling.size(); ++k) {
+              T& c = g.scaling(k);
+              if (c < tiny) {
+                g.log(k) += std::log(c);
+              } else {
+                g.product(k) *= c;
+              }
+              c = c > 0 ? 1/c : 0;
+            }
+          } else {
+            g.product *= g.scaling;
+            g.scaling = g.scaling.inverse();
+          }
+          if ((g.product < tiny).any()) {
+            for (typename array::Index k = 0; k < g.product.size(); ++k) {
+              if (g.product(k) < tiny) {
+                g.log(k) += std::log(g.product(k));
+                g.product(k) = 1;
+              }
+            }
+          }
+        }
+    };
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_ALGORITHM_MULTI_FORWARD_H_ */
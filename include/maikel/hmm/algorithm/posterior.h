@@ -0,0 +1,79 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_ALGORITHM_POSTERIOR_H_
+#define HMM_ALGORITHM_POSTERIOR_H_
+
+#include <vector>
+
+#include <gsl_assert.h>
+#include <gsl_util.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/algorithm/forward.h"
+
+namespace maikel { namespace hmm {
+
+  /**
+   * Posterior state probabilities P(q_t = i | O) for a sequence in memory.
+   * Row t of the result belongs to the t-th symbol. The scaled forward
+   * coefficients are kept for the whole sequence and combined with the
+   * scaled backward coefficients on the way back.
+   */
+  template <class RandomIter, class T>
+    typename hidden_markov_model<T>::matrix
+    posteriors(RandomIter first, RandomIter last, hidden_markov_model<T> const& hmm)
+    {
+      using size_type  = typename hidden_markov_model<T>::size_type;
+      using matrix     = typename hidden_markov_model<T>::matrix;
+      using row_vector = typename hidden_markov_model<T>::row_vector;
+      size_type length = gsl::narrow<size_type>(last - first);
+      size_type N = hmm.states();
+      matrix gamma(length, N);
+      if (length == 0)
+        return gamma;
+
+      std::vector<T> scaling(length);
+      row_vector alpha(N), prev_alpha(N);
+      scaling[0] = detail::forward_initial(hmm, first[0], alpha);
+      gamma.row(0) = alpha;
+      for (size_type t = 1; t < length; ++t) {
+        prev_alpha.swap(alpha);
+        scaling[t] = detail::forward_recursion(hmm, prev_alpha, first[t], alpha);
+        gamma.row(t) = alpha;
+      }
+
+      matrix const& A = hmm.transition_matrix();
+      matrix const& B = hmm.symbol_probabilities();
+      row_vector beta = row_vector::Constant(N, scaling[length-1]), next_beta(N);
+      for (size_type t = length - 1; ; --t) {
+        gamma.row(t) = gamma.row(t).cwiseProduct(beta);
+        T sum = gamma.row(t).sum();
+        if (sum > 0)
+          gamma.row(t) /= sum;
+        if (t == 0)
+          break;
+        size_type ob = gsl::narrow<size_type>(first[t]);
+        next_beta.swap(beta);
+        beta = (A * B.col(ob).cwiseProduct(next_beta.transpose())).transpose() * scaling[t-1];
+      }
+      return gamma;
+    }
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_ALGORITHM_POSTERIOR_H_ */
@@ -0,0 +1,239 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_ALGORITHM_SLIDING_WINDOW_H_
+#define HMM_ALGORITHM_SLIDING_WINDOW_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <vector>
+
+#include <gsl_assert.h>
+#include <gsl_util.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+
+namespace maikel { namespace hmm {
+
+  /**
+   * Log-likelihood of the last `window` symbols of a stream, as if the
+   * model started with its initial distribution at the first symbol of the
+   * window. With the transfer matrices M_o = A diag(B(., o)) this is
+   *
+   *     P(o_1 ... o_W) = (pi .* B(., o_1)) M_{o_2} ... M_{o_W} 1
+   *
+   * The product of the W-1 transfer matrices is kept in a queue made of two
+   * stacks. Pushing multiplies onto the aggregate of the back stack, and
+   * when the front stack runs empty the back stack is moved over while the
+   * suffix products are formed. Every symbol therefore costs two N x N
+   * matrix products amortized, independent of W. All aggregates are scaled
+   * to a maximum of one and carry the logarithm of their scale.
+   *
+   * Example:
+   *
+   *     sliding_window_scorer<double> scorer(hmm, 1000);
+   *     for (int s : stream)
+   *       std::cout << scorer.push(s) << '\n';
+   */
+  template <class T>
+    class sliding_window_scorer {
+      public:
+        using model      = hidden_markov_model<T>;
+        using matrix     = typename model::matrix;
+        using row_vector = typename model::row_vector;
+        using size_type  = typename model::size_type;
+
+        sliding_window_scorer(model const& hmm, std::size_t window)
+        : hmm_{&hmm}, window_size_{window}
+        {
+          Expects(window > 0);
+          matrix const& A = hmm.transition_matrix();
+          matrix const& B = hmm.symbol_probabilities();
+          for (size_type o = 0; o < hmm.symbols(); ++o)
+            transfer_.push_back(A * B.col(o).asDiagonal());
+        }
+
+        /// Adds a symbol and returns the log-likelihood of the window which ends with it.
+        template <class Symbol>
+          T push(Symbol s)
+          {
+            size_type o = gsl::narrow<size_type>(s);
+            Expects(0 <= o && o < hmm_->symbols());
+            if (window_.size() == window_size_) {
+              window_.pop_front();
+              if (!window_.empty())
+                pop_transfer();
+            }
+            window_.push_back(o);
+            if (window_.size() > 1)
+              push_transfer(o);
+            ++position_;
+            log_likelihood_ = evaluate();
+            return log_likelihood_;
+          }
+
+        /// Log-likelihood of the current window, 0 before the first symbol.
+        T log_likelihood() const noexcept { return log_likelihood_; }
+
+        /// Number of symbols in the current window.
+        std::size_t size() const noexcept { return window_.size(); }
+        std::size_t window() const noexcept { return window_size_; }
+        bool full() const noexcept { return window_.size() == window_size_; }
+
+        /// Number of symbols pushed since the start or the last reset.
+        std::uint64_t position() const noexcept { return position_; }
+
+        void reset() noexcept
+        {
+          window_.clear();
+          front_.clear();
+          back_count_ = 0;
+          position_ = 0;
+          log_likelihood_ = 0;
+        }
+
+      private:
+        struct scaled_matrix {
+            matrix value;
+            T log;
+        };
+
+        model const* hmm_; // not owning
+        std::size_t window_size_;
+        std::vector<matrix> transfer_;
+        std::deque<size_type> window_;
+        std::vector<scaled_matrix> front_; // back() is the product of the whole front stack
+        scaled_matrix back_;               // product of the last back_count_ transfer matrices
+        std::size_t back_count_ = 0;
+        std::uint64_t position_ = 0;
+        T log_likelihood_ = 0;
+
+        static void rescale(scaled_matrix& m)
+        {
+          T scale = m.value.maxCoeff();
+          if (scale > 0) {
+            m.value /= scale;
+            m.log += std::log(scale);
+          } else {
+            m.log = -std::numeric_limits<T>::infinity();
+          }
+        }
+
+        void push_transfer(size_type o)
+        {
+          if (back_count_ == 0)
+            back_ = scaled_matrix{transfer_[o], 0};
+          else
+            back_.value = back_.value * transfer_[o];
+          rescale(back_);
+          ++back_count_;
+        }
+
+        // removes the oldest transfer matrix, which belongs to window_.front()
+        void pop_transfer()
+        {
+          if (front_.empty()) {
+            Expects(back_count_ > 0 && back_count_ <= window_.size());
+            for (std::size_t i = 0; i < back_count_; ++i) {
+              size_type o = window_[window_.size() - 1 - i];
+              if (front_.empty()) {
+                front_.push_back(scaled_matrix{transfer_[o], 0});
+              } else {
+                scaled_matrix const& behind = front_.back();
+                front_.push_back(scaled_matrix{transfer_[o] * behind.value, behind.log});
+              }
+              rescale(front_.back());
+            }
+            back_count_ = 0;
+          }
+          front_.pop_back();
+        }
+
+        // (pi .* B(., o_1)) F G 1 with the front product F and the back product G
+        T evaluate() const
+        {
+          using column_vector = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+          column_vector r = column_vector::Ones(hmm_->states());
+          T log = 0;
+          if (back_count_ > 0) {
+            r = back_.value * r;
+            log += back_.log;
+          }
+          if (!front_.empty()) {
+            r = front_.back().value * r;
+            log += front_.back().log;
+          }
+          T p = hmm_->initial_distribution().cwiseProduct(
+              hmm_->symbol_probabilities().col(window_.front()).transpose()).dot(r.transpose());
+          return p > 0 ? log + std::log(p) : -std::numeric_limits<T>::infinity();
+        }
+    };
+
+  enum class window_alarm { none, threshold, cusum };
+
+  template <class T>
+    struct window_alarm_options {
+        T threshold = -std::numeric_limits<T>::infinity();    // lowest mean log-likelihood per symbol
+        T cusum_target = 0;                                    // expected mean per symbol minus the slack
+        T cusum_limit = std::numeric_limits<T>::infinity();   // largest accumulated shortfall
+    };
+
+  /**
+   * Watches the mean log-likelihood per symbol of consecutive windows. It
+   * raises a threshold alarm when a window falls below `threshold` and a
+   * CUSUM alarm when the one sided cumulative sum
+   *
+   *     S_t = max(0, S_{t-1} + cusum_target - x_t)
+   *
+   * exceeds `cusum_limit`, which catches a drift that stays above the
+   * threshold. The sum starts again at zero after a CUSUM alarm.
+   */
+  template <class T>
+    class window_alarm_monitor {
+      public:
+        explicit window_alarm_monitor(window_alarm_options<T> options = {})
+        : options_(options) {}
+
+        window_alarm update(T log_likelihood, std::size_t symbols)
+        {
+          Expects(symbols > 0);
+          T mean = log_likelihood / static_cast<T>(symbols);
+          cusum_ = std::max(T{0}, cusum_ + options_.cusum_target - mean);
+          if (mean < options_.threshold)
+            return window_alarm::threshold;
+          if (cusum_ > options_.cusum_limit) {
+            cusum_ = 0;
+            return window_alarm::cusum;
+          }
+          return window_alarm::none;
+        }
+
+        T cusum() const noexcept { return cusum_; }
+        void reset() noexcept { cusum_ = 0; }
+
+      private:
+        window_alarm_options<T> options_;
+        T cusum_ = 0;
+    };
+
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_ALGORITHM_SLIDING_WINDOW_H_ */
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_ALGORITHM_VITERBI_H_
+#define HMM_ALGORITHM_VITERBI_H_
+
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include <gsl_assert.h>
+#include <gsl_util.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/isa_kernels.h"
+
+namespace maikel { namespace hmm {
+
+  template <class T>
+    struct viterbi_result {
+        std::vector<std::uint32_t> states; // most probable state per symbol
+        T log_probability = 0;              // of the sequence along that path
+    };
+
+  /**
+   * Most probable state sequence for the symbols [first, last). The
+   * recursion runs on logarithms, so long sequences do not underflow. The
+   * back pointers need one 32 bit index per symbol and state.
+   */
+  template <class InputIter, class T>
+    viterbi_result<T>
+    viterbi(InputIter first, InputIter last, hidden_markov_model<T> const& hmm)
+    {
+      using size_type  = typename hidden_markov_model<T>::size_type;
+      using matrix     = typename hidden_markov_model<T>::matrix;
+      using row_vector = typename hidden_markov_model<T>::row_vector;
+      size_type N = hmm.states();
+      matrix logA = hmm.transition_matrix().array().log().matrix();
+      matrix logB = hmm.symbol_probabilities().array().log().matrix();
+      row_vector delta = hmm.initial_distribution().array().log().matrix();
+      row_vector next(N);
+
+      viterbi_result<T> result;
+      if (first == last)
+        return result;
+      std::vector<std::uint32_t> back;
+      size_type ob = gsl::narrow<size_type>(*first);
+      Expects(0 <= ob && ob < hmm.symbols());
+      delta += logB.col(ob).transpose();
+      kernel_table<T> const* kernels = dispatched_kernels<T>();
+      // the kernel runs over contiguous columns of the transposed matrix
+      matrix logAt;
+      if (kernels)
+        logAt = logA.transpose();
+      std::size_t length = 1;
+      for (++first; first != last; ++first, ++length) {
+        ob = gsl::narrow<size_type>(*first);
+        Expects(0 <= ob && ob < hmm.symbols());
+        if (kernels) {
+          std::size_t offset = back.size();
+          back.resize(offset + static_cast<std::size_t>(N));
+          kernels->max_plus(logAt.data(), delta.data(), next.data(), back.data() + offset, N);
+          next += logB.col(ob).transpose();
+        } else {
+          for (size_type j = 0; j < N; ++j) {
+            size_type arg = 0;
+            T best = delta(0) + logA(0, j);
+            for (size_type i = 1; i < N; ++i) {
+              T candidate = delta(i) + logA(i, j);
+              if (candidate > best) {
+                best = candidate;
+                arg = i;
+              }
+            }
+            next(j) = best + logB(j, ob);
+            back.push_back(static_cast<std::uint32_t>(arg));
+          }
+        }
+        delta.swap(next);
+      }
+
+      size_type state;
+      result.log_probability = delta.maxCoeff(&state);
+      result.states.resize(length);
+      result.states[length-1] = static_cast<std::uint32_t>(state);
+      for (std::size_t t = length - 1; t > 0; --t)
+        result.states[t-1] = back[(t-1)*N + result.states[t]];
+      return result;
+    }
+
+  /**
+   * Most probable state sequences of many sequences under one model. The
+   * deltas of all sequences are the rows of one column major matrix, so the
+   * maximum over the predecessors of a state runs down contiguous columns
+   * for all sequences at once, and the logarithms of the parameters are
+   * taken once per batch. Like batch_log_likelihoods() the sequences are
+   * advanced longest first. The paths are those of viterbi().
+   *
+   * Example:
+   *
+   *     std::vector<std::vector<int>> sequences = ...;
+   *     std::vector<viterbi_result<double>> paths = batch_viterbi(sequences, hmm);
+   */
+  template <class Sequence, class T>
+    std::vector<viterbi_result<T>>
+    batch_viterbi(std::vector<Sequence> const& sequences, hidden_markov_model<T> const& hmm)
+    {
+      using size_type  = typename hidden_markov_model<T>::size_type;
+      using matrix     = typename hidden_markov_model<T>::matrix;
+      using row_vector = typename hidden_markov_model<T>::row_vector;
+      using lanes      = Eigen::Array<T, Eigen::Dynamic, 1>;
+      using arguments  = Eigen::Array<std::uint32_t, Eigen::Dynamic, 1>;
+
+      std::vector<viterbi_result<T>> result(sequences.size());
+      std::vector<std::size_t> order(sequences.size());
+      std::iota(order.begin(), order.end(), std::size_t{0});
+      std::stable_sort(order.begin(), order.end(), [&sequences] (std::size_t i, std::size_t j) {
+        return sequences[i].size() > sequences[j].size();
+      });
+      while (!order.empty() && sequences[order.back()].size() == 0)
+        order.pop_back();
+      if (order.empty())
+        return result;
+
+      size_type N = hmm.states();
+      size_type K = gsl::narrow<size_type>(order.size());
+      matrix logA = hmm.transition_matrix().array().log().matrix();
+      matrix logB = hmm.symbol_probabilities().array().log().matrix();
+      row_vector logpi = hmm.initial_distribution().array().log().matrix();
+      matrix delta(K, N), next(K, N);
+      lanes best(K), candidate(K);
+      arguments arg(K);
+      std::vector<std::vector<std::uint32_t>> back(order.size());
+
+      auto symbol = [&] (size_type k, std::size_t t) {
+        size_type o = gsl::narrow<size_type>(sequences[order[k]][t]);
+        Expects(0 <= o && o < hmm.symbols());
+        return o;
+      };
+
+      for (size_type k = 0; k < K; ++k)
+        delta.row(k) = logpi + logB.col(symbol(k, 0)).transpose();
+
+      size_type active = K;
+      for (std::size_t t = 1; ; ++t) {
+        while (active > 0 && sequences[order[active-1]].size() <= t)
+          --active;
+        if (active == 0)
+          break;
+        for (size_type j = 0; j < N; ++j) {
+          best.head(active) = delta.col(0).head(active).array() + logA(0, j);
+          arg.head(active).setZero();
+          for (size_type i = 1; i < N; ++i) {
+            candidate.head(active) = delta.col(i).head(active).array() + logA(i, j);
+            arg.head(active) = (candidate.head(active) > best.head(active))
+                .select(static_cast<std::uint32_t>(i), arg.head(active));
+            best.head(active) = (candidate.head(active) > best.head(active))
+                .select(candidate.head(active), best.head(active));
+          }
+          for (size_type k = 0; k < active; ++k) {
+            next(k, j) = best(k) + logB(j, symbol(k, t));
+            back[k].push_back(arg(k));
+          }
+        }
+        delta.topRows(active).swap(next.topRows(active));
+      }
+
+      for (size_type k = 0; k < K; ++k) {
+        viterbi_result<T>& path = result[order[k]];
+        std::size_t length = sequences[order[k]].size();
+        size_type state;
+        path.log_probability = delta.row(k).maxCoeff(&state);
+        path.states.resize(length);
+        path.states[length-1] = static_cast<std::uint32_t>(state);
+        for (std::size_t t = length - 1; t > 0; --t)
+          path.states[t-1] = back[k][(t-1)*N + path.states[t]];
+      }
+      return result;
+    }
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_ALGORITHM_VITERBI_H_ */
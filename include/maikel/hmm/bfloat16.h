@@ -0,0 +1,105 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_BFLOAT16_H_
+#define HMM_BFLOAT16_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "maikel/hmm/isa_kernels.h"
+
+/*
+ * bfloat16 is the upper half of an IEEE float: the same sign and 8 bit
+ * exponent, but 7 instead of 23 stored mantissa bits. It keeps the range
+ * of float, which matters for coefficients because small forward and
+ * backward coefficients are not rounded to zero, and it converts with
+ * shifts, which vectorize on every instruction set.
+ *
+ * Rounding is stochastic: the 16 dropped bits are added to a dither from
+ * a hash of a key before they are cut off, so a value rounds up with the
+ * probability of its distance to the lower neighbour. A value is off by
+ * less than 2^-7 of itself, twice the error of rounding to nearest, but
+ * the errors do not depend on the value. Coefficients repeat, a state
+ * which emits a symbol with high probability has about the same forward
+ * coefficient every time the symbol is seen, and rounded to nearest their
+ * errors would add up instead of cancelling in the expected counts. The
+ * same keys give the same bits.
+ *
+ * The conversions of arrays use the dispatched kernels (isa_kernels.h)
+ * if there are any.
+ */
+
+namespace maikel { namespace hmm {
+
+  /// 16 bits of dither for key, a 32 bit integer hash.
+  inline std::uint32_t bfloat16_dither(std::uint32_t key) noexcept
+  {
+    std::uint32_t h = key*0x9e3779b1u;
+    h ^= h >> 15;
+    h *= 0x85ebca77u;
+    h ^= h >> 13;
+    return h >> 16;
+  }
+
+  /// x rounded stochastically to bfloat16 with the dither of key. A NaN stays a NaN.
+  inline std::uint16_t to_bfloat16(float x, std::uint32_t key) noexcept
+  {
+    std::uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u)
+      return static_cast<std::uint16_t>((bits >> 16) | 0x40u);
+    return static_cast<std::uint16_t>((bits + bfloat16_dither(key)) >> 16);
+  }
+
+  /// The float of a bfloat16, which is exact.
+  inline float from_bfloat16(std::uint16_t x) noexcept
+  {
+    std::uint32_t bits = static_cast<std::uint32_t>(x) << 16;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  /// Rounds the n values at x to bfloat16 into out, x[i] with the dither of key + i.
+  template <class T>
+    void encode_bfloat16(T const* x, std::uint16_t* out, std::ptrdiff_t n, std::uint32_t key)
+    {
+      if (kernel_table<T> const* kernels = dispatched_kernels<T>()) {
+        kernels->to_bfloat16(x, out, n, key);
+        return;
+      }
+      for (std::ptrdiff_t i = 0; i < n; ++i)
+        out[i] = to_bfloat16(static_cast<float>(x[i]), key + static_cast<std::uint32_t>(i));
+    }
+
+  /// Widens the n bfloat16 values at in into x.
+  template <class T>
+    void decode_bfloat16(std::uint16_t const* in, T* x, std::ptrdiff_t n)
+    {
+      if (kernel_table<T> const* kernels = dispatched_kernels<T>()) {
+        kernels->from_bfloat16(in, x, n);
+        return;
+      }
+      for (std::ptrdiff_t i = 0; i < n; ++i)
+        x[i] = static_cast<T>(from_bfloat16(in[i]));
+    }
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_BFLOAT16_H_ */
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Binary file format for packed sequences. A file starts with a header
+ *
+ *     char[8]  magic "MKLPSEQ"
+ *     uint32   bits per symbol
+ *     uint32   number of symbols in the alphabet
+ *     uint64   length of the sequence
+ *
+ * followed by ceil(length*bits/64) 64-bit words in host byte order, which
+ * are the words of a packed_sequence<std::uint64_t>.
+ */
+
+#ifndef HMM_BINARY_SEQUENCE_H_
+#define HMM_BINARY_SEQUENCE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include <gsl_assert.h>
+
+#include "maikel/hmm/packed_sequence.h"
+
+namespace maikel { namespace hmm {
+
+  struct binary_sequence_error: public std::runtime_error {
+      binary_sequence_error(std::string s): std::runtime_error(s) {}
+  };
+
+  struct packed_sequence_header {
+      char magic[8];
+      std::uint32_t bits;
+      std::uint32_t symbols;
+      std::uint64_t length;
+  };
+
+  static_assert(sizeof(packed_sequence_header) == 24, "Unexpected padding in the file header.");
+
+  constexpr char packed_sequence_magic[8] = { 'M', 'K', 'L', 'P', 'S', 'E', 'Q', '\0' };
+
+  inline packed_sequence_header make_packed_sequence_header(std::size_t symbols, std::uint64_t length)
+  {
+    packed_sequence_header header;
+    std::memcpy(header.magic, packed_sequence_magic, sizeof(header.magic));
+    header.bits = bits_per_symbol(symbols);
+    header.symbols = static_cast<std::uint32_t>(symbols);
+    header.length = length;
+    return header;
+  }
+
+  inline std::size_t packed_words(packed_sequence_header const& header) noexcept
+  {
+    const std::uint64_t per_word = 64 / header.bits;
+    return static_cast<std::size_t>((header.length + per_word - 1) / per_word);
+  }
+
+  /**
+   * Reads and validates the header at the current position of `in`.
+   */
+  inline packed_sequence_header read_packed_sequence_header(std::istream& in)
+  {
+    packed_sequence_header header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+      throw binary_sequence_error("Could not read the header of a packed sequence.");
+    if (std::memcmp(header.magic, packed_sequence_magic, sizeof(header.magic)))
+      throw binary_sequence_error("Input is not a packed sequence.");
+    if (header.bits != bits_per_symbol(header.symbols))
+      throw binary_sequence_error("Bits per symbol do not match the alphabet size.");
+    return header;
+  }
+
+  /**
+   * Returns true if the next bytes of `in` are the magic of a packed
+   * sequence. Nothing is extracted from the stream.
+   */
+  inline bool is_packed_sequence(std::istream& in)
+  {
+    char magic[sizeof(packed_sequence_magic)] = {};
+    std::size_t n = 0;
+    std::streambuf* buffer = in.rdbuf();
+    for (; n < sizeof(magic); ++n) {
+      int c = buffer->sgetc();
+      if (c == std::char_traits<char>::eof() || c != packed_sequence_magic[n])
+        break;
+      magic[n] = static_cast<char>(buffer->sbumpc());
+    }
+    for (std::size_t k = n; k > 0; --k)
+      buffer->sungetc();
+    return n == sizeof(magic);
+  }
+
+  inline packed_sequence<> read_binary_sequence(std::istream& in)
+  {
+    packed_sequence_header header = read_packed_sequence_header(in);
+    packed_sequence<> sequence(header.symbols);
+    std::vector<std::uint64_t> words(packed_words(header));
+    std::streamsize bytes = words.size()*sizeof(std::uint64_t);
+    if (!in.read(reinterpret_cast<char*>(words.data()), bytes))
+      throw binary_sequence_error("Packed sequence is shorter than its header claims.");
+    sequence.append_words(words.data(), header.length);
+    return sequence;
+  }
+
+  /**
+   * Packs symbols into a large word buffer and hands full buffers to the
+   * stream with a single write(). The length of the sequence has to be known
+   * in advance so that the output can be a pipe.
+   */
+  class binary_sequence_writer {
+    public:
+      static const std::size_t default_buffer_words = std::size_t{1} << 19;
+
+      binary_sequence_writer(std::ostream& out, std::size_t symbols, std::uint64_t length,
+          std::size_t buffer_words = default_buffer_words)
+      : out_(out), header_{make_packed_sequence_header(symbols, length)},
+        per_word_{64 / header_.bits}
+      {
+        Expects(buffer_words > 0);
+        buffer_.reserve(buffer_words);
+        if (!out_.write(reinterpret_cast<char const*>(&header_), sizeof(header_)))
+          throw binary_sequence_error("Could not write the header of a packed sequence.");
+      }
+
+      ~binary_sequence_writer() noexcept
+      {
+        try {
+          close();
+        } catch (...) {
+        }
+      }
+
+      void push_back(std::uint32_t symbol)
+      {
+        Expects(symbol < header_.symbols && written_ < header_.length);
+        current_ |= std::uint64_t{symbol} << (offset_*header_.bits);
+        ++written_;
+        if (++offset_ == per_word_)
+          store_word();
+      }
+
+      template <class InputIter>
+        void write(InputIter first, InputIter last)
+        {
+          for (; first != last; ++first)
+            push_back(static_cast<std::uint32_t>(*first));
+        }
+
+      std::uint64_t written() const noexcept { return written_; }
+
+      /**
+       * Writes the remaining buffer. Throws if fewer symbols than announced
+       * in the header have been written.
+       */
+      void close()
+      {
+        if (closed_)
+          return;
+        closed_ = true;
+        if (offset_)
+          store_word();
+        flush_buffer();
+        out_.flush();
+        if (written_ != header_.length)
+          throw binary_sequence_error("Packed sequence is shorter than announced in its header.");
+      }
+
+    private:
+      std::ostream& out_;
+      packed_sequence_header header_;
+      unsigned per_word_;
+      std::vector<std::uint64_t> buffer_;
+      std::uint64_t current_ = 0;
+      unsigned offset_ = 0;
+      std::uint64_t written_ = 0;
+      bool closed_ = false;
+
+      void store_word()
+      {
+        buffer_.push_back(current_);
+        current_ = 0;
+        offset_ = 0;
+        if (buffer_.size() == buffer_.capacity())
+          flush_buffer();
+      }
+
+      void flush_buffer()
+      {
+        if (buffer_.empty())
+          return;
+        std::streamsize bytes = buffer_.size()*sizeof(std::uint64_t);
+        if (!out_.write(reinterpret_cast<char const*>(buffer_.data()), bytes))
+          throw binary_sequence_error("Could not write packed sequence.");
+        buffer_.clear();
+      }
+  };
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_BINARY_SEQUENCE_H_ */
@@ -0,0 +1,327 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Container file for many packed sequences over one alphabet. A file is
+ *
+ *     corpus_header                     40 bytes
+ *     alphabet                          symbol names separated by '\n',
+ *                                       padded with '\0' to 8 bytes
+ *     words                             the packed words of all sequences,
+ *                                       every sequence starts a new word
+ *     index                             one corpus_entry per sequence
+ *
+ * All integers are in host byte order. The words of a sequence are the words
+ * of a packed_sequence<std::uint64_t>, so they can be viewed in place.
+ */
+
+#ifndef HMM_CORPUS_H_
+#define HMM_CORPUS_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include <gsl_assert.h>
+
+#include "maikel/hmm/packed_sequence.h"
+#include "maikel/mapped_file.h"
+
+namespace maikel { namespace hmm {
+
+  struct corpus_error: public std::runtime_error {
+      corpus_error(std::string s): std::runtime_error(s) {}
+  };
+
+  struct corpus_header {
+      char magic[8];
+      std::uint32_t bits;
+      std::uint32_t symbols;
+      std::uint64_t sequences;
+      std::uint64_t alphabet_bytes;
+      std::uint64_t index_offset;
+  };
+
+  struct corpus_entry {
+      std::uint64_t word_offset; // in words from the start of the word section
+      std::uint64_t length;
+  };
+
+  static_assert(sizeof(corpus_header) == 40, "Unexpected padding in the corpus header.");
+  static_assert(sizeof(corpus_entry) == 16, "Unexpected padding in the corpus index.");
+
+  constexpr char corpus_magic[8] = { 'M', 'K', 'L', 'C', 'O', 'R', 'P', '\0' };
+
+  /**
+   * Writes a corpus file. Sequences are appended to the word section as they
+   * are added and the index is written by close(), so only the index is kept
+   * in memory.
+   *
+   * Example:
+   *
+   *     maikel::hmm::corpus_writer writer("sessions.corpus", { "a", "b", "c" });
+   *     for (auto&& session : sessions)
+   *       writer.add(begin(session), end(session));
+   *     writer.close();
+   */
+  class corpus_writer {
+    public:
+      corpus_writer(std::string const& path, std::vector<std::string> alphabet)
+      : out_(path, std::ofstream::binary | std::ofstream::trunc),
+        alphabet_(std::move(alphabet))
+      {
+        if (!out_)
+          throw corpus_error("Could not open " + path + " for writing.");
+        std::memcpy(header_.magic, corpus_magic, sizeof(header_.magic));
+        header_.bits = bits_per_symbol(alphabet_.size());
+        header_.symbols = static_cast<std::uint32_t>(alphabet_.size());
+        header_.sequences = 0;
+        header_.index_offset = 0;
+        std::string names;
+        for (std::string const& name : alphabet_) {
+          if (name.find('\n') != std::string::npos)
+            throw corpus_error("Symbol names must not contain line breaks.");
+          names += name;
+          names += '\n';
+        }
+        names.resize((names.size() + 7) / 8 * 8, '\0');
+        header_.alphabet_bytes = names.size();
+        write(&header_, sizeof(header_));
+        write(names.data(), names.size());
+      }
+
+      corpus_writer(corpus_writer const&) = delete;
+      corpus_writer& operator=(corpus_writer const&) = delete;
+
+      ~corpus_writer() noexcept
+      {
+        try {
+          close();
+        } catch (...) {
+        }
+      }
+
+      std::vector<std::string> const& alphabet() const noexcept { return alphabet_; }
+
+      /// Number of sequences added so far.
+      std::size_t size() const noexcept { return index_.size(); }
+
+      /**
+       * Appends a sequence of symbol indices and returns its index in the
+       * corpus.
+       */
+      template <class InputIter>
+        std::size_t add(InputIter first, InputIter last)
+        {
+          packed_sequence<std::uint64_t> packed(alphabet_.size());
+          for (; first != last; ++first) {
+            Expects(static_cast<std::size_t>(*first) < alphabet_.size());
+            packed.push_back(static_cast<packed_symbol>(*first));
+          }
+          return add(packed);
+        }
+
+      std::size_t add(packed_sequence<std::uint64_t> const& sequence)
+      {
+        Expects(!closed_);
+        if (sequence.bits() != header_.bits)
+          throw corpus_error("Sequence and corpus use different bits per symbol.");
+        index_.push_back({ words_, sequence.size() });
+        write(sequence.words(), sequence.word_count()*sizeof(std::uint64_t));
+        words_ += sequence.word_count();
+        return index_.size() - 1;
+      }
+
+      /// Writes the index and the final header. Called by the destructor.
+      void close()
+      {
+        if (closed_)
+          return;
+        closed_ = true;
+        header_.sequences = index_.size();
+        header_.index_offset = sizeof(header_) + header_.alphabet_bytes + words_*sizeof(std::uint64_t);
+        write(index_.data(), index_.size()*sizeof(corpus_entry));
+        out_.seekp(0);
+        write(&header_, sizeof(header_));
+        out_.close();
+        if (!out_)
+          throw corpus_error("Could not finish the corpus file.");
+      }
+
+    private:
+      std::ofstream out_;
+      std::vector<std::string> alphabet_;
+      corpus_header header_;
+      std::vector<corpus_entry> index_;
+      std::uint64_t words_ = 0;
+      bool closed_ = false;
+
+      void write(void const* data, std::size_t bytes)
+      {
+        if (!out_.write(static_cast<char const*>(data), static_cast<std::streamsize>(bytes)))
+          throw corpus_error("Could not write the corpus file.");
+      }
+  };
+
+  /**
+   * Read only, memory mapped corpus file. Every sequence is a
+   * packed_sequence_view onto the mapping, so opening a corpus costs one
+   * mmap and looking up a sequence costs one index access.
+   */
+  class corpus {
+    public:
+      using sequence_view = packed_sequence_view<std::uint64_t>;
+      using size_type     = std::size_t;
+
+      explicit corpus(std::string const& path)
+      : file_(path, mapped_file::access_pattern::random)
+      {
+        if (file_.size() < sizeof(corpus_header))
+          throw corpus_error(path + " is too short for a corpus.");
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, corpus_magic, sizeof(header_.magic)))
+          throw corpus_error(path + " is not a corpus.");
+        if (header_.bits != bits_per_symbol(header_.symbols))
+          throw corpus_error("Bits per symbol do not match the alphabet size.");
+        std::uint64_t words_offset = sizeof(header_) + header_.alphabet_bytes;
+        if (header_.alphabet_bytes % 8 || header_.index_offset < words_offset ||
+            (header_.index_offset - words_offset) % sizeof(std::uint64_t) ||
+            header_.index_offset + header_.sequences*sizeof(corpus_entry) > file_.size())
+          throw corpus_error(path + " is truncated or has a broken header.");
+        words_ = reinterpret_cast<std::uint64_t const*>(file_.data() + words_offset);
+        word_count_ = (header_.index_offset - words_offset) / sizeof(std::uint64_t);
+        index_ = reinterpret_cast<corpus_entry const*>(file_.data() + header_.index_offset);
+        read_alphabet(file_.data() + sizeof(header_));
+        for (size_type i = 0; i < size(); ++i) {
+          std::uint64_t per_word = 64 / header_.bits;
+          if (index_[i].word_offset + (index_[i].length + per_word - 1) / per_word > word_count_)
+            throw corpus_error("Sequence " + std::to_string(i) + " lies outside of " + path + ".");
+          total_length_ += index_[i].length;
+        }
+      }
+
+      size_type size() const noexcept { return static_cast<size_type>(header_.sequences); }
+      bool empty() const noexcept { return size() == 0; }
+      size_type symbols() const noexcept { return header_.symbols; }
+      unsigned bits() const noexcept { return header_.bits; }
+      std::vector<std::string> const& alphabet() const noexcept { return alphabet_; }
+
+      /// Sum of the lengths of all sequences.
+      std::uint64_t total_length() const noexcept { return total_length_; }
+
+      size_type length(size_type i) const
+      {
+        Expects(i < size());
+        return static_cast<size_type>(index_[i].length);
+      }
+
+      sequence_view operator[](size_type i) const
+      {
+        Expects(i < size());
+        return { words_ + index_[i].word_offset, header_.bits, static_cast<size_type>(index_[i].length) };
+      }
+
+      /// Hints the kernel that sequence `i` is going to be read soon.
+      void prefetch(size_type i) const noexcept
+      {
+        if (i >= size() || !index_[i].length)
+          return;
+        std::uint64_t per_word = 64 / header_.bits;
+        std::size_t bytes = (index_[i].length + per_word - 1) / per_word * sizeof(std::uint64_t);
+        char const* first = reinterpret_cast<char const*>(words_ + index_[i].word_offset);
+        std::uintptr_t page = reinterpret_cast<std::uintptr_t>(first) & ~std::uintptr_t{4095};
+        ::madvise(reinterpret_cast<void*>(page), bytes + (reinterpret_cast<std::uintptr_t>(first) - page),
+            MADV_WILLNEED);
+      }
+
+    private:
+      mapped_file file_;
+      corpus_header header_;
+      std::uint64_t const* words_ = nullptr;
+      std::uint64_t word_count_ = 0;
+      corpus_entry const* index_ = nullptr;
+      std::vector<std::string> alphabet_;
+      std::uint64_t total_length_ = 0;
+
+      void read_alphabet(char const* names)
+      {
+        char const* last = names + header_.alphabet_bytes;
+        char const* first = names;
+        for (char const* it = names; it != last && *it; ++it) {
+          if (*it == '\n') {
+            alphabet_.emplace_back(first, it);
+            first = it + 1;
+          }
+        }
+        if (alphabet_.size() != header_.symbols)
+          throw corpus_error("The alphabet does not match the number of symbols.");
+      }
+  };
+
+  /**
+   * A unit of work: a set of sequence indices and the sum of their lengths.
+   */
+  struct corpus_shard {
+      std::vector<std::size_t> sequences;
+      std::uint64_t length = 0;
+  };
+
+  /**
+   * Splits the sequences of a corpus into `shards` sets of roughly equal total
+   * length. Sequences are handed out from the longest to the shortest, each
+   * to the shard with the least work so far, which is within 4/3 of the best
+   * possible maximum load. Within a shard the sequences are in file order.
+   */
+  inline std::vector<corpus_shard> partition_corpus(corpus const& sequences, std::size_t shards)
+  {
+    Expects(shards > 0);
+    std::vector<std::size_t> order(sequences.size());
+    std::iota(order.begin(), order.end(), std::size_t{0});
+    std::stable_sort(order.begin(), order.end(), [&sequences] (std::size_t i, std::size_t j) {
+      return sequences.length(i) > sequences.length(j);
+    });
+
+    using load = std::pair<std::uint64_t, std::size_t>;
+    std::priority_queue<load, std::vector<load>, std::greater<load>> least_loaded;
+    for (std::size_t k = 0; k < shards; ++k)
+      least_loaded.push({ 0, k });
+    std::vector<corpus_shard> result(shards);
+    for (std::size_t i : order) {
+      load next = least_loaded.top();
+      least_loaded.pop();
+      result[next.second].sequences.push_back(i);
+      result[next.second].length += sequences.length(i);
+      next.first += sequences.length(i);
+      least_loaded.push(next);
+    }
+    for (corpus_shard& shard : result)
+      std::sort(shard.sequences.begin(), shard.sequences.end());
+    return result;
+  }
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_CORPUS_H_ */
@@ -85,6 +85,28 @@ namespace maikel { namespace hmm {
           size_type num_symbols;
       };
 
+  /**
+   * Copy of `hmm` with parameters of type To, for example to run the mixed
+   * precision algorithms on a model in double (see precision.h). The rows
+   * are normalized again after the rounding.
+   */
+  template <class To, class From>
+    hidden_markov_model<To> precision_cast(hidden_markov_model<From> const& hmm)
+    {
+      using matrix = typename hidden_markov_model<To>::matrix;
+      using row_vector = typename hidden_markov_model<To>::row_vector;
+      using size_type = typename hidden_markov_model<To>::size_type;
+      matrix A = hmm.transition_matrix().template cast<To>();
+      matrix B = hmm.symbol_probabilities().template cast<To>();
+      row_vector pi = hmm.initial_distribution().template cast<To>();
+      for (size_type i = 0; i < A.rows(); ++i) {
+        A.row(i) /= A.row(i).sum();
+        B.row(i) /= B.row(i).sum();
+      }
+      pi /= pi.sum();
+      return hidden_markov_model<To>(A, B, pi);
+    }
+
 } // namespace hmm
 } // namespace maikel
 
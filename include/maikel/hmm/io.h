@@ -20,12 +20,15 @@
 
 #include <map>
 #include <istream>
+#include <limits>
+#include <sstream>
 #include <Eigen/Dense>
 #include <gsl_assert.h>
 #include <range/v3/all.hpp>
 #include <iostream>
 
 #include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/packed_sequence.h"
 #include "maikel/function_profiler.h"
 
 namespace maikel { namespace hmm {
@@ -120,6 +123,30 @@ namespace maikel { namespace hmm {
       return hidden_markov_model<float_type>(A, B, pi);
     }
 
+  /// Writes the rows of `matrix` as lines, the inverse of read_ascii_matrix().
+  template <class Derived>
+    void write_ascii_matrix(std::ostream& out, Eigen::DenseBase<Derived> const& matrix)
+    {
+      using Index = typename Eigen::DenseBase<Derived>::Index;
+      for (Index i = 0; i < matrix.rows(); ++i) {
+        for (Index j = 0; j < matrix.cols(); ++j)
+          out << (j ? " " : "") << matrix(i, j);
+        out << '\n';
+      }
+    }
+
+  /// Writes a model in the format of read_hidden_markov_model(), which reads back the same numbers.
+  template <class float_type>
+    void write_hidden_markov_model(std::ostream& out, hidden_markov_model<float_type> const& hmm)
+    {
+      std::streamsize precision = out.precision(std::numeric_limits<float_type>::max_digits10);
+      out << hmm.states() << ' ' << hmm.symbols() << '\n';
+      write_ascii_matrix(out, hmm.transition_matrix());
+      write_ascii_matrix(out, hmm.symbol_probabilities());
+      write_ascii_matrix(out, hmm.initial_distribution());
+      out.precision(precision);
+    }
+
   template <class float_type>
     typename std::enable_if<
         std::is_floating_point<float_type>::value,
@@ -195,6 +222,60 @@ namespace maikel { namespace hmm {
       ranges::copy(sequence_input | ranges::view::transform(symbol_map), ranges::back_inserter(sequence));
       return sequence;
     }
+
+  template <class Word = std::uint64_t>
+    packed_sequence<Word>
+    read_packed_sequence(std::istream& in)
+    {
+      MAIKEL_PROFILER;
+      std::map<std::string, packed_symbol> symbol_to_index = read_symbol_map<packed_symbol>(in);
+      packed_sequence<Word> sequence(symbol_to_index.size());
+      sequence.reserve(read_sequence_length<std::size_t>(in));
+      auto symbol_map = [&symbol_to_index] (std::string const& symbol) {
+          auto found = symbol_to_index.find(symbol);
+          if (found == symbol_to_index.end())
+            throw read_sequence_error("Unkown Symbols in Input.");
+          return found->second;
+      };
+      auto sequence_input = ranges::istream_range<std::string>(in);
+      ranges::copy(sequence_input | ranges::view::transform(symbol_map), ranges::back_inserter(sequence));
+      return sequence;
+    }
+
+  template <class Word = std::uint64_t, class Symbol, class Integral>
+    packed_sequence<Word>
+    read_packed_sequence(std::istream& in, std::map<Symbol,Integral> const& symbol_to_index)
+    {
+      MAIKEL_PROFILER;
+      packed_sequence<Word> sequence(symbol_to_index.size());
+      sequence.reserve(read_sequence_length<std::size_t>(in));
+      auto symbol_map = [&symbol_to_index] (Symbol const& symbol) {
+          auto found = symbol_to_index.find(symbol);
+          if (found == symbol_to_index.end())
+            throw read_sequence_error("Unkown Symbols in Input.");
+          return gsl::narrow<packed_symbol>(found->second);
+      };
+      auto sequence_input = ranges::istream_range<Symbol>(in);
+      ranges::copy(sequence_input | ranges::view::transform(symbol_map), ranges::back_inserter(sequence));
+      return sequence;
+    }
+
+  /**
+   * Writes symbols counted from 0 in the text format of read_sequence(),
+   * whose first line lists the names of the symbols. The names are 1 to
+   * `symbols`, which read_sequence() maps back to 0 to symbols - 1.
+   */
+  template <class InputIter>
+    void write_text_sequence(std::ostream& out, InputIter first, InputIter last, std::size_t symbols)
+    {
+      std::ostringstream body;
+      std::size_t length = 0;
+      for (; first != last; ++first, ++length)
+        body << static_cast<std::size_t>(*first) + 1 << ' ';
+      for (std::size_t o = 1; o <= symbols; ++o)
+        out << o << ' ';
+      out << '\n' << length << '\n' << body.str() << '\n';
+    }
 } // namespace hmm
 } // namespace maikel
 
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "maikel/hmm/isa_kernels.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MAIKEL_KERNELS_X86 1
+#endif
+
+namespace maikel { namespace hmm {
+
+  namespace detail {
+    // defined by the variants of isa_kernels.cpp
+    extern kernel_set const sse2_kernels;
+#ifdef MAIKEL_KERNELS_X86
+    extern kernel_set const sse42_kernels;
+    extern kernel_set const avx2_kernels;
+    extern kernel_set const avx512_kernels;
+#endif
+  }
+
+  namespace {
+
+    char const* const isa_names[static_cast<int>(isa::count)] = { "sse2", "sse4.2", "avx2", "avx512" };
+
+    bool parse_isa(char const* name, isa& level) noexcept
+    {
+      for (int i = 0; i < static_cast<int>(isa::count); ++i)
+        if (!std::strcmp(name, isa_names[i])) {
+          level = static_cast<isa>(i);
+          return true;
+        }
+      if (!std::strcmp(name, "sse42")) {
+        level = isa::sse42;
+        return true;
+      }
+      return false;
+    }
+
+    kernel_set const& choose_kernels() noexcept
+    {
+      isa level = best_supported_isa();
+      char const* forced = std::getenv("MAIKEL_HMM_ISA");
+      if (forced && *forced && std::strcmp(forced, "auto")) {
+        isa wanted;
+        if (!parse_isa(forced, wanted))
+          std::fprintf(stderr, "MAIKEL_HMM_ISA=%s is unknown, using %s.\n", forced, isa_name(level));
+        else if (!isa_supported(wanted) || !kernels_for(wanted))
+          std::fprintf(stderr, "MAIKEL_HMM_ISA=%s is not supported here, using %s.\n", forced, isa_name(level));
+        else
+          level = wanted;
+      }
+      return *kernels_for(level);
+    }
+
+  } // namespace
+
+  char const* isa_name(isa level) noexcept
+  {
+    int i = static_cast<int>(level);
+    return 0 <= i && i < static_cast<int>(isa::count) ? isa_names[i] : "unknown";
+  }
+
+  bool isa_supported(isa level) noexcept
+  {
+#ifdef MAIKEL_KERNELS_X86
+    // also checks that the operating system saves the vector registers
+    __builtin_cpu_init();
+    switch (level) {
+      case isa::sse2:   return __builtin_cpu_supports("sse2");
+      case isa::sse42:  return __builtin_cpu_supports("sse4.2");
+      case isa::avx2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+      case isa::avx512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma");
+      default:          return false;
+    }
+#else
+    // the baseline variant is compiled without any flags
+    return level == isa::sse2;
+#endif
+  }
+
+  kernel_set const* kernels_for(isa level) noexcept
+  {
+    switch (level) {
+      case isa::sse2:   return &detail::sse2_kernels;
+#ifdef MAIKEL_KERNELS_X86
+      case isa::sse42:  return &detail::sse42_kernels;
+      case isa::avx2:   return &detail::avx2_kernels;
+      case isa::avx512: return &detail::avx512_kernels;
+#endif
+      default:          return nullptr;
+    }
+  }
+
+  isa best_supported_isa() noexcept
+  {
+    for (int i = static_cast<int>(isa::count) - 1; i > 0; --i)
+      if (isa_supported(static_cast<isa>(i)) && kernels_for(static_cast<isa>(i)))
+        return static_cast<isa>(i);
+    return isa::sse2;
+  }
+
+  kernel_set const& active_kernels() noexcept
+  {
+    static kernel_set const& kernels = choose_kernels();
+    return kernels;
+  }
+
+} // namespace hmm
+} // namespace maikel
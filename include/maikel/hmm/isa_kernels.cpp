@@ -0,0 +1,226 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compiled once per instruction set with MAIKEL_KERNEL_ISA set to one of
+ * the names of maikel::hmm::isa and the matching -m flags, see
+ * CMakeLists.txt. Every loop is written so that it vectorizes with
+ * -fopenmp-simd and without -ffast-math.
+ *
+ * Nothing from the standard library is used here on purpose: an inline
+ * function which is not inlined ends up as a weak symbol, and the linker
+ * could pick the AVX-512 copy for callers on any CPU. Only <cstddef> and
+ * <cstdint> typedefs and compiler builtins are safe.
+ */
+
+#include "maikel/hmm/isa_kernels.h"
+
+#ifndef MAIKEL_KERNEL_ISA
+#error "Compile isa_kernels.cpp with MAIKEL_KERNEL_ISA set to sse2, sse42, avx2 or avx512."
+#endif
+
+#define MAIKEL_KERNEL_CONCAT_IMPL(a, b) a ## b
+#define MAIKEL_KERNEL_CONCAT(a, b) MAIKEL_KERNEL_CONCAT_IMPL(a, b)
+
+namespace maikel { namespace hmm {
+
+  namespace {
+
+    inline float exp_of(float x) noexcept { return __builtin_expf(x); }
+    inline double exp_of(double x) noexcept { return __builtin_exp(x); }
+    inline float log_of(float x) noexcept { return __builtin_logf(x); }
+    inline double log_of(double x) noexcept { return __builtin_log(x); }
+    inline float infinity_of(float) noexcept { return __builtin_inff(); }
+    inline double infinity_of(double) noexcept { return __builtin_inf(); }
+
+    template <class T>
+      accumulator_t<T> forward_step(T const* __restrict A, T const* __restrict prev, T const* __restrict b,
+          T* __restrict alpha, std::ptrdiff_t n)
+      {
+        accumulator_t<T> scaling = 0;
+        std::ptrdiff_t j = 0;
+        // four columns per pass over prev share its loads and the loop overhead
+        for (; j + 4 <= n; j += 4) {
+          T const* __restrict c0 = A + j*n;
+          T const* __restrict c1 = c0 + n;
+          T const* __restrict c2 = c1 + n;
+          T const* __restrict c3 = c2 + n;
+          T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+#pragma omp simd reduction(+:s0,s1,s2,s3)
+          for (std::ptrdiff_t i = 0; i < n; ++i) {
+            s0 += prev[i]*c0[i];
+            s1 += prev[i]*c1[i];
+            s2 += prev[i]*c2[i];
+            s3 += prev[i]*c3[i];
+          }
+          alpha[j] = s0*b[j];
+          alpha[j+1] = s1*b[j+1];
+          alpha[j+2] = s2*b[j+2];
+          alpha[j+3] = s3*b[j+3];
+          scaling += alpha[j];
+          scaling += alpha[j+1];
+          scaling += alpha[j+2];
+          scaling += alpha[j+3];
+        }
+        for (; j < n; ++j) {
+          T const* __restrict column = A + j*n;
+          T sum = 0;
+#pragma omp simd reduction(+:sum)
+          for (std::ptrdiff_t i = 0; i < n; ++i)
+            sum += prev[i]*column[i];
+          alpha[j] = sum*b[j];
+          scaling += alpha[j];
+        }
+        return scaling;
+      }
+
+    template <class T>
+      void backward_step(T const* __restrict A, T const* __restrict b, T const* __restrict next,
+          T scaling, T* __restrict beta, T* __restrict work, std::ptrdiff_t n)
+      {
+#pragma omp simd
+        for (std::ptrdiff_t j = 0; j < n; ++j) {
+          work[j] = b[j]*next[j];
+          beta[j] = 0;
+        }
+        // beta = A work, one column at a time so that the inner loop is contiguous
+        for (std::ptrdiff_t j = 0; j < n; ++j) {
+          T const* __restrict column = A + j*n;
+          T w = work[j];
+#pragma omp simd
+          for (std::ptrdiff_t i = 0; i < n; ++i)
+            beta[i] += column[i]*w;
+        }
+#pragma omp simd
+        for (std::ptrdiff_t i = 0; i < n; ++i)
+          beta[i] *= scaling;
+      }
+
+    template <class T>
+      void xi_accumulate(T const* __restrict A, T const* __restrict alpha, T const* __restrict w,
+          T* __restrict xi, T* __restrict gamma, std::ptrdiff_t n)
+      {
+        for (std::ptrdiff_t j = 0; j < n; ++j) {
+          T const* __restrict column = A + j*n;
+          T* __restrict xi_column = xi + j*n;
+          T wj = w[j];
+#pragma omp simd
+          for (std::ptrdiff_t i = 0; i < n; ++i) {
+            T xi_t = alpha[i]*column[i]*wj;
+            xi_column[i] += xi_t;
+            gamma[i] += xi_t;
+          }
+        }
+      }
+
+    template <class T>
+      T log_sum_exp(T const* __restrict x, std::ptrdiff_t n)
+      {
+        if (n <= 0)
+          return -infinity_of(T());
+        T max = x[0];
+#pragma omp simd reduction(max:max)
+        for (std::ptrdiff_t i = 1; i < n; ++i)
+          max = x[i] > max ? x[i] : max;
+        // all -infinity, or an infinity which would give inf - inf
+        if (max == infinity_of(T()) || max == -infinity_of(T()))
+          return max;
+        T sum = 0;
+#pragma omp simd reduction(+:sum)
+        for (std::ptrdiff_t i = 0; i < n; ++i)
+          sum += exp_of(x[i] - max);
+        return max + log_of(sum);
+      }
+
+    template <class T>
+      void max_plus(T const* __restrict logAt, T const* __restrict delta, T* __restrict best,
+          std::uint32_t* __restrict arg, std::ptrdiff_t n)
+      {
+#pragma omp simd
+        for (std::ptrdiff_t j = 0; j < n; ++j) {
+          best[j] = delta[0] + logAt[j];
+          arg[j] = 0;
+        }
+        for (std::ptrdiff_t i = 1; i < n; ++i) {
+          T const* __restrict column = logAt + i*n;
+          T d = delta[i];
+          std::uint32_t index = static_cast<std::uint32_t>(i);
+#pragma omp simd
+          for (std::ptrdiff_t j = 0; j < n; ++j) {
+            T candidate = d + column[j];
+            bool better = candidate > best[j];
+            best[j] = better ? candidate : best[j];
+            arg[j] = better ? index : arg[j];
+          }
+        }
+      }
+
+    // the same hash as bfloat16_dither() in bfloat16.h, which can not be called from here
+    inline std::uint32_t dither_of(std::uint32_t key) noexcept
+    {
+      std::uint32_t h = key*0x9e3779b1u;
+      h ^= h >> 15;
+      h *= 0x85ebca77u;
+      h ^= h >> 13;
+      return h >> 16;
+    }
+
+    template <class T>
+      void to_bfloat16(T const* __restrict x, std::uint16_t* __restrict out, std::ptrdiff_t n,
+          std::uint32_t key)
+      {
+#pragma omp simd
+        for (std::ptrdiff_t i = 0; i < n; ++i) {
+          float value = static_cast<float>(x[i]);
+          std::uint32_t bits;
+          __builtin_memcpy(&bits, &value, sizeof(bits));
+          std::uint32_t rounded = (bits + dither_of(key + static_cast<std::uint32_t>(i))) >> 16;
+          // a NaN stays quiet instead of rounding up to infinity
+          bool nan = (bits & 0x7fffffffu) > 0x7f800000u;
+          out[i] = static_cast<std::uint16_t>(nan ? (bits >> 16) | 0x40u : rounded);
+        }
+      }
+
+    template <class T>
+      void from_bfloat16(std::uint16_t const* __restrict in, T* __restrict x, std::ptrdiff_t n)
+      {
+#pragma omp simd
+        for (std::ptrdiff_t i = 0; i < n; ++i) {
+          std::uint32_t bits = static_cast<std::uint32_t>(in[i]) << 16;
+          float value;
+          __builtin_memcpy(&value, &bits, sizeof(value));
+          x[i] = value;
+        }
+      }
+
+    template <class T>
+      constexpr kernel_table<T> make_table() noexcept
+      {
+        return { &forward_step<T>, &backward_step<T>, &xi_accumulate<T>, &log_sum_exp<T>, &max_plus<T>,
+                 &to_bfloat16<T>, &from_bfloat16<T> };
+      }
+
+  } // namespace
+
+  namespace detail {
+    extern kernel_set const MAIKEL_KERNEL_CONCAT(MAIKEL_KERNEL_ISA, _kernels);
+    kernel_set const MAIKEL_KERNEL_CONCAT(MAIKEL_KERNEL_ISA, _kernels) = {
+      isa::MAIKEL_KERNEL_ISA, make_table<float>(), make_table<double>()
+    };
+  }
+
+} // namespace hmm
+} // namespace maikel
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_ISA_KERNELS_H_
+#define HMM_ISA_KERNELS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "maikel/hmm/precision.h"
+
+/*
+ * The inner loops of the forward and backward steps, of the xi
+ * accumulation of Baum-Welch, of log-sum-exp, of the Viterbi max-plus
+ * step and of the bfloat16 conversions of spilled coefficients, compiled
+ * once per instruction set (isa_kernels.cpp) and picked at startup by
+ * isa_dispatch.cpp from what the CPU supports. The environment
+ * variable MAIKEL_HMM_ISA forces a variant, which is meant for testing.
+ *
+ * The algorithms use the kernels if MAIKEL_DISPATCH_KERNELS is defined and
+ * their scalar type is float or double; the object files then have to be
+ * linked in. Otherwise dispatched_kernels() returns nullptr and the
+ * generic loops in the headers are used, so the library stays header only.
+ *
+ * Matrices are column major like Eigen's default. Variants may round
+ * differently, because wider vectors sum in a different order and the
+ * AVX2 and AVX-512 variants contract to fused multiply-adds.
+ */
+
+namespace maikel { namespace hmm {
+
+  enum class isa { sse2 = 0, sse42, avx2, avx512, count };
+
+  template <class T>
+    struct kernel_table {
+        /// alpha = (prev A) .* b, returns the sum of alpha, taken in accumulator_t<T>.
+        accumulator_t<T> (*forward_step)(T const* A, T const* prev, T const* b, T* alpha, std::ptrdiff_t n);
+        /// beta = scaling A (b .* next), `work` holds n values.
+        void (*backward_step)(T const* A, T const* b, T const* next, T scaling, T* beta, T* work,
+            std::ptrdiff_t n);
+        /// xi(i,j) += alpha(i) A(i,j) w(j) and gamma(i) += alpha(i) A(i,j) w(j).
+        void (*xi_accumulate)(T const* A, T const* alpha, T const* w, T* xi, T* gamma, std::ptrdiff_t n);
+        /// log(sum exp(x)), -infinity for an empty x.
+        T (*log_sum_exp)(T const* x, std::ptrdiff_t n);
+        /**
+         * best(j) = max_i delta(i) + logAt(j,i) and arg(j) the first i
+         * attaining it, where logAt is the transposed log transition matrix.
+         */
+        void (*max_plus)(T const* logAt, T const* delta, T* best, std::uint32_t* arg, std::ptrdiff_t n);
+        /// out = x rounded stochastically to bfloat16 with the dither of key + i, see maikel/hmm/bfloat16.h.
+        void (*to_bfloat16)(T const* x, std::uint16_t* out, std::ptrdiff_t n, std::uint32_t key);
+        /// x = in widened from bfloat16, which is exact.
+        void (*from_bfloat16)(std::uint16_t const* in, T* x, std::ptrdiff_t n);
+    };
+
+  struct kernel_set {
+      isa level;
+      kernel_table<float> single_precision;
+      kernel_table<double> double_precision;
+  };
+
+  /// Name of an instruction set as accepted by MAIKEL_HMM_ISA.
+  char const* isa_name(isa level) noexcept;
+
+  /// Whether the CPU and the operating system support `level`.
+  bool isa_supported(isa level) noexcept;
+
+  /// Widest instruction set which is supported and was compiled in.
+  isa best_supported_isa() noexcept;
+
+  /// Kernels of one instruction set, nullptr if it was not compiled in.
+  kernel_set const* kernels_for(isa level) noexcept;
+
+  /**
+   * Kernels chosen on the first call, from MAIKEL_HMM_ISA if it names a
+   * supported instruction set, otherwise the best supported one. An
+   * unknown or unsupported value is reported on stderr once.
+   */
+  kernel_set const& active_kernels() noexcept;
+
+  namespace detail {
+    template <class T>
+      struct dispatched_kernels_impl {
+          static kernel_table<T> const* get() noexcept { return nullptr; }
+      };
+
+#ifdef MAIKEL_DISPATCH_KERNELS
+    template <>
+      struct dispatched_kernels_impl<float> {
+          static kernel_table<float> const* get() noexcept { return &active_kernels().single_precision; }
+      };
+
+    template <>
+      struct dispatched_kernels_impl<double> {
+          static kernel_table<double> const* get() noexcept { return &active_kernels().double_precision; }
+      };
+#endif
+  }
+
+  /// The active kernels for T, or nullptr if the generic code is to be used.
+  template <class T>
+    kernel_table<T> const* dispatched_kernels() noexcept
+    {
+      return detail::dispatched_kernels_impl<T>::get();
+    }
+
+  /// log(sum exp(x)) of the n values at x without overflow.
+  template <class T>
+    T log_sum_exp(T const* x, std::ptrdiff_t n)
+    {
+      if (kernel_table<T> const* kernels = dispatched_kernels<T>())
+        return kernels->log_sum_exp(x, n);
+      if (n <= 0)
+        return -std::numeric_limits<T>::infinity();
+      T max = *std::max_element(x, x + n);
+      if (std::isinf(max))
+        return max;
+      T sum = 0;
+      for (std::ptrdiff_t i = 0; i < n; ++i)
+        sum += std::exp(x[i] - max);
+      return max + std::log(sum);
+    }
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_ISA_KERNELS_H_ */
@@ -0,0 +1,345 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Binary file format for many hidden markov models. A file is
+ *
+ *     model_bank_header                 64 bytes
+ *     parameter blocks                  per model A (N x N), B (N x M) and
+ *                                       pi (N), column major, every matrix
+ *                                       starts at a multiple of 64 bytes
+ *     index                             one model_bank_entry per model
+ *     names                             the model names, not terminated
+ *
+ * All numbers are in host byte order. The parameters are stored normalized,
+ * so they are used as they are.
+ */
+
+#ifndef HMM_MODEL_BANK_H_
+#define HMM_MODEL_BANK_H_
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include <Eigen/Dense>
+#include <gsl_assert.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/mapped_file.h"
+
+namespace maikel { namespace hmm {
+
+  struct model_bank_error: public std::runtime_error {
+      model_bank_error(std::string s): std::runtime_error(s) {}
+  };
+
+  struct model_bank_header {
+      char magic[8];
+      std::uint32_t scalar_bytes;
+      std::uint32_t reserved;
+      std::uint64_t models;
+      std::uint64_t index_offset;
+      std::uint64_t names_offset;
+      char padding[24];
+  };
+
+  struct model_bank_entry {
+      std::uint32_t states;
+      std::uint32_t symbols;
+      std::uint64_t offset;       // of the parameter block, in bytes
+      std::uint64_t name_offset;  // relative to the names section
+      std::uint64_t name_length;
+  };
+
+  static_assert(sizeof(model_bank_header) == 64, "Unexpected padding in the model bank header.");
+  static_assert(sizeof(model_bank_entry) == 32, "Unexpected padding in the model bank index.");
+
+  constexpr char model_bank_magic[8] = { 'M', 'K', 'L', 'B', 'A', 'N', 'K', '\0' };
+
+  namespace detail {
+
+    const std::uint64_t model_bank_alignment = 64;
+
+    inline std::uint64_t align_model_bank(std::uint64_t bytes) noexcept
+    {
+      return (bytes + model_bank_alignment - 1) / model_bank_alignment * model_bank_alignment;
+    }
+
+    /// Byte offsets of B and pi relative to A and the size of a whole block.
+    template <class T>
+      struct model_bank_layout {
+          std::uint64_t B, pi, bytes;
+
+          model_bank_layout(std::uint64_t states, std::uint64_t symbols) noexcept
+          : B{align_model_bank(states*states*sizeof(T))},
+            pi{B + align_model_bank(states*symbols*sizeof(T))},
+            bytes{pi + align_model_bank(states*sizeof(T))} {}
+      };
+
+  } // namespace detail
+
+  /**
+   * Writes the models of a bank one after another. The index and the names
+   * are written by close(), which is called by the destructor.
+   *
+   * Example:
+   *
+   *     maikel::hmm::model_bank_writer<double> writer("customers.bank");
+   *     writer.add("customer-17", hmm);
+   */
+  template <class T>
+    class model_bank_writer {
+      public:
+        explicit model_bank_writer(std::string const& path)
+        : out_(path, std::ofstream::binary | std::ofstream::trunc)
+        {
+          if (!out_)
+            throw model_bank_error("Could not open " + path + " for writing.");
+          std::memset(&header_, 0, sizeof(header_));
+          std::memcpy(header_.magic, model_bank_magic, sizeof(header_.magic));
+          header_.scalar_bytes = sizeof(T);
+          write(&header_, sizeof(header_));
+          position_ = sizeof(header_);
+        }
+
+        model_bank_writer(model_bank_writer const&) = delete;
+        model_bank_writer& operator=(model_bank_writer const&) = delete;
+
+        ~model_bank_writer() noexcept
+        {
+          try {
+            close();
+          } catch (...) {
+          }
+        }
+
+        std::size_t size() const noexcept { return index_.size(); }
+
+        std::size_t add(std::string const& name, hidden_markov_model<T> const& hmm)
+        {
+          Expects(!closed_);
+          std::uint64_t states = static_cast<std::uint64_t>(hmm.states());
+          std::uint64_t symbols = static_cast<std::uint64_t>(hmm.symbols());
+          detail::model_bank_layout<T> layout(states, symbols);
+          model_bank_entry entry;
+          entry.states = static_cast<std::uint32_t>(states);
+          entry.symbols = static_cast<std::uint32_t>(symbols);
+          entry.offset = position_;
+          entry.name_offset = names_.size();
+          entry.name_length = name.size();
+          index_.push_back(entry);
+          names_ += name;
+
+          write_padded(hmm.transition_matrix().data(), states*states*sizeof(T));
+          write_padded(hmm.symbol_probabilities().data(), states*symbols*sizeof(T));
+          write_padded(hmm.initial_distribution().data(), states*sizeof(T));
+          Ensures(position_ == entry.offset + layout.bytes);
+          return index_.size() - 1;
+        }
+
+        void close()
+        {
+          if (closed_)
+            return;
+          closed_ = true;
+          header_.models = index_.size();
+          header_.index_offset = position_;
+          header_.names_offset = position_ + index_.size()*sizeof(model_bank_entry);
+          write(index_.data(), index_.size()*sizeof(model_bank_entry));
+          write(names_.data(), names_.size());
+          out_.seekp(0);
+          write(&header_, sizeof(header_));
+          out_.close();
+          if (!out_)
+            throw model_bank_error("Could not finish the model bank.");
+        }
+
+      private:
+        std::ofstream out_;
+        model_bank_header header_;
+        std::vector<model_bank_entry> index_;
+        std::string names_;
+        std::uint64_t position_ = 0;
+        bool closed_ = false;
+
+        void write(void const* data, std::size_t bytes)
+        {
+          if (!out_.write(static_cast<char const*>(data), static_cast<std::streamsize>(bytes)))
+            throw model_bank_error("Could not write the model bank.");
+        }
+
+        void write_padded(void const* data, std::size_t bytes)
+        {
+          static const char zeros[detail::model_bank_alignment] = {};
+          write(data, bytes);
+          std::uint64_t padding = detail::align_model_bank(bytes) - bytes;
+          write(zeros, padding);
+          position_ += bytes + padding;
+        }
+    };
+
+  /**
+   * Memory mapped model bank. Opening a bank maps the file and reads the
+   * index only. parameters() wraps the mapped arrays with Eigen maps and
+   * operator[] builds a hidden_markov_model on its first use, so a process
+   * only pays for the models it scores with.
+   *
+   * Example:
+   *
+   *     maikel::hmm::model_bank<double> bank("customers.bank");
+   *     auto const& hmm = bank[bank.find("customer-17")];
+   */
+  template <class T>
+    class model_bank {
+      public:
+        using model       = hidden_markov_model<T>;
+        using size_type   = std::size_t;
+        using matrix_map  = Eigen::Map<const typename model::matrix, Eigen::Aligned>;
+        using vector_map  = Eigen::Map<const typename model::row_vector, Eigen::Aligned>;
+
+        static const size_type npos = static_cast<size_type>(-1);
+
+        /// Zero copy view onto the parameters of one model.
+        struct parameters_view {
+            matrix_map A;
+            matrix_map B;
+            vector_map pi;
+        };
+
+        explicit model_bank(std::string const& path)
+        : file_(path, mapped_file::access_pattern::random)
+        {
+          if (file_.size() < sizeof(model_bank_header))
+            throw model_bank_error(path + " is too short for a model bank.");
+          std::memcpy(&header_, file_.data(), sizeof(header_));
+          if (std::memcmp(header_.magic, model_bank_magic, sizeof(header_.magic)))
+            throw model_bank_error(path + " is not a model bank.");
+          if (header_.scalar_bytes != sizeof(T))
+            throw model_bank_error(path + " stores parameters of a different floating point type.");
+          if (header_.index_offset > file_.size() ||
+              header_.models > (file_.size() - header_.index_offset) / sizeof(model_bank_entry) ||
+              header_.names_offset != header_.index_offset + header_.models*sizeof(model_bank_entry))
+            throw model_bank_error(path + " is truncated or has a broken header.");
+          index_ = reinterpret_cast<model_bank_entry const*>(file_.data() + header_.index_offset);
+          names_ = file_.data() + header_.names_offset;
+          for (size_type i = 0; i < size(); ++i) {
+            model_bank_entry const& entry = index_[i];
+            detail::model_bank_layout<T> layout(entry.states, entry.symbols);
+            if (entry.offset % detail::model_bank_alignment ||
+                entry.offset + layout.bytes > header_.index_offset ||
+                header_.names_offset + entry.name_offset + entry.name_length > file_.size())
+              throw model_bank_error("Model " + std::to_string(i) + " lies outside of " + path + ".");
+          }
+          models_.resize(size());
+          once_.reset(new std::once_flag[size()]);
+        }
+
+        size_type size() const noexcept { return static_cast<size_type>(header_.models); }
+        bool empty() const noexcept { return size() == 0; }
+
+        size_type states(size_type i) const
+        {
+          Expects(i < size());
+          return index_[i].states;
+        }
+
+        size_type symbols(size_type i) const
+        {
+          Expects(i < size());
+          return index_[i].symbols;
+        }
+
+        std::string name(size_type i) const
+        {
+          Expects(i < size());
+          return std::string(names_ + index_[i].name_offset, index_[i].name_length);
+        }
+
+        /// Index of the model with the given name or npos.
+        size_type find(std::string const& name) const
+        {
+          std::call_once(names_once_, [this] {
+            by_name_.reserve(size());
+            for (size_type i = 0; i < size(); ++i)
+              by_name_.emplace(this->name(i), i);
+          });
+          auto found = by_name_.find(name);
+          return found == by_name_.end() ? npos : found->second;
+        }
+
+        parameters_view parameters(size_type i) const
+        {
+          Expects(i < size());
+          model_bank_entry const& entry = index_[i];
+          detail::model_bank_layout<T> layout(entry.states, entry.symbols);
+          char const* block = file_.data() + entry.offset;
+          typename model::size_type N = entry.states, M = entry.symbols;
+          return { matrix_map(reinterpret_cast<T const*>(block), N, N),
+                   matrix_map(reinterpret_cast<T const*>(block + layout.B), N, M),
+                   vector_map(reinterpret_cast<T const*>(block + layout.pi), N) };
+        }
+
+        /**
+         * Returns the i-th model and builds it on the first call. Safe to
+         * call from several threads.
+         */
+        model const& operator[](size_type i) const
+        {
+          Expects(i < size());
+          std::call_once(once_[i], [this, i] {
+            parameters_view p = parameters(i);
+            models_[i].reset(new model(p.A, p.B, p.pi));
+          });
+          return *models_[i];
+        }
+
+        /// Hints the kernel that the parameters of model `i` are needed soon.
+        void prefetch(size_type i) const noexcept
+        {
+          if (i >= size())
+            return;
+          detail::model_bank_layout<T> layout(index_[i].states, index_[i].symbols);
+          std::uintptr_t first = reinterpret_cast<std::uintptr_t>(file_.data() + index_[i].offset);
+          std::uintptr_t page = first & ~std::uintptr_t{4095};
+          ::madvise(reinterpret_cast<void*>(page), layout.bytes + (first - page), MADV_WILLNEED);
+        }
+
+      private:
+        mapped_file file_;
+        model_bank_header header_;
+        model_bank_entry const* index_ = nullptr;
+        char const* names_ = nullptr;
+        mutable std::vector<std::unique_ptr<model>> models_;
+        std::unique_ptr<std::once_flag[]> once_;
+        mutable std::once_flag names_once_;
+        mutable std::unordered_map<std::string, size_type> by_name_;
+    };
+
+  template <class T>
+    const typename model_bank<T>::size_type model_bank<T>::npos;
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_MODEL_BANK_H_ */
@@ -0,0 +1,332 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Bit packed storage for observation sequences. Every symbol occupies 1, 2,
+ * 4, 8 or 16 bits depending on the size of the alphabet, so a word never
+ * holds a partial symbol. The iterators are random access and can be handed
+ * to forward(), backward() and update_matrices() in place of the iterators
+ * of a std::vector.
+ */
+
+#ifndef HMM_PACKED_SEQUENCE_H_
+#define HMM_PACKED_SEQUENCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <gsl_assert.h>
+
+namespace maikel { namespace hmm {
+
+  struct packed_sequence_error: public std::runtime_error {
+      packed_sequence_error(std::string s): std::runtime_error(s) {}
+  };
+
+  /**
+   * Returns the smallest power of two bits (1, 2, 4, 8 or 16) which can
+   * encode an alphabet with the given number of symbols.
+   */
+  inline unsigned bits_per_symbol(std::size_t symbols)
+  {
+    if (symbols <= 2)
+      return 1;
+    if (symbols <= 4)
+      return 2;
+    if (symbols <= 16)
+      return 4;
+    if (symbols <= 256)
+      return 8;
+    if (symbols <= 65536)
+      return 16;
+    throw packed_sequence_error("Alphabet is too large for a packed sequence.");
+  }
+
+  using packed_symbol = std::uint16_t;
+
+  template <class Word>
+    class packed_sequence_iterator
+    : public std::iterator<std::random_access_iterator_tag,
+        packed_symbol, std::ptrdiff_t, void, packed_symbol>
+    {
+      public:
+        using word_type  = Word;
+        using value_type = packed_symbol;
+        using reference  = packed_symbol;
+        using difference_type = std::ptrdiff_t;
+
+        packed_sequence_iterator() = default;
+
+        packed_sequence_iterator(Word const* words, unsigned bits, std::size_t pos) noexcept
+        : words_{words}, pos_{pos}, bits_{bits},
+          shift_{log2(std::numeric_limits<Word>::digits / bits)} {}
+
+        reference operator*() const noexcept
+        {
+          return decode(pos_);
+        }
+
+        reference operator[](difference_type n) const noexcept
+        {
+          return decode(pos_ + n);
+        }
+
+        packed_sequence_iterator& operator++() noexcept { ++pos_; return *this; }
+        packed_sequence_iterator& operator--() noexcept { --pos_; return *this; }
+        packed_sequence_iterator operator++(int) noexcept { auto tmp = *this; ++pos_; return tmp; }
+        packed_sequence_iterator operator--(int) noexcept { auto tmp = *this; --pos_; return tmp; }
+
+        packed_sequence_iterator& operator+=(difference_type n) noexcept { pos_ += n; return *this; }
+        packed_sequence_iterator& operator-=(difference_type n) noexcept { pos_ -= n; return *this; }
+
+        packed_sequence_iterator operator+(difference_type n) const noexcept
+        { auto tmp = *this; return tmp += n; }
+        packed_sequence_iterator operator-(difference_type n) const noexcept
+        { auto tmp = *this; return tmp -= n; }
+        friend packed_sequence_iterator operator+(difference_type n, packed_sequence_iterator it) noexcept
+        { return it += n; }
+
+        difference_type operator-(packed_sequence_iterator const& other) const noexcept
+        {
+          return static_cast<difference_type>(pos_) - static_cast<difference_type>(other.pos_);
+        }
+
+        bool operator==(packed_sequence_iterator const& o) const noexcept { return pos_ == o.pos_; }
+        bool operator!=(packed_sequence_iterator const& o) const noexcept { return pos_ != o.pos_; }
+        bool operator< (packed_sequence_iterator const& o) const noexcept { return pos_ <  o.pos_; }
+        bool operator> (packed_sequence_iterator const& o) const noexcept { return pos_ >  o.pos_; }
+        bool operator<=(packed_sequence_iterator const& o) const noexcept { return pos_ <= o.pos_; }
+        bool operator>=(packed_sequence_iterator const& o) const noexcept { return pos_ >= o.pos_; }
+
+        std::size_t position() const noexcept { return pos_; }
+
+      private:
+        Word const* words_ = nullptr; // not owning
+        std::size_t pos_ = 0;
+        unsigned bits_ = 8;
+        unsigned shift_ = 3;
+
+        static constexpr unsigned log2(unsigned n) noexcept
+        {
+          return n <= 1 ? 0 : 1 + log2(n / 2);
+        }
+
+        packed_symbol decode(std::size_t pos) const noexcept
+        {
+          std::size_t per_word_mask = (std::size_t{1} << shift_) - 1;
+          Word word = words_[pos >> shift_];
+          Word mask = (Word{1} << bits_) - 1;
+          return static_cast<packed_symbol>((word >> ((pos & per_word_mask)*bits_)) & mask);
+        }
+    };
+
+  /**
+   * Unpacks `count` symbols starting at symbol `first` into `out`. Every word
+   * is loaded once and then shifted out symbol by symbol, which is the fast
+   * path for consumers which need a plain array of indices.
+   */
+  template <class Word, class OutputIter>
+    OutputIter
+    unpack_symbols(Word const* words, unsigned bits, std::size_t first, std::size_t count, OutputIter out)
+    {
+      const unsigned per_word = std::numeric_limits<Word>::digits / bits;
+      const Word mask = (Word{1} << bits) - 1;
+      std::size_t word_index = first / per_word;
+      unsigned offset = first % per_word;
+      while (count) {
+        Word word = words[word_index++] >> (offset*bits);
+        unsigned n = per_word - offset;
+        if (n > count)
+          n = static_cast<unsigned>(count);
+        for (unsigned k = 0; k < n; ++k, word >>= bits)
+          *out++ = static_cast<packed_symbol>(word & mask);
+        count -= n;
+        offset = 0;
+      }
+      return out;
+    }
+
+  /**
+   * Non owning view onto packed symbols, for example inside of a memory
+   * mapped file.
+   */
+  template <class Word = std::uint64_t>
+    class packed_sequence_view {
+      public:
+        using word_type      = Word;
+        using value_type     = packed_symbol;
+        using size_type      = std::size_t;
+        using iterator       = packed_sequence_iterator<Word>;
+        using const_iterator = iterator;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = reverse_iterator;
+
+        packed_sequence_view() = default;
+
+        packed_sequence_view(Word const* words, unsigned bits, size_type size) noexcept
+        : words_{words}, size_{size}, bits_{bits} {}
+
+        size_type size() const noexcept { return size_; }
+        bool empty() const noexcept { return size_ == 0; }
+        unsigned bits() const noexcept { return bits_; }
+        Word const* words() const noexcept { return words_; }
+
+        value_type operator[](size_type i) const noexcept { return begin()[i]; }
+
+        iterator begin() const noexcept { return {words_, bits_, 0}; }
+        iterator end() const noexcept { return {words_, bits_, size_}; }
+        reverse_iterator rbegin() const noexcept { return reverse_iterator(end()); }
+        reverse_iterator rend() const noexcept { return reverse_iterator(begin()); }
+
+        template <class OutputIter>
+          OutputIter unpack(size_type first, size_type count, OutputIter out) const
+          {
+            Expects(first + count <= size_);
+            return unpack_symbols(words_, bits_, first, count, out);
+          }
+
+      private:
+        Word const* words_ = nullptr; // not owning
+        size_type size_ = 0;
+        unsigned bits_ = 8;
+    };
+
+  /**
+   * Owning container of packed symbols. The number of bits per symbol is
+   * chosen from the alphabet size in the constructor. It has push_back() and
+   * can be filled by std::back_inserter, for example with the output of a
+   * sequence generator.
+   */
+  template <class Word = std::uint64_t>
+    class packed_sequence {
+      public:
+        static_assert(std::is_unsigned<Word>::value, "Words have to be unsigned integers.");
+
+        using word_type      = Word;
+        using value_type     = packed_symbol;
+        using size_type      = std::size_t;
+        using iterator       = packed_sequence_iterator<Word>;
+        using const_iterator = iterator;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = reverse_iterator;
+
+        static const unsigned word_bits = std::numeric_limits<Word>::digits;
+
+        explicit packed_sequence(size_type symbols)
+        : symbols_{symbols}, bits_{bits_per_symbol(symbols)},
+          per_word_{symbols_per_word(symbols)} {}
+
+        template <class InputIter>
+          packed_sequence(size_type symbols, InputIter first, InputIter last)
+          : packed_sequence(symbols)
+          {
+            for (; first != last; ++first)
+              push_back(static_cast<value_type>(*first));
+          }
+
+        size_type size() const noexcept { return size_; }
+        bool empty() const noexcept { return size_ == 0; }
+        size_type symbols() const noexcept { return symbols_; }
+        unsigned bits() const noexcept { return bits_; }
+
+        Word const* words() const noexcept { return words_.data(); }
+        size_type word_count() const noexcept { return words_.size(); }
+
+        void reserve(size_type n)
+        {
+          words_.reserve((n + per_word_ - 1) / per_word_);
+        }
+
+        void clear() noexcept
+        {
+          words_.clear();
+          size_ = 0;
+        }
+
+        void push_back(value_type s)
+        {
+          Expects(s < symbols_);
+          unsigned offset = size_ % per_word_;
+          if (offset == 0)
+            words_.push_back(0);
+          words_.back() |= static_cast<Word>(s) << (offset*bits_);
+          ++size_;
+        }
+
+        void set(size_type i, value_type s)
+        {
+          Expects(i < size_ && s < symbols_);
+          Word mask = (Word{1} << bits_) - 1;
+          unsigned shift = (i % per_word_) * bits_;
+          Word& word = words_[i / per_word_];
+          word = (word & ~(mask << shift)) | (static_cast<Word>(s) << shift);
+        }
+
+        /**
+         * Appends already packed words, for example when reading a binary
+         * file. `count` is the number of symbols stored in `words` and the
+         * sequence has to be word aligned at this point.
+         */
+        void append_words(Word const* words, size_type count)
+        {
+          Expects(size_ % per_word_ == 0);
+          words_.insert(words_.end(), words, words + (count + per_word_ - 1) / per_word_);
+          size_ += count;
+        }
+
+        value_type operator[](size_type i) const noexcept { return begin()[i]; }
+
+        iterator begin() const noexcept { return {words_.data(), bits_, 0}; }
+        iterator end() const noexcept { return {words_.data(), bits_, size_}; }
+        reverse_iterator rbegin() const noexcept { return reverse_iterator(end()); }
+        reverse_iterator rend() const noexcept { return reverse_iterator(begin()); }
+
+        packed_sequence_view<Word> view() const noexcept
+        {
+          return {words_.data(), bits_, size_};
+        }
+
+        template <class OutputIter>
+          OutputIter unpack(size_type first, size_type count, OutputIter out) const
+          {
+            Expects(first + count <= size_);
+            return unpack_symbols(words_.data(), bits_, first, count, out);
+          }
+
+      private:
+        static unsigned symbols_per_word(size_type symbols)
+        {
+          if (bits_per_symbol(symbols) > word_bits)
+            throw packed_sequence_error("Alphabet is too large for the word type of a packed sequence.");
+          return word_bits / bits_per_symbol(symbols);
+        }
+
+        std::vector<Word> words_;
+        size_type size_ = 0;
+        size_type symbols_;
+        unsigned bits_;
+        unsigned per_word_;
+    };
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_PACKED_SEQUENCE_H_ */
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_PRECISION_H_
+#define HMM_PRECISION_H_
+
+/*
+ * Mixed precision: a hidden_markov_model<float> keeps its parameters and
+ * the forward and backward coefficients in float, so twice as many states
+ * fit into a vector register and the coefficients of Baum-Welch need half
+ * the memory. Every sum which runs over the states or over the sequence is
+ * carried in accumulator_t<float>, which is double:
+ *
+ *   - the sum of the forward coefficients from which the scaling factor
+ *     is taken,
+ *   - the log-likelihood of forward_scorer, which adds one logarithm per
+ *     symbol,
+ *   - the expected transition and emission counts of update_matrices(),
+ *     which are returned as double matrices.
+ *
+ * Products, the sums of the matrix-vector products and the transition
+ * counts of a few symbols stay in float. Against the same model in double,
+ * with u = 2^-24 the unit roundoff of float (tests/precision.t.cpp):
+ *
+ *   - |Delta log P| < 2e-7 T for a sequence of T symbols, about 3 u per
+ *     symbol. Most of it comes from rounding the parameters to float,
+ *     which alone changes log P by up to 2 u per symbol. Measured on
+ *     random models with 4 to 256 states: 0.5e-8 T to 4e-8 T.
+ *   - the transition and emission probabilities of one Baum-Welch step
+ *     differ by less than 1e-6, independent of T. Measured: below 5e-8.
+ *
+ * A float sum of the log-likelihood would instead round every step to
+ * the spacing of floats near log P, which is 0.016 once |log P| passes
+ * 131072, and float counts stop growing once they reach 1/u times what a
+ * single symbol adds.
+ *
+ * Convert models between the precisions with precision_cast().
+ */
+
+namespace maikel { namespace hmm {
+
+  /// Type in which sums over states or symbols of T values are carried.
+  template <class T>
+    struct accumulator {
+        using type = T;
+    };
+
+  template <>
+    struct accumulator<float> {
+        using type = double;
+    };
+
+  template <class T>
+    using accumulator_t = typename accumulator<T>::type;
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_PRECISION_H_ */
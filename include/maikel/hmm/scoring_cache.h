@@ -0,0 +1,299 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_SCORING_CACHE_H_
+#define HMM_SCORING_CACHE_H_
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include <gsl_assert.h>
+
+#include "maikel/lru_cache.h"
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/algorithm/forward.h"
+
+namespace maikel { namespace hmm {
+
+  namespace detail {
+
+    inline std::uint64_t mix64(std::uint64_t x) noexcept
+    {
+      x ^= x >> 33;
+      x *= 0xff51afd7ed558ccdULL;
+      x ^= x >> 33;
+      x *= 0xc4ceb9fe1a85ec53ULL;
+      x ^= x >> 33;
+      return x;
+    }
+
+  } // namespace detail
+
+  /**
+   * Hash of the dimensions and the parameters of a model. Models with the
+   * same parameters share cache entries, also across reloads of a bank.
+   * Takes anything with the Eigen interface, e.g. the maps of a model bank.
+   */
+  template <class MatrixA, class MatrixB, class VectorPi>
+    std::uint64_t model_fingerprint(MatrixA const& A, MatrixB const& B, VectorPi const& pi) noexcept
+    {
+      using scalar = typename MatrixA::Scalar;
+      std::uint64_t h = detail::mix64(static_cast<std::uint64_t>(B.rows()) << 32
+                                      ^ static_cast<std::uint64_t>(B.cols()));
+      auto add = [&h] (scalar const* data, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+          std::uint64_t bits = 0;
+          std::memcpy(&bits, data + i, sizeof(scalar));
+          h = detail::mix64(h ^ bits) + 0x9e3779b97f4a7c15ULL;
+        }
+      };
+      add(A.data(), static_cast<std::size_t>(A.size()));
+      add(B.data(), static_cast<std::size_t>(B.size()));
+      add(pi.data(), static_cast<std::size_t>(pi.size()));
+      return h;
+    }
+
+  template <class T>
+    std::uint64_t model_fingerprint(hidden_markov_model<T> const& hmm) noexcept
+    {
+      return model_fingerprint(hmm.transition_matrix(), hmm.symbol_probabilities(), hmm.initial_distribution());
+    }
+
+  /**
+   * Two independent 64 bit hashes of a sequence which are extended symbol
+   * by symbol, so the hash of every prefix comes for free. Together with
+   * the length they identify a sequence in the caches.
+   */
+  class sequence_hash {
+    public:
+      template <class Symbol>
+        void push(Symbol s) noexcept
+        {
+          std::uint64_t x = static_cast<std::uint64_t>(s);
+          first_ = detail::mix64(first_ ^ (x + 0x9e3779b97f4a7c15ULL));
+          second_ = detail::mix64(second_ + x*0xbf58476d1ce4e5b9ULL + 1);
+          ++length_;
+        }
+
+      std::uint64_t length() const noexcept { return length_; }
+      std::uint64_t first() const noexcept { return first_; }
+      std::uint64_t second() const noexcept { return second_; }
+
+    private:
+      std::uint64_t first_ = 0x243f6a8885a308d3ULL;
+      std::uint64_t second_ = 0x13198a2e03707344ULL;
+      std::uint64_t length_ = 0;
+  };
+
+  struct scoring_cache_key {
+      std::uint64_t model;
+      std::uint64_t length;
+      std::uint64_t first;
+      std::uint64_t second;
+
+      scoring_cache_key(std::uint64_t fingerprint, sequence_hash const& hash) noexcept
+      : model{fingerprint}, length{hash.length()}, first{hash.first()}, second{hash.second()} {}
+
+      bool operator==(scoring_cache_key const& other) const noexcept
+      {
+        return model == other.model && length == other.length
+            && first == other.first && second == other.second;
+      }
+  };
+
+  struct scoring_cache_key_hash {
+      std::size_t operator()(scoring_cache_key const& key) const noexcept
+      {
+        return static_cast<std::size_t>(key.first ^ detail::mix64(key.model + key.length));
+      }
+  };
+
+  struct scoring_cache_statistics {
+      std::uint64_t hits = 0;             // whole sequences found
+      std::uint64_t prefix_hits = 0;      // resumed from a checkpoint
+      std::uint64_t misses = 0;           // scored from the start
+      std::uint64_t symbols_skipped = 0;  // forward steps saved by checkpoints
+      std::uint64_t symbols_scored = 0;
+  };
+
+  /**
+   * Memoizes forward results. Two caches share one byte budget each, both
+   * forget the least recently used entries first:
+   *
+   *     results       log-likelihood of whole sequences
+   *     checkpoints   scaled alpha and accumulated log-likelihood after
+   *                   every `checkpoint_every` symbols of a sequence
+   *
+   * A sequence which shares a prefix of at least `checkpoint_every` symbols
+   * with a sequence scored before resumes the forward algorithm from the
+   * last shared checkpoint. All members are safe to call from several
+   * threads; the forward steps themselves run outside of the lock.
+   *
+   * Example:
+   *
+   *     maikel::hmm::scoring_cache<double> cache;
+   *     std::uint64_t fingerprint = maikel::hmm::model_fingerprint(hmm);
+   *     double logprob = cache.log_likelihood(hmm, fingerprint, begin(seq), end(seq));
+   */
+  template <class T>
+    class scoring_cache {
+      public:
+        using model      = hidden_markov_model<T>;
+        using row_vector = typename model::row_vector;
+
+        explicit scoring_cache(
+            std::size_t result_bytes = std::size_t{16} << 20,
+            std::size_t checkpoint_bytes = std::size_t{256} << 20,
+            std::size_t checkpoint_every = 1024)
+        : results_(result_bytes), checkpoints_(checkpoint_bytes), every_{checkpoint_every}
+        {
+          Expects(checkpoint_every > 0);
+        }
+
+        std::size_t checkpoint_every() const noexcept { return every_; }
+
+        /// Cached log-likelihood of the whole sequence, if there is one.
+        bool find(std::uint64_t fingerprint, sequence_hash const& hash, T& log_likelihood)
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          T const* found = results_.find(scoring_cache_key(fingerprint, hash));
+          if (!found)
+            return false;
+          log_likelihood = *found;
+          ++statistics_.hits;
+          return true;
+        }
+
+        void insert(std::uint64_t fingerprint, sequence_hash const& hash, T log_likelihood)
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          results_.insert(scoring_cache_key(fingerprint, hash), log_likelihood, result_cost);
+        }
+
+        /// Counts a sequence which was scored without the cache, e.g. in a batch.
+        void count_miss(std::uint64_t length) noexcept
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          ++statistics_.misses;
+          statistics_.symbols_scored += length;
+        }
+
+        template <class RandomIter>
+          T log_likelihood(model const& hmm, std::uint64_t fingerprint, RandomIter first, RandomIter last)
+          {
+            std::size_t length = static_cast<std::size_t>(last - first);
+            if (length == 0)
+              return 0;
+
+            // prefix hashes at every checkpoint and of the whole sequence
+            std::vector<sequence_hash> at_checkpoint;
+            sequence_hash hash;
+            for (std::size_t t = 0; t < length; ++t) {
+              hash.push(first[t]);
+              if ((t + 1) % every_ == 0)
+                at_checkpoint.push_back(hash);
+            }
+
+            T logprob = 0;
+            std::size_t resume = 0;
+            row_vector alpha(hmm.states()), prev_alpha(hmm.states());
+            {
+              std::lock_guard<std::mutex> lock(mutex_);
+              if (T const* found = results_.find(scoring_cache_key(fingerprint, hash))) {
+                ++statistics_.hits;
+                return *found;
+              }
+              for (std::size_t c = at_checkpoint.size(); c-- > 0; ) {
+                if (checkpoint const* found = checkpoints_.find(scoring_cache_key(fingerprint, at_checkpoint[c]))) {
+                  prev_alpha = found->alpha;
+                  logprob = found->log_likelihood;
+                  resume = (c + 1)*every_;
+                  break;
+                }
+              }
+              if (resume) {
+                ++statistics_.prefix_hits;
+                statistics_.symbols_skipped += resume;
+              } else {
+                ++statistics_.misses;
+              }
+              statistics_.symbols_scored += length - resume;
+            }
+
+            std::vector<checkpoint> fresh;
+            for (std::size_t t = resume; t < length; ++t) {
+              T scaling = t == 0
+                  ? detail::forward_initial(hmm, first[t], alpha)
+                  : detail::forward_recursion(hmm, prev_alpha, first[t], alpha);
+              prev_alpha.swap(alpha);
+              logprob = scaling ? logprob - std::log(scaling) : -std::numeric_limits<T>::infinity();
+              if ((t + 1) % every_ == 0 && t + 1 < length)
+                fresh.push_back(checkpoint{prev_alpha, logprob});
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::size_t cost = checkpoint_cost + static_cast<std::size_t>(hmm.states())*sizeof(T);
+            for (std::size_t i = 0; i < fresh.size(); ++i)
+              checkpoints_.insert(scoring_cache_key(fingerprint, at_checkpoint[resume/every_ + i]),
+                                  std::move(fresh[i]), cost);
+            results_.insert(scoring_cache_key(fingerprint, hash), logprob, result_cost);
+            return logprob;
+          }
+
+        scoring_cache_statistics statistics() const
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          return statistics_;
+        }
+
+        void clear()
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          results_.clear();
+          checkpoints_.clear();
+        }
+
+      private:
+        struct checkpoint {
+            row_vector alpha;
+            T log_likelihood;
+        };
+
+        // rough bytes per entry including the list node and the hash table
+        static constexpr std::size_t result_cost = 96;
+        static constexpr std::size_t checkpoint_cost = 112;
+
+        mutable std::mutex mutex_;
+        lru_cache<scoring_cache_key, T, scoring_cache_key_hash> results_;
+        lru_cache<scoring_cache_key, checkpoint, scoring_cache_key_hash> checkpoints_;
+        std::size_t every_;
+        scoring_cache_statistics statistics_;
+    };
+
+  template <class T>
+    constexpr std::size_t scoring_cache<T>::result_cost;
+  template <class T>
+    constexpr std::size_t scoring_cache<T>::checkpoint_cost;
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_SCORING_CACHE_H_ */
@@ -0,0 +1,484 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Line based protocol of the scoring service. Every request is one line
+ * and is answered by one line which starts with "ok" or "error".
+ *
+ *     likelihood <model> <symbol>...   ok <log-likelihood>
+ *     decode <model> <symbol>...       ok <log-probability> <state>...
+ *     posterior <model> <symbol>...    ok <length> <states> <P(q_t = i | O)>...
+ *     stats                            ok <key>=<value>...
+ *     reload                           ok <number of models>
+ *
+ * Models are referred to by their name in the model bank and symbols are
+ * indices as in the text sequence files. Posteriors are written row by row.
+ */
+
+#ifndef HMM_SCORING_SERVICE_H_
+#define HMM_SCORING_SERVICE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "maikel/latency_histogram.h"
+#include "maikel/hmm/model_bank.h"
+#include "maikel/hmm/scoring_cache.h"
+#include "maikel/hmm/algorithm/batch_forward.h"
+#include "maikel/hmm/algorithm/posterior.h"
+#include "maikel/hmm/algorithm/viterbi.h"
+
+namespace maikel { namespace hmm {
+
+  struct scoring_service_options {
+      std::size_t max_batch = 256;                  // requests per batch
+      std::chrono::microseconds max_delay{100};     // to wait for a batch to fill up
+      std::size_t workers = 1;                      // threads which score batches
+      bool preload = true;                          // build all models when loading a bank
+      std::size_t cache_bytes = std::size_t{64} << 20;  // for cached results, 0 disables the cache
+      std::size_t checkpoint_every = 1024;          // symbols between cached forward coefficients
+  };
+
+  /**
+   * Keeps a model bank resident and answers requests of many clients.
+   * handle() queues a request and blocks until a worker has answered it.
+   * A worker takes everything which arrived within `max_delay` of the oldest
+   * waiting request, up to `max_batch` requests, and scores all likelihood
+   * requests for the same model with one batched forward pass and all its
+   * decode requests with one batched Viterbi pass. Posteriors need the
+   * backward pass as well and are computed one request at a time.
+   *
+   * reload() opens the bank again and swaps it in. Batches which are being
+   * scored keep the old bank until they are done. A new bank has to be
+   * renamed over the old file instead of overwriting it, since the old one
+   * is still mapped.
+   *
+   * Likelihoods are memoized in a scoring_cache which is keyed by the
+   * parameters of the models, so it stays valid across reloads. Sequences
+   * with at least `checkpoint_every` symbols are scored one by one so that
+   * they can resume from a cached prefix, shorter ones are batched.
+   *
+   * Example:
+   *
+   *     maikel::hmm::scoring_service<double> service("models.bank");
+   *     std::string answer = service.handle("likelihood customer-17 0 1 1 0");
+   */
+  template <class T>
+    class scoring_service {
+      public:
+        using bank_type = model_bank<T>;
+        using clock     = std::chrono::steady_clock;
+
+        explicit scoring_service(std::string bank_path, scoring_service_options options = {})
+        : path_{std::move(bank_path)}, options_(options)
+        {
+          options_.max_batch = std::max(options_.max_batch, std::size_t{1});
+          options_.workers = std::max(options_.workers, std::size_t{1});
+          if (options_.cache_bytes)
+            cache_.reset(new scoring_cache<T>(options_.cache_bytes / 4, options_.cache_bytes / 4 * 3,
+                                              std::max(options_.checkpoint_every, std::size_t{1})));
+          resident_ = open_bank();
+          for (std::size_t i = 0; i < options_.workers; ++i)
+            workers_.emplace_back([this] { work(); });
+        }
+
+        scoring_service(scoring_service const&) = delete;
+        scoring_service& operator=(scoring_service const&) = delete;
+
+        /// Answers the requests which are still queued and stops the workers.
+        ~scoring_service()
+        {
+          {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            stop_ = true;
+          }
+          queue_changed_.notify_all();
+          for (std::thread& worker : workers_)
+            worker.join();
+        }
+
+        std::string handle(std::string const& line)
+        {
+          clock::time_point arrival = clock::now();
+          std::unique_ptr<pending> request(new pending);
+          request->arrival = arrival;
+          std::string error = parse(line, *request);
+          if (!error.empty()) {
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            return "error " + error;
+          }
+          if (request->kind == request_kind::stats)
+            return statistics();
+          if (request->kind == request_kind::reload) {
+            try {
+              return "ok " + std::to_string(reload());
+            } catch (std::exception const& e) {
+              errors_.fetch_add(1, std::memory_order_relaxed);
+              return std::string("error ") + e.what();
+            }
+          }
+
+          std::future<std::string> answer = request->answer.get_future();
+          {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            queue_.push_back(std::move(request));
+          }
+          queue_changed_.notify_one();
+          return answer.get();
+        }
+
+        /// Opens the model bank again and returns its number of models.
+        std::size_t reload()
+        {
+          std::shared_ptr<resident_bank const> resident = open_bank();
+          std::size_t size = resident->bank.size();
+          {
+            std::lock_guard<std::mutex> lock(bank_mutex_);
+            resident_.swap(resident);
+          }
+          reloads_.fetch_add(1, std::memory_order_relaxed);
+          return size;
+        }
+
+        std::shared_ptr<bank_type const> bank() const
+        {
+          std::shared_ptr<resident_bank const> resident = this->resident();
+          return std::shared_ptr<bank_type const>(resident, &resident->bank);
+        }
+
+        /// Statistics of the result cache, all zero if it is disabled.
+        scoring_cache_statistics cache_statistics() const
+        {
+          return cache_ ? cache_->statistics() : scoring_cache_statistics{};
+        }
+
+        latency_histogram const& likelihood_latencies() const noexcept { return latencies_[0]; }
+        latency_histogram const& decode_latencies() const noexcept { return latencies_[1]; }
+        latency_histogram const& posterior_latencies() const noexcept { return latencies_[2]; }
+        std::uint64_t batches() const noexcept { return batches_.load(std::memory_order_relaxed); }
+
+        /// One line with counters, throughput and latency percentiles in microseconds.
+        std::string statistics() const
+        {
+          std::uint64_t requests = 0;
+          for (latency_histogram const& h : latencies_)
+            requests += h.count();
+          double seconds = std::chrono::duration<double>(clock::now() - started_).count();
+          std::uint64_t batches = this->batches();
+          std::ostringstream out;
+          out << "ok models=" << bank()->size()
+              << " requests=" << requests
+              << " errors=" << errors_.load(std::memory_order_relaxed)
+              << " batches=" << batches
+              << " mean_batch=" << (batches ? static_cast<double>(requests) / static_cast<double>(batches) : 0.0)
+              << " reloads=" << reloads_.load(std::memory_order_relaxed)
+              << " throughput=" << (seconds > 0 ? static_cast<double>(requests) / seconds : 0.0);
+          scoring_cache_statistics cache = cache_statistics();
+          out << " cache_hits=" << cache.hits
+              << " cache_prefix_hits=" << cache.prefix_hits
+              << " cache_misses=" << cache.misses
+              << " cache_symbols_skipped=" << cache.symbols_skipped;
+          char const* names[] = { "likelihood", "decode", "posterior" };
+          for (int k = 0; k < 3; ++k) {
+            latency_histogram const& h = latencies_[k];
+            out << ' ' << names[k] << "_count=" << h.count()
+                << ' ' << names[k] << "_p50_us=" << static_cast<double>(h.percentile(0.5)) / 1000
+                << ' ' << names[k] << "_p99_us=" << static_cast<double>(h.percentile(0.99)) / 1000
+                << ' ' << names[k] << "_max_us=" << static_cast<double>(h.max()) / 1000;
+          }
+          return out.str();
+        }
+
+      private:
+        enum class request_kind { likelihood = 0, decode = 1, posterior = 2, stats, reload };
+
+        struct pending {
+            request_kind kind;
+            std::string model;
+            std::vector<std::uint32_t> symbols;
+            clock::time_point arrival;
+            std::promise<std::string> answer;
+        };
+
+        std::string path_;
+        scoring_service_options options_;
+        clock::time_point started_ = clock::now();
+
+        struct resident_bank {
+            explicit resident_bank(std::string const& path): bank(path) {}
+            bank_type bank;
+            std::vector<std::uint64_t> fingerprints;
+        };
+
+        mutable std::mutex bank_mutex_;
+        std::shared_ptr<resident_bank const> resident_;
+        std::unique_ptr<scoring_cache<T>> cache_;
+
+        std::mutex queue_mutex_;
+        std::condition_variable queue_changed_;
+        std::deque<std::unique_ptr<pending>> queue_;
+        bool stop_ = false;
+        std::vector<std::thread> workers_;
+
+        latency_histogram latencies_[3];
+        std::atomic<std::uint64_t> errors_{0};
+        std::atomic<std::uint64_t> batches_{0};
+        std::atomic<std::uint64_t> reloads_{0};
+
+        std::shared_ptr<resident_bank const> open_bank() const
+        {
+          std::shared_ptr<resident_bank> resident = std::make_shared<resident_bank>(path_);
+          bank_type const& bank = resident->bank;
+          for (std::size_t i = 0; i < bank.size(); ++i) {
+            if (options_.preload)
+              bank[i];
+            if (cache_) {
+              auto p = bank.parameters(i);
+              resident->fingerprints.push_back(model_fingerprint(p.A, p.B, p.pi));
+            }
+          }
+          return resident;
+        }
+
+        std::shared_ptr<resident_bank const> resident() const
+        {
+          std::lock_guard<std::mutex> lock(bank_mutex_);
+          return resident_;
+        }
+
+        static std::string parse(std::string const& line, pending& request)
+        {
+          std::istringstream in(line);
+          std::string command;
+          if (!(in >> command))
+            return "empty request";
+          if (command == "stats") {
+            request.kind = request_kind::stats;
+            return {};
+          }
+          if (command == "reload") {
+            request.kind = request_kind::reload;
+            return {};
+          }
+          if (command == "likelihood")
+            request.kind = request_kind::likelihood;
+          else if (command == "decode")
+            request.kind = request_kind::decode;
+          else if (command == "posterior")
+            request.kind = request_kind::posterior;
+          else
+            return "unknown request " + command;
+          if (!(in >> request.model))
+            return "missing model name";
+          long long symbol;
+          while (in >> symbol) {
+            if (symbol < 0 || symbol > std::numeric_limits<std::uint32_t>::max())
+              return "symbol out of range";
+            request.symbols.push_back(static_cast<std::uint32_t>(symbol));
+          }
+          if (!in.eof())
+            return "symbols have to be non-negative integers";
+          return {};
+        }
+
+        void work()
+        {
+          std::unique_lock<std::mutex> lock(queue_mutex_);
+          while (true) {
+            queue_changed_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty())
+              return;
+            clock::time_point deadline = queue_.front()->arrival + options_.max_delay;
+            queue_changed_.wait_until(lock, deadline, [this] {
+              return stop_ || queue_.size() >= options_.max_batch;
+            });
+            std::vector<std::unique_ptr<pending>> batch;
+            while (!queue_.empty() && batch.size() < options_.max_batch) {
+              batch.push_back(std::move(queue_.front()));
+              queue_.pop_front();
+            }
+            if (!queue_.empty())
+              queue_changed_.notify_one();
+            lock.unlock();
+            process(batch);
+            lock.lock();
+          }
+        }
+
+        void answer(pending& request, std::string text)
+        {
+          if (text.compare(0, 5, "error") == 0)
+            errors_.fetch_add(1, std::memory_order_relaxed);
+          else
+            latencies_[static_cast<int>(request.kind)].record(clock::now() - request.arrival);
+          request.answer.set_value(std::move(text));
+        }
+
+        void process(std::vector<std::unique_ptr<pending>>& batch)
+        {
+          std::shared_ptr<resident_bank const> resident = this->resident();
+          bank_type const& bank = resident->bank;
+          batches_.fetch_add(1, std::memory_order_relaxed);
+
+          // likelihood and decode requests grouped by model
+          std::map<std::size_t, std::vector<pending*>> likelihoods;
+          std::map<std::size_t, std::vector<pending*>> decodes;
+          for (std::unique_ptr<pending>& request : batch) {
+            try {
+              std::size_t k = bank.find(request->model);
+              if (k == bank_type::npos) {
+                answer(*request, "error unknown model " + request->model);
+                continue;
+              }
+              std::size_t symbols = bank.symbols(k);
+              if (std::any_of(request->symbols.begin(), request->symbols.end(),
+                    [symbols] (std::uint32_t s) { return s >= symbols; })) {
+                answer(*request, "error symbol out of range for model " + request->model);
+                continue;
+              }
+              if (request->kind == request_kind::decode) {
+                decodes[k].push_back(request.get());
+                continue;
+              }
+              if (request->kind == request_kind::posterior) {
+                answer(*request, posterior_answer(bank[k], request->symbols));
+                continue;
+              }
+              if (cache_) {
+                std::vector<std::uint32_t> const& sequence = request->symbols;
+                if (sequence.size() >= cache_->checkpoint_every()) {
+                  T logprob = cache_->log_likelihood(bank[k], resident->fingerprints[k], sequence.begin(), sequence.end());
+                  answer(*request, "ok " + format(logprob));
+                  continue;
+                }
+                T logprob;
+                if (cache_->find(resident->fingerprints[k], hash_of(sequence), logprob)) {
+                  answer(*request, "ok " + format(logprob));
+                  continue;
+                }
+              }
+              likelihoods[k].push_back(request.get());
+            } catch (...) {
+              answer(*request, current_error());
+            }
+          }
+
+          for (auto& group : likelihoods) {
+            std::vector<std::vector<std::uint32_t>> sequences;
+            for (pending* request : group.second)
+              sequences.push_back(std::move(request->symbols));
+            std::vector<T> logprobs;
+            try {
+              logprobs = batch_log_likelihoods(sequences, bank[group.first]);
+            } catch (...) {
+              std::string error = current_error();
+              for (pending* request : group.second)
+                answer(*request, error);
+              continue;
+            }
+            for (std::size_t i = 0; i < logprobs.size(); ++i) {
+              if (cache_) {
+                cache_->count_miss(sequences[i].size());
+                cache_->insert(resident->fingerprints[group.first], hash_of(sequences[i]), logprobs[i]);
+              }
+              answer(*group.second[i], "ok " + format(logprobs[i]));
+            }
+          }
+
+          for (auto& group : decodes) {
+            std::vector<std::vector<std::uint32_t>> sequences;
+            for (pending* request : group.second)
+              sequences.push_back(std::move(request->symbols));
+            std::vector<viterbi_result<T>> paths;
+            try {
+              paths = batch_viterbi(sequences, bank[group.first]);
+            } catch (...) {
+              std::string error = current_error();
+              for (pending* request : group.second)
+                answer(*request, error);
+              continue;
+            }
+            for (std::size_t i = 0; i < paths.size(); ++i)
+              answer(*group.second[i], decode_answer(paths[i]));
+          }
+        }
+
+        /// The answer to a request whose scoring threw, called from a catch block.
+        static std::string current_error()
+        {
+          try {
+            throw;
+          } catch (std::exception const& e) {
+            return std::string("error ") + e.what();
+          } catch (...) {
+            return "error unknown failure";
+          }
+        }
+
+        static sequence_hash hash_of(std::vector<std::uint32_t> const& sequence) noexcept
+        {
+          sequence_hash hash;
+          for (std::uint32_t s : sequence)
+            hash.push(s);
+          return hash;
+        }
+
+        static std::string decode_answer(viterbi_result<T> const& path)
+        {
+          std::string text = "ok " + format(path.log_probability);
+          for (std::uint32_t state : path.states)
+            text += ' ' + std::to_string(state);
+          return text;
+        }
+
+        static std::string posterior_answer(hidden_markov_model<T> const& hmm,
+            std::vector<std::uint32_t> const& symbols)
+        {
+          typename hidden_markov_model<T>::matrix gamma = posteriors(symbols.begin(), symbols.end(), hmm);
+          std::string text = "ok " + std::to_string(gamma.rows()) + ' ' + std::to_string(gamma.cols());
+          for (typename hidden_markov_model<T>::size_type t = 0; t < gamma.rows(); ++t)
+            for (typename hidden_markov_model<T>::size_type i = 0; i < gamma.cols(); ++i)
+              text += ' ' + format(gamma(t, i));
+          return text;
+        }
+
+        static std::string format(T value)
+        {
+          char buffer[32];
+          std::snprintf(buffer, sizeof(buffer), "%.*g", std::numeric_limits<T>::max_digits10,
+              static_cast<double>(value));
+          return buffer;
+        }
+    };
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_SCORING_SERVICE_H_ */
@@ -17,12 +17,27 @@
 #ifndef HMM_SEQUENCE_GENERATOR_H_
 #define HMM_SEQUENCE_GENERATOR_H_
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <random>
+#include <thread>
+#include <vector>
+
 #include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/random.h"
 
 namespace maikel { namespace hmm {
 
   namespace detail {
+    /**
+     * Generates observations from a hidden markov model. Each state and
+     * symbol is drawn from an alias table in O(1). The random numbers are
+     * taken from a counter based engine such that step t always uses the
+     * numbers 2t (transition) and 2t+1 (emission) of the stream. Hence the
+     * output only depends on the seed, no matter whether it is produced by
+     * operator() or by generate() with any number of threads.
+     */
     template <class float_type>
       class sequence_generator {
         public:
@@ -33,68 +48,183 @@ namespace maikel { namespace hmm {
           using matrix      = typename hmm::matrix;
           using row_vector  = typename hmm::row_vector;
 
+          /// Symbols per unit of work in generate(). It does not depend on
+          /// the number of threads, which keeps the output reproducible.
+          static const std::size_t chunk_length = std::size_t{1} << 16;
+
         private:
           // random device stuff
-          std::default_random_engine m_engine;
-          std::uniform_real_distribution<float_type> m_uniform {0, 1};
+          counter_based_engine m_engine;
+          alias_table m_initial;
+          std::vector<alias_table> m_transition;
+          std::vector<alias_table> m_emission;
           // current context variables
-          hmm const& m_hmm;
-          state_type m_current_state;
+          std::uint64_t m_position = 0;
+          state_type m_current_state = 0;
+          std::uint64_t m_repaired_steps = 0;
 
         public:
           explicit sequence_generator(hmm const& hmm)
-          : m_engine(std::random_device()()), m_hmm(hmm)
+          : sequence_generator(hmm, std::random_device()())
+          {}
+
+          sequence_generator(hmm const& hmm, std::uint64_t seed)
+          : m_engine(seed), m_initial(hmm.initial_distribution())
           {
-            float_type X = m_uniform(m_engine);
-            m_current_state = find_by_distribution(m_hmm.initial_distribution(), X);;
+            matrix const& A = hmm.transition_matrix();
+            matrix const& B = hmm.symbol_probabilities();
+            m_transition.reserve(hmm.states());
+            m_emission.reserve(hmm.states());
+            for (index_type i = 0; i < hmm.states(); ++i) {
+              m_transition.emplace_back(A.row(i));
+              m_emission.emplace_back(B.row(i));
+            }
           }
 
           symbol_type operator()() noexcept
           {
-            float_type X = m_uniform(m_engine);
-            // get next symbol
-            symbol_type symbol =
-                find_by_distribution(m_hmm.symbol_probabilities(), m_current_state, X);
-            // advance a state
-            m_current_state =
-                find_by_distribution(m_hmm.transition_matrix(), m_current_state, X);
+            m_current_state = next_state(m_current_state, m_position);
+            symbol_type symbol = emit(m_current_state, m_position);
+            ++m_position;
             return symbol;
           }
 
-        private:
-          index_type
-          find_by_distribution(row_vector const& dist, float_type X)
-          noexcept
+          /// Returns the hidden state which emitted the latest symbol.
+          state_type state() const noexcept
+          {
+            return m_current_state;
+          }
+
+          /// Returns the number of symbols generated so far.
+          std::uint64_t position() const noexcept
+          {
+            return m_position;
+          }
+
+          /// Returns the number of steps the last generate() redid serially.
+          std::uint64_t repaired_steps() const noexcept
+          {
+            return m_repaired_steps;
+          }
+
+          /**
+           * Generates the next `n` symbols into `symbols` and their hidden
+           * states into `states`, using up to `threads` threads.
+           *
+           * Every chunk is first generated speculatively, starting from a
+           * guessed state. Then the chunks are repaired in order from the true
+           * state at their beginning. Since two paths which reach the same
+           * state at the same time use the same random numbers from there on,
+           * a repair stops as soon as the path merges with the speculation.
+           *
+           * The speed-up relies on the chain mixing, so that the guessed and
+           * the true path meet early in a chunk. A periodic or reducible
+           * chain may never let them meet. If a repair reaches the end of
+           * its chunk, the rest of the sequence is generated serially and
+           * the remaining speculation is dropped, so the serial part never
+           * takes more than n steps. With one thread nothing is speculated.
+           */
+          template <class SymbolOut, class StateOut>
+            std::pair<SymbolOut, StateOut>
+            generate(std::size_t n, SymbolOut symbols, StateOut states,
+                unsigned threads = std::thread::hardware_concurrency())
+            {
+              std::vector<std::uint32_t> symbol_buffer(n);
+              std::vector<std::uint32_t> state_buffer(n);
+              generate_into(n, symbol_buffer.data(), state_buffer.data(), threads);
+              return { std::copy(symbol_buffer.begin(), symbol_buffer.end(), symbols),
+                       std::copy(state_buffer.begin(), state_buffer.end(), states) };
+            }
+
+          template <class SymbolOut>
+            SymbolOut
+            generate(std::size_t n, SymbolOut symbols,
+                unsigned threads = std::thread::hardware_concurrency())
+            {
+              std::vector<std::uint32_t> symbol_buffer(n);
+              std::vector<std::uint32_t> state_buffer(n);
+              generate_into(n, symbol_buffer.data(), state_buffer.data(), threads);
+              return std::copy(symbol_buffer.begin(), symbol_buffer.end(), symbols);
+            }
+
+          /**
+           * Same as generate() but writes into plain arrays of length `n`.
+           */
+          void generate_into(std::size_t n, std::uint32_t* symbols, std::uint32_t* states,
+              unsigned threads = std::thread::hardware_concurrency())
           {
-            float_type P_fn = 0;
-            index_type state = 0;
-            index_type max = dist.size();
-            while (state < max) {
-              P_fn += dist(state);
-              if (P_fn < X)
-                ++state;
-              else
+            m_repaired_steps = 0;
+            if (n == 0)
+              return;
+            std::size_t chunks = (n + chunk_length - 1) / chunk_length;
+            threads = std::max(1u, std::min<unsigned>(threads, chunks));
+            if (threads == 1) {
+              run(m_current_state, 0, n, symbols, states);
+              m_current_state = states[n-1];
+              m_position += n;
+              return;
+            }
+
+            // speculative pass, the first chunk starts from the true state
+            auto speculate = [&](unsigned id) {
+              for (std::size_t c = id; c < chunks; c += threads) {
+                std::size_t first = c*chunk_length;
+                std::size_t last = std::min(n, first + chunk_length);
+                state_type state = c == 0 ? m_current_state : 0;
+                run(state, first, last, symbols, states);
+              }
+            };
+            std::vector<std::thread> workers;
+            for (unsigned id = 0; id < threads; ++id)
+              workers.emplace_back(speculate, id);
+            for (std::thread& worker : workers)
+              worker.join();
+
+            // repair pass
+            for (std::size_t c = 1; c < chunks; ++c) {
+              std::size_t t = c*chunk_length;
+              std::size_t last = std::min(n, t + chunk_length);
+              state_type state = states[t-1];
+              for (; t < last; ++t) {
+                ++m_repaired_steps;
+                state = next_state(state, m_position + t);
+                if (state == states[t])
+                  break;
+                states[t] = static_cast<std::uint32_t>(state);
+                symbols[t] = static_cast<std::uint32_t>(emit(state, m_position + t));
+              }
+              if (t == last) {
+                // the paths did not meet within a chunk, the later guesses are not trusted either
+                run(state, last, n, symbols, states);
+                m_repaired_steps += n - last;
                 break;
+              }
             }
-            return state;
+
+            m_current_state = states[n-1];
+            m_position += n;
           }
 
-          index_type
-          find_by_distribution(matrix const& dist, index_type row, float_type X)
-          noexcept
+        private:
+          state_type next_state(state_type state, std::uint64_t t) const noexcept
           {
-            Expects(row < dist.rows());
-            float_type P_fn = 0;
-            index_type state = 0;
-            index_type cols = dist.cols();
-            while (state < cols) {
-              P_fn += dist(row, state);
-              if (P_fn < X)
-                ++state;
-              else
-                break;
+            std::uint64_t bits = m_engine.at(2*t);
+            return t == 0 ? m_initial(bits) : m_transition[state](bits);
+          }
+
+          symbol_type emit(state_type state, std::uint64_t t) const noexcept
+          {
+            return m_emission[state](m_engine.at(2*t + 1));
+          }
+
+          void run(state_type state, std::size_t first, std::size_t last,
+              std::uint32_t* symbols, std::uint32_t* states) const noexcept
+          {
+            for (std::size_t t = first; t < last; ++t) {
+              state = next_state(state, m_position + t);
+              states[t] = static_cast<std::uint32_t>(state);
+              symbols[t] = static_cast<std::uint32_t>(emit(state, m_position + t));
             }
-            return state;
           }
       };
   } // namespace detail
@@ -106,6 +236,44 @@ namespace maikel { namespace hmm {
       return detail::sequence_generator<float_type>(hmm);
     }
 
+  template <class float_type>
+    detail::sequence_generator<float_type>
+    make_sequence_generator(hidden_markov_model<float_type> const& hmm, std::uint64_t seed)
+    {
+      return detail::sequence_generator<float_type>(hmm, seed);
+    }
+
+  /**
+   * A model with every row of A, B and pi drawn uniformly from the simplex,
+   * which only depends on the seed. Benchmarks and tests use it to get
+   * models of any size without model files.
+   */
+  template <class float_type>
+    hidden_markov_model<float_type>
+    random_hidden_markov_model(
+        typename hidden_markov_model<float_type>::size_type states,
+        typename hidden_markov_model<float_type>::size_type symbols,
+        std::uint64_t seed)
+    {
+      Expects(states > 0 && symbols > 0);
+      using matrix = typename hidden_markov_model<float_type>::matrix;
+      using row_vector = typename hidden_markov_model<float_type>::row_vector;
+      counter_based_engine engine(seed);
+      // normalized exponential variates are uniform on the simplex
+      auto simplex_rows = [&engine] (matrix& m) {
+        for (typename matrix::Index i = 0; i < m.rows(); ++i) {
+          for (typename matrix::Index j = 0; j < m.cols(); ++j)
+            m(i, j) = static_cast<float_type>(-std::log1p(-uniform_from_bits<double>(engine())));
+          m.row(i) /= m.row(i).sum();
+        }
+      };
+      matrix A(states, states), B(states, symbols), pi(1, states);
+      simplex_rows(A);
+      simplex_rows(B);
+      simplex_rows(pi);
+      return hidden_markov_model<float_type>(A, B, row_vector(pi));
+    }
+
 } // namespace hmm
 } // namespace maikel
 
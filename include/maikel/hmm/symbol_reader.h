@@ -0,0 +1,304 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_SYMBOL_READER_H_
+#define HMM_SYMBOL_READER_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gsl_assert.h>
+
+#include "maikel/hmm/binary_sequence.h"
+#include "maikel/hmm/packed_sequence.h"
+
+namespace maikel { namespace hmm {
+
+  struct symbol_reader_error: public std::runtime_error {
+      symbol_reader_error(std::string s): std::runtime_error(s) {}
+  };
+
+  /**
+   * Reads a sequence in chunks from a file or from stdin ("-") without ever
+   * holding the whole sequence. Both formats of generate_sequence are
+   * understood and told apart by the first bytes:
+   *
+   *  - packed binary sequences (see binary_sequence.h) and
+   *  - text with a line of integer symbols, a line with the length and the
+   *    whitespace separated symbols.
+   *
+   * The text parser only handles integer symbols, which it maps to their
+   * position in the symbol line with a lookup table.
+   *
+   * Example:
+   *
+   *     maikel::hmm::symbol_reader reader("-");
+   *     std::vector<maikel::hmm::packed_symbol> chunk(1 << 16);
+   *     while (std::size_t n = reader.read(chunk.data(), chunk.size()))
+   *       scorer.push(chunk.begin(), chunk.begin() + n);
+   */
+  class symbol_reader {
+    public:
+      static const std::size_t default_buffer_bytes = std::size_t{1} << 20;
+
+      explicit symbol_reader(std::string const& path,
+          std::size_t buffer_bytes = default_buffer_bytes)
+      : buffer_(std::max(buffer_bytes, sizeof(packed_sequence_header)))
+      {
+        if (path == "-") {
+          fd_ = STDIN_FILENO;
+        } else {
+          fd_ = ::open(path.c_str(), O_RDONLY);
+          if (fd_ < 0)
+            throw symbol_reader_error("Could not open " + path + ": " + std::strerror(errno));
+          owns_fd_ = true;
+#ifdef POSIX_FADV_SEQUENTIAL
+          ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        }
+        try {
+          read_header();
+        } catch (...) {
+          if (owns_fd_)
+            ::close(fd_);
+          throw;
+        }
+      }
+
+      symbol_reader(symbol_reader const&) = delete;
+      symbol_reader& operator=(symbol_reader const&) = delete;
+
+      ~symbol_reader() noexcept
+      {
+        if (owns_fd_)
+          ::close(fd_);
+      }
+
+      bool is_binary() const noexcept { return binary_; }
+
+      /// Size of the alphabet.
+      std::size_t symbols() const noexcept { return symbols_; }
+
+      /// Length stated in the header. The text format does not enforce it.
+      std::uint64_t announced_length() const noexcept { return length_; }
+
+      /// Number of symbols returned by read() so far.
+      std::uint64_t position() const noexcept { return position_; }
+
+      /**
+       * Writes up to `max` symbols to `out` and returns their number. Returns
+       * zero only at the end of the input.
+       */
+      std::size_t read(packed_symbol* out, std::size_t max)
+      {
+        std::size_t n = binary_ ? read_binary(out, max) : read_text(out, max);
+        position_ += n;
+        return n;
+      }
+
+    private:
+      int fd_ = -1;
+      bool owns_fd_ = false;
+      bool binary_ = false;
+      bool eof_ = false;
+      std::vector<char> buffer_;
+      std::size_t begin_ = 0;
+      std::size_t end_ = 0;
+      std::size_t symbols_ = 0;
+      std::uint64_t length_ = 0;
+      std::uint64_t position_ = 0;
+
+      // binary state
+      unsigned bits_ = 0;
+      unsigned per_word_ = 0;
+      std::uint64_t word_ = 0;
+      unsigned offset_ = 0;
+
+      // text state, maps integer symbols to their indices
+      std::vector<int> index_of_;
+
+      // moves unread bytes to the front and fills the rest of the buffer
+      bool refill()
+      {
+        if (eof_)
+          return false;
+        if (begin_ > 0) {
+          std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+          end_ -= begin_;
+          begin_ = 0;
+        }
+        while (end_ < buffer_.size()) {
+          ssize_t n = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+          if (n < 0 && errno == EINTR)
+            continue;
+          if (n < 0)
+            throw symbol_reader_error(std::string("Could not read the sequence: ") + std::strerror(errno));
+          if (n == 0) {
+            eof_ = true;
+            break;
+          }
+          end_ += static_cast<std::size_t>(n);
+          if (end_ - begin_ >= sizeof(std::uint64_t))
+            break;
+        }
+        return end_ > begin_;
+      }
+
+      bool available(std::size_t bytes)
+      {
+        while (end_ - begin_ < bytes)
+          if (!refill() || eof_)
+            return end_ - begin_ >= bytes;
+        return true;
+      }
+
+      void read_header()
+      {
+        available(sizeof(packed_sequence_header));
+        if (end_ - begin_ >= sizeof(packed_sequence_magic) &&
+            !std::memcmp(buffer_.data() + begin_, packed_sequence_magic, sizeof(packed_sequence_magic))) {
+          if (!available(sizeof(packed_sequence_header)))
+            throw symbol_reader_error("Could not read the header of a packed sequence.");
+          packed_sequence_header header;
+          std::memcpy(&header, buffer_.data() + begin_, sizeof(header));
+          begin_ += sizeof(header);
+          if (header.bits != bits_per_symbol(header.symbols))
+            throw symbol_reader_error("Bits per symbol do not match the alphabet size.");
+          binary_ = true;
+          symbols_ = header.symbols;
+          length_ = header.length;
+          bits_ = header.bits;
+          per_word_ = 64 / bits_;
+          offset_ = per_word_;
+          return;
+        }
+        std::vector<std::uint64_t> line;
+        if (!read_line(line) || line.empty())
+          throw symbol_reader_error("Could not read the symbol line.");
+        for (std::size_t i = 0; i < line.size(); ++i) {
+          if (line[i] > std::numeric_limits<packed_symbol>::max())
+            throw symbol_reader_error("Symbol " + std::to_string(line[i]) + " is too large.");
+          if (line[i] >= index_of_.size())
+            index_of_.resize(line[i] + 1, -1);
+          if (index_of_[line[i]] < 0)
+            index_of_[line[i]] = static_cast<int>(symbols_++);
+        }
+        if (!read_line(line) || line.size() != 1)
+          throw symbol_reader_error("Could not read the sequence length.");
+        length_ = line[0];
+      }
+
+      // parses one line of unsigned integers
+      bool read_line(std::vector<std::uint64_t>& values)
+      {
+        values.clear();
+        bool in_number = false;
+        std::uint64_t value = 0;
+        for (;;) {
+          if (begin_ == end_ && !refill())
+            break;
+          char c = buffer_[begin_++];
+          if (c >= '0' && c <= '9') {
+            value = 10*value + static_cast<std::uint64_t>(c - '0');
+            in_number = true;
+            continue;
+          }
+          if (in_number)
+            values.push_back(value);
+          in_number = false;
+          value = 0;
+          if (c == '\n')
+            return true;
+          if (c != ' ' && c != '\t' && c != '\r')
+            throw symbol_reader_error("Only integer symbols can be read as a stream.");
+        }
+        if (in_number)
+          values.push_back(value);
+        return !values.empty();
+      }
+
+      std::size_t read_text(packed_symbol* out, std::size_t max)
+      {
+        std::size_t n = 0;
+        std::uint64_t value = 0;
+        bool in_number = false;
+        while (n < max) {
+          if (begin_ == end_ && !refill())
+            break;
+          // scan the buffered bytes without further checks for refills
+          char const* p = buffer_.data() + begin_;
+          char const* last = buffer_.data() + end_;
+          while (p != last && n < max) {
+            char c = *p++;
+            if (static_cast<unsigned char>(c - '0') < 10) {
+              value = 10*value + static_cast<std::uint64_t>(c - '0');
+              in_number = true;
+            } else if (in_number) {
+              out[n++] = index_of(value);
+              value = 0;
+              in_number = false;
+            } else if (c != ' ' && c != '\n' && c != '\t' && c != '\r') {
+              throw symbol_reader_error("Only integer symbols can be read as a stream.");
+            }
+          }
+          begin_ = static_cast<std::size_t>(p - buffer_.data());
+        }
+        // numbers are only cut off by a refill, so this is the last one
+        if (in_number)
+          out[n++] = index_of(value);
+        return n;
+      }
+
+      packed_symbol index_of(std::uint64_t value) const
+      {
+        if (value >= index_of_.size() || index_of_[value] < 0)
+          throw symbol_reader_error("Unknown symbol " + std::to_string(value) + " in input.");
+        return static_cast<packed_symbol>(index_of_[value]);
+      }
+
+      std::size_t read_binary(packed_symbol* out, std::size_t max)
+      {
+        const std::uint64_t mask = (std::uint64_t{1} << bits_) - 1;
+        std::size_t n = static_cast<std::size_t>(
+            std::min<std::uint64_t>(max, length_ - position_));
+        for (std::size_t k = 0; k < n; ++k) {
+          if (offset_ == per_word_) {
+            if (!available(sizeof(std::uint64_t)))
+              throw symbol_reader_error("Packed sequence is shorter than its header claims.");
+            std::memcpy(&word_, buffer_.data() + begin_, sizeof(word_));
+            begin_ += sizeof(word_);
+            offset_ = 0;
+          }
+          out[k] = static_cast<packed_symbol>((word_ >> (offset_*bits_)) & mask);
+          ++offset_;
+        }
+        return n;
+      }
+  };
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_SYMBOL_READER_H_ */
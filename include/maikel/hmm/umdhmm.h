@@ -0,0 +1,163 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HMM_UMDHMM_H_
+#define HMM_UMDHMM_H_
+
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gsl_assert.h>
+#include <gsl_util.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+
+namespace maikel { namespace hmm {
+
+  /**
+   * Conversions between our model and sequence files and those of UMDHMM
+   * (third_party/umdhmm-v1.02). UMDHMM writes a model as
+   *
+   *     M= <symbols>
+   *     N= <states>
+   *     A:
+   *     <N rows of N numbers>
+   *     B:
+   *     <N rows of M numbers>
+   *     pi:
+   *     <N numbers>
+   *
+   * and a sequence as "T= <length>" followed by the symbols, which count
+   * from 1. Some of its sample sequences start with an "R= 1" line, which
+   * is skipped.
+   */
+  struct umdhmm_format_error: public std::runtime_error {
+      umdhmm_format_error(std::string s): std::runtime_error(s) {}
+  };
+
+  namespace detail {
+    inline void expect_umdhmm_label(std::istream& in, std::string const& label)
+    {
+      std::string word;
+      if (!(in >> word) || word != label)
+        throw umdhmm_format_error("Expected '" + label + "' but read '" + word + "'.");
+    }
+
+    template <class Matrix>
+      void read_umdhmm_rows(std::istream& in, Matrix& m)
+      {
+        for (typename Matrix::Index i = 0; i < m.rows(); ++i) {
+          for (typename Matrix::Index j = 0; j < m.cols(); ++j)
+            if (!(in >> m(i, j)))
+              throw umdhmm_format_error("Could not read the entries of a matrix.");
+          m.row(i) /= m.row(i).sum();
+        }
+      }
+
+    template <class Matrix>
+      void write_umdhmm_rows(std::ostream& out, Matrix const& m)
+      {
+        for (typename Matrix::Index i = 0; i < m.rows(); ++i) {
+          for (typename Matrix::Index j = 0; j < m.cols(); ++j)
+            out << (j ? " " : "") << m(i, j);
+          out << '\n';
+        }
+      }
+  }
+
+  /// Reads a UMDHMM model. Rows are normalized like read_hidden_markov_model() does.
+  template <class T>
+    hidden_markov_model<T> read_umdhmm_model(std::istream& in)
+    {
+      using matrix = typename hidden_markov_model<T>::matrix;
+      using row_vector = typename hidden_markov_model<T>::row_vector;
+      long symbols = 0, states = 0;
+      detail::expect_umdhmm_label(in, "M=");
+      if (!(in >> symbols) || symbols <= 0)
+        throw umdhmm_format_error("Could not read the number of symbols.");
+      detail::expect_umdhmm_label(in, "N=");
+      if (!(in >> states) || states <= 0)
+        throw umdhmm_format_error("Could not read the number of states.");
+      matrix A(states, states), B(states, symbols);
+      row_vector pi(states);
+      detail::expect_umdhmm_label(in, "A:");
+      detail::read_umdhmm_rows(in, A);
+      detail::expect_umdhmm_label(in, "B:");
+      detail::read_umdhmm_rows(in, B);
+      detail::expect_umdhmm_label(in, "pi:");
+      detail::read_umdhmm_rows(in, pi);
+      return hidden_markov_model<T>(A, B, pi);
+    }
+
+  /// Writes a model such that UMDHMM reads back the same numbers.
+  template <class T>
+    void write_umdhmm_model(std::ostream& out, hidden_markov_model<T> const& hmm)
+    {
+      std::streamsize precision = out.precision(std::numeric_limits<T>::max_digits10);
+      out << "M= " << hmm.symbols() << "\nN= " << hmm.states() << "\nA:\n";
+      detail::write_umdhmm_rows(out, hmm.transition_matrix());
+      out << "B:\n";
+      detail::write_umdhmm_rows(out, hmm.symbol_probabilities());
+      out << "pi:\n";
+      detail::write_umdhmm_rows(out, hmm.initial_distribution());
+      out.precision(precision);
+    }
+
+  /// Reads a UMDHMM sequence and returns its symbols counted from 0.
+  inline std::vector<std::uint32_t> read_umdhmm_sequence(std::istream& in)
+  {
+    std::string label;
+    long length = 0;
+    if (!(in >> label))
+      throw umdhmm_format_error("The sequence is empty.");
+    if (label == "R=") {
+      long runs;
+      if (!(in >> runs >> label))
+        throw umdhmm_format_error("Could not read the number of sequences.");
+    }
+    if (label != "T=" || !(in >> length) || length <= 0)
+      throw umdhmm_format_error("Could not read the length of the sequence.");
+    std::vector<std::uint32_t> sequence;
+    sequence.reserve(gsl::narrow<std::size_t>(length));
+    for (long t = 0; t < length; ++t) {
+      long symbol;
+      if (!(in >> symbol) || symbol < 1)
+        throw umdhmm_format_error("Could not read the symbols of the sequence.");
+      sequence.push_back(gsl::narrow<std::uint32_t>(symbol - 1));
+    }
+    return sequence;
+  }
+
+  template <class InputIter>
+    void write_umdhmm_sequence(std::ostream& out, InputIter first, InputIter last)
+    {
+      std::ostringstream symbols;
+      long length = 0;
+      for (; first != last; ++first, ++length)
+        symbols << static_cast<long>(*first) + 1 << ' ';
+      out << "T= " << length << '\n' << symbols.str() << '\n';
+    }
+
+} // namespace hmm
+} // namespace maikel
+
+#endif /* HMM_UMDHMM_H_ */
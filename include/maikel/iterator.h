@@ -3,5 +3,7 @@
 
 #include "maikel/iterator/ostream_binary_iterator.h"
 #include "maikel/iterator/istream_binary_iterator.h"
+#include "maikel/iterator/mapped_coefficients.h"
+#include "maikel/iterator/reverse_block_reader.h"
 
 #endif /* ITERATOR_H_ */
@@ -0,0 +1,370 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_MAIKEL_ITERATOR_ASYNC_BINARY_WRITER_H_
+#define INCLUDE_MAIKEL_ITERATOR_ASYNC_BINARY_WRITER_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <Eigen/Dense>
+#include <gsl_assert.h>
+
+namespace maikel {
+
+  struct async_writer_error: public std::runtime_error {
+      async_writer_error(std::string s): std::runtime_error(s) {}
+  };
+
+  /**
+   * Binary file sink which hands full buffers to a background thread. The
+   * producer only blocks if all buffers are waiting to be written, so with
+   * two or three buffers the computation overlaps with the disk.
+   *
+   * With `direct` the file is opened with O_DIRECT where the file system
+   * supports it. Buffers are then aligned to and written in multiples of
+   * 4096 bytes and only the last partial block is written without O_DIRECT.
+   * An error of the background thread is rethrown by the next write(),
+   * flush() or close().
+   *
+   * Example:
+   *
+   *     maikel::async_binary_writer alphas("alphas.dat");
+   *     std::copy(first, last, maikel::async_binary_output_iterator<double>(alphas));
+   */
+  class async_binary_writer {
+    public:
+      static const std::size_t block_size = 4096;
+      static const std::size_t default_buffer_bytes = std::size_t{1} << 22;
+
+      explicit async_binary_writer(std::string const& path,
+          std::size_t buffer_bytes = default_buffer_bytes,
+          std::size_t buffers = 2, bool direct = false)
+      : buffer_bytes_{round_up(std::max(buffer_bytes, std::size_t{block_size}))}
+      {
+        Expects(buffers >= 2);
+        open(path, direct);
+        try {
+          memory_.reserve(buffers);
+          for (std::size_t i = 0; i < buffers; ++i) {
+            void* memory = nullptr;
+            if (::posix_memalign(&memory, block_size, buffer_bytes_))
+              throw std::bad_alloc();
+            memory_.push_back(static_cast<char*>(memory));
+          }
+          current_ = memory_[0];
+          for (std::size_t i = 1; i < buffers; ++i)
+            free_.push_back(memory_[i]);
+          writer_ = std::thread(&async_binary_writer::run, this);
+        } catch (...) {
+          // the destructor does not run for a constructor which throws
+          release();
+          ::close(fd_);
+          throw;
+        }
+      }
+
+      async_binary_writer(async_binary_writer const&) = delete;
+      async_binary_writer& operator=(async_binary_writer const&) = delete;
+
+      ~async_binary_writer() noexcept
+      {
+        try {
+          close();
+        } catch (...) {
+        }
+        release();
+      }
+
+      void write(void const* data, std::size_t bytes)
+      {
+        Expects(is_open_);
+        char const* begin = static_cast<char const*>(data);
+        while (bytes) {
+          std::size_t n = std::min(bytes, buffer_bytes_ - used_);
+          std::memcpy(current_ + used_, begin, n);
+          used_ += n;
+          begin += n;
+          bytes -= n;
+          if (used_ == buffer_bytes_)
+            submit();
+        }
+      }
+
+      template <class T>
+        void write_value(T const& value)
+        {
+          static_assert(std::is_trivially_copyable<T>::value, "Only trivial types can be written.");
+          write(&value, sizeof(T));
+        }
+
+      /**
+       * Blocks until everything written so far has reached the file.
+       */
+      void flush()
+      {
+        Expects(is_open_);
+        if (used_ % block_size == 0 || !direct_) {
+          if (used_)
+            submit();
+          wait_until_idle();
+        } else {
+          // keep the partial block, O_DIRECT can only write whole blocks
+          std::size_t whole = used_ - used_ % block_size;
+          std::vector<char> tail(current_ + whole, current_ + used_);
+          used_ = whole;
+          if (used_)
+            submit();
+          wait_until_idle();
+          std::memcpy(current_, tail.data(), tail.size());
+          used_ = tail.size();
+        }
+      }
+
+      /**
+       * Writes all pending data, stops the background thread and closes the
+       * file. Called by the destructor, which swallows errors.
+       */
+      void close()
+      {
+        if (!is_open_)
+          return;
+        is_open_ = false;
+        std::size_t whole = direct_ ? used_ - used_ % block_size : used_;
+        std::vector<char> tail(current_ + whole, current_ + used_);
+        used_ = whole;
+        std::exception_ptr error;
+        try {
+          if (used_)
+            submit();
+        } catch (...) {
+          error = std::current_exception();
+        }
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          stop_ = true;
+        }
+        full_cond_.notify_one();
+        writer_.join();
+        if (!tail.empty() && !error && !error_) {
+#ifdef O_DIRECT
+          ::fcntl(fd_, F_SETFL, ::fcntl(fd_, F_GETFL) & ~O_DIRECT);
+#endif
+          try {
+            write_all(tail.data(), tail.size());
+          } catch (...) {
+            error = std::current_exception();
+          }
+        }
+        ::close(fd_);
+        fd_ = -1;
+        if (error)
+          std::rethrow_exception(error);
+        rethrow_error();
+      }
+
+      bool is_direct() const noexcept { return direct_; }
+      std::size_t buffer_bytes() const noexcept { return buffer_bytes_; }
+
+    private:
+      int fd_ = -1;
+      bool direct_ = false;
+      bool is_open_ = false;
+      std::size_t buffer_bytes_;
+      std::vector<char*> memory_;
+      char* current_ = nullptr;
+      std::size_t used_ = 0;
+
+      std::mutex mutex_;
+      std::condition_variable full_cond_;
+      std::condition_variable free_cond_;
+      std::deque<std::pair<char*, std::size_t>> full_;
+      std::vector<char*> free_;
+      std::size_t in_flight_ = 0;
+      bool stop_ = false;
+      std::exception_ptr error_;
+      std::thread writer_;
+
+      static std::size_t round_up(std::size_t bytes) noexcept
+      {
+        return (bytes + block_size - 1) / block_size * block_size;
+      }
+
+      void open(std::string const& path, bool direct)
+      {
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if (direct) {
+          fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+          direct_ = fd_ >= 0;
+        }
+#endif
+        if (fd_ < 0)
+          fd_ = ::open(path.c_str(), flags, 0644);
+        if (fd_ < 0)
+          throw async_writer_error("Could not open " + path + ": " + std::strerror(errno));
+        is_open_ = true;
+      }
+
+      void release() noexcept
+      {
+        for (char* memory : memory_)
+          std::free(memory);
+        memory_.clear();
+      }
+
+      void rethrow_error()
+      {
+        std::exception_ptr error;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          std::swap(error, error_);
+        }
+        if (error)
+          std::rethrow_exception(error);
+      }
+
+      // hands the current buffer to the writer thread and takes a free one
+      void submit()
+      {
+        rethrow_error();
+        std::unique_lock<std::mutex> lock(mutex_);
+        full_.emplace_back(current_, used_);
+        ++in_flight_;
+        full_cond_.notify_one();
+        free_cond_.wait(lock, [this] { return !free_.empty(); });
+        current_ = free_.back();
+        free_.pop_back();
+        used_ = 0;
+      }
+
+      void wait_until_idle()
+      {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          free_cond_.wait(lock, [this] { return in_flight_ == 0; });
+        }
+        rethrow_error();
+      }
+
+      void write_all(char const* data, std::size_t bytes)
+      {
+        while (bytes) {
+          ssize_t n = ::write(fd_, data, bytes);
+          if (n < 0 && errno == EINTR)
+            continue;
+          if (n <= 0)
+            throw async_writer_error(std::string("Could not write: ") + std::strerror(errno));
+          data += n;
+          bytes -= static_cast<std::size_t>(n);
+        }
+      }
+
+      void run()
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+          full_cond_.wait(lock, [this] { return stop_ || !full_.empty(); });
+          if (full_.empty())
+            return;
+          std::pair<char*, std::size_t> buffer = full_.front();
+          full_.pop_front();
+          lock.unlock();
+          std::exception_ptr error;
+          try {
+            write_all(buffer.first, buffer.second);
+          } catch (...) {
+            error = std::current_exception();
+          }
+          lock.lock();
+          if (error && !error_)
+            error_ = error;
+          free_.push_back(buffer.first);
+          --in_flight_;
+          free_cond_.notify_all();
+        }
+      }
+  };
+
+  /**
+   * Output iterator onto an async_binary_writer. It accepts single values,
+   * std::vectors and Eigen vectors of T and (scaling, alpha) pairs as they
+   * are produced by forward(). Copies of the iterator share the writer.
+   */
+  template <class T>
+    class async_binary_output_iterator
+    : public std::iterator<std::output_iterator_tag, void, void, void, void>
+    {
+      public:
+        explicit async_binary_output_iterator(async_binary_writer& writer) noexcept
+        : writer_{&writer} {}
+
+        async_binary_output_iterator& operator=(T const& value)
+        {
+          writer_->write_value(value);
+          return *this;
+        }
+
+        async_binary_output_iterator& operator=(std::vector<T> const& values)
+        {
+          writer_->write(values.data(), sizeof(T)*values.size());
+          return *this;
+        }
+
+        template <class Derived>
+          async_binary_output_iterator& operator=(Eigen::PlainObjectBase<Derived> const& values)
+          {
+            static_assert(std::is_same<typename Derived::Scalar, T>::value, "Scalar types differ.");
+            writer_->write(values.data(), sizeof(T)*values.size());
+            return *this;
+          }
+
+        template <class Vector>
+          async_binary_output_iterator& operator=(std::pair<T, Vector> const& pair)
+          {
+            *this = pair.first;
+            *this = pair.second;
+            return *this;
+          }
+
+        async_binary_output_iterator& operator*() noexcept { return *this; }
+        async_binary_output_iterator& operator++() noexcept { return *this; }
+        async_binary_output_iterator& operator++(int) noexcept { return *this; }
+
+      private:
+        async_binary_writer* writer_; // not owning
+    };
+
+}
+
+#endif /* INCLUDE_MAIKEL_ITERATOR_ASYNC_BINARY_WRITER_H_ */
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_MAIKEL_ITERATOR_BFLOAT16_COEFFICIENTS_H_
+#define INCLUDE_MAIKEL_ITERATOR_BFLOAT16_COEFFICIENTS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <gsl_assert.h>
+
+#include "maikel/hmm/bfloat16.h"
+#include "maikel/iterator/async_binary_writer.h"
+#include "maikel/mapped_file.h"
+
+/*
+ * Compact spill format for forward and backward coefficients: a record is
+ * alpha[N] (or beta[N]) in bfloat16, a quarter of a record of doubles.
+ * There is no header and no scaling factor; the scaling factors feed the
+ * log-likelihood and the backward recursion, so they stay in full
+ * precision in a file of their own.
+ *
+ * Every coefficient is off by less than 2^-7 of itself. The writer rounds
+ * stochastically with the position of a value in the file as key, so the
+ * errors cancel in the sums over the sequence: one Baum-Welch update from
+ * bfloat16 coefficients moves the transition and emission probabilities
+ * by less than 1.3e-4 for 2000 symbols and by less than 1.3e-5 for 200000
+ * symbols, measured on random models with 2 to 200 states. Rounded to
+ * nearest the emission probabilities stay off by 2e-4 however long the
+ * sequence is. Keep full records where the coefficients are needed for
+ * more than expected counts and posteriors.
+ */
+
+namespace maikel {
+
+  /**
+   * Output iterator onto an async_binary_writer which writes std::vectors
+   * and Eigen vectors of T as bfloat16 records. Copies of the iterator
+   * share the writer; only one of them should be written to, because each
+   * counts the values for the dither on its own.
+   *
+   * Example:
+   *
+   *     maikel::async_binary_writer betas("betas.bf16");
+   *     std::copy(first, last, maikel::async_bfloat16_output_iterator<double>(betas));
+   */
+  template <class T>
+    class async_bfloat16_output_iterator
+    : public std::iterator<std::output_iterator_tag, void, void, void, void>
+    {
+      public:
+        explicit async_bfloat16_output_iterator(async_binary_writer& writer) noexcept
+        : writer_{&writer} {}
+
+        async_bfloat16_output_iterator& operator=(std::vector<T> const& values)
+        {
+          write(values.data(), values.size());
+          return *this;
+        }
+
+        template <class Derived>
+          async_bfloat16_output_iterator& operator=(Eigen::PlainObjectBase<Derived> const& values)
+          {
+            static_assert(std::is_same<typename Derived::Scalar, T>::value, "Scalar types differ.");
+            write(values.data(), static_cast<std::size_t>(values.size()));
+            return *this;
+          }
+
+        async_bfloat16_output_iterator& operator*() noexcept { return *this; }
+        async_bfloat16_output_iterator& operator++() noexcept { return *this; }
+        async_bfloat16_output_iterator& operator++(int) noexcept { return *this; }
+
+      private:
+        async_binary_writer* writer_; // not owning
+        std::vector<std::uint16_t> buffer_;
+        std::uint32_t position_ = 0;  // of the next value, the key of its dither
+
+        void write(T const* values, std::size_t n)
+        {
+          buffer_.resize(n);
+          hmm::encode_bfloat16(values, buffer_.data(), static_cast<std::ptrdiff_t>(n), position_);
+          writer_->write(buffer_.data(), sizeof(std::uint16_t)*n);
+          position_ += static_cast<std::uint32_t>(n);
+        }
+    };
+
+  /**
+   * Random access range over the bfloat16 records of a memory mapped file.
+   * Dereferencing widens a record into a row vector of T, so the range
+   * can be handed to update_matrices() or anything else which reads the
+   * coefficients through a random access iterator.
+   *
+   * Example:
+   *
+   *     maikel::mapped_bfloat16_coefficients<double> alphas("alphas.bf16", states);
+   *     for (auto it = alphas.rbegin(); it != alphas.rend(); ++it)
+   *       use(*it);
+   */
+  template <class T>
+    class mapped_bfloat16_coefficients {
+      public:
+        using row_vector = Eigen::Matrix<T, 1, Eigen::Dynamic>;
+        using value_type = row_vector;
+        using size_type  = std::size_t;
+
+        mapped_bfloat16_coefficients(std::string const& path, size_type states,
+            mapped_file::access_pattern pattern = mapped_file::access_pattern::sequential)
+        : file_(path, pattern), states_{states}
+        {
+          Expects(states_ > 0);
+          if (file_.size() % (states_*sizeof(std::uint16_t)))
+            throw mapped_file_error("Size of " + path + " is not a multiple of the record size.");
+          size_ = file_.size() / (states_*sizeof(std::uint16_t));
+        }
+
+        class iterator
+        : public std::iterator<std::random_access_iterator_tag,
+            value_type, std::ptrdiff_t, void, value_type>
+        {
+          public:
+            iterator() = default;
+
+            value_type operator*() const
+            {
+              return parent_->record(pos_);
+            }
+
+            value_type operator[](std::ptrdiff_t n) const
+            {
+              return parent_->record(pos_ + n);
+            }
+
+            iterator& operator++() noexcept { ++pos_; return *this; }
+            iterator& operator--() noexcept { --pos_; return *this; }
+            iterator operator++(int) noexcept { iterator tmp = *this; ++pos_; return tmp; }
+            iterator operator--(int) noexcept { iterator tmp = *this; --pos_; return tmp; }
+            iterator& operator+=(std::ptrdiff_t n) noexcept { pos_ += n; return *this; }
+            iterator& operator-=(std::ptrdiff_t n) noexcept { pos_ -= n; return *this; }
+            iterator operator+(std::ptrdiff_t n) const noexcept { iterator tmp = *this; return tmp += n; }
+            iterator operator-(std::ptrdiff_t n) const noexcept { iterator tmp = *this; return tmp -= n; }
+
+            std::ptrdiff_t operator-(iterator const& other) const noexcept
+            {
+              return static_cast<std::ptrdiff_t>(pos_) - static_cast<std::ptrdiff_t>(other.pos_);
+            }
+
+            bool operator==(iterator const& o) const noexcept { return pos_ == o.pos_; }
+            bool operator!=(iterator const& o) const noexcept { return pos_ != o.pos_; }
+            bool operator< (iterator const& o) const noexcept { return pos_ <  o.pos_; }
+            bool operator> (iterator const& o) const noexcept { return pos_ >  o.pos_; }
+            bool operator<=(iterator const& o) const noexcept { return pos_ <= o.pos_; }
+            bool operator>=(iterator const& o) const noexcept { return pos_ >= o.pos_; }
+
+            friend iterator operator+(std::ptrdiff_t n, iterator const& it) noexcept { return it + n; }
+
+          private:
+            friend class mapped_bfloat16_coefficients;
+
+            iterator(mapped_bfloat16_coefficients const& parent, size_type pos) noexcept
+            : parent_{&parent}, pos_{pos} {}
+
+            mapped_bfloat16_coefficients const* parent_ = nullptr;
+            size_type pos_ = 0;
+        };
+
+        using reverse_iterator = std::reverse_iterator<iterator>;
+
+        size_type size() const noexcept { return size_; }
+        size_type states() const noexcept { return states_; }
+        bool empty() const noexcept { return size_ == 0; }
+
+        value_type operator[](size_type i) const
+        {
+          Expects(i < size_);
+          return record(i);
+        }
+
+        /// Widens record i into `out` without allocating if it has the right size.
+        template <class Derived>
+          void decode(size_type i, Eigen::PlainObjectBase<Derived>& out) const
+          {
+            static_assert(std::is_same<typename Derived::Scalar, T>::value, "Scalar types differ.");
+            Expects(i < size_);
+            out.resize(1, static_cast<typename Derived::Index>(states_));
+            hmm::decode_bfloat16(base(i), out.data(), static_cast<std::ptrdiff_t>(states_));
+          }
+
+        iterator begin() const noexcept { return {*this, 0}; }
+        iterator end() const noexcept { return {*this, size_}; }
+        reverse_iterator rbegin() const noexcept { return reverse_iterator(end()); }
+        reverse_iterator rend() const noexcept { return reverse_iterator(begin()); }
+
+      private:
+        mapped_file file_;
+        size_type states_;
+        size_type size_ = 0;
+
+        std::uint16_t const* base(size_type i) const noexcept
+        {
+          return reinterpret_cast<std::uint16_t const*>(file_.data()) + i*states_;
+        }
+
+        value_type record(size_type i) const
+        {
+          row_vector values(states_);
+          hmm::decode_bfloat16(base(i), values.data(), static_cast<std::ptrdiff_t>(states_));
+          return values;
+        }
+    };
+
+}
+
+#endif /* INCLUDE_MAIKEL_ITERATOR_BFLOAT16_COEFFICIENTS_H_ */
@@ -78,12 +78,12 @@ namespace maikel {
 
       inline operator bool()
       {
-        return sin_;
+        return static_cast<bool>(sin_);
       }
 
       inline bool next()
       {
-        return std::getline(sin_, line_);
+        return static_cast<bool>(std::getline(sin_, line_));
       }
 
       inline iterator begin() noexcept
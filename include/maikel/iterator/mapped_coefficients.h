@@ -0,0 +1,148 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_MAIKEL_ITERATOR_MAPPED_COEFFICIENTS_H_
+#define INCLUDE_MAIKEL_ITERATOR_MAPPED_COEFFICIENTS_H_
+
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include <Eigen/Dense>
+#include <gsl_assert.h>
+
+#include "maikel/mapped_file.h"
+
+namespace maikel {
+
+  /**
+   * Random access range over binary coefficient records in a memory mapped
+   * file. A record is either (scaling, alpha[N]), as written by
+   * ostream_buffered_binary_iterator, or alpha[N] only. Dereferencing yields
+   * the scaling factor and an Eigen::Map onto the mapped alpha, so nothing is
+   * copied. Records of a scaling-free file have a scaling factor of 1.
+   *
+   * Example:
+   *
+   *     maikel::mapped_coefficients<double> alphas("alphas.dat", states, false);
+   *     for (auto it = alphas.rbegin(); it != alphas.rend(); ++it)
+   *       use((*it).second);
+   */
+  template <class T>
+    class mapped_coefficients {
+      public:
+        using row_vector = Eigen::Matrix<T, 1, Eigen::Dynamic>;
+        using alpha_map  = Eigen::Map<const row_vector>;
+        using value_type = std::pair<T, alpha_map>;
+        using size_type  = std::size_t;
+
+        mapped_coefficients(std::string const& path, size_type states, bool with_scaling = true,
+            mapped_file::access_pattern pattern = mapped_file::access_pattern::sequential)
+        : file_(path, pattern), states_{states},
+          stride_{states + (with_scaling ? 1 : 0)}, with_scaling_{with_scaling}
+        {
+          Expects(states_ > 0);
+          if (file_.size() % (stride_*sizeof(T)))
+            throw mapped_file_error("Size of " + path + " is not a multiple of the record size.");
+          size_ = file_.size() / (stride_*sizeof(T));
+        }
+
+        class iterator
+        : public std::iterator<std::random_access_iterator_tag,
+            value_type, std::ptrdiff_t, void, value_type>
+        {
+          public:
+            iterator() = default;
+
+            value_type operator*() const noexcept
+            {
+              return parent_->record(pos_);
+            }
+
+            value_type operator[](std::ptrdiff_t n) const noexcept
+            {
+              return parent_->record(pos_ + n);
+            }
+
+            iterator& operator++() noexcept { ++pos_; return *this; }
+            iterator& operator--() noexcept { --pos_; return *this; }
+            iterator operator++(int) noexcept { iterator tmp = *this; ++pos_; return tmp; }
+            iterator operator--(int) noexcept { iterator tmp = *this; --pos_; return tmp; }
+            iterator& operator+=(std::ptrdiff_t n) noexcept { pos_ += n; return *this; }
+            iterator& operator-=(std::ptrdiff_t n) noexcept { pos_ -= n; return *this; }
+            iterator operator+(std::ptrdiff_t n) const noexcept { iterator tmp = *this; return tmp += n; }
+            iterator operator-(std::ptrdiff_t n) const noexcept { iterator tmp = *this; return tmp -= n; }
+
+            std::ptrdiff_t operator-(iterator const& other) const noexcept
+            {
+              return static_cast<std::ptrdiff_t>(pos_) - static_cast<std::ptrdiff_t>(other.pos_);
+            }
+
+            bool operator==(iterator const& o) const noexcept { return pos_ == o.pos_; }
+            bool operator!=(iterator const& o) const noexcept { return pos_ != o.pos_; }
+            bool operator< (iterator const& o) const noexcept { return pos_ <  o.pos_; }
+            bool operator> (iterator const& o) const noexcept { return pos_ >  o.pos_; }
+            bool operator<=(iterator const& o) const noexcept { return pos_ <= o.pos_; }
+            bool operator>=(iterator const& o) const noexcept { return pos_ >= o.pos_; }
+
+            friend iterator operator+(std::ptrdiff_t n, iterator const& it) noexcept { return it + n; }
+
+          private:
+            friend class mapped_coefficients;
+
+            iterator(mapped_coefficients const& parent, size_type pos) noexcept
+            : parent_{&parent}, pos_{pos} {}
+
+            mapped_coefficients const* parent_ = nullptr;
+            size_type pos_ = 0;
+        };
+
+        using reverse_iterator = std::reverse_iterator<iterator>;
+
+        size_type size() const noexcept { return size_; }
+        size_type states() const noexcept { return states_; }
+        bool empty() const noexcept { return size_ == 0; }
+
+        value_type operator[](size_type i) const
+        {
+          Expects(i < size_);
+          return record(i);
+        }
+
+        iterator begin() const noexcept { return {*this, 0}; }
+        iterator end() const noexcept { return {*this, size_}; }
+        reverse_iterator rbegin() const noexcept { return reverse_iterator(end()); }
+        reverse_iterator rend() const noexcept { return reverse_iterator(begin()); }
+
+      private:
+        mapped_file file_;
+        size_type states_;
+        size_type stride_;
+        bool with_scaling_;
+        size_type size_ = 0;
+
+        value_type record(size_type i) const noexcept
+        {
+          T const* base = reinterpret_cast<T const*>(file_.data()) + i*stride_;
+          if (with_scaling_)
+            return { base[0], alpha_map(base + 1, states_) };
+          return { T{1}, alpha_map(base, states_) };
+        }
+    };
+
+}
+
+#endif /* INCLUDE_MAIKEL_ITERATOR_MAPPED_COEFFICIENTS_H_ */
@@ -1,7 +1,9 @@
 #ifndef OSTREAM_BINARY_ITERATOR_H_
 #define OSTREAM_BINARY_ITERATOR_H_
 
+#include <array>
 #include <iterator>
+#include <vector>
 
 #include "gsl_assert.h"
 
@@ -50,7 +52,7 @@ namespace maikel {
         return _M_alpha;
       }
 
-      const _Tp*
+      const alpha_type<_Tp>*
       operator->() const { return &(operator*()); }
 
       alphas_binary_input_iterator&
@@ -79,20 +81,11 @@ namespace maikel {
       {
         _M_ok = (_M_stream != nullptr && *_M_stream) ? true : false;
         if (_M_ok) {
-          std::size_t type_size = sizeof(_Tp);
-          std::size_t buffer_size = type_size*(_M_num_states+1);
-          std::vector<char_type> buffer(buffer_size);
-          _M_stream->read(buffer.data(), buffer_size);
+          // read straight into the record, no intermediate buffer
+          _M_stream->read(reinterpret_cast<char_type*>(&_M_alpha.first), sizeof(_Tp));
+          _M_stream->read(reinterpret_cast<char_type*>(_M_alpha.second.data()),
+              sizeof(_Tp)*_M_num_states);
           _M_ok = *_M_stream ? true : false;
-          if (_M_ok && _M_stream->gcount()
-              == gsl::narrow<std::streamsize>(buffer_size)) {
-            std::copy(buffer.data(), buffer.data()+type_size,
-                reinterpret_cast<char_type*>(&_M_alpha.first));
-            std::copy(
-                buffer.data()+type_size,
-                buffer.data()+buffer_size,
-                reinterpret_cast<char_type*>(_M_alpha.second.data()));
-          }
         }
       }
   };
@@ -143,6 +136,7 @@ namespace maikel {
       void flush() {
         if (_M_num_elements > 0 && _M_stream)
           _M_stream.write(_M_buffer.data(), _M_num_elements);
+        _M_num_elements = 0;
       }
 
       /// Writes @a value to underlying ostream using write().
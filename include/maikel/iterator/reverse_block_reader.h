@@ -0,0 +1,309 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_MAIKEL_ITERATOR_REVERSE_BLOCK_READER_H_
+#define INCLUDE_MAIKEL_ITERATOR_REVERSE_BLOCK_READER_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/iterator/iterator_facade.hpp>
+#include <gsl_assert.h>
+
+#include "maikel/hmm/binary_sequence.h"
+
+namespace maikel {
+
+  struct reverse_reader_error: public std::runtime_error {
+      reverse_reader_error(std::string s): std::runtime_error(s) {}
+  };
+
+  /**
+   * Reads a binary file of T's from its end to its beginning in blocks of
+   * fixed size. Only one block is held in memory and the kernel is asked to
+   * read ahead the block preceding it. The range is an input range, so it
+   * can be handed to backward() for the sequence as well as for the scaling
+   * factors.
+   *
+   * Example:
+   *
+   *     maikel::reverse_binary_reader<double> scaling("scaling.dat");
+   *     for (auto&& beta : backward(seq.rbegin(), seq.rend(), scaling.begin(), hmm))
+   *       use(beta);
+   */
+  template <class T>
+    class reverse_binary_reader {
+      public:
+        static const std::size_t default_block_bytes = std::size_t{1} << 20;
+
+        /**
+         * Opens `path` and reads `count` elements which start `offset` bytes
+         * into the file. By default all elements until the end of the file
+         * are read.
+         */
+        explicit reverse_binary_reader(std::string const& path,
+            std::size_t block_elements = default_block_bytes / sizeof(T),
+            std::uint64_t offset = 0,
+            std::uint64_t count = std::numeric_limits<std::uint64_t>::max())
+        : block_elements_{block_elements}, offset_{offset}
+        {
+          Expects(block_elements_ > 0);
+          fd_ = ::open(path.c_str(), O_RDONLY);
+          if (fd_ < 0)
+            throw reverse_reader_error("Could not open " + path + ": " + std::strerror(errno));
+          off_t size = ::lseek(fd_, 0, SEEK_END);
+          if (size < 0 || static_cast<std::uint64_t>(size) < offset_) {
+            ::close(fd_);
+            throw reverse_reader_error("Could not seek in " + path + ".");
+          }
+          std::uint64_t available = (static_cast<std::uint64_t>(size) - offset_) / sizeof(T);
+          remaining_ = size_ = std::min(count, available);
+          load_previous_block();
+        }
+
+        reverse_binary_reader(reverse_binary_reader const&) = delete;
+        reverse_binary_reader& operator=(reverse_binary_reader const&) = delete;
+
+        ~reverse_binary_reader() noexcept
+        {
+          ::close(fd_);
+        }
+
+        class iterator
+        : public boost::iterator_facade<iterator, T const, std::input_iterator_tag>
+        {
+          public:
+            iterator() = default;
+
+          private:
+            friend class reverse_binary_reader;
+            friend class boost::iterator_core_access;
+
+            iterator(reverse_binary_reader& rng)
+            : rng_{ rng ? &rng : nullptr } {}
+
+            reverse_binary_reader* rng_ = nullptr;
+
+            T const& dereference() const
+            {
+              Expects(rng_);
+              return rng_->block_[rng_->pos_];
+            }
+
+            bool equal(iterator other) const noexcept
+            {
+              return rng_ == other.rng_;
+            }
+
+            void increment()
+            {
+              Expects(rng_);
+              if (!rng_->next())
+                rng_ = nullptr;
+            }
+        };
+
+        operator bool() const noexcept
+        {
+          return !block_.empty();
+        }
+
+        /// Number of elements in the whole range.
+        std::uint64_t size() const noexcept { return size_; }
+
+        iterator begin() noexcept
+        {
+          return {*this};
+        }
+
+        iterator end() noexcept
+        {
+          return {};
+        }
+
+      private:
+        int fd_ = -1;
+        std::size_t block_elements_;
+        std::uint64_t offset_;
+        std::uint64_t size_ = 0;
+        std::uint64_t remaining_ = 0; // elements in front of the current block
+        std::vector<T> block_;
+        std::size_t pos_ = 0;
+
+        bool next()
+        {
+          if (pos_ > 0) {
+            --pos_;
+            return true;
+          }
+          load_previous_block();
+          return !block_.empty();
+        }
+
+        void load_previous_block()
+        {
+          std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, block_elements_));
+          remaining_ -= n;
+          block_.resize(n);
+          read_all(reinterpret_cast<char*>(block_.data()), n*sizeof(T), offset_ + remaining_*sizeof(T));
+          pos_ = n ? n-1 : 0;
+#ifdef POSIX_FADV_WILLNEED
+          if (remaining_) {
+            std::uint64_t ahead = std::min<std::uint64_t>(remaining_, block_elements_);
+            ::posix_fadvise(fd_, offset_ + (remaining_-ahead)*sizeof(T), ahead*sizeof(T),
+                POSIX_FADV_WILLNEED);
+          }
+#endif
+        }
+
+        void read_all(char* data, std::size_t bytes, std::uint64_t position)
+        {
+          while (bytes) {
+            ssize_t n = ::pread(fd_, data, bytes, static_cast<off_t>(position));
+            if (n < 0 && errno == EINTR)
+              continue;
+            if (n <= 0)
+              throw reverse_reader_error("Could not read a block backwards.");
+            data += n;
+            bytes -= static_cast<std::size_t>(n);
+            position += static_cast<std::uint64_t>(n);
+          }
+        }
+    };
+
+  /**
+   * Reads the symbols of a packed sequence file (see binary_sequence.h) from
+   * the last to the first one, holding one block of words in memory.
+   */
+  class reverse_packed_sequence_reader {
+    public:
+      using symbol_type = hmm::packed_symbol;
+
+      explicit reverse_packed_sequence_reader(std::string const& path,
+          std::size_t block_words = reverse_binary_reader<std::uint64_t>::default_block_bytes / 8)
+      : header_{read_header(path)},
+        words_(path, block_words, sizeof(hmm::packed_sequence_header), hmm::packed_words(header_)),
+        word_it_{words_.begin()}, per_word_{64 / header_.bits},
+        mask_{(std::uint64_t{1} << header_.bits) - 1}, remaining_{header_.length}
+      {
+        if (words_.size() != hmm::packed_words(header_))
+          throw reverse_reader_error("Packed sequence " + path + " is shorter than its header claims.");
+        if (remaining_) {
+          offset_ = static_cast<unsigned>((remaining_ - 1) % per_word_);
+          word_ = *word_it_;
+        }
+      }
+
+      class iterator
+      : public boost::iterator_facade<iterator, symbol_type const,
+          std::input_iterator_tag, symbol_type>
+      {
+        public:
+          iterator() = default;
+
+        private:
+          friend class reverse_packed_sequence_reader;
+          friend class boost::iterator_core_access;
+
+          iterator(reverse_packed_sequence_reader& rng)
+          : rng_{ rng ? &rng : nullptr } {}
+
+          reverse_packed_sequence_reader* rng_ = nullptr;
+
+          symbol_type dereference() const
+          {
+            Expects(rng_);
+            return static_cast<symbol_type>(
+                (rng_->word_ >> (rng_->offset_*rng_->header_.bits)) & rng_->mask_);
+          }
+
+          bool equal(iterator other) const noexcept
+          {
+            return rng_ == other.rng_;
+          }
+
+          void increment()
+          {
+            Expects(rng_);
+            if (!rng_->next())
+              rng_ = nullptr;
+          }
+      };
+
+      operator bool() const noexcept
+      {
+        return remaining_ > 0;
+      }
+
+      std::uint64_t size() const noexcept { return header_.length; }
+      std::size_t symbols() const noexcept { return header_.symbols; }
+
+      iterator begin() noexcept
+      {
+        return {*this};
+      }
+
+      iterator end() noexcept
+      {
+        return {};
+      }
+
+    private:
+      hmm::packed_sequence_header header_;
+      reverse_binary_reader<std::uint64_t> words_;
+      reverse_binary_reader<std::uint64_t>::iterator word_it_;
+      unsigned per_word_;
+      std::uint64_t mask_;
+      std::uint64_t remaining_;
+      std::uint64_t word_ = 0;
+      unsigned offset_ = 0;
+
+      static hmm::packed_sequence_header read_header(std::string const& path)
+      {
+        std::ifstream in(path, std::ifstream::binary);
+        if (!in)
+          throw reverse_reader_error("Could not open " + path + ".");
+        return hmm::read_packed_sequence_header(in);
+      }
+
+      bool next()
+      {
+        if (--remaining_ == 0)
+          return false;
+        if (offset_ > 0) {
+          --offset_;
+        } else {
+          word_ = *++word_it_;
+          offset_ = per_word_ - 1;
+        }
+        return true;
+      }
+  };
+
+}
+
+#endif /* INCLUDE_MAIKEL_ITERATOR_REVERSE_BLOCK_READER_H_ */
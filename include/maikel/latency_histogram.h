@@ -0,0 +1,176 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIKEL_LATENCY_HISTOGRAM_H_
+#define MAIKEL_LATENCY_HISTOGRAM_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+namespace maikel {
+
+  /**
+   * Lock free histogram of durations in nanoseconds. Values below 16 have a
+   * bucket each, every power of two above is split into 16 buckets, so a
+   * percentile is off by at most 1/16 of its value. Recording is a few
+   * relaxed atomic increments and can be done from any thread.
+   * record_exclusive() skips the atomic read-modify-writes for histograms
+   * which only one thread records into, while others may still read them.
+   *
+   * Example:
+   *
+   *     maikel::latency_histogram latencies;
+   *     auto start = std::chrono::steady_clock::now();
+   *     handle(request);
+   *     latencies.record(std::chrono::steady_clock::now() - start);
+   *     std::cout << latencies.percentile(0.99) << "ns\n";
+   */
+  class latency_histogram {
+    public:
+      static constexpr unsigned sub_bits = 4;
+      static constexpr unsigned sub_buckets = 1u << sub_bits;
+      static constexpr unsigned buckets = sub_buckets + (64 - sub_bits)*sub_buckets;
+
+      latency_histogram() noexcept { reset(); }
+
+      latency_histogram(latency_histogram const&) = delete;
+      latency_histogram& operator=(latency_histogram const&) = delete;
+
+      void record(std::uint64_t nanoseconds) noexcept
+      {
+        counts_[bucket_of(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(nanoseconds, std::memory_order_relaxed);
+        std::uint64_t max = max_.load(std::memory_order_relaxed);
+        while (nanoseconds > max && !max_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+          ;
+        std::uint64_t min = min_.load(std::memory_order_relaxed);
+        while (nanoseconds < min && !min_.compare_exchange_weak(min, nanoseconds, std::memory_order_relaxed))
+          ;
+      }
+
+      /// Same as record(), but only one thread may record into this histogram.
+      void record_exclusive(std::uint64_t value) noexcept
+      {
+        increment(counts_[bucket_of(value)], 1);
+        increment(count_, 1);
+        increment(sum_, value);
+        if (value > max_.load(std::memory_order_relaxed))
+          max_.store(value, std::memory_order_relaxed);
+        if (value < min_.load(std::memory_order_relaxed))
+          min_.store(value, std::memory_order_relaxed);
+      }
+
+      template <class Rep, class Period>
+        void record(std::chrono::duration<Rep, Period> duration) noexcept
+        {
+          auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+          record(static_cast<std::uint64_t>(ns > 0 ? ns : 0));
+        }
+
+      std::uint64_t count() const noexcept { return count_.load(std::memory_order_relaxed); }
+      std::uint64_t sum() const noexcept { return sum_.load(std::memory_order_relaxed); }
+      std::uint64_t max() const noexcept { return max_.load(std::memory_order_relaxed); }
+      std::uint64_t min() const noexcept { return count() ? min_.load(std::memory_order_relaxed) : 0; }
+
+      double mean() const noexcept
+      {
+        std::uint64_t n = count();
+        return n ? static_cast<double>(sum()) / static_cast<double>(n) : 0.0;
+      }
+
+      /// Upper end of the bucket which holds the q-quantile, 0 <= q <= 1.
+      std::uint64_t percentile(double q) const noexcept
+      {
+        std::uint64_t n = count();
+        if (n == 0)
+          return 0;
+        q = q < 0 ? 0 : (q > 1 ? 1 : q);
+        std::uint64_t rank = static_cast<std::uint64_t>(q * static_cast<double>(n - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (unsigned b = 0; b < buckets; ++b) {
+          seen += counts_[b].load(std::memory_order_relaxed);
+          if (seen >= rank)
+            return std::min(upper_bound(b), max());
+        }
+        return max();
+      }
+
+      /// Adds the counts of `other`, e.g. to combine per thread histograms.
+      void merge(latency_histogram const& other) noexcept
+      {
+        for (unsigned b = 0; b < buckets; ++b)
+          counts_[b].fetch_add(other.counts_[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        count_.fetch_add(other.count(), std::memory_order_relaxed);
+        sum_.fetch_add(other.sum(), std::memory_order_relaxed);
+        std::uint64_t theirs = other.max(), max = max_.load(std::memory_order_relaxed);
+        while (theirs > max && !max_.compare_exchange_weak(max, theirs, std::memory_order_relaxed))
+          ;
+        theirs = other.min_.load(std::memory_order_relaxed);
+        std::uint64_t min = min_.load(std::memory_order_relaxed);
+        while (theirs < min && !min_.compare_exchange_weak(min, theirs, std::memory_order_relaxed))
+          ;
+      }
+
+      void reset() noexcept
+      {
+        for (auto& c : counts_)
+          c.store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+        min_.store(std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed);
+      }
+
+      static unsigned bucket_of(std::uint64_t value) noexcept
+      {
+        if (value < sub_buckets)
+          return static_cast<unsigned>(value);
+        unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+        unsigned mantissa = static_cast<unsigned>(value >> (exponent - sub_bits)) & (sub_buckets - 1);
+        return sub_buckets + (exponent - sub_bits)*sub_buckets + mantissa;
+      }
+
+      static std::uint64_t upper_bound(unsigned bucket) noexcept
+      {
+        if (bucket < sub_buckets)
+          return bucket;
+        unsigned exponent = (bucket - sub_buckets) / sub_buckets + sub_bits;
+        std::uint64_t mantissa = (bucket - sub_buckets) % sub_buckets;
+        std::uint64_t lower = (sub_buckets + mantissa) << (exponent - sub_bits);
+        return lower + ((std::uint64_t{1} << (exponent - sub_bits)) - 1);
+      }
+
+    private:
+      std::array<std::atomic<std::uint64_t>, buckets> counts_;
+      std::atomic<std::uint64_t> count_;
+      std::atomic<std::uint64_t> sum_;
+      std::atomic<std::uint64_t> max_;
+      std::atomic<std::uint64_t> min_;
+
+      static void increment(std::atomic<std::uint64_t>& counter, std::uint64_t value) noexcept
+      {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+      }
+  };
+
+}
+
+#endif /* MAIKEL_LATENCY_HISTOGRAM_H_ */
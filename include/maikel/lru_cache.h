@@ -0,0 +1,101 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIKEL_LRU_CACHE_H_
+#define MAIKEL_LRU_CACHE_H_
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace maikel {
+
+  /**
+   * Map which forgets the least recently used entries once the sum of the
+   * costs of its entries exceeds its capacity. The cost of an entry is
+   * given when it is inserted, usually its size in bytes. Not thread safe.
+   *
+   * Example:
+   *
+   *     maikel::lru_cache<std::string, double> cache(1 << 20);
+   *     cache.insert("abc", 1.5, 64);
+   *     if (double const* value = cache.find("abc"))
+   *       use(*value);
+   */
+  template <class Key, class Value, class Hash = std::hash<Key>>
+    class lru_cache {
+      public:
+        explicit lru_cache(std::size_t capacity): capacity_{capacity} {}
+
+        /// Returns the value for `key` and marks it as used, or nullptr.
+        Value const* find(Key const& key)
+        {
+          auto found = index_.find(key);
+          if (found == index_.end())
+            return nullptr;
+          entries_.splice(entries_.begin(), entries_, found->second);
+          return &found->second->value;
+        }
+
+        void insert(Key const& key, Value value, std::size_t cost)
+        {
+          if (cost > capacity_)
+            return;
+          auto found = index_.find(key);
+          if (found != index_.end()) {
+            cost_ -= found->second->cost;
+            entries_.erase(found->second);
+            index_.erase(found);
+          }
+          entries_.push_front(entry{key, std::move(value), cost});
+          index_.emplace(key, entries_.begin());
+          cost_ += cost;
+          while (cost_ > capacity_) {
+            cost_ -= entries_.back().cost;
+            index_.erase(entries_.back().key);
+            entries_.pop_back();
+          }
+        }
+
+        std::size_t size() const noexcept { return index_.size(); }
+        std::size_t cost() const noexcept { return cost_; }
+        std::size_t capacity() const noexcept { return capacity_; }
+
+        void clear() noexcept
+        {
+          index_.clear();
+          entries_.clear();
+          cost_ = 0;
+        }
+
+      private:
+        struct entry {
+            Key key;
+            Value value;
+            std::size_t cost;
+        };
+
+        std::size_t capacity_;
+        std::size_t cost_ = 0;
+        std::list<entry> entries_;
+        std::unordered_map<Key, typename std::list<entry>::iterator, Hash> index_;
+    };
+
+}
+
+#endif /* MAIKEL_LRU_CACHE_H_ */
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIKEL_MAPPED_FILE_H_
+#define MAIKEL_MAPPED_FILE_H_
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace maikel {
+
+  struct mapped_file_error: public std::runtime_error {
+      mapped_file_error(std::string s): std::runtime_error(s) {}
+  };
+
+  /**
+   * Read only memory mapping of a whole file. The mapping is released in
+   * the destructor. Empty files give a valid object with data() == nullptr.
+   */
+  class mapped_file {
+    public:
+      enum class access_pattern { normal, sequential, random };
+
+      mapped_file() = default;
+
+      explicit mapped_file(std::string const& path, access_pattern pattern = access_pattern::normal)
+      {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+          throw mapped_file_error("Could not open " + path + ": " + std::strerror(errno));
+        struct stat info;
+        if (::fstat(fd, &info) < 0) {
+          ::close(fd);
+          throw mapped_file_error("Could not stat " + path + ": " + std::strerror(errno));
+        }
+        size_ = static_cast<std::size_t>(info.st_size);
+        if (size_ > 0) {
+          void* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+          if (data == MAP_FAILED) {
+            ::close(fd);
+            throw mapped_file_error("Could not map " + path + ": " + std::strerror(errno));
+          }
+          data_ = static_cast<char const*>(data);
+          advise(pattern);
+        }
+        ::close(fd);
+      }
+
+      mapped_file(mapped_file const&) = delete;
+      mapped_file& operator=(mapped_file const&) = delete;
+
+      mapped_file(mapped_file&& other) noexcept
+      : data_{other.data_}, size_{other.size_}
+      {
+        other.data_ = nullptr;
+        other.size_ = 0;
+      }
+
+      mapped_file& operator=(mapped_file&& other) noexcept
+      {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        return *this;
+      }
+
+      ~mapped_file() noexcept
+      {
+        if (data_)
+          ::munmap(const_cast<char*>(data_), size_);
+      }
+
+      char const* data() const noexcept { return data_; }
+      std::size_t size() const noexcept { return size_; }
+
+      /// Hints the kernel how the mapping is going to be read.
+      void advise(access_pattern pattern) const noexcept
+      {
+        if (!data_)
+          return;
+        int advice = pattern == access_pattern::sequential ? MADV_SEQUENTIAL
+                   : pattern == access_pattern::random     ? MADV_RANDOM
+                   :                                         MADV_NORMAL;
+        ::madvise(const_cast<char*>(data_), size_, advice);
+      }
+
+    private:
+      char const* data_ = nullptr;
+      std::size_t size_ = 0;
+  };
+
+}
+
+#endif /* MAIKEL_MAPPED_FILE_H_ */
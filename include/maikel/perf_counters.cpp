@@ -0,0 +1,263 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "maikel/perf_counters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace maikel {
+
+  namespace {
+
+    char const* const event_names[perf_events] = {
+      "cycles", "instructions", "LLC misses", "branch misses"
+    };
+
+    // Kernels are only ever added, a deque keeps references to them valid.
+    std::mutex kernels_mutex;
+    std::deque<kernel_statistics> kernels;
+
+#ifdef __linux__
+    std::uint64_t const event_configs[perf_events] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    int open_event(std::uint64_t config, int group) noexcept
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = config;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+    }
+#endif
+
+    std::string describe_errno(int error)
+    {
+      std::string reason = std::strerror(error);
+      if (error == EACCES || error == EPERM)
+        reason += " (see /proc/sys/kernel/perf_event_paranoid)";
+      return reason;
+    }
+
+    double per(double x, double y) noexcept { return y > 0 ? x / y : 0.0; }
+
+  } // namespace
+
+  perf_counter_group::perf_counter_group()
+  {
+    for (int& fd : fds_)
+      fd = -1;
+#ifdef __linux__
+    int leader = -1;
+    for (unsigned e = 0; e < perf_events; ++e) {
+      fds_[e] = open_event(event_configs[e], leader);
+      if (fds_[e] < 0) {
+        error_ += std::string(error_.empty() ? "" : "; ") + event_names[e] + ": " + describe_errno(errno);
+        continue;
+      }
+      if (leader < 0)
+        leader = fds_[e];
+      events_ |= 1u << e;
+    }
+#else
+    error_ = "hardware counters are only supported on Linux";
+#endif
+  }
+
+  perf_counter_group::~perf_counter_group()
+  {
+#ifdef __linux__
+    // members first, the leader last
+    for (unsigned e = perf_events; e-- > 0; )
+      if (fds_[e] >= 0)
+        close(fds_[e]);
+#endif
+  }
+
+  perf_sample perf_counter_group::read() const noexcept
+  {
+    perf_sample sample;
+#ifdef __linux__
+    if (!events_)
+      return sample;
+    int leader = -1;
+    for (int fd : fds_)
+      if (fd >= 0) {
+        leader = fd;
+        break;
+      }
+    // nr, time enabled, time running and one value per opened event in the order of opening
+    std::uint64_t buffer[3 + perf_events];
+    if (::read(leader, buffer, sizeof(buffer)) < static_cast<ssize_t>(3*sizeof(std::uint64_t)))
+      return sample;
+    double scale = buffer[2] ? static_cast<double>(buffer[1]) / static_cast<double>(buffer[2]) : 0.0;
+    std::uint64_t value = 0;
+    for (unsigned e = 0; e < perf_events && value < buffer[0]; ++e)
+      if (counts(static_cast<perf_event>(e)))
+        sample.values[e] = static_cast<std::uint64_t>(static_cast<double>(buffer[3 + value++]) * scale);
+#endif
+    return sample;
+  }
+
+  perf_counter_group& perf_counter_group::this_thread()
+  {
+    thread_local perf_counter_group group;
+    return group;
+  }
+
+  double kernel_statistics::ipc() const noexcept
+  {
+    if (!counts(perf_cycles) || !counts(perf_instructions))
+      return 0.0;
+    return per(static_cast<double>(counters[perf_instructions]), static_cast<double>(counters[perf_cycles]));
+  }
+
+  double kernel_statistics::gflops() const noexcept
+  {
+    return per(flops, static_cast<double>(ns));
+  }
+
+  double kernel_statistics::bytes_per_symbol() const noexcept
+  {
+    return per(bytes, static_cast<double>(symbols));
+  }
+
+  double kernel_statistics::llc_misses_per_symbol() const noexcept
+  {
+    if (!counts(perf_llc_misses))
+      return 0.0;
+    return per(static_cast<double>(counters[perf_llc_misses]), static_cast<double>(symbols));
+  }
+
+  kernel_site::kernel_site(char const* name)
+  {
+    std::lock_guard<std::mutex> lock(kernels_mutex);
+    kernels.emplace_back();
+    kernels.back().name = name;
+    kernels.back().events = (1u << perf_events) - 1;
+    id_ = static_cast<std::uint32_t>(kernels.size() - 1);
+  }
+
+  kernel_counters::kernel_counters(kernel_site const& site) noexcept
+  : site_{site.id()}, group_{nullptr}
+  {
+    try {
+      group_ = &perf_counter_group::this_thread();
+    } catch (...) {
+    }
+    start_time_ = clock::now();
+    if (group_)
+      start_ = group_->read();
+  }
+
+  kernel_counters::~kernel_counters() noexcept
+  {
+    perf_sample end;
+    if (group_)
+      end = group_->read();
+    clock::time_point end_time = clock::now();
+    std::lock_guard<std::mutex> lock(kernels_mutex);
+    kernel_statistics& k = kernels[site_];
+    k.calls += 1;
+    k.ns += static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time_).count());
+    k.events &= group_ ? group_->events() : 0u;
+    for (unsigned e = 0; e < perf_events; ++e)
+      if (end.values[e] > start_.values[e])
+        k.counters[e] += end.values[e] - start_.values[e];
+    k.flops += flops_;
+    k.bytes += bytes_;
+    k.symbols += symbols_;
+  }
+
+  std::vector<kernel_statistics> kernel_counters::statistics()
+  {
+    std::lock_guard<std::mutex> lock(kernels_mutex);
+    std::vector<kernel_statistics> result;
+    for (kernel_statistics const& k : kernels)
+      if (k.calls)
+        result.push_back(k);
+    return result;
+  }
+
+  void kernel_counters::print_statistics(std::ostream& out)
+  {
+    std::vector<kernel_statistics> all = statistics();
+    if (all.empty())
+      return;
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    std::string const& error = perf_counter_group::this_thread().error();
+    if (!error.empty())
+      out << "Hardware counters unavailable: " << error << '\n';
+    out << "Hardware counters of kernels:\n";
+    out << "     calls         ms      IPC   GFLOP/s  bytes/symbol  LLC misses/symbol  branch misses  kernel\n";
+    out << std::fixed;
+    for (kernel_statistics const& k : all) {
+      out << std::setw(10) << k.calls << ' '
+          << std::setw(10) << std::setprecision(3) << static_cast<double>(k.ns) / 1e6 << ' ';
+      if (k.counts(perf_cycles) && k.counts(perf_instructions))
+        out << std::setw(8) << std::setprecision(2) << k.ipc() << ' ';
+      else
+        out << std::setw(8) << '-' << ' ';
+      out << std::setw(9) << std::setprecision(3) << k.gflops() << ' '
+          << std::setw(13) << std::setprecision(1) << k.bytes_per_symbol() << ' ';
+      if (k.counts(perf_llc_misses))
+        out << std::setw(18) << std::setprecision(4) << k.llc_misses_per_symbol() << ' ';
+      else
+        out << std::setw(18) << '-' << ' ';
+      if (k.counts(perf_branch_misses))
+        out << std::setw(14) << k.counters[perf_branch_misses] << "  ";
+      else
+        out << std::setw(14) << '-' << "  ";
+      out << k.name << '\n';
+    }
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+  void kernel_counters::reset()
+  {
+    std::lock_guard<std::mutex> lock(kernels_mutex);
+    for (kernel_statistics& k : kernels) {
+      std::string name = std::move(k.name);
+      k = kernel_statistics();
+      k.name = std::move(name);
+      k.events = (1u << perf_events) - 1;
+    }
+  }
+
+}
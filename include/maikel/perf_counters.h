@@ -0,0 +1,187 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIKEL_PERF_COUNTERS_H_
+#define MAIKEL_PERF_COUNTERS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "maikel/function_profiler.h"
+
+/*
+ * MAIKEL_KERNEL_PROFILER(work, "name") opens a named profiler scope and, if
+ * MAIKEL_PROFILE_COUNTERS is defined, reads the hardware counters of the
+ * calling thread at its start and its end. The kernel tells how much work
+ * it did through `work.add_work(flops, bytes, symbols)`, which costs
+ * nothing if the counters are disabled.
+ */
+#ifdef MAIKEL_PROFILE_COUNTERS
+#define MAIKEL_KERNEL_PROFILER(work, x) \
+  MAIKEL_NAMED_PROFILER(x); \
+  static ::maikel::kernel_site const MAIKEL_PROFILER_CONCAT(__maikel_kernel_site_, __LINE__)(x); \
+  ::maikel::kernel_counters work(MAIKEL_PROFILER_CONCAT(__maikel_kernel_site_, __LINE__))
+#else
+#define MAIKEL_KERNEL_PROFILER(work, x) \
+  MAIKEL_NAMED_PROFILER(x); \
+  ::maikel::kernel_work work
+#endif
+
+namespace maikel {
+
+  enum perf_event : unsigned {
+    perf_cycles = 0,
+    perf_instructions,
+    perf_llc_misses,
+    perf_branch_misses,
+    perf_events
+  };
+
+  /// Counter values, only meaningful for the events which could be opened.
+  struct perf_sample {
+      std::uint64_t values[perf_events] = {};
+  };
+
+  /**
+   * Cycles, instructions, last level cache misses and branch misses of the
+   * calling thread in user space, opened with perf_event_open(2) as one
+   * group. Events which can not be opened, because the kernel or the CPU
+   * does not support them or perf_event_paranoid forbids them, are left
+   * out and error() tells why. Without any event the group is unavailable
+   * and read() returns zeros, so callers do not need a special case.
+   *
+   * If the kernel multiplexes the group the values are scaled by the time
+   * it was enabled over the time it was running.
+   */
+  class perf_counter_group {
+    public:
+      perf_counter_group();
+      ~perf_counter_group();
+
+      perf_counter_group(perf_counter_group const&) = delete;
+      perf_counter_group& operator=(perf_counter_group const&) = delete;
+
+      bool available() const noexcept { return events_ != 0; }
+      bool counts(perf_event e) const noexcept { return events_ & (1u << e); }
+
+      /// Bit i is set if event i is counted.
+      unsigned events() const noexcept { return events_; }
+
+      /// Why some or all events could not be opened, empty if all were.
+      std::string const& error() const noexcept { return error_; }
+
+      perf_sample read() const noexcept;
+
+      /// The group of the calling thread, opened on its first use.
+      static perf_counter_group& this_thread();
+
+    private:
+      int fds_[perf_events];
+      unsigned events_ = 0;
+      std::string error_;
+  };
+
+  /// Totals of all calls of one kernel over all threads.
+  struct kernel_statistics {
+      std::string name;
+      std::uint64_t calls = 0;
+      std::uint64_t ns = 0;
+      unsigned events = 0;               // counted in every call, see perf_counter_group
+      std::uint64_t counters[perf_events] = {};
+      double flops = 0;
+      double bytes = 0;                  // touched by the kernel, not necessarily from memory
+      std::uint64_t symbols = 0;
+
+      bool counts(perf_event e) const noexcept { return events & (1u << e); }
+      double ipc() const noexcept;
+      double gflops() const noexcept;
+      double bytes_per_symbol() const noexcept;
+      double llc_misses_per_symbol() const noexcept;
+  };
+
+  /// Registers a kernel once, the macro keeps one static site per place.
+  class kernel_site {
+    public:
+      explicit kernel_site(char const* name);
+      std::uint32_t id() const noexcept { return id_; }
+
+    private:
+      std::uint32_t id_;
+  };
+
+  /// The work of a kernel if the counters are disabled.
+  struct kernel_work {
+      void add_work(double, double, std::uint64_t) const noexcept {}
+  };
+
+  /**
+   * Reads the counters of the calling thread at its construction and its
+   * destruction and adds the difference to the totals of its kernel. One
+   * read is a system call, so kernels should be scopes over a whole
+   * sequence or a whole iteration and not over a single step.
+   *
+   * Example:
+   *
+   *     {
+   *       MAIKEL_KERNEL_PROFILER(work, "forward");
+   *       for (auto&& alpha : forward(first, last, hmm))
+   *         logprob += std::log(alpha.first);
+   *       work.add_work(2.0*N*N*T, 8.0*N*N*T, T);
+   *     }
+   *     maikel::kernel_counters::print_statistics(std::cerr);
+   */
+  class kernel_counters {
+    public:
+      using clock = std::chrono::steady_clock;
+
+      explicit kernel_counters(kernel_site const& site) noexcept;
+      ~kernel_counters() noexcept;
+
+      kernel_counters(kernel_counters const&) = delete;
+      kernel_counters& operator=(kernel_counters const&) = delete;
+
+      /// Floating point operations, bytes touched and symbols processed by this call.
+      void add_work(double flops, double bytes, std::uint64_t symbols) noexcept
+      {
+        flops_ += flops;
+        bytes_ += bytes;
+        symbols_ += symbols;
+      }
+
+      /// Statistics of all kernels which were called, in the order of their sites.
+      static std::vector<kernel_statistics> statistics();
+
+      /// Prints IPC, GFLOP/s, bytes and misses per symbol per kernel. Prints nothing without kernels.
+      static void print_statistics(std::ostream& out);
+
+      static void reset();
+
+    private:
+      std::uint32_t site_;
+      perf_counter_group* group_;
+      perf_sample start_;
+      clock::time_point start_time_;
+      double flops_ = 0;
+      double bytes_ = 0;
+      std::uint64_t symbols_ = 0;
+  };
+
+}
+
+#endif /* MAIKEL_PERF_COUNTERS_H_ */
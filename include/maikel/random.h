@@ -0,0 +1,150 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIKEL_RANDOM_H_
+#define MAIKEL_RANDOM_H_
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <Eigen/Dense>
+#include <gsl_assert.h>
+
+namespace maikel {
+
+  /**
+   * Counter based random number engine. The n-th number of a stream is a
+   * pure function of (seed, n), computed by the splitmix64 finalizer. Streams
+   * can therefore be split between threads or skipped in O(1) and always
+   * give the same numbers for the same seed.
+   */
+  class counter_based_engine {
+    public:
+      using result_type = std::uint64_t;
+
+      explicit counter_based_engine(std::uint64_t seed = 0, std::uint64_t counter = 0) noexcept
+      : key_{mix(seed ^ 0x6a09e667f3bcc909ull)}, counter_{counter} {}
+
+      static constexpr result_type min() noexcept { return 0; }
+      static constexpr result_type max() noexcept { return std::numeric_limits<result_type>::max(); }
+
+      result_type operator()() noexcept
+      {
+        return at(counter_++);
+      }
+
+      result_type at(std::uint64_t n) const noexcept
+      {
+        return mix(key_ + (n + 1)*0x9e3779b97f4a7c15ull);
+      }
+
+      void discard(std::uint64_t n) noexcept { counter_ += n; }
+      void seek(std::uint64_t n) noexcept { counter_ = n; }
+      std::uint64_t counter() const noexcept { return counter_; }
+
+    private:
+      std::uint64_t key_;
+      std::uint64_t counter_;
+
+      static std::uint64_t mix(std::uint64_t z) noexcept
+      {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+      }
+  };
+
+  /**
+   * Maps 64 random bits to a uniformly distributed number in [0, 1).
+   */
+  template <class T>
+    inline T uniform_from_bits(std::uint64_t bits) noexcept
+    {
+      return static_cast<T>(bits >> 11) * static_cast<T>(1.0/9007199254740992.0);
+    }
+
+  /**
+   * Walker's alias table for sampling from a discrete distribution in O(1).
+   * Construction follows Vose's method. One draw consumes 64 random bits:
+   * the upper half selects a column and the lower half is the biased coin.
+   */
+  class alias_table {
+    public:
+      alias_table() = default;
+
+      template <class Derived>
+        explicit alias_table(Eigen::DenseBase<Derived> const& weights)
+        {
+          using Index = typename Eigen::DenseBase<Derived>::Index;
+          std::size_t n = weights.size();
+          Expects(n > 0 && n <= std::numeric_limits<std::uint32_t>::max());
+          threshold_.resize(n);
+          alias_.resize(n);
+
+          double total = 0;
+          for (Index i = 0; i < weights.size(); ++i)
+            total += weights(i);
+          Expects(total > 0);
+
+          std::vector<double> scaled(n);
+          std::vector<std::uint32_t> small, large;
+          for (std::size_t i = 0; i < n; ++i) {
+            scaled[i] = weights(static_cast<Index>(i)) * n / total;
+            (scaled[i] < 1 ? small : large).push_back(static_cast<std::uint32_t>(i));
+          }
+          while (!small.empty() && !large.empty()) {
+            std::uint32_t s = small.back();
+            std::uint32_t l = large.back();
+            small.pop_back();
+            set(s, scaled[s], l);
+            scaled[l] -= 1 - scaled[s];
+            if (scaled[l] < 1) {
+              large.pop_back();
+              small.push_back(l);
+            }
+          }
+          for (std::uint32_t l : large)
+            set(l, 1, l);
+          for (std::uint32_t s : small)
+            set(s, 1, s);
+        }
+
+      std::size_t size() const noexcept { return alias_.size(); }
+
+      std::size_t operator()(std::uint64_t bits) const noexcept
+      {
+        std::uint64_t column = ((bits >> 32) * alias_.size()) >> 32;
+        std::uint32_t coin = static_cast<std::uint32_t>(bits);
+        return coin < threshold_[column] ? column : alias_[column];
+      }
+
+    private:
+      // probability to keep a column, in units of 2^-32
+      std::vector<std::uint64_t> threshold_;
+      std::vector<std::uint32_t> alias_;
+
+      void set(std::uint32_t column, double probability, std::uint32_t alias)
+      {
+        threshold_[column] = probability >= 1
+            ? (std::uint64_t{1} << 32)
+            : static_cast<std::uint64_t>(probability * 4294967296.0);
+        alias_[column] = alias;
+      }
+  };
+
+}
+
+#endif /* MAIKEL_RANDOM_H_ */
@@ -0,0 +1,609 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/binary_sequence.h"
+#include "maikel/hmm/corpus.h"
+#include "maikel/hmm/io.h"
+#include "maikel/hmm/sequence_generator.h"
+#include "maikel/hmm/symbol_reader.h"
+#include "maikel/iterator/async_binary_writer.h"
+#include "maikel/iterator/bfloat16_coefficients.h"
+#include "maikel/iterator/getlines.h"
+#include "maikel/iterator/mapped_coefficients.h"
+#include "maikel/iterator/ostream_binary_iterator.h"
+#include "maikel/iterator/reverse_block_reader.h"
+
+enum Exit_Error_Codes {
+  exit_success = 0,
+  exit_not_enough_arguments = 1,
+  exit_io_error = 2,
+  exit_argument_error = 3
+};
+
+using float_type = double;
+using model = maikel::hmm::hidden_markov_model<float_type>;
+using clock_type = std::chrono::steady_clock;
+
+volatile double sink;
+
+struct io_options {
+    std::string prefix = "io_bench";
+    std::size_t states = 32;             // of the coefficient files
+    std::size_t model_states = 256;      // of the model file
+    std::size_t symbols = 16;
+    std::size_t length = std::size_t{1} << 22;
+    std::size_t records = std::size_t{1} << 18;
+    std::size_t corpus_sequence = 10000; // length of one sequence in the corpus
+    std::vector<std::string> caches { "warm", "cold" };
+    std::vector<std::string> paths;      // empty means all
+    unsigned repetitions = 3;
+    std::uint64_t seed = 1;
+    bool sync = false;
+    bool keep = false;
+};
+
+/// A reader or writer of one file. run() returns the number of records it read or wrote.
+struct io_case {
+    std::string name;
+    std::string file;
+    std::string unit;
+    bool writer;
+    std::function<std::size_t()> run;
+};
+
+struct io_result {
+    std::string name;
+    std::string cache;                   // "warm", "cold" or "-" for writers
+    std::string unit;
+    std::uint64_t bytes;
+    std::size_t records;
+    std::vector<double> seconds;         // one per repetition
+    double resident;                     // largest fraction of the file cached before a run
+};
+
+std::uint64_t file_size(std::string const& path)
+{
+  struct stat info;
+  if (::stat(path.c_str(), &info))
+    throw std::runtime_error("Could not stat " + path + ".");
+  return static_cast<std::uint64_t>(info.st_size);
+}
+
+/// Flushes the dirty pages of a file, even if it has already been closed.
+void sync_file(std::string const& path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Could not open " + path + ".");
+  ::fdatasync(fd);
+  ::close(fd);
+}
+
+/**
+ * Drops the clean pages of a file from the page cache. Dirty pages cannot
+ * be dropped, so the file is synced first. This works without privileges,
+ * unlike /proc/sys/vm/drop_caches, but pages shared with another mapping
+ * stay resident, which resident_fraction() shows.
+ */
+void evict(std::string const& path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Could not open " + path + ".");
+  ::fdatasync(fd);
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+}
+
+/// Fraction of the pages of a file which are in the page cache.
+double resident_fraction(std::string const& path)
+{
+  std::uint64_t size = file_size(path);
+  if (!size)
+    return 1.0;
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return -1.0;
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return -1.0;
+  std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  std::vector<unsigned char> pages((size + page - 1) / page);
+  double fraction = -1.0;
+  if (!::mincore(data, size, pages.data())) {
+    std::size_t resident = 0;
+    for (unsigned char p : pages)
+      resident += p & 1;
+    fraction = static_cast<double>(resident) / static_cast<double>(pages.size());
+  }
+  ::munmap(data, size);
+  return fraction;
+}
+
+double median(std::vector<double> samples)
+{
+  std::sort(samples.begin(), samples.end());
+  std::size_t n = samples.size();
+  return n % 2 ? samples[n/2] : (samples[n/2 - 1] + samples[n/2]) / 2;
+}
+
+std::vector<io_case> make_cases(io_options const& options, model const& hmm,
+    std::vector<std::uint32_t> const& sequence, std::vector<double> const& alpha)
+{
+  using namespace maikel;
+  using namespace maikel::hmm;
+  std::string model_file = options.prefix + ".model.txt";
+  std::string text_file = options.prefix + ".sequence.txt";
+  std::string binary_file = options.prefix + ".sequence.bin";
+  std::string corpus_file = options.prefix + ".corpus.bin";
+  std::string coefficient_file = options.prefix + ".alphas.bin";
+  std::string bfloat16_file = options.prefix + ".alphas.bf16";
+  std::size_t N = options.states;
+  std::size_t M = options.symbols;
+  std::size_t records = options.records;
+  std::size_t numbers = static_cast<std::size_t>(hmm.states()*(hmm.states() + hmm.symbols() + 1));
+  double scaling = 0.5;
+
+  std::vector<io_case> cases;
+
+  // writers, which also create the files of the readers
+  cases.push_back({"write_model", model_file, "numbers", true, [=, &hmm] {
+    std::ofstream out(model_file);
+    write_hidden_markov_model(out, hmm);
+    return numbers;
+  }});
+  cases.push_back({"write_text_sequence", text_file, "symbols", true, [=, &sequence] {
+    std::ofstream out(text_file);
+    write_text_sequence(out, sequence.begin(), sequence.end(), M);
+    return sequence.size();
+  }});
+  cases.push_back({"write_binary_sequence", binary_file, "symbols", true, [=, &sequence] {
+    std::ofstream out(binary_file, std::ofstream::binary);
+    binary_sequence_writer writer(out, M, sequence.size());
+    writer.write(sequence.begin(), sequence.end());
+    writer.close();
+    return sequence.size();
+  }});
+  cases.push_back({"write_corpus", corpus_file, "symbols", true, [=, &sequence] {
+    std::vector<std::string> alphabet;
+    for (std::size_t o = 0; o < M; ++o)
+      alphabet.push_back(std::to_string(o));
+    corpus_writer writer(corpus_file, alphabet);
+    for (std::size_t t = 0; t < sequence.size(); t += options.corpus_sequence) {
+      std::size_t end = std::min(sequence.size(), t + options.corpus_sequence);
+      writer.add(sequence.begin() + t, sequence.begin() + end);
+    }
+    writer.close();
+    return sequence.size();
+  }});
+  cases.push_back({"write_ofstream", coefficient_file, "records", true, [=, &alpha] {
+    std::ofstream out(coefficient_file, std::ofstream::binary);
+    for (std::size_t t = 0; t < records; ++t) {
+      out.write(reinterpret_cast<char const*>(&scaling), sizeof(double));
+      out.write(reinterpret_cast<char const*>(alpha.data()), static_cast<std::streamsize>(N*sizeof(double)));
+    }
+    return records;
+  }});
+  cases.push_back({"write_buffered_iterator", coefficient_file, "records", true, [=, &alpha] {
+    std::ofstream out(coefficient_file, std::ofstream::binary);
+    ostream_buffered_binary_iterator<double, 4096> writer(out);
+    alpha_type<double> record(scaling, alpha);
+    for (std::size_t t = 0; t < records; ++t)
+      *writer++ = record;
+    writer.flush();
+    return records;
+  }});
+  cases.push_back({"write_async", coefficient_file, "records", true, [=, &alpha] {
+    async_binary_writer out(coefficient_file);
+    for (std::size_t t = 0; t < records; ++t) {
+      out.write_value(scaling);
+      out.write(alpha.data(), N*sizeof(double));
+    }
+    out.close();
+    return records;
+  }});
+  cases.push_back({"write_async_direct", coefficient_file, "records", true, [=, &alpha] {
+    async_binary_writer out(coefficient_file, async_binary_writer::default_buffer_bytes, 2, true);
+    for (std::size_t t = 0; t < records; ++t) {
+      out.write_value(scaling);
+      out.write(alpha.data(), N*sizeof(double));
+    }
+    out.close();
+    return records;
+  }});
+  // the compact spill format, alpha only and a quarter of the bytes
+  cases.push_back({"write_async_bfloat16", bfloat16_file, "records", true, [=, &alpha] {
+    async_binary_writer out(bfloat16_file);
+    async_bfloat16_output_iterator<double> writer(out);
+    for (std::size_t t = 0; t < records; ++t)
+      *writer++ = alpha;
+    out.close();
+    return records;
+  }});
+
+  // readers of the model file
+  cases.push_back({"read_hidden_markov_model", model_file, "numbers", false, [=] {
+    std::ifstream in(model_file);
+    model read = read_hidden_markov_model<float_type>(in);
+    sink = read.transition_matrix()(0, 0);
+    return numbers;
+  }});
+  cases.push_back({"getlines", model_file, "lines", false, [=] {
+    std::ifstream in(model_file);
+    std::size_t count = 0, bytes = 0;
+    for (std::string const& line : getlines(in)) {
+      bytes += line.size();
+      ++count;
+    }
+    sink = static_cast<double>(bytes);
+    return count;
+  }});
+  cases.push_back({"std_getline", model_file, "lines", false, [=] {
+    std::ifstream in(model_file);
+    std::string line;
+    std::size_t count = 0, bytes = 0;
+    while (std::getline(in, line)) {
+      bytes += line.size();
+      ++count;
+    }
+    sink = static_cast<double>(bytes);
+    return count;
+  }});
+
+  // readers of the sequence files
+  cases.push_back({"read_sequence", text_file, "symbols", false, [=] {
+    std::ifstream in(text_file);
+    std::vector<std::uint32_t> read = read_sequence<std::uint32_t>(in);
+    sink = read.back();
+    return read.size();
+  }});
+  cases.push_back({"read_packed_sequence", text_file, "symbols", false, [=] {
+    std::ifstream in(text_file);
+    packed_sequence<> read = read_packed_sequence(in);
+    sink = static_cast<double>(read.size());
+    return read.size();
+  }});
+  cases.push_back({"symbol_reader_text", text_file, "symbols", false, [=] {
+    symbol_reader reader(text_file);
+    std::vector<packed_symbol> chunk(1 << 16);
+    std::size_t count = 0, checksum = 0;
+    while (std::size_t n = reader.read(chunk.data(), chunk.size())) {
+      checksum += chunk[n - 1];
+      count += n;
+    }
+    sink = static_cast<double>(checksum);
+    return count;
+  }});
+  cases.push_back({"read_binary_sequence", binary_file, "symbols", false, [=] {
+    std::ifstream in(binary_file, std::ifstream::binary);
+    packed_sequence<> read = read_binary_sequence(in);
+    sink = static_cast<double>(read.size());
+    return read.size();
+  }});
+  cases.push_back({"symbol_reader_binary", binary_file, "symbols", false, [=] {
+    symbol_reader reader(binary_file);
+    std::vector<packed_symbol> chunk(1 << 16);
+    std::size_t count = 0, checksum = 0;
+    while (std::size_t n = reader.read(chunk.data(), chunk.size())) {
+      checksum += chunk[n - 1];
+      count += n;
+    }
+    sink = static_cast<double>(checksum);
+    return count;
+  }});
+  cases.push_back({"reverse_packed_sequence_reader", binary_file, "symbols", false, [=] {
+    reverse_packed_sequence_reader reader(binary_file);
+    std::size_t count = 0, checksum = 0;
+    for (auto&& symbol : reader) {
+      checksum += symbol;
+      ++count;
+    }
+    sink = static_cast<double>(checksum);
+    return count;
+  }});
+  cases.push_back({"corpus", corpus_file, "symbols", false, [=] {
+    hmm::corpus sessions(corpus_file);
+    std::size_t count = 0, checksum = 0;
+    for (std::size_t i = 0; i < sessions.size(); ++i)
+      for (auto&& symbol : sessions[i]) {
+        checksum += symbol;
+        ++count;
+      }
+    sink = static_cast<double>(checksum);
+    return count;
+  }});
+
+  // readers of the coefficient file
+  cases.push_back({"alphas_binary_input_iterator", coefficient_file, "records", false, [=] {
+    std::ifstream in(coefficient_file, std::ifstream::binary);
+    alphas_binary_input_iterator<double> first(in, N), last;
+    std::size_t count = 0;
+    double checksum = 0;
+    for (; first != last; ++first, ++count)
+      checksum += std::accumulate(first->second.begin(), first->second.end(), first->first);
+    sink = checksum;
+    return count;
+  }});
+  cases.push_back({"mapped_coefficients", coefficient_file, "records", false, [=] {
+    mapped_coefficients<double> alphas(coefficient_file, N);
+    double checksum = 0;
+    for (auto it = alphas.begin(); it != alphas.end(); ++it)
+      checksum += (*it).first + (*it).second.sum();
+    sink = checksum;
+    return alphas.size();
+  }});
+  cases.push_back({"mapped_coefficients_reverse", coefficient_file, "records", false, [=] {
+    mapped_coefficients<double> alphas(coefficient_file, N);
+    double checksum = 0;
+    for (auto it = alphas.rbegin(); it != alphas.rend(); ++it)
+      checksum += (*it).first + (*it).second.sum();
+    sink = checksum;
+    return alphas.size();
+  }});
+  cases.push_back({"reverse_binary_reader", coefficient_file, "records", false, [=] {
+    reverse_binary_reader<double> values(coefficient_file);
+    std::size_t count = 0;
+    double checksum = 0;
+    for (double value : values) {
+      checksum += value;
+      ++count;
+    }
+    sink = checksum;
+    return count / (N + 1);
+  }});
+  cases.push_back({"mapped_bfloat16_coefficients", bfloat16_file, "records", false, [=] {
+    mapped_bfloat16_coefficients<double> alphas(bfloat16_file, N);
+    Eigen::RowVectorXd record;
+    double checksum = 0;
+    for (std::size_t t = 0; t < alphas.size(); ++t) {
+      alphas.decode(t, record);
+      checksum += record.sum();
+    }
+    sink = checksum;
+    return alphas.size();
+  }});
+  return cases;
+}
+
+bool selected(io_options const& options, std::string const& name)
+{
+  return options.paths.empty()
+      || std::find(options.paths.begin(), options.paths.end(), name) != options.paths.end();
+}
+
+io_result measure(io_case const& c, std::string const& cache, io_options const& options)
+{
+  io_result result { c.name, c.writer ? "-" : cache, c.unit, 0, 0, {}, 0.0 };
+  if (!c.writer && cache == "warm")
+    c.run();
+  for (unsigned r = 0; r < options.repetitions; ++r) {
+    if (!c.writer && cache == "cold") {
+      evict(c.file);
+      result.resident = std::max(result.resident, resident_fraction(c.file));
+    }
+    clock_type::time_point start = clock_type::now();
+    result.records = c.run();
+    if (c.writer && options.sync)
+      sync_file(c.file);
+    result.seconds.push_back(std::chrono::duration<double>(clock_type::now() - start).count());
+  }
+  if (!c.writer && cache == "warm")
+    result.resident = resident_fraction(c.file);
+  result.bytes = file_size(c.file);
+  return result;
+}
+
+void print_result(io_result const& r)
+{
+  double seconds = median(r.seconds);
+  std::cout << std::left << std::setw(31) << r.name << std::right << std::setw(6) << r.cache
+            << std::fixed << std::setprecision(1) << std::setw(10) << static_cast<double>(r.bytes) / 1e6
+            << std::setw(11) << static_cast<double>(r.bytes) / 1e6 / seconds
+            << std::setprecision(3) << std::setw(13) << static_cast<double>(r.records) / 1e6 / seconds
+            << ' ' << std::left << std::setw(8) << r.unit << std::right;
+  if (r.cache == "-")
+    std::cout << std::setw(10) << '-';
+  else
+    std::cout << std::setprecision(0) << std::setw(9) << 100*r.resident << '%';
+  std::cout << '\n';
+}
+
+void write_json(std::ostream& out, io_options const& options, std::vector<io_result> const& results)
+{
+  out << "{\"repetitions\":" << options.repetitions << ",\"seed\":" << options.seed
+      << ",\"states\":" << options.states << ",\"model_states\":" << options.model_states
+      << ",\"symbols\":" << options.symbols << ",\"length\":" << options.length
+      << ",\"records\":" << options.records << ",\"sync\":" << (options.sync ? "true" : "false")
+      << ",\n\"results\":[";
+  out << std::setprecision(6);
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    io_result const& r = results[i];
+    double seconds = median(r.seconds);
+    out << (i ? ",\n" : "\n")
+        << "{\"path\":\"" << r.name << "\",\"cache\":\"" << r.cache << "\",\"unit\":\"" << r.unit
+        << "\",\"bytes\":" << r.bytes << ",\"records\":" << r.records
+        << ",\"seconds\":" << seconds
+        << ",\"mb_per_second\":" << static_cast<double>(r.bytes) / 1e6 / seconds
+        << ",\"records_per_second\":" << static_cast<double>(r.records) / seconds
+        << ",\"resident\":" << (r.cache == "-" ? 0.0 : r.resident) << "}";
+  }
+  out << "\n]}\n";
+}
+
+template <class T>
+  bool parse_number(std::string const& argument, T& value)
+  {
+    std::istringstream in(argument);
+    double number;
+    if (!(in >> number) || number < 1)
+      return false;
+    value = static_cast<T>(number);
+    return true;
+  }
+
+std::vector<std::string> split(std::string const& argument)
+{
+  std::vector<std::string> list;
+  std::istringstream in(argument);
+  std::string item;
+  while (std::getline(in, item, ','))
+    list.push_back(item);
+  return list;
+}
+
+void print_usage(char const* program)
+{
+  std::cerr << "Usage: " << program << " [--prefix <path>] [--states <n>] [--model-states <n>]\n"
+            << "           [--symbols <m>] [--length <t>] [--records <r>] [--cache <warm,cold>]\n"
+            << "           [--paths <name,...>] [--repetitions <runs>] [--seed <seed>]\n"
+            << "           [--sync] [--keep] [--json <file>]\n"
+            << "Writes a random model, text and binary sequences, a corpus and files of\n"
+            << "forward coefficients in double and bfloat16 next to <path> with every\n"
+            << "writer, then reads them with every reader. Prints the median MB/s and\n"
+            << "records/s of each, for the readers once with the file in the page cache\n"
+            << "and once after dropping it, and how much of the file was cached before\n"
+            << "the run. With --sync the writers are timed until the data is on disk.\n"
+            << "The files are removed at the end unless --keep is given.\n";
+}
+
+int main(int argc, char *argv[])
+{
+  using namespace maikel::hmm;
+
+  io_options options;
+  std::string json_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+    bool ok = true;
+    if (argument == "--prefix" && i+1 < argc)
+      options.prefix = argv[++i];
+    else if (argument == "--states" && i+1 < argc)
+      ok = parse_number(argv[++i], options.states);
+    else if (argument == "--model-states" && i+1 < argc)
+      ok = parse_number(argv[++i], options.model_states);
+    else if (argument == "--symbols" && i+1 < argc)
+      ok = parse_number(argv[++i], options.symbols);
+    else if (argument == "--length" && i+1 < argc)
+      ok = parse_number(argv[++i], options.length);
+    else if (argument == "--records" && i+1 < argc)
+      ok = parse_number(argv[++i], options.records);
+    else if (argument == "--cache" && i+1 < argc)
+      options.caches = split(argv[++i]);
+    else if (argument == "--paths" && i+1 < argc)
+      options.paths = split(argv[++i]);
+    else if (argument == "--repetitions" && i+1 < argc)
+      ok = parse_number(argv[++i], options.repetitions);
+    else if (argument == "--seed" && i+1 < argc)
+      options.seed = std::stoull(argv[++i]);
+    else if (argument == "--sync")
+      options.sync = true;
+    else if (argument == "--keep")
+      options.keep = true;
+    else if (argument == "--json" && i+1 < argc)
+      json_path = argv[++i];
+    else {
+      print_usage(argv[0]);
+      return exit_argument_error;
+    }
+    if (!ok) {
+      std::cerr << "Could not read the number " << argv[i] << ".\n";
+      return exit_argument_error;
+    }
+  }
+  for (std::string const& cache : options.caches)
+    if (cache != "warm" && cache != "cold") {
+      std::cerr << "Unknown cache state " << cache << ".\n";
+      return exit_argument_error;
+    }
+
+  model hmm = random_hidden_markov_model<float_type>(
+      static_cast<model::size_type>(options.model_states),
+      static_cast<model::size_type>(options.symbols), options.seed);
+  model small = random_hidden_markov_model<float_type>(
+      static_cast<model::size_type>(options.states),
+      static_cast<model::size_type>(options.symbols), options.seed);
+  std::vector<std::uint32_t> sequence(options.length), states(options.length);
+  make_sequence_generator(small, options.seed).generate_into(
+      options.length, sequence.data(), states.data(), 1);
+  std::vector<double> alpha(options.states, 1.0 / static_cast<double>(options.states));
+
+  std::vector<io_case> cases = make_cases(options, hmm, sequence, alpha);
+  std::vector<io_result> results;
+  try {
+    // every writer runs once, so that all files exist whichever paths are selected
+    for (io_case const& c : cases)
+      if (c.writer && !selected(options, c.name))
+        c.run();
+
+    std::cout << "path                            cache        MB       MB/s    Mrecords/s unit      cached\n";
+    for (io_case const& c : cases) {
+      if (!selected(options, c.name))
+        continue;
+      if (c.writer) {
+        results.push_back(measure(c, "-", options));
+        print_result(results.back());
+      } else {
+        for (std::string const& cache : options.caches) {
+          results.push_back(measure(c, cache, options));
+          print_result(results.back());
+        }
+      }
+    }
+  } catch (std::runtime_error const& error) {
+    std::cerr << "I/O failed: " << error.what() << '\n';
+    return exit_io_error;
+  }
+
+  if (!options.keep) {
+    std::vector<std::string> files;
+    for (io_case const& c : cases)
+      if (std::find(files.begin(), files.end(), c.file) == files.end())
+        files.push_back(c.file);
+    for (std::string const& file : files)
+      std::remove(file.c_str());
+  }
+
+  if (!json_path.empty()) {
+    std::ofstream json(json_path);
+    if (!json) {
+      std::cerr << "Could not open " << json_path << " for writing.\n";
+      return exit_io_error;
+    }
+    write_json(json, options, results);
+  }
+  return exit_success;
+}
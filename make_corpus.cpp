@@ -0,0 +1,132 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "maikel/hmm/binary_sequence.h"
+#include "maikel/hmm/corpus.h"
+#include "maikel/hmm/io.h"
+
+enum Exit_Error_Codes {
+  exit_success = 0,
+  exit_not_enough_arguments = 1,
+  exit_io_error = 2,
+  exit_argument_error = 3
+};
+
+using symbol_map = std::map<std::string, maikel::hmm::packed_symbol>;
+
+void print_usage(char const* program)
+{
+  std::cerr << "Usage: " << program << " <output.corpus> [sequence files ...]\n"
+            << "Reads the names of the sequence files from stdin if none are given.\n";
+}
+
+std::vector<std::string> alphabet_of(symbol_map const& symbol_to_index)
+{
+  std::vector<std::string> alphabet(symbol_to_index.size());
+  for (auto const& entry : symbol_to_index)
+    alphabet[entry.second] = entry.first;
+  return alphabet;
+}
+
+std::vector<std::string> numbered_alphabet(std::size_t symbols)
+{
+  std::vector<std::string> alphabet;
+  for (std::size_t i = 0; i < symbols; ++i)
+    alphabet.push_back(std::to_string(i));
+  return alphabet;
+}
+
+/**
+ * Appends one text or packed binary sequence file to the corpus. The first
+ * file fixes the alphabet. Symbols of later text files are mapped by name.
+ */
+void add_sequence_file(
+    std::string const& path, std::unique_ptr<maikel::hmm::corpus_writer>& writer,
+    std::string const& corpus_path)
+{
+  std::ifstream in(path, std::ifstream::binary);
+  if (!in)
+    throw maikel::hmm::corpus_error("Could not open " + path + ".");
+  if (maikel::hmm::is_packed_sequence(in)) {
+    maikel::hmm::packed_sequence<> sequence = maikel::hmm::read_binary_sequence(in);
+    if (!writer)
+      writer.reset(new maikel::hmm::corpus_writer(corpus_path, numbered_alphabet(sequence.symbols())));
+    if (writer->alphabet() != numbered_alphabet(sequence.symbols()))
+      throw maikel::hmm::corpus_error(path + " uses a different alphabet than the corpus.");
+    writer->add(sequence);
+    return;
+  }
+  symbol_map file_symbols = maikel::hmm::read_symbol_map<maikel::hmm::packed_symbol>(in);
+  std::vector<std::string> file_alphabet = alphabet_of(file_symbols);
+  if (!writer)
+    writer.reset(new maikel::hmm::corpus_writer(corpus_path, file_alphabet));
+  std::vector<std::string> const& alphabet = writer->alphabet();
+  symbol_map corpus_symbols;
+  for (std::size_t i = 0; i < alphabet.size(); ++i)
+    corpus_symbols[alphabet[i]] = static_cast<maikel::hmm::packed_symbol>(i);
+  for (std::string const& name : file_alphabet)
+    if (!corpus_symbols.count(name))
+      throw maikel::hmm::corpus_error(path + " has the symbol " + name + " which is not in the corpus.");
+  maikel::hmm::packed_sequence<> sequence(alphabet.size());
+  sequence.reserve(maikel::hmm::read_sequence_length<std::size_t>(in));
+  std::string symbol;
+  while (in >> symbol) {
+    auto found = corpus_symbols.find(symbol);
+    if (found == corpus_symbols.end())
+      throw maikel::hmm::read_sequence_error("Unkown Symbols in Input.");
+    sequence.push_back(found->second);
+  }
+  writer->add(sequence);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return exit_not_enough_arguments;
+  }
+  std::string corpus_path(argv[1]);
+  std::vector<std::string> paths(argv + 2, argv + argc);
+  if (paths.empty())
+    paths.assign(std::istream_iterator<std::string>(std::cin), std::istream_iterator<std::string>());
+  if (paths.empty()) {
+    print_usage(argv[0]);
+    return exit_not_enough_arguments;
+  }
+
+  std::unique_ptr<maikel::hmm::corpus_writer> writer;
+  try {
+    for (std::string const& path : paths)
+      add_sequence_file(path, writer, corpus_path);
+    writer->close();
+  } catch (std::exception const& error) {
+    std::cerr << error.what() << "\n";
+    return exit_io_error;
+  }
+
+  maikel::hmm::corpus result(corpus_path);
+  std::cout << result.size() << " sequences with " << result.total_length()
+            << " symbols over an alphabet of " << result.symbols() << " symbols.\n";
+  return exit_success;
+}
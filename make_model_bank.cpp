@@ -0,0 +1,85 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/model_bank.h"
+#include "maikel/hmm/io.h"
+
+enum Exit_Error_Codes {
+  exit_success = 0,
+  exit_not_enough_arguments = 1,
+  exit_io_error = 2,
+  exit_argument_error = 3
+};
+
+void print_usage(char const* program)
+{
+  std::cerr << "Usage: " << program << " <output.bank> [model.dat ...]\n"
+            << "Reads the names of the model files from stdin if none are given.\n"
+            << "Every model is named after its file without directory and extension.\n";
+}
+
+std::string model_name(std::string const& path)
+{
+  std::string::size_type slash = path.find_last_of('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  std::string::size_type dot = name.find_last_of('.');
+  return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+int main(int argc, char *argv[])
+{
+  using float_type = double;
+
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return exit_not_enough_arguments;
+  }
+  std::string bank_path(argv[1]);
+  std::vector<std::string> paths(argv + 2, argv + argc);
+  if (paths.empty())
+    paths.assign(std::istream_iterator<std::string>(std::cin), std::istream_iterator<std::string>());
+  if (paths.empty()) {
+    print_usage(argv[0]);
+    return exit_not_enough_arguments;
+  }
+
+  try {
+    maikel::hmm::model_bank_writer<float_type> writer(bank_path);
+    for (std::string const& path : paths) {
+      std::ifstream in(path);
+      if (!in) {
+        std::cerr << "Could not open " << path << ".\n";
+        return exit_io_error;
+      }
+      writer.add(model_name(path), maikel::hmm::read_hidden_markov_model<float_type>(in));
+    }
+    writer.close();
+  } catch (std::exception const& error) {
+    std::cerr << error.what() << "\n";
+    return exit_io_error;
+  }
+
+  maikel::hmm::model_bank<float_type> bank(bank_path);
+  std::cout << "Wrote " << bank.size() << " models to " << bank_path << ".\n";
+  return exit_success;
+}
@@ -16,11 +16,16 @@
 
 #include "hidden-markov-models.t.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <tuple>
 #include <vector>
 #include <Eigen/Dense>
 #include "maikel/hmm/hidden_markov_model.h"
 #include "maikel/hmm/algorithm.h"
+#include "maikel/hmm/sequence_generator.h"
 
 namespace {
 
@@ -74,6 +79,393 @@ CASE ( "Test forward algorithm for test case in Rabiners Paper" ) {
   EXPECT(maikel::almost_equal(probability, 1.536f /10000));
 }
 
+CASE ( "Block forward algorithm agrees with the forward algorithm" ) {
+  Eigen::Matrix3d A;
+  A << 0.4, 0.3, 0.3,
+       0.2, 0.6, 0.2,
+       0.1, 0.1, 0.8;
+  Eigen::Matrix<double, 3, 2> B;
+  B << 0.9, 0.1,
+       0.3, 0.7,
+       0.5, 0.5;
+  Eigen::RowVector3d pi;
+  pi << 0.2, 0.3, 0.5;
+  maikel::hmm::hidden_markov_model<double> hmm(A, B, pi);
+  std::vector<int> sequence;
+  for (int t = 0; t < 1000; ++t)
+    sequence.push_back((t*t + t/7) % 2);
+
+  double logprob = 0;
+  std::vector<std::pair<double, Eigen::RowVectorXd>> coefficients;
+  for (auto&& alpha : maikel::hmm::forward(begin(sequence), end(sequence), hmm)) {
+    logprob -= std::log(alpha.first);
+    coefficients.push_back(alpha);
+  }
+
+  for (std::size_t k : { 1, 3, 5, 8 }) {
+    maikel::hmm::block_transfer_table<double> table(hmm, k);
+    EXPECT(table.blocks() == (1 << k));
+    double block_logprob =
+        maikel::hmm::block_log_likelihood(begin(sequence), end(sequence), table, hmm);
+    EXPECT((maikel::almost_equal<double, 1000>(logprob, block_logprob)));
+
+    std::vector<std::pair<double, Eigen::RowVectorXd>> expanded;
+    auto blocks = maikel::hmm::block_forward(begin(sequence), end(sequence), table, hmm);
+    for (auto it = blocks.begin(); it != blocks.end(); ++it)
+      blocks.expand(std::back_inserter(expanded));
+    EXPECT(expanded.size() == coefficients.size());
+    for (std::size_t t = 0; t < expanded.size(); ++t)
+      EXPECT(expanded[t].second.isApprox(coefficients[t].second));
+  }
+
+  maikel::hmm::block_transfer_table<double> table(hmm);
+  EXPECT(table.block_length() > 1);
+}
+
+CASE ( "Block backward coefficients agree with the backward algorithm" ) {
+  auto hmm = maikel::hmm::random_hidden_markov_model<double>(4, 2, 29);
+  std::vector<int> sequence;
+  for (int t = 0; t < 1000; ++t)
+    sequence.push_back((t*t + t/7) % 2);
+
+  double logprob = 0;
+  std::vector<double> scaling;
+  for (auto&& alpha : maikel::hmm::forward(begin(sequence), end(sequence), hmm)) {
+    logprob -= std::log(alpha.first);
+    scaling.push_back(alpha.first);
+  }
+  std::vector<Eigen::RowVectorXd> betas(sequence.size());
+  std::size_t t = sequence.size();
+  for (auto&& beta : maikel::hmm::backward(sequence.rbegin(), sequence.rend(), scaling.rbegin(), hmm))
+    betas[--t] = beta / beta.sum();
+
+  for (std::size_t k : { 1, 3, 5, 8 }) {
+    maikel::hmm::block_transfer_table<double> table(hmm, k);
+    auto blocks = maikel::hmm::block_backward(sequence.rbegin(), sequence.rend(), table, hmm);
+    double log_norm = 0;
+    Eigen::RowVectorXd beta_0;
+    std::size_t position = sequence.size();
+    for (auto&& beta : blocks) {
+      position -= blocks.step_length();
+      EXPECT(beta.second.isApprox(betas[position]));
+      log_norm += beta.first;
+      beta_0 = beta.second;
+    }
+    EXPECT(position == 0u);
+    Eigen::RowVectorXd weighted = hmm.initial_distribution().cwiseProduct(
+        hmm.symbol_probabilities().col(sequence[0]).transpose());
+    double block_logprob = std::log(weighted.dot(beta_0)) + log_norm;
+    EXPECT((maikel::almost_equal<double, 1000>(logprob, block_logprob)));
+  }
+}
+
+CASE ( "The forward scorer agrees with the forward algorithm when fed in pieces" ) {
+  Eigen::Matrix3d A;
+  A << 0.4, 0.3, 0.3,
+       0.2, 0.6, 0.2,
+       0.1, 0.1, 0.8;
+  Eigen::Matrix<double, 3, 2> B;
+  B << 0.9, 0.1,
+       0.3, 0.7,
+       0.5, 0.5;
+  Eigen::RowVector3d pi;
+  pi << 0.2, 0.3, 0.5;
+  maikel::hmm::hidden_markov_model<double> hmm(A, B, pi);
+  std::vector<int> sequence;
+  for (int t = 0; t < 1000; ++t)
+    sequence.push_back((t*t + t/7) % 2);
+
+  double logprob = 0;
+  Eigen::RowVectorXd last_alpha;
+  for (auto&& alpha : maikel::hmm::forward(begin(sequence), end(sequence), hmm)) {
+    logprob -= std::log(alpha.first);
+    last_alpha = alpha.second;
+  }
+
+  maikel::hmm::forward_scorer<double> scorer(hmm);
+  scorer.push(sequence.front());
+  for (std::size_t t = 1; t < sequence.size(); t += 37)
+    scorer.push(sequence.begin() + t, sequence.begin() + std::min(t + 37, sequence.size()));
+  EXPECT(scorer.length() == sequence.size());
+  EXPECT((maikel::almost_equal<double, 1000>(logprob, scorer.log_likelihood())));
+  EXPECT(scorer.alpha().isApprox(last_alpha));
+
+  scorer.reset();
+  scorer.push(sequence.begin(), sequence.end());
+  EXPECT((maikel::almost_equal<double, 1000>(logprob, scorer.log_likelihood())));
+}
+
+CASE ( "The multi model scorer agrees with scoring every model on its own" ) {
+  std::vector<maikel::hmm::hidden_markov_model<double>> models;
+  for (int k = 0; k < 12; ++k) {
+    int states = 2 + k % 3, symbols = 2 + k % 2;
+    Eigen::MatrixXd A(states, states), B(states, symbols);
+    Eigen::RowVectorXd pi(states);
+    for (int i = 0; i < states; ++i) {
+      for (int j = 0; j < states; ++j)
+        A(i,j) = 1 + (i*j + k) % 5;
+      for (int o = 0; o < symbols; ++o)
+        B(i,o) = 1 + (i + o*k) % 3;
+      pi(i) = 1 + (i + k) % 2;
+      A.row(i) /= A.row(i).sum();
+      B.row(i) /= B.row(i).sum();
+    }
+    pi /= pi.sum();
+    models.emplace_back(A, B, pi);
+  }
+  std::vector<maikel::hmm::hidden_markov_model<double> const*> pointers;
+  for (auto const& hmm : models)
+    pointers.push_back(&hmm);
+  std::vector<int> sequence;
+  for (int t = 0; t < 5000; ++t)
+    sequence.push_back((t*t + t/7) % 2);
+
+  maikel::hmm::multi_forward_scorer<double> scorer(pointers);
+  EXPECT(scorer.size() == models.size());
+  EXPECT(scorer.symbols() == 2u);
+  scorer.push(sequence.begin(), sequence.end());
+  std::vector<double> expected;
+  for (auto const& hmm : models) {
+    maikel::hmm::forward_scorer<double> single(hmm);
+    single.push(sequence.begin(), sequence.end());
+    expected.push_back(single.log_likelihood());
+  }
+  std::vector<double> all = scorer.log_likelihoods();
+  for (std::size_t k = 0; k < models.size(); ++k)
+    EXPECT((maikel::almost_equal<double, 100000>(expected[k], all[k])));
+  std::size_t best = std::max_element(expected.begin(), expected.end()) - expected.begin();
+  EXPECT((maikel::almost_equal<double, 100000>(all[scorer.best()], expected[best])));
+
+  scorer.reset();
+  scorer.push(sequence.begin(), sequence.begin() + 10);
+  maikel::hmm::forward_scorer<double> single(models[3]);
+  single.push(sequence.begin(), sequence.begin() + 10);
+  EXPECT((maikel::almost_equal<double, 100000>(single.log_likelihood(), scorer.log_likelihood(3))));
+}
+
+CASE ( "Early abandoning scoring finds the same best models as scoring all of them" ) {
+  std::vector<maikel::hmm::hidden_markov_model<double>> models;
+  for (int k = 0; k < 40; ++k) {
+    int states = 2 + k % 4;
+    Eigen::MatrixXd A(states, states), B(states, 3);
+    Eigen::RowVectorXd pi(states);
+    for (int i = 0; i < states; ++i) {
+      for (int j = 0; j < states; ++j)
+        A(i,j) = 1 + (i*j + 3*k) % 7;
+      for (int o = 0; o < 3; ++o)
+        B(i,o) = 1 + (i*o + k) % 5;
+      pi(i) = 1;
+      A.row(i) /= A.row(i).sum();
+      B.row(i) /= B.row(i).sum();
+    }
+    pi /= pi.sum();
+    models.emplace_back(A, B, pi);
+  }
+  std::vector<maikel::hmm::hidden_markov_model<double> const*> pointers;
+  for (auto const& hmm : models)
+    pointers.push_back(&hmm);
+  std::vector<int> sequence;
+  for (int t = 0; t < 20000; ++t)
+    sequence.push_back((t*t + t/7) % 3);
+
+  std::vector<double> exact;
+  for (auto const& hmm : models) {
+    maikel::hmm::forward_scorer<double> scorer(hmm);
+    scorer.push(sequence.begin(), sequence.end());
+    exact.push_back(scorer.log_likelihood());
+  }
+  std::vector<double> sorted = exact;
+  std::sort(sorted.rbegin(), sorted.rend());
+
+  for (std::size_t top : { 1, 2 }) {
+    auto result = maikel::hmm::early_abandon_scores(sequence.begin(), sequence.end(), pointers, top);
+    EXPECT(result.ranking.size() == top);
+    for (std::size_t r = 0; r < top; ++r)
+      EXPECT((maikel::almost_equal<double, 1000>(exact[result.ranking[r]], sorted[r])));
+    for (std::size_t k = 0; k < models.size(); ++k) {
+      if (result.complete[k])
+        EXPECT((maikel::almost_equal<double, 1000>(exact[k], result.log_likelihoods[k])));
+      else
+        EXPECT(result.log_likelihoods[k] >= exact[k]);
+    }
+    EXPECT(result.steps < models.size()*sequence.size() / 2);
+  }
+
+  double threshold = sorted[0] + 1;
+  auto none = maikel::hmm::early_abandon_scores(sequence.begin(), sequence.end(), pointers, 1, threshold);
+  EXPECT(none.ranking.empty());
+}
+
+CASE ( "Early abandoning scoring abandons models without a symbol of the sequence" ) {
+  Eigen::MatrixXd A(2,2), B_small(2,2), B_large(2,3);
+  A << 0.7, 0.3,
+       0.4, 0.6;
+  B_small << 0.9, 0.1,
+             0.2, 0.8;
+  B_large << 0.5, 0.3, 0.2,
+             0.1, 0.3, 0.6;
+  Eigen::RowVectorXd pi(2);
+  pi << 0.5, 0.5;
+  maikel::hmm::hidden_markov_model<double> small(A, B_small, pi), large(A, B_large, pi);
+  std::vector<maikel::hmm::hidden_markov_model<double> const*> pointers { &small, &large };
+  double const inf = std::numeric_limits<double>::infinity();
+
+  for (int first : { 0, 2 }) {
+    std::vector<int> sequence { first };
+    for (int t = 1; t < 1000; ++t)
+      sequence.push_back(t % 3);
+    auto result = maikel::hmm::early_abandon_scores(sequence.begin(), sequence.end(), pointers, 2);
+    EXPECT(result.ranking == std::vector<std::size_t>{ 1 });
+    EXPECT_NOT(result.complete[0]);
+    EXPECT(result.log_likelihoods[0] == -inf);
+    maikel::hmm::forward_scorer<double> scorer(large);
+    scorer.push(sequence.begin(), sequence.end());
+    EXPECT((maikel::almost_equal<double, 1000>(scorer.log_likelihood(), result.log_likelihoods[1])));
+  }
+
+  std::vector<int> unknown { 0, 1, 7, 1 };
+  auto none = maikel::hmm::early_abandon_scores(unknown.begin(), unknown.end(), pointers, 2);
+  EXPECT(none.ranking.empty());
+  EXPECT(none.steps == 0u);
+
+  std::vector<int> common { 0, 1, 1, 0 };
+  auto both = maikel::hmm::early_abandon_scores(common.begin(), common.end(), pointers, 2);
+  EXPECT(both.ranking.size() == 2u);
+}
+
+CASE ( "Viterbi and posteriors agree with enumerating all state sequences" ) {
+  Eigen::MatrixXd A(3,3), B(3,2);
+  A << 0.5, 0.3, 0.2,
+       0.2, 0.6, 0.2,
+       0.1, 0.3, 0.6;
+  B << 0.9, 0.1,
+       0.3, 0.7,
+       0.5, 0.5;
+  Eigen::RowVectorXd pi(3);
+  pi << 0.2, 0.3, 0.5;
+  maikel::hmm::hidden_markov_model<double> hmm(A, B, pi);
+  std::vector<int> sequence { 0, 1, 1, 0, 1, 0 };
+  int length = static_cast<int>(sequence.size());
+
+  double best = 0, total = 0;
+  std::vector<int> best_path, path(length);
+  Eigen::MatrixXd marginals = Eigen::MatrixXd::Zero(length, 3);
+  for (int code = 0; code < 729; ++code) {
+    for (int t = 0, c = code; t < length; ++t, c /= 3)
+      path[t] = c % 3;
+    double p = pi(path[0]) * B(path[0], sequence[0]);
+    for (int t = 1; t < length; ++t)
+      p *= A(path[t-1], path[t]) * B(path[t], sequence[t]);
+    total += p;
+    for (int t = 0; t < length; ++t)
+      marginals(t, path[t]) += p;
+    if (p > best) {
+      best = p;
+      best_path = path;
+    }
+  }
+  marginals /= total;
+
+  auto decoded = maikel::hmm::viterbi(sequence.begin(), sequence.end(), hmm);
+  EXPECT(decoded.states == std::vector<std::uint32_t>(best_path.begin(), best_path.end()));
+  EXPECT(std::abs(decoded.log_probability - std::log(best)) < 1e-12);
+
+  Eigen::MatrixXd gamma = maikel::hmm::posteriors(sequence.begin(), sequence.end(), hmm);
+  EXPECT(gamma.rows() == length);
+  EXPECT(gamma.isApprox(marginals, 1e-12));
+}
+
+CASE ( "Batched forward agrees with scoring every sequence on its own" ) {
+  Eigen::MatrixXd A(3,3), B(3,3);
+  A << 0.4, 0.3, 0.3,
+       0.2, 0.6, 0.2,
+       0.1, 0.1, 0.8;
+  B << 0.7, 0.2, 0.1,
+       0.1, 0.8, 0.1,
+       0.2, 0.2, 0.6;
+  Eigen::RowVectorXd pi(3);
+  pi << 0.3, 0.3, 0.4;
+  maikel::hmm::hidden_markov_model<double> hmm(A, B, pi);
+  std::vector<std::vector<int>> sequences;
+  for (int k = 0; k < 17; ++k) {
+    sequences.emplace_back();
+    for (int t = 0; t < (k * 37) % 101; ++t)
+      sequences.back().push_back((t*k + t/3) % 3);
+  }
+  std::vector<double> batched = maikel::hmm::batch_log_likelihoods(sequences, hmm);
+  EXPECT(batched.size() == sequences.size());
+  for (std::size_t k = 0; k < sequences.size(); ++k) {
+    maikel::hmm::forward_scorer<double> scorer(hmm);
+    scorer.push(sequences[k].begin(), sequences[k].end());
+    EXPECT(std::abs(batched[k] - scorer.log_likelihood()) < 1e-9);
+  }
+}
+
+CASE ( "Batched Viterbi paths equal those of single sequences" ) {
+  auto hmm = maikel::hmm::random_hidden_markov_model<double>(7, 4, 41);
+  std::vector<std::vector<int>> sequences;
+  for (int k = 0; k < 17; ++k) {
+    sequences.emplace_back();
+    for (int t = 0; t < (k * 37) % 101; ++t)
+      sequences.back().push_back((t*k + t/3) % 4);
+  }
+  std::vector<maikel::hmm::viterbi_result<double>> batched = maikel::hmm::batch_viterbi(sequences, hmm);
+  EXPECT(batched.size() == sequences.size());
+  for (std::size_t k = 0; k < sequences.size(); ++k) {
+    maikel::hmm::viterbi_result<double> single =
+        maikel::hmm::viterbi(sequences[k].begin(), sequences[k].end(), hmm);
+    EXPECT(batched[k].states == single.states);
+    EXPECT(batched[k].log_probability == single.log_probability);
+  }
+}
+
+CASE ( "The sliding window scorer agrees with scoring every window from scratch" ) {
+  Eigen::MatrixXd A(3,3), B(3,3);
+  A << 0.4, 0.3, 0.3,
+       0.2, 0.6, 0.2,
+       0.1, 0.1, 0.8;
+  B << 0.7, 0.2, 0.1,
+       0.1, 0.8, 0.1,
+       0.2, 0.2, 0.6;
+  Eigen::RowVectorXd pi(3);
+  pi << 0.3, 0.3, 0.4;
+  maikel::hmm::hidden_markov_model<double> hmm(A, B, pi);
+  std::vector<int> sequence;
+  for (int t = 0; t < 3000; ++t)
+    sequence.push_back((t*t + t/7) % 3);
+
+  for (std::size_t window : { std::size_t{1}, std::size_t{2}, std::size_t{7}, std::size_t{1000} }) {
+    maikel::hmm::sliding_window_scorer<double> scorer(hmm, window);
+    for (std::size_t t = 0; t < sequence.size(); ++t) {
+      double windowed = scorer.push(sequence[t]);
+      if (t % 97 && t + 1 != window && t + 1 != sequence.size())
+        continue;
+      std::size_t first = t + 1 > window ? t + 1 - window : 0;
+      maikel::hmm::forward_scorer<double> exact(hmm);
+      exact.push(sequence.begin() + first, sequence.begin() + t + 1);
+      EXPECT(scorer.size() == t + 1 - first);
+      EXPECT(std::abs(windowed - exact.log_likelihood()) < 1e-8 * std::max(1.0, std::abs(windowed)));
+    }
+  }
+}
+
+CASE ( "The window alarm monitor raises threshold and CUSUM alarms" ) {
+  maikel::hmm::window_alarm_options<double> options;
+  options.threshold = -3;
+  options.cusum_target = -1;
+  options.cusum_limit = 2;
+  maikel::hmm::window_alarm_monitor<double> monitor(options);
+  EXPECT(monitor.update(-10, 10) == maikel::hmm::window_alarm::none);
+  EXPECT(monitor.update(-40, 10) == maikel::hmm::window_alarm::threshold);
+  EXPECT(monitor.cusum() == 3);
+  EXPECT(monitor.update(-10, 10) == maikel::hmm::window_alarm::cusum);
+  EXPECT(monitor.cusum() == 0);
+  EXPECT(monitor.update(-15, 10) == maikel::hmm::window_alarm::none);
+  EXPECT(monitor.update(-20, 10) == maikel::hmm::window_alarm::none);
+  EXPECT(monitor.update(-20, 10) == maikel::hmm::window_alarm::cusum);
+}
+
+
 
 //
 //CASE ( "Test forward and backward algorithms for test case in Rabiners Paper" ) {
@@ -0,0 +1,316 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidden-markov-models.t.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <Eigen/Dense>
+#include "maikel/iterator/ostream_binary_iterator.h"
+#include "maikel/iterator/mapped_coefficients.h"
+#include "maikel/iterator/async_binary_writer.h"
+#include "maikel/iterator/bfloat16_coefficients.h"
+#include "maikel/iterator/reverse_block_reader.h"
+#include "maikel/hmm/binary_sequence.h"
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/algorithm.h"
+#include "maikel/hmm/algorithm/baum_welch.h"
+#include "maikel/hmm/sequence_generator.h"
+
+namespace {
+
+std::vector<std::pair<double, std::vector<double>>> make_records(std::size_t count, std::size_t states)
+{
+  std::vector<std::pair<double, std::vector<double>>> records;
+  for (std::size_t t = 0; t < count; ++t) {
+    std::vector<double> alpha(states);
+    for (std::size_t i = 0; i < states; ++i)
+      alpha[i] = 1.0 / (t + i + 1);
+    records.emplace_back(t + 0.5, alpha);
+  }
+  return records;
+}
+
+CASE ( "Mapped coefficients give back the records of a coefficient file" ) {
+  auto records = make_records(1000, 3);
+  {
+    std::ofstream out("coefficients.t.bin", std::ofstream::binary);
+    maikel::ostream_buffered_binary_iterator<double, 4096> writer(out);
+    for (auto const& record : records)
+      *writer++ = record;
+  }
+
+  maikel::mapped_coefficients<double> mapped("coefficients.t.bin", 3);
+  EXPECT(mapped.size() == records.size());
+  std::size_t t = 0;
+  for (auto&& record : mapped) {
+    EXPECT(record.first == records[t].first);
+    for (std::size_t i = 0; i < 3; ++i)
+      EXPECT(record.second(i) == records[t].second[i]);
+    ++t;
+  }
+  t = records.size();
+  for (auto it = mapped.rbegin(); it != mapped.rend(); ++it)
+    EXPECT((*it).first == records[--t].first);
+  EXPECT(mapped.rbegin() < mapped.rend());
+  EXPECT(mapped.rend() >= mapped.rbegin());
+  EXPECT(mapped.end() > mapped.begin());
+  EXPECT(mapped.begin() <= mapped.begin());
+  EXPECT((2 + mapped.begin())[0].first == records[2].first);
+
+  std::ifstream in("coefficients.t.bin", std::ifstream::binary);
+  maikel::alphas_binary_input_iterator<double> first(in, 3), last;
+  EXPECT(std::distance(first, last) == static_cast<std::ptrdiff_t>(records.size()));
+  std::remove("coefficients.t.bin");
+}
+
+CASE ( "Mapped coefficients reject truncated files" ) {
+  {
+    std::ofstream out("coefficients.t.bin", std::ofstream::binary);
+    double value = 1;
+    out.write(reinterpret_cast<char const*>(&value), sizeof(value));
+  }
+  EXPECT_THROWS_AS(maikel::mapped_coefficients<double>("coefficients.t.bin", 3),
+                   maikel::mapped_file_error);
+  std::remove("coefficients.t.bin");
+}
+
+CASE ( "Flushing a buffered binary iterator twice writes the data once" ) {
+  std::ostringstream out;
+  maikel::ostream_buffered_binary_iterator<double, 4096> writer(out);
+  *writer++ = 1.0;
+  writer.flush();
+  writer.flush();
+  EXPECT(out.str().size() == sizeof(double));
+}
+
+CASE ( "The asynchronous writer writes all records in order" ) {
+  auto records = make_records(1000, 3);
+  for (bool direct : { false, true }) {
+    {
+      maikel::async_binary_writer writer("coefficients.t.bin", 100, 3, direct);
+      maikel::async_binary_output_iterator<double> out(writer);
+      for (std::size_t t = 0; t < records.size(); ++t) {
+        Eigen::RowVectorXd alpha = Eigen::Map<Eigen::RowVectorXd>(records[t].second.data(), 3);
+        *out++ = std::make_pair(records[t].first, alpha);
+        if (t == 500)
+          writer.flush();
+      }
+    }
+    maikel::mapped_coefficients<double> mapped("coefficients.t.bin", 3);
+    EXPECT(mapped.size() == records.size());
+    for (std::size_t t = 0; t < mapped.size(); ++t) {
+      EXPECT(mapped[t].first == records[t].first);
+      EXPECT(mapped[t].second(2) == records[t].second[2]);
+    }
+    std::remove("coefficients.t.bin");
+  }
+}
+
+CASE ( "The asynchronous writer closes its file if it cannot allocate its buffers" ) {
+  // the lowest free descriptor is reused, a leaked one would move it up
+  int before = ::open("/dev/null", O_RDONLY);
+  ::close(before);
+  EXPECT_THROWS_AS(maikel::async_binary_writer("coefficients.t.bin", std::size_t{1} << 60), std::bad_alloc);
+  int after = ::open("/dev/null", O_RDONLY);
+  ::close(after);
+  EXPECT(after == before);
+  std::remove("coefficients.t.bin");
+}
+
+
+CASE ( "bfloat16 coefficient files give back the records to 2^-7" ) {
+  auto records = make_records(1000, 3);
+  {
+    maikel::async_binary_writer writer("coefficients.t.bin", 100, 3);
+    maikel::async_bfloat16_output_iterator<double> out(writer);
+    for (auto const& record : records)
+      *out++ = record.second;
+  }
+  maikel::mapped_bfloat16_coefficients<double> mapped("coefficients.t.bin", 3);
+  EXPECT(mapped.size() == records.size());
+  Eigen::RowVectorXd alpha;
+  for (std::size_t t = 0; t < mapped.size(); ++t) {
+    mapped.decode(t, alpha);
+    EXPECT(alpha == mapped.begin()[t]);
+    for (std::size_t i = 0; i < 3; ++i)
+      EXPECT(std::abs(alpha(i) - records[t].second[i]) < std::ldexp(records[t].second[i], -7));
+  }
+  EXPECT((*mapped.rbegin()) == mapped[records.size() - 1]);
+  EXPECT(mapped.rbegin() < mapped.rend());
+  EXPECT(mapped.rend() >= mapped.rbegin());
+  EXPECT(mapped.end() > mapped.begin());
+  EXPECT(mapped.begin() <= mapped.begin());
+  EXPECT(*(2 + mapped.begin()) == mapped[2]);
+  std::remove("coefficients.t.bin");
+
+  {
+    std::ofstream out("coefficients.t.bin", std::ofstream::binary);
+    out.write("\0\0\0\0", 4);
+  }
+  EXPECT_THROWS_AS(maikel::mapped_bfloat16_coefficients<double>("coefficients.t.bin", 3),
+                   maikel::mapped_file_error);
+  std::remove("coefficients.t.bin");
+}
+
+CASE ( "A Baum-Welch update from bfloat16 coefficient files stays within 1e-4 of double" ) {
+  using namespace maikel::hmm;
+  using sequence = std::vector<std::uint32_t>;
+  using row_vectors = std::vector<Eigen::RowVectorXd>;
+  using mapped = maikel::mapped_bfloat16_coefficients<double>;
+  for (int states : { 5, 40 }) {
+    auto hmm = random_hidden_markov_model<double>(states, 6, 23 + states);
+    std::size_t length = 20000;
+    sequence symbols(length), hidden(length);
+    make_sequence_generator(hmm, 9).generate_into(length, symbols.data(), hidden.data(), 1);
+
+    std::vector<double> scaling;
+    row_vectors alphas, betas(length);
+    {
+      maikel::async_binary_writer writer("coefficients.t.alphas");
+      maikel::async_bfloat16_output_iterator<double> out(writer);
+      for (auto&& alpha : forward(symbols.begin(), symbols.end(), hmm)) {
+        scaling.push_back(alpha.first);
+        alphas.push_back(alpha.second);
+        *out++ = alpha.second;
+      }
+    }
+    std::size_t t = length;
+    for (auto&& beta : backward(symbols.rbegin(), symbols.rend(), scaling.rbegin(), hmm))
+      betas[--t] = beta;
+    {
+      maikel::async_binary_writer writer("coefficients.t.betas");
+      std::copy(betas.begin(), betas.end(), maikel::async_bfloat16_output_iterator<double>(writer));
+    }
+
+    auto exact = update_matrices<sequence::const_iterator, row_vectors::const_iterator,
+        row_vectors::const_iterator, double>(states, 6);
+    auto expected = exact(symbols.begin(), symbols.end(), alphas.cbegin(), betas.cbegin(), scaling.back(), hmm);
+    mapped spilled_alphas("coefficients.t.alphas", states), spilled_betas("coefficients.t.betas", states);
+    auto compact = update_matrices<sequence::const_iterator, mapped::iterator, mapped::iterator, double>(
+        states, 6);
+    auto result = compact(symbols.begin(), symbols.end(), spilled_alphas.begin(), spilled_betas.begin(),
+        scaling.back(), hmm);
+    EXPECT((result.first - expected.first).cwiseAbs().maxCoeff() < 1e-4);
+    EXPECT((result.second - expected.second).cwiseAbs().maxCoeff() < 1e-4);
+    EXPECT(rows_are_probability_arrays(result.first));
+    EXPECT(rows_are_probability_arrays(result.second));
+    std::remove("coefficients.t.alphas");
+    std::remove("coefficients.t.betas");
+  }
+}
+
+CASE ( "The reverse reader gives back a binary file backwards across blocks" ) {
+  std::vector<double> values(1000);
+  for (std::size_t t = 0; t < values.size(); ++t)
+    values[t] = t + 0.25;
+  {
+    std::ofstream out("coefficients.t.bin", std::ofstream::binary);
+    out.write(reinterpret_cast<char const*>(values.data()), values.size()*sizeof(double));
+  }
+  for (std::size_t block : { 1, 7, 1000, 4096 }) {
+    maikel::reverse_binary_reader<double> reversed("coefficients.t.bin", block);
+    EXPECT(reversed.size() == values.size());
+    std::vector<double> read(reversed.begin(), reversed.end());
+    EXPECT(std::equal(read.begin(), read.end(), values.rbegin()));
+  }
+  std::remove("coefficients.t.bin");
+}
+
+CASE ( "The reverse packed sequence reader gives back symbols backwards" ) {
+  for (std::size_t length : { 0, 1, 31, 32, 33, 1000 }) {
+    std::vector<unsigned> symbols(length);
+    for (std::size_t t = 0; t < length; ++t)
+      symbols[t] = (t*7 + t/3) % 3;
+    {
+      std::ofstream out("coefficients.t.bin", std::ofstream::binary);
+      maikel::hmm::binary_sequence_writer writer(out, 3, length);
+      writer.write(symbols.begin(), symbols.end());
+    }
+    maikel::reverse_packed_sequence_reader reversed("coefficients.t.bin", 2);
+    EXPECT(reversed.size() == length);
+    std::vector<unsigned> read(reversed.begin(), reversed.end());
+    EXPECT(read.size() == length);
+    EXPECT(std::equal(read.begin(), read.end(), symbols.rbegin()));
+    std::remove("coefficients.t.bin");
+  }
+}
+
+CASE ( "The reverse packed sequence reader rejects truncated files" ) {
+  {
+    std::ofstream out("coefficients.t.bin", std::ofstream::binary);
+    auto header = maikel::hmm::make_packed_sequence_header(2, 1000);
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  }
+  EXPECT_THROWS_AS(maikel::reverse_packed_sequence_reader("coefficients.t.bin"),
+                   maikel::reverse_reader_error);
+  std::remove("coefficients.t.bin");
+}
+
+
+CASE ( "The backward pass can be fed by reverse readers" ) {
+  Eigen::Matrix3d A;
+  A << 0.4, 0.3, 0.3,
+       0.2, 0.6, 0.2,
+       0.1, 0.1, 0.8;
+  Eigen::Matrix<double, 3, 2> B;
+  B << 0.9, 0.1,
+       0.3, 0.7,
+       0.5, 0.5;
+  Eigen::RowVector3d pi;
+  pi << 0.2, 0.3, 0.5;
+  maikel::hmm::hidden_markov_model<double> hmm(A, B, pi);
+  std::vector<int> sequence;
+  for (int t = 0; t < 1000; ++t)
+    sequence.push_back((t*t + t/7) % 2);
+
+  std::vector<double> scaling;
+  for (auto&& alpha : maikel::hmm::forward(begin(sequence), end(sequence), hmm))
+    scaling.push_back(alpha.first);
+  std::vector<Eigen::RowVectorXd> betas;
+  for (auto&& beta : maikel::hmm::backward(sequence.rbegin(), sequence.rend(), scaling.rbegin(), hmm))
+    betas.push_back(beta);
+
+  {
+    std::ofstream out("coefficients.t.bin", std::ofstream::binary);
+    out.write(reinterpret_cast<char const*>(scaling.data()), scaling.size()*sizeof(double));
+    std::ofstream seq_out("coefficients.t.seq", std::ofstream::binary);
+    maikel::hmm::binary_sequence_writer writer(seq_out, 2, sequence.size());
+    writer.write(sequence.begin(), sequence.end());
+  }
+  maikel::reverse_binary_reader<double> reversed_scaling("coefficients.t.bin", 10);
+  maikel::reverse_packed_sequence_reader reversed_sequence("coefficients.t.seq", 3);
+  std::size_t t = 0;
+  for (auto&& beta : maikel::hmm::backward(reversed_sequence.begin(), reversed_sequence.end(),
+                                           reversed_scaling.begin(), hmm)) {
+    EXPECT(t < betas.size());
+    EXPECT(beta.isApprox(betas[t]));
+    ++t;
+  }
+  EXPECT(t == betas.size());
+  std::remove("coefficients.t.bin");
+  std::remove("coefficients.t.seq");
+}
+
+}
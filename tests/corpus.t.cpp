@@ -0,0 +1,103 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidden-markov-models.t.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include "maikel/hmm/corpus.h"
+
+namespace {
+
+std::vector<std::vector<int>> make_sessions(std::size_t count)
+{
+  std::vector<std::vector<int>> sessions;
+  for (std::size_t k = 0; k < count; ++k) {
+    std::vector<int> session((k*k*37) % 1000);
+    for (std::size_t t = 0; t < session.size(); ++t)
+      session[t] = (t*k + t/3) % 3;
+    sessions.push_back(session);
+  }
+  return sessions;
+}
+
+CASE ( "A corpus gives back all sequences that were written into it" ) {
+  auto sessions = make_sessions(200);
+  {
+    maikel::hmm::corpus_writer writer("corpus.t.bin", { "a", "b", "c" });
+    for (auto const& session : sessions)
+      writer.add(session.begin(), session.end());
+  }
+  maikel::hmm::corpus corpus("corpus.t.bin");
+  EXPECT(corpus.size() == sessions.size());
+  EXPECT(corpus.symbols() == 3u);
+  EXPECT(corpus.bits() == 2u);
+  EXPECT((corpus.alphabet() == std::vector<std::string>{ "a", "b", "c" }));
+  std::uint64_t total = 0;
+  for (std::size_t k = 0; k < sessions.size(); ++k) {
+    EXPECT(corpus.length(k) == sessions[k].size());
+    auto view = corpus[k];
+    EXPECT(std::equal(sessions[k].begin(), sessions[k].end(), view.begin()));
+    total += sessions[k].size();
+  }
+  EXPECT(corpus.total_length() == total);
+  std::remove("corpus.t.bin");
+}
+
+CASE ( "A corpus rejects files which are not corpora" ) {
+  {
+    std::ofstream out("corpus.t.bin");
+    out << "0 1\n2\n0 1\n";
+  }
+  EXPECT_THROWS_AS(maikel::hmm::corpus("corpus.t.bin"), maikel::hmm::corpus_error);
+  std::remove("corpus.t.bin");
+}
+
+CASE ( "Partitioning a corpus gives length balanced shards covering every sequence" ) {
+  auto sessions = make_sessions(500);
+  {
+    maikel::hmm::corpus_writer writer("corpus.t.bin", { "a", "b", "c" });
+    for (auto const& session : sessions)
+      writer.add(session.begin(), session.end());
+  }
+  maikel::hmm::corpus corpus("corpus.t.bin");
+  std::vector<maikel::hmm::corpus_shard> shards = maikel::hmm::partition_corpus(corpus, 7);
+  EXPECT(shards.size() == 7u);
+
+  std::vector<std::size_t> seen;
+  std::uint64_t longest = 0, lightest = corpus.total_length(), heaviest = 0;
+  for (auto const& shard : shards) {
+    EXPECT(std::is_sorted(shard.sequences.begin(), shard.sequences.end()));
+    std::uint64_t length = 0;
+    for (std::size_t i : shard.sequences) {
+      length += corpus.length(i);
+      longest = std::max<std::uint64_t>(longest, corpus.length(i));
+    }
+    EXPECT(length == shard.length);
+    lightest = std::min(lightest, length);
+    heaviest = std::max(heaviest, length);
+    seen.insert(seen.end(), shard.sequences.begin(), shard.sequences.end());
+  }
+  std::sort(seen.begin(), seen.end());
+  EXPECT(seen.size() == corpus.size());
+  EXPECT(std::unique(seen.begin(), seen.end()) == seen.end());
+  EXPECT(heaviest - lightest <= longest);
+  std::remove("corpus.t.bin");
+}
+
+}
@@ -14,31 +14,142 @@
  * limitations under the License.
  */
 
+#define MAIKEL_PROFILE_FUNCTIONS
+#define MAIKEL_PROFILE_COUNTERS
+
 #include <iostream>
 #include <limits>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
 #include "maikel/function_profiler.h"
+#include "maikel/perf_counters.h"
 
+thread_local volatile std::size_t sink;
 
 void barfoo()
 {
-  maikel::function_profiler(__PRETTY_FUNCTION__, __FILE__);
-  std::size_t max = 200000000;
+  MAIKEL_PROFILER;
+  std::size_t max = 2000000;
   std::size_t n = 0;
   for (std::size_t i = 0; i < max; ++i) n += i;
+  sink = n;
 }
 
 void foobar()
 {
-  maikel::function_profiler(__PRETTY_FUNCTION__, __FILE__);
+  MAIKEL_PROFILER;
   int max = 20000;
   int n = 0;
   for (int i = 0; i < max; ++i) n += i*i;
+  sink = static_cast<std::size_t>(n);
+  barfoo();
+}
+
+void worker()
+{
+  MAIKEL_NAMED_PROFILER("worker");
+  for (int i = 0; i < 10; ++i) foobar();
+}
+
+void allocator()
+{
+  MAIKEL_PROFILER;
+  std::vector<double> buffer(1000);
+  Eigen::VectorXd vector = Eigen::VectorXd::Zero(1000);
+  sink = buffer.size() + static_cast<std::size_t>(vector.size());
+}
+
+void kernel()
+{
+  MAIKEL_KERNEL_PROFILER(work, "kernel");
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < 100000; ++i) n += i;
+  sink = n;
+  work.add_work(100000, 800000, 1000);
+}
+
+int check(bool condition, char const* what)
+{
+  if (!condition)
+    std::cerr << "FAILED: " << what << "\n";
+  return condition ? 0 : 1;
 }
 
 int main()
 {
+  maikel::function_profiler::enable_trace(1000);
   barfoo();
   barfoo();
-  for (int i =0; i < 10; ++i) foobar();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t)
+    threads.emplace_back(worker);
+  for (std::thread& thread : threads)
+    thread.join();
+  {
+    maikel::function_profiler legacy("legacy", __FILE__);
+  }
+
   maikel::function_profiler::print_statistics(std::cout);
+  std::ostringstream folded, trace;
+  maikel::function_profiler::write_folded_stacks(folded);
+  maikel::function_profiler::write_chrome_trace(trace);
+  std::cout << folded.str();
+
+  std::vector<maikel::profile_node> tree = maikel::function_profiler::call_tree();
+  int failures = 0;
+  std::uint64_t top_level = 0;
+  for (std::size_t child : tree[0].children)
+    top_level += tree[child].inclusive_ns;
+  failures += check(top_level == tree[0].inclusive_ns, "the total is the sum of the top level calls");
+  for (std::size_t child : tree[0].children) {
+    maikel::profile_node const& n = tree[child];
+    if (n.name == "barfoo")
+      failures += check(n.calls == 2, "barfoo is called twice from main");
+    if (n.name == "worker") {
+      failures += check(n.calls == 4, "four workers");
+      failures += check(n.children.size() == 1 && tree[n.children[0]].calls == 40, "foobar is called 40 times");
+      maikel::profile_node const& inner = tree[tree[n.children[0]].children.at(0)];
+      failures += check(inner.name == "barfoo" && inner.calls == 40, "barfoo below foobar");
+    }
+  }
+  failures += check(folded.str().find("worker;foobar;barfoo ") != std::string::npos, "folded stacks");
+  failures += check(trace.str().find("\"name\":\"foobar\"") != std::string::npos, "chrome trace");
+
+  for (maikel::profile_site_statistics const& site : maikel::function_profiler::site_statistics()) {
+    if (site.name == "barfoo")
+      failures += check(site.calls == 42, "barfoo is called 42 times in all");
+    failures += check(site.min_ns <= site.p50_ns && site.p50_ns <= site.p90_ns && site.p90_ns <= site.p99_ns
+                      && site.p99_ns <= site.p999_ns && site.p999_ns <= site.max_ns, "ordered percentiles");
+  }
+  std::ostringstream json;
+  maikel::function_profiler::write_json(json);
+  failures += check(json.str().find("\"p999_ns\":") != std::string::npos, "json report");
+
+  maikel::function_profiler::reset();
+  failures += check(maikel::function_profiler::call_tree().size() == 1, "reset forgets everything");
+
+  if (maikel::function_profiler::tracks_allocations()) {
+    allocator();
+    allocator();
+    tree = maikel::function_profiler::call_tree();
+    failures += check(tree.size() == 2 && tree[1].allocations == 4, "new and Eigen allocate twice per call");
+    failures += check(tree.size() == 2 && tree[1].allocated_bytes >= 32000, "allocated bytes");
+    failures += check(tree.size() == 2 && tree[1].peak_bytes >= 16000 && tree[1].peak_bytes < 32000,
+                      "both buffers are live at the peak");
+    maikel::function_profiler::reset();
+  }
+
+  // works without permission for perf events too, then only the counters are missing
+  std::thread other(kernel);
+  kernel();
+  other.join();
+  maikel::kernel_counters::print_statistics(std::cout);
+  std::vector<maikel::kernel_statistics> kernels = maikel::kernel_counters::statistics();
+  failures += check(kernels.size() == 1 && kernels[0].calls == 2, "kernel is called twice");
+  failures += check(!kernels.empty() && kernels[0].bytes_per_symbol() == 800.0, "bytes per symbol");
+  failures += check(!kernels.empty() && kernels[0].gflops() > 0, "GFLOP/s");
+  failures += check(maikel::function_profiler::site_statistics().size() == 1, "kernels are profiled scopes");
+  return failures;
 }
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidden-markov-models.t.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+#include <Eigen/Dense>
+#include "maikel/hmm/bfloat16.h"
+#include "maikel/hmm/isa_kernels.h"
+
+namespace {
+
+  using maikel::hmm::isa;
+  using maikel::hmm::kernel_set;
+
+  // every variant which was compiled in and runs on this machine
+  std::vector<kernel_set const*> usable_kernels()
+  {
+    std::vector<kernel_set const*> sets;
+    for (int i = 0; i < static_cast<int>(isa::count); ++i) {
+      isa level = static_cast<isa>(i);
+      if (maikel::hmm::isa_supported(level) && maikel::hmm::kernels_for(level))
+        sets.push_back(maikel::hmm::kernels_for(level));
+    }
+    return sets;
+  }
+
+  Eigen::MatrixXd random_matrix(std::ptrdiff_t rows, std::ptrdiff_t cols, std::mt19937& engine)
+  {
+    std::uniform_real_distribution<double> uniform(0.01, 1.0);
+    Eigen::MatrixXd m(rows, cols);
+    for (std::ptrdiff_t j = 0; j < cols; ++j)
+      for (std::ptrdiff_t i = 0; i < rows; ++i)
+        m(i, j) = uniform(engine);
+    return m;
+  }
+
+  bool close(Eigen::MatrixXd const& x, Eigen::MatrixXd const& y)
+  {
+    return (x - y).cwiseAbs().maxCoeff() <= 1e-12 * std::max(1.0, y.cwiseAbs().maxCoeff());
+  }
+
+}
+
+CASE ( "The baseline kernels are always there and the chosen ones run here" )
+{
+  EXPECT(maikel::hmm::kernels_for(isa::sse2) != nullptr);
+  isa best = maikel::hmm::best_supported_isa();
+  EXPECT(maikel::hmm::isa_supported(best));
+  EXPECT(maikel::hmm::kernels_for(best) != nullptr);
+  EXPECT(maikel::hmm::isa_supported(maikel::hmm::active_kernels().level));
+  EXPECT(std::string(maikel::hmm::isa_name(isa::avx2)) == "avx2");
+}
+
+CASE ( "Every kernel variant agrees with the plain loops" )
+{
+  std::mt19937 engine(7);
+  for (kernel_set const* set : usable_kernels())
+    for (std::ptrdiff_t n : { 1, 3, 17, 64 }) {
+      auto const& k = set->double_precision;
+      Eigen::MatrixXd A = random_matrix(n, n, engine);
+      Eigen::RowVectorXd prev = random_matrix(1, n, engine), b = random_matrix(1, n, engine);
+      Eigen::RowVectorXd result(n), work(n);
+
+      double sum = k.forward_step(A.data(), prev.data(), b.data(), result.data(), n);
+      Eigen::RowVectorXd alpha = (prev * A).cwiseProduct(b);
+      EXPECT(close(result, alpha));
+      EXPECT(std::abs(sum - alpha.sum()) <= 1e-12 * alpha.sum());
+
+      k.backward_step(A.data(), b.data(), prev.data(), 0.5, result.data(), work.data(), n);
+      Eigen::RowVectorXd beta = 0.5 * (A * b.cwiseProduct(prev).transpose()).transpose();
+      EXPECT(close(result, beta));
+
+      Eigen::MatrixXd xi = Eigen::MatrixXd::Ones(n, n);
+      Eigen::RowVectorXd gamma = Eigen::RowVectorXd::Zero(n);
+      k.xi_accumulate(A.data(), prev.data(), b.data(), xi.data(), gamma.data(), n);
+      Eigen::MatrixXd update = prev.transpose().asDiagonal() * A * b.asDiagonal();
+      EXPECT(close(xi, Eigen::MatrixXd::Ones(n, n) + update));
+      EXPECT(close(gamma, update.rowwise().sum().transpose()));
+
+      Eigen::MatrixXd logA = A.array().log().matrix();
+      Eigen::MatrixXd logAt = logA.transpose();
+      std::vector<std::uint32_t> arg(n);
+      k.max_plus(logAt.data(), prev.data(), result.data(), arg.data(), n);
+      for (std::ptrdiff_t j = 0; j < n; ++j) {
+        std::ptrdiff_t i;
+        double best = (prev.transpose() + logA.col(j)).maxCoeff(&i);
+        EXPECT(result(j) == best);
+        EXPECT(arg[j] == static_cast<std::uint32_t>(i));
+      }
+
+      Eigen::RowVectorXd x = 100.0 * prev;
+      double expected = std::log((x.array() - x.maxCoeff()).exp().sum()) + x.maxCoeff();
+      EXPECT(std::abs(k.log_sum_exp(x.data(), n) - expected) <= 1e-12 * std::abs(expected));
+    }
+}
+
+CASE ( "Single precision kernels agree with the double precision ones" )
+{
+  std::mt19937 engine(11);
+  for (kernel_set const* set : usable_kernels()) {
+    std::ptrdiff_t n = 33;
+    Eigen::MatrixXd A = random_matrix(n, n, engine);
+    Eigen::RowVectorXd prev = random_matrix(1, n, engine), b = random_matrix(1, n, engine);
+    Eigen::MatrixXf Af = A.cast<float>();
+    Eigen::RowVectorXf prevf = prev.cast<float>(), bf = b.cast<float>(), resultf(n);
+    Eigen::RowVectorXd result(n);
+    set->double_precision.forward_step(A.data(), prev.data(), b.data(), result.data(), n);
+    set->single_precision.forward_step(Af.data(), prevf.data(), bf.data(), resultf.data(), n);
+    EXPECT((resultf.cast<double>() - result).cwiseAbs().maxCoeff() <= 1e-5 * result.maxCoeff());
+  }
+}
+
+CASE ( "Max-plus takes the first of equal candidates and log-sum-exp handles infinities" )
+{
+  double const inf = std::numeric_limits<double>::infinity();
+  for (kernel_set const* set : usable_kernels()) {
+    auto const& k = set->double_precision;
+    Eigen::MatrixXd logAt = Eigen::MatrixXd::Constant(5, 5, std::log(0.2));
+    Eigen::RowVectorXd delta = Eigen::RowVectorXd::Constant(5, -1.0), best(5);
+    std::vector<std::uint32_t> arg(5, 7);
+    k.max_plus(logAt.data(), delta.data(), best.data(), arg.data(), 5);
+    EXPECT(arg == std::vector<std::uint32_t>(5, 0));
+
+    std::vector<double> none { -inf, -inf, -inf };
+    EXPECT(k.log_sum_exp(none.data(), 3) == -inf);
+    EXPECT(k.log_sum_exp(none.data(), 0) == -inf);
+    std::vector<double> some { -inf, 0.0, -inf };
+    EXPECT(k.log_sum_exp(some.data(), 3) == 0.0);
+  }
+}
+
+CASE ( "Every variant rounds to bfloat16 like the scalar conversion" )
+{
+  double const inf = std::numeric_limits<double>::infinity();
+  std::mt19937 engine(13);
+  std::uniform_real_distribution<double> exponent(-40.0, 10.0);
+  std::vector<double> x { 0.0, -0.0, 1.0, -1.5, inf, -inf, std::numeric_limits<double>::quiet_NaN(), 1e-42 };
+  for (int i = 0; i < 1000; ++i)
+    x.push_back(std::pow(10.0, exponent(engine)));
+  std::ptrdiff_t n = static_cast<std::ptrdiff_t>(x.size());
+  for (kernel_set const* set : usable_kernels()) {
+    std::vector<std::uint16_t> bits(n);
+    std::vector<double> back(n);
+    set->double_precision.to_bfloat16(x.data(), bits.data(), n, 17);
+    set->double_precision.from_bfloat16(bits.data(), back.data(), n);
+    for (std::ptrdiff_t i = 0; i < n; ++i) {
+      EXPECT(bits[i] == maikel::hmm::to_bfloat16(static_cast<float>(x[i]), 17 + static_cast<std::uint32_t>(i)));
+      if (std::isnan(x[i]))
+        EXPECT(std::isnan(back[i]));
+      else if (std::isinf(x[i]))
+        EXPECT(back[i] == x[i]);
+      else if (std::abs(x[i]) > 1e-37)
+        EXPECT(std::abs(back[i] - x[i]) < std::ldexp(std::abs(x[i]), -7));
+      else
+        EXPECT(std::abs(back[i] - x[i]) < 1e-37);
+    }
+    std::vector<float> single(x.begin(), x.end());
+    std::vector<std::uint16_t> single_bits(n);
+    set->single_precision.to_bfloat16(single.data(), single_bits.data(), n, 17);
+    EXPECT(single_bits == bits);
+  }
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidden-markov-models.t.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/model_bank.h"
+#include "maikel/hmm/sequence_generator.h"
+
+namespace {
+
+CASE ( "A model bank gives back the parameters of its models" ) {
+  std::vector<maikel::hmm::hidden_markov_model<double>> models;
+  {
+    maikel::hmm::model_bank_writer<double> writer("model_bank.t.bin");
+    for (int k = 0; k < 20; ++k) {
+      models.push_back(maikel::hmm::random_hidden_markov_model<double>(1 + k % 7, 2 + k % 3, k));
+      writer.add("model-" + std::to_string(k), models.back());
+    }
+  }
+  maikel::hmm::model_bank<double> bank("model_bank.t.bin");
+  EXPECT(bank.size() == models.size());
+  for (std::size_t k = 0; k < bank.size(); ++k) {
+    EXPECT(bank.name(k) == "model-" + std::to_string(k));
+    EXPECT(bank.states(k) == static_cast<std::size_t>(models[k].states()));
+    EXPECT(bank.symbols(k) == static_cast<std::size_t>(models[k].symbols()));
+    auto parameters = bank.parameters(k);
+    EXPECT(reinterpret_cast<std::uintptr_t>(parameters.A.data()) % 64 == 0);
+    EXPECT(reinterpret_cast<std::uintptr_t>(parameters.B.data()) % 64 == 0);
+    EXPECT(reinterpret_cast<std::uintptr_t>(parameters.pi.data()) % 64 == 0);
+    EXPECT(parameters.A == models[k].transition_matrix());
+    EXPECT(parameters.B == models[k].symbol_probabilities());
+    EXPECT(parameters.pi == models[k].initial_distribution());
+  }
+  std::size_t k = bank.find("model-13");
+  EXPECT(k == 13u);
+  EXPECT(bank.find("model-20") == bank.npos);
+  auto const& hmm = bank[k];
+  EXPECT(&hmm == &bank[k]);
+  EXPECT(hmm.transition_matrix() == models[k].transition_matrix());
+  std::remove("model_bank.t.bin");
+}
+
+CASE ( "A model bank rejects banks of a different floating point type" ) {
+  {
+    maikel::hmm::model_bank_writer<double> writer("model_bank.t.bin");
+    writer.add("model", maikel::hmm::random_hidden_markov_model<double>(2, 2, 1));
+  }
+  EXPECT_THROWS_AS(maikel::hmm::model_bank<float>("model_bank.t.bin"), maikel::hmm::model_bank_error);
+  {
+    std::ofstream out("model_bank.t.bin");
+    out << "N= 2\n";
+  }
+  EXPECT_THROWS_AS(maikel::hmm::model_bank<double>("model_bank.t.bin"), maikel::hmm::model_bank_error);
+  std::remove("model_bank.t.bin");
+}
+
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidden-markov-models.t.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <numeric>
+#include <vector>
+#include <Eigen/Dense>
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/algorithm/forward.h"
+#include "maikel/hmm/algorithm/backward.h"
+#include "maikel/hmm/packed_sequence.h"
+#include "maikel/hmm/binary_sequence.h"
+#include "maikel/hmm/symbol_reader.h"
+
+namespace {
+
+CASE ( "Packed sequences choose the bit width from the alphabet size" ) {
+  EXPECT(maikel::hmm::bits_per_symbol(2) == 1);
+  EXPECT(maikel::hmm::bits_per_symbol(3) == 2);
+  EXPECT(maikel::hmm::bits_per_symbol(16) == 4);
+  EXPECT(maikel::hmm::bits_per_symbol(17) == 8);
+  EXPECT(maikel::hmm::bits_per_symbol(300) == 16);
+  EXPECT_THROWS_AS(maikel::hmm::bits_per_symbol(70000), maikel::hmm::packed_sequence_error);
+  EXPECT(maikel::hmm::packed_sequence<std::uint8_t>(256).bits() == 8);
+  EXPECT_THROWS_AS(maikel::hmm::packed_sequence<std::uint8_t>(257), maikel::hmm::packed_sequence_error);
+}
+
+CASE ( "Packed sequences of narrow words give back what was pushed into them" ) {
+  maikel::hmm::packed_sequence<std::uint8_t> bytes(5);
+  maikel::hmm::packed_sequence<std::uint16_t> halves(300);
+  std::vector<maikel::hmm::packed_symbol> plain;
+  for (std::size_t t = 0; t < 100; ++t) {
+    plain.push_back((t*7 + t/3) % 5);
+    bytes.push_back(plain.back());
+    halves.push_back(plain.back());
+  }
+  bytes.set(42, 4);
+  halves.set(42, 4);
+  plain[42] = 4;
+  EXPECT(std::equal(plain.begin(), plain.end(), bytes.begin()));
+  EXPECT(std::equal(plain.begin(), plain.end(), halves.begin()));
+}
+
+CASE ( "Packed sequences give back what was pushed into them" ) {
+  for (std::size_t symbols : { 2, 4, 11, 200, 1000 }) {
+    std::vector<maikel::hmm::packed_symbol> plain;
+    for (std::size_t t = 0; t < 1000; ++t)
+      plain.push_back((t*7 + t/3) % symbols);
+    maikel::hmm::packed_sequence<> packed(symbols, plain.begin(), plain.end());
+    EXPECT(packed.size() == plain.size());
+    EXPECT(std::equal(plain.begin(), plain.end(), packed.begin()));
+    EXPECT(std::equal(plain.rbegin(), plain.rend(), packed.rbegin()));
+    EXPECT(packed.end() - packed.begin() == 1000);
+
+    std::vector<maikel::hmm::packed_symbol> unpacked(plain.size() - 13);
+    packed.unpack(13, unpacked.size(), unpacked.begin());
+    EXPECT(std::equal(unpacked.begin(), unpacked.end(), plain.begin() + 13));
+
+    packed.set(500, 1);
+    EXPECT(packed[500] == 1);
+    EXPECT(packed[499] == plain[499]);
+    EXPECT(packed[501] == plain[501]);
+  }
+}
+
+CASE ( "Forward and backward accept packed sequences" ) {
+  Eigen::Matrix3f A;
+  A << 0.4, 0.3, 0.3,
+       0.2, 0.6, 0.2,
+       0.1, 0.1, 0.8;
+  Eigen::Matrix3f B;
+  B << 1.0, 0.0, 0.0,
+       0.0, 1.0, 0.0,
+       0.0, 0.0, 1.0;
+  Eigen::Vector3f pi;
+  pi << 0.0, 0.0, 1.0;
+  std::vector<int> sequence { 2, 2, 2, 0, 0, 2, 1, 2 };
+  maikel::hmm::packed_sequence<> packed(3, sequence.begin(), sequence.end());
+  maikel::hmm::hidden_markov_model<float> hmm(A, B, pi);
+
+  std::vector<float> scaling;
+  for (auto&& alpha : maikel::hmm::forward(packed.begin(), packed.end(), hmm))
+    scaling.push_back(alpha.first);
+  float probability = std::accumulate(scaling.begin(), scaling.end(), 1.0, std::multiplies<float>());
+  EXPECT(maikel::almost_equal(1/probability, 1.536f /10000));
+
+  std::vector<float> betas_packed, betas_plain;
+  for (auto&& beta : maikel::hmm::backward(packed.rbegin(), packed.rend(), scaling.rbegin(), hmm))
+    betas_packed.push_back(beta.sum());
+  for (auto&& beta : maikel::hmm::backward(sequence.rbegin(), sequence.rend(), scaling.rbegin(), hmm))
+    betas_plain.push_back(beta.sum());
+  EXPECT(betas_packed == betas_plain);
+}
+
+CASE ( "Binary sequence files round trip through the buffered writer" ) {
+  std::vector<int> plain;
+  for (int t = 0; t < 10007; ++t)
+    plain.push_back((t*t) % 5);
+  std::stringstream file;
+  {
+    maikel::hmm::binary_sequence_writer writer(file, 5, plain.size(), 16);
+    writer.write(plain.begin(), plain.end());
+  }
+  EXPECT(maikel::hmm::is_packed_sequence(file));
+  maikel::hmm::packed_sequence<> packed = maikel::hmm::read_binary_sequence(file);
+  EXPECT(packed.bits() == 4);
+  EXPECT(packed.size() == plain.size());
+  EXPECT(std::equal(plain.begin(), plain.end(), packed.begin()));
+
+  std::stringstream text("0 1\n2\n0 1\n");
+  EXPECT_NOT(maikel::hmm::is_packed_sequence(text));
+  EXPECT_THROWS_AS(maikel::hmm::read_binary_sequence(text), maikel::hmm::binary_sequence_error);
+}
+
+
+CASE ( "The symbol reader streams text and binary sequences in chunks" ) {
+  std::vector<int> plain;
+  for (int t = 0; t < 10007; ++t)
+    plain.push_back((t*t) % 3 * 10);
+  {
+    std::ofstream text("packed_sequence.t.txt");
+    text << "0 10 20 \n" << plain.size() << "\n";
+    for (int symbol : plain)
+      text << symbol << ' ';
+    text << "\n";
+    std::ofstream binary("packed_sequence.t.bin", std::ofstream::binary);
+    maikel::hmm::binary_sequence_writer writer(binary, 3, plain.size());
+    for (int symbol : plain)
+      writer.push_back(symbol / 10);
+  }
+  for (char const* path : { "packed_sequence.t.txt", "packed_sequence.t.bin" }) {
+    // a tiny buffer cuts numbers and words at every possible place
+    maikel::hmm::symbol_reader reader(path, 7);
+    EXPECT(reader.symbols() == 3u);
+    EXPECT(reader.announced_length() == plain.size());
+    std::vector<maikel::hmm::packed_symbol> chunk(100), read;
+    while (std::size_t n = reader.read(chunk.data(), chunk.size()))
+      read.insert(read.end(), chunk.begin(), chunk.begin() + n);
+    EXPECT(read.size() == plain.size());
+    EXPECT(reader.position() == plain.size());
+    for (std::size_t t = 0; t < read.size(); ++t)
+      EXPECT(read[t] == plain[t] / 10);
+  }
+  EXPECT(maikel::hmm::symbol_reader("packed_sequence.t.bin").is_binary());
+  EXPECT_NOT(maikel::hmm::symbol_reader("packed_sequence.t.txt").is_binary());
+
+  {
+    std::ofstream text("packed_sequence.t.txt");
+    text << "0 1\n3\n0 1 2\n";
+  }
+  maikel::hmm::symbol_reader reader("packed_sequence.t.txt");
+  std::vector<maikel::hmm::packed_symbol> chunk(10);
+  EXPECT_THROWS_AS(reader.read(chunk.data(), chunk.size()), maikel::hmm::symbol_reader_error);
+  std::remove("packed_sequence.t.txt");
+  std::remove("packed_sequence.t.bin");
+}
+
+}
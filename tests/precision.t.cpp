@@ -0,0 +1,125 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidden-markov-models.t.h"
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "maikel/hmm/algorithm/forward.h"
+#include "maikel/hmm/algorithm/backward.h"
+#include "maikel/hmm/algorithm/baum_welch.h"
+#include "maikel/hmm/algorithm/forward_scorer.h"
+#include "maikel/hmm/precision.h"
+#include "maikel/hmm/sequence_generator.h"
+
+namespace {
+
+  using namespace maikel::hmm;
+  using sequence = std::vector<std::uint32_t>;
+
+  sequence random_sequence(hidden_markov_model<double> const& hmm, std::size_t length, std::uint64_t seed)
+  {
+    sequence symbols(length), states(length);
+    auto generator = make_sequence_generator(hmm, seed);
+    generator.generate_into(length, symbols.data(), states.data(), 1);
+    return symbols;
+  }
+
+  /// One E-step and update in precision T, the log-likelihood is returned.
+  template <class T>
+    double reestimate(hidden_markov_model<T> const& hmm, sequence const& symbols,
+        Eigen::MatrixXd& A, Eigen::MatrixXd& B)
+    {
+      using row_vector = typename hidden_markov_model<T>::row_vector;
+      std::size_t length = symbols.size();
+      std::vector<T> scaling(length);
+      std::vector<row_vector> alphas(length), betas(length);
+      accumulator_t<T> logprob = 0;
+      std::size_t t = 0;
+      for (auto&& alpha : forward(symbols.begin(), symbols.end(), hmm)) {
+        scaling[t] = alpha.first;
+        alphas[t++] = alpha.second;
+        logprob -= std::log(static_cast<accumulator_t<T>>(alpha.first));
+      }
+      t = 0;
+      for (auto&& beta : backward(symbols.rbegin(), symbols.rend(), scaling.rbegin(), hmm))
+        betas[length - 1 - t++] = beta;
+      auto update = update_matrices<sequence::const_iterator,
+          typename std::vector<row_vector>::const_iterator,
+          typename std::vector<row_vector>::const_iterator, T>(hmm.states(), hmm.symbols());
+      auto matrices = update(symbols.begin(), symbols.end(), alphas.cbegin(), betas.cbegin(), scaling.back(), hmm);
+      A = matrices.first.template cast<double>();
+      B = matrices.second.template cast<double>();
+      return logprob;
+    }
+
+  double max_difference(Eigen::MatrixXd const& x, Eigen::MatrixXd const& y)
+  {
+    return (x - y).cwiseAbs().maxCoeff();
+  }
+
+}
+
+CASE ( "Float models sum in double" )
+{
+  EXPECT((std::is_same<accumulator_t<float>, double>::value));
+  EXPECT((std::is_same<accumulator_t<double>, double>::value));
+  EXPECT((std::is_same<decltype(std::declval<forward_scorer<float>&>().log_likelihood()), double>::value));
+}
+
+CASE ( "A model cast to float and back stays stochastic and close" )
+{
+  auto hmm = random_hidden_markov_model<double>(13, 7, 3);
+  auto single = precision_cast<float>(hmm);
+  auto back = precision_cast<double>(single);
+  EXPECT(max_difference(back.transition_matrix(), hmm.transition_matrix()) < 1e-7);
+  EXPECT(max_difference(back.symbol_probabilities(), hmm.symbol_probabilities()) < 1e-7);
+  EXPECT((back.initial_distribution() - hmm.initial_distribution()).cwiseAbs().maxCoeff() < 1e-7);
+}
+
+CASE ( "Mixed precision log-likelihoods stay within 2e-7 per symbol of double" )
+{
+  for (int states : { 4, 33, 128 }) {
+    auto hmm = random_hidden_markov_model<double>(states, 8, 11 + states);
+    auto single = precision_cast<float>(hmm);
+    sequence symbols = random_sequence(hmm, 50000, 5);
+    forward_scorer<double> exact(hmm);
+    forward_scorer<float> mixed(single);
+    exact.push(symbols.begin(), symbols.end());
+    mixed.push(symbols.begin(), symbols.end());
+    EXPECT(std::abs(mixed.log_likelihood() - exact.log_likelihood()) < 2e-7 * symbols.size());
+  }
+}
+
+CASE ( "Mixed precision Baum-Welch updates stay within 1e-6 of double" )
+{
+  // long enough that the float counts are folded into double many times
+  for (int states : { 5, 40 }) {
+    auto hmm = random_hidden_markov_model<double>(states, 6, 23 + states);
+    sequence symbols = random_sequence(hmm, 20011, 9);
+    Eigen::MatrixXd A, B, A_mixed, B_mixed;
+    double logprob = reestimate(hmm, symbols, A, B);
+    double logprob_mixed = reestimate(precision_cast<float>(hmm), symbols, A_mixed, B_mixed);
+    EXPECT(std::abs(logprob_mixed - logprob) < 2e-7 * symbols.size());
+    EXPECT(max_difference(A_mixed, A) < 1e-6);
+    EXPECT(max_difference(B_mixed, B) < 1e-6);
+    EXPECT(rows_are_probability_arrays(A_mixed));
+    EXPECT(rows_are_probability_arrays(B_mixed));
+  }
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidden-markov-models.t.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#include "maikel/latency_histogram.h"
+#include "maikel/lru_cache.h"
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/model_bank.h"
+#include "maikel/hmm/scoring_cache.h"
+#include "maikel/hmm/scoring_service.h"
+#include "maikel/hmm/sequence_generator.h"
+#include "maikel/hmm/algorithm/forward_scorer.h"
+
+namespace {
+
+CASE ( "A latency histogram finds percentiles within its bucket resolution" ) {
+  maikel::latency_histogram histogram;
+  EXPECT(histogram.percentile(0.5) == 0u);
+  for (std::uint64_t v = 1; v <= 10000; ++v)
+    histogram.record(v * 1000);
+  EXPECT(histogram.count() == 10000u);
+  EXPECT(histogram.max() == 10000000u);
+  double p50 = static_cast<double>(histogram.percentile(0.5));
+  double p99 = static_cast<double>(histogram.percentile(0.99));
+  EXPECT(p50 >= 5000000.0);
+  EXPECT(p50 <= 5000000.0 * 17 / 16);
+  EXPECT(p99 >= 9900000.0);
+  EXPECT(p99 <= 9900000.0 * 17 / 16);
+  EXPECT(histogram.percentile(1.0) == histogram.max());
+  for (unsigned b = 1; b < maikel::latency_histogram::buckets; ++b)
+    EXPECT(maikel::latency_histogram::bucket_of(maikel::latency_histogram::upper_bound(b-1) + 1) == b);
+}
+
+CASE ( "A single writer histogram merges like a shared one" ) {
+  maikel::latency_histogram exclusive, shared, merged;
+  EXPECT(exclusive.min() == 0u);
+  for (std::uint64_t v = 3; v < 3000; v += 7) {
+    exclusive.record_exclusive(v);
+    shared.record(v);
+  }
+  merged.merge(exclusive);
+  EXPECT(merged.count() == shared.count());
+  EXPECT(merged.sum() == shared.sum());
+  EXPECT(merged.min() == 3u);
+  EXPECT(merged.max() == shared.max());
+  EXPECT(merged.percentile(0.9) == shared.percentile(0.9));
+}
+
+CASE ( "The scoring service answers concurrent requests in batches" ) {
+  auto first = maikel::hmm::random_hidden_markov_model<double>(2, 3, 1);
+  auto second = maikel::hmm::random_hidden_markov_model<double>(2, 3, 2);
+  {
+    maikel::hmm::model_bank_writer<double> writer("scoring_service.t.bank");
+    writer.add("first", first);
+    writer.add("second", second);
+  }
+  maikel::hmm::scoring_service_options options;
+  options.max_delay = std::chrono::microseconds(2000);
+  maikel::hmm::scoring_service<double> service("scoring_service.t.bank", options);
+
+  auto request_of = [] (std::size_t c) {
+    std::string request = c % 2 ? "likelihood second" : "likelihood first";
+    for (std::size_t t = 0; t < 10 + c; ++t)
+      request += ' ' + std::to_string((t*c + t/3) % 3);
+    return request;
+  };
+  std::vector<std::string> answers(32);
+  std::vector<std::thread> clients;
+  for (std::size_t c = 0; c < answers.size(); ++c)
+    clients.emplace_back([&service, &answers, &request_of, c] {
+      answers[c] = service.handle(request_of(c));
+    });
+  for (std::thread& client : clients)
+    client.join();
+  for (std::size_t c = 0; c < answers.size(); ++c) {
+    maikel::hmm::forward_scorer<double> scorer(c % 2 ? second : first);
+    for (std::size_t t = 0; t < 10 + c; ++t)
+      scorer.push((t*c + t/3) % 3);
+    EXPECT(answers[c].compare(0, 3, "ok ") == 0);
+    EXPECT(std::abs(std::strtod(answers[c].c_str() + 3, nullptr) - scorer.log_likelihood()) < 1e-9);
+  }
+  EXPECT(service.batches() < answers.size());
+  EXPECT(service.likelihood_latencies().count() == answers.size());
+
+  std::vector<std::string> paths(8);
+  clients.clear();
+  for (std::size_t c = 0; c < paths.size(); ++c)
+    clients.emplace_back([&service, &paths, &request_of, c] {
+      paths[c] = service.handle("decode" + request_of(c).substr(10));
+    });
+  for (std::thread& client : clients)
+    client.join();
+  for (std::size_t c = 0; c < paths.size(); ++c) {
+    std::vector<std::uint32_t> symbols;
+    for (std::size_t t = 0; t < 10 + c; ++t)
+      symbols.push_back(static_cast<std::uint32_t>((t*c + t/3) % 3));
+    auto path = maikel::hmm::viterbi(symbols.begin(), symbols.end(), c % 2 ? second : first);
+    std::string states;
+    for (std::uint32_t state : path.states)
+      states += ' ' + std::to_string(state);
+    EXPECT(paths[c].compare(0, 3, "ok ") == 0);
+    EXPECT(paths[c].substr(paths[c].size() - states.size()) == states);
+  }
+
+  EXPECT(service.handle("decode" + request_of(3).substr(10)) == paths[3]);
+  EXPECT(service.handle("posterior second 0 1").compare(0, 7, "ok 2 2 ") == 0);
+  EXPECT(service.handle("likelihood nobody 0 1").compare(0, 5, "error") == 0);
+  EXPECT(service.handle("likelihood first 0 3").compare(0, 5, "error") == 0);
+  EXPECT(service.handle("likelihood first 0 x").compare(0, 5, "error") == 0);
+  EXPECT(service.handle(request_of(0)) == answers[0]);
+  EXPECT(service.cache_statistics().hits == 1u);
+  EXPECT(service.handle("stats").find("likelihood_p99_us=") != std::string::npos);
+
+  {
+    maikel::hmm::model_bank_writer<double> writer("scoring_service.t.bank.new");
+    writer.add("second", second);
+  }
+  std::rename("scoring_service.t.bank.new", "scoring_service.t.bank");
+  EXPECT(service.handle("reload") == "ok 1");
+  EXPECT(service.handle("likelihood first 0 1").compare(0, 5, "error") == 0);
+  EXPECT(service.handle("likelihood second 0 1").compare(0, 3, "ok ") == 0);
+  std::remove("scoring_service.t.bank");
+}
+
+CASE ( "The scoring service answers the next request after a model fails to build" ) {
+  {
+    maikel::hmm::model_bank_writer<double> writer("scoring_service.t.broken.bank");
+    writer.add("broken", maikel::hmm::random_hidden_markov_model<double>(2, 3, 1));
+    writer.add("first", maikel::hmm::random_hidden_markov_model<double>(2, 3, 2));
+  }
+  {
+    // A(0,0) of the broken model, whose first row then sums to more than one
+    std::fstream file("scoring_service.t.broken.bank", std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(sizeof(maikel::hmm::model_bank_header));
+    double broken = 1.8;
+    file.write(reinterpret_cast<char const*>(&broken), sizeof(broken));
+  }
+  maikel::hmm::scoring_service_options options;
+  options.preload = false;
+  maikel::hmm::scoring_service<double> service("scoring_service.t.broken.bank", options);
+  EXPECT(service.handle("likelihood broken 0 1 2").compare(0, 6, "error ") == 0);
+  EXPECT(service.handle("decode broken 0 1 2").compare(0, 6, "error ") == 0);
+  EXPECT(service.handle("likelihood first 0 1 2").compare(0, 3, "ok ") == 0);
+  EXPECT(service.handle("decode first 0 1 2").compare(0, 3, "ok ") == 0);
+  std::remove("scoring_service.t.broken.bank");
+}
+
+
+CASE ( "A LRU cache forgets the least recently used entries first" ) {
+  maikel::lru_cache<int, std::string> cache(3);
+  cache.insert(1, "one", 1);
+  cache.insert(2, "two", 1);
+  cache.insert(3, "three", 1);
+  EXPECT(*cache.find(1) == "one");
+  cache.insert(4, "four", 1);
+  EXPECT(cache.find(2) == nullptr);
+  EXPECT(cache.find(1) != nullptr);
+  cache.insert(5, "five", 2);
+  EXPECT(cache.size() == 2u);
+  EXPECT(cache.cost() == 3u);
+  EXPECT(cache.find(3) == nullptr);
+  EXPECT(cache.find(4) == nullptr);
+  cache.insert(6, "too big", 4);
+  EXPECT(cache.find(6) == nullptr);
+  EXPECT(*cache.find(5) == "five");
+}
+
+CASE ( "The scoring cache resumes sequences from a shared prefix" ) {
+  auto hmm = maikel::hmm::random_hidden_markov_model<double>(2, 3, 3);
+  std::uint64_t fingerprint = maikel::hmm::model_fingerprint(hmm);
+  EXPECT(fingerprint == maikel::hmm::model_fingerprint(maikel::hmm::random_hidden_markov_model<double>(2, 3, 3)));
+  EXPECT(fingerprint != maikel::hmm::model_fingerprint(maikel::hmm::random_hidden_markov_model<double>(2, 3, 4)));
+
+  maikel::hmm::scoring_cache<double> cache(1 << 20, 1 << 20, 100);
+  auto exact = [&hmm] (std::vector<int> const& sequence) {
+    maikel::hmm::forward_scorer<double> scorer(hmm);
+    scorer.push(sequence.begin(), sequence.end());
+    return scorer.log_likelihood();
+  };
+  std::vector<int> first, second;
+  for (int t = 0; t < 1000; ++t)
+    first.push_back((t*t + t/5) % 3);
+  second.assign(first.begin(), first.begin() + 750);
+  for (int t = 0; t < 300; ++t)
+    second.push_back(t % 3);
+
+  double a = cache.log_likelihood(hmm, fingerprint, first.begin(), first.end());
+  EXPECT(std::abs(a - exact(first)) < 1e-9);
+  EXPECT(cache.log_likelihood(hmm, fingerprint, first.begin(), first.end()) == a);
+  double b = cache.log_likelihood(hmm, fingerprint, second.begin(), second.end());
+  EXPECT(std::abs(b - exact(second)) < 1e-9);
+  double c = cache.log_likelihood(hmm, fingerprint, first.begin(), first.begin() + 700);
+  EXPECT(std::abs(c - exact(std::vector<int>(first.begin(), first.begin() + 700))) < 1e-9);
+
+  maikel::hmm::scoring_cache_statistics statistics = cache.statistics();
+  EXPECT(statistics.hits == 1u);
+  EXPECT(statistics.misses == 1u);
+  EXPECT(statistics.prefix_hits == 2u);
+  EXPECT(statistics.symbols_skipped == 700u + 700u);
+  EXPECT(statistics.symbols_scored == 1000u + 350u);
+}
+}
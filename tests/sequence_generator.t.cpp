@@ -0,0 +1,128 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidden-markov-models.t.h"
+
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include <Eigen/Dense>
+#include "maikel/random.h"
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/sequence_generator.h"
+
+namespace {
+
+CASE ( "Alias tables sample from the given distribution" ) {
+  Eigen::RowVector4d dist;
+  dist << 0.1, 0.0, 0.6, 0.3;
+  maikel::alias_table table(dist);
+  maikel::counter_based_engine engine(42);
+  std::vector<double> histogram(4);
+  const int draws = 400000;
+  for (int i = 0; i < draws; ++i)
+    histogram[table(engine())] += 1.0 / draws;
+  EXPECT(histogram[1] == 0.0);
+  for (int i = 0; i < 4; ++i)
+    EXPECT(std::abs(histogram[i] - dist(i)) < 0.005);
+}
+
+CASE ( "Counter based engines can be split and replayed" ) {
+  maikel::counter_based_engine a(7), b(7), c(8);
+  std::uint64_t x = a();
+  EXPECT(x == b());
+  EXPECT(x != c());
+  b.seek(100);
+  EXPECT(b() == a.at(100));
+}
+
+CASE ( "Generated sequences only depend on the seed" ) {
+  auto hmm = maikel::hmm::random_hidden_markov_model<double>(3, 2, 5);
+  std::size_t n = 5*maikel::hmm::detail::sequence_generator<double>::chunk_length + 123;
+
+  auto sequential = maikel::hmm::make_sequence_generator(hmm, 1234);
+  std::vector<std::size_t> symbols, states;
+  for (std::size_t t = 0; t < n; ++t) {
+    symbols.push_back(sequential());
+    states.push_back(sequential.state());
+  }
+
+  for (unsigned threads : { 1, 2, 3, 8 }) {
+    auto bulk = maikel::hmm::make_sequence_generator(hmm, 1234);
+    std::vector<std::size_t> bulk_symbols, bulk_states;
+    bulk.generate(100, std::back_inserter(bulk_symbols), std::back_inserter(bulk_states), threads);
+    bulk.generate(n - 100, std::back_inserter(bulk_symbols), std::back_inserter(bulk_states), threads);
+    EXPECT(bulk_symbols == symbols);
+    EXPECT(bulk_states == states);
+    EXPECT(bulk.position() == n);
+  }
+
+  auto other = maikel::hmm::make_sequence_generator(hmm, 4321);
+  std::vector<std::size_t> other_symbols;
+  other.generate(n, std::back_inserter(other_symbols));
+  EXPECT(other_symbols != symbols);
+}
+
+CASE ( "A periodic chain is generated like serially and repaired at most once" ) {
+  // a 3-cycle never forgets its state, the guessed paths of the chunks never meet the true one
+  Eigen::Matrix3d A;
+  A << 0, 1, 0,
+       0, 0, 1,
+       1, 0, 0;
+  Eigen::Matrix<double, 3, 2> B;
+  B << 0.9, 0.1,
+       0.3, 0.7,
+       0.5, 0.5;
+  Eigen::RowVector3d pi;
+  pi << 0.2, 0.3, 0.5;
+  maikel::hmm::hidden_markov_model<double> hmm(A, B, pi);
+  std::size_t chunk = maikel::hmm::detail::sequence_generator<double>::chunk_length;
+  std::size_t n = 5*chunk + 123;
+
+  for (std::uint64_t seed : { 1, 2, 3 }) {
+    auto sequential = maikel::hmm::make_sequence_generator(hmm, seed);
+    std::vector<std::uint32_t> symbols, states;
+    for (std::size_t t = 0; t < n; ++t) {
+      symbols.push_back(static_cast<std::uint32_t>(sequential()));
+      states.push_back(static_cast<std::uint32_t>(sequential.state()));
+    }
+    auto bulk = maikel::hmm::make_sequence_generator(hmm, seed);
+    std::vector<std::uint32_t> bulk_symbols(n), bulk_states(n);
+    bulk.generate_into(n, bulk_symbols.data(), bulk_states.data(), 4);
+    EXPECT(bulk_symbols == symbols);
+    EXPECT(bulk_states == states);
+    EXPECT(bulk.repaired_steps() <= n - chunk);
+  }
+}
+
+CASE ( "Random models are stochastic and only depend on the seed" ) {
+  auto a = maikel::hmm::random_hidden_markov_model<double>(5, 3, 17);
+  auto b = maikel::hmm::random_hidden_markov_model<double>(5, 3, 17);
+  auto c = maikel::hmm::random_hidden_markov_model<double>(5, 3, 18);
+  EXPECT(a.states() == 5);
+  EXPECT(a.symbols() == 3);
+  EXPECT(a.transition_matrix() == b.transition_matrix());
+  EXPECT(a.symbol_probabilities() == b.symbol_probabilities());
+  EXPECT(a.transition_matrix() != c.transition_matrix());
+  for (int i = 0; i < 5; ++i) {
+    EXPECT(std::abs(a.transition_matrix().row(i).sum() - 1.0) < 1e-12);
+    EXPECT(std::abs(a.symbol_probabilities().row(i).sum() - 1.0) < 1e-12);
+  }
+  EXPECT(std::abs(a.initial_distribution().sum() - 1.0) < 1e-12);
+}
+
+}
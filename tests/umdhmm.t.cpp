@@ -0,0 +1,95 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidden-markov-models.t.h"
+
+#include <cmath>
+#include <sstream>
+#include "maikel/hmm/io.h"
+#include "maikel/hmm/umdhmm.h"
+
+namespace {
+  char const* const umdhmm_t2 =
+      "M= 2\n"
+      "N= 3\n"
+      "A:\n"
+      "0.333 0.333 0.333\n"
+      "0.333 0.333 0.333\n"
+      "0.333 0.333 0.333\n"
+      "B:\n"
+      "0.5 0.5\n"
+      "0.75 0.25\n"
+      "0.25 0.75\n"
+      "pi:\n"
+      "0.333 0.333 0.333\n";
+}
+
+CASE ( "Reads a UMDHMM model and normalizes its rows" )
+{
+  std::istringstream in(umdhmm_t2);
+  auto hmm = maikel::hmm::read_umdhmm_model<double>(in);
+  EXPECT(hmm.states() == 3);
+  EXPECT(hmm.symbols() == 2);
+  EXPECT(std::abs(hmm.transition_matrix()(1, 2) - 1.0/3) < 1e-12);
+  EXPECT(std::abs(hmm.symbol_probabilities()(1, 0) - 0.75) < 1e-12);
+  EXPECT(std::abs(hmm.initial_distribution()(2) - 1.0/3) < 1e-12);
+}
+
+CASE ( "Converting a model to UMDHMM and ours keeps its numbers" )
+{
+  std::istringstream in(umdhmm_t2);
+  auto hmm = maikel::hmm::read_umdhmm_model<double>(in);
+  std::stringstream umdhmm;
+  maikel::hmm::write_umdhmm_model(umdhmm, hmm);
+  auto from_umdhmm = maikel::hmm::read_umdhmm_model<double>(umdhmm);
+  std::stringstream ours;
+  maikel::hmm::write_hidden_markov_model(ours, from_umdhmm);
+  auto from_ours = maikel::hmm::read_hidden_markov_model<double>(ours);
+  EXPECT(from_ours.transition_matrix().isApprox(hmm.transition_matrix()));
+  EXPECT(from_ours.symbol_probabilities().isApprox(hmm.symbol_probabilities()));
+  EXPECT(from_ours.initial_distribution().isApprox(hmm.initial_distribution()));
+}
+
+CASE ( "Reads UMDHMM sequences with and without a number of runs" )
+{
+  std::istringstream plain("T= 4\n2 1 2 2\n");
+  std::istringstream runs("R= 1\nT= 4\n2 1 2 2\n");
+  std::vector<std::uint32_t> expected { 1, 0, 1, 1 };
+  EXPECT(maikel::hmm::read_umdhmm_sequence(plain) == expected);
+  EXPECT(maikel::hmm::read_umdhmm_sequence(runs) == expected);
+}
+
+CASE ( "Rejects UMDHMM input with missing labels or symbols" )
+{
+  std::istringstream no_label("2\n3\n");
+  EXPECT_THROWS_AS(maikel::hmm::read_umdhmm_model<double>(no_label), maikel::hmm::umdhmm_format_error);
+  std::istringstream zero_symbol("T= 2\n0 1\n");
+  EXPECT_THROWS_AS(maikel::hmm::read_umdhmm_sequence(zero_symbol), maikel::hmm::umdhmm_format_error);
+  std::istringstream too_short("T= 3\n1 2\n");
+  EXPECT_THROWS_AS(maikel::hmm::read_umdhmm_sequence(too_short), maikel::hmm::umdhmm_format_error);
+}
+
+CASE ( "A sequence converted from UMDHMM reads back in our text format" )
+{
+  std::vector<std::uint32_t> sequence { 2, 0, 1, 1, 2 };
+  std::stringstream umdhmm;
+  maikel::hmm::write_umdhmm_sequence(umdhmm, sequence.begin(), sequence.end());
+  std::vector<std::uint32_t> from_umdhmm = maikel::hmm::read_umdhmm_sequence(umdhmm);
+  EXPECT(from_umdhmm == sequence);
+  std::stringstream ours;
+  maikel::hmm::write_text_sequence(ours, from_umdhmm.begin(), from_umdhmm.end(), 3);
+  EXPECT(maikel::hmm::read_sequence<std::uint32_t>(ours) == sequence);
+}
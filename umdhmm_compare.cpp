@@ -0,0 +1,409 @@
+/*
+ * Copyright 2016 Maikel Nadolski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "maikel/hmm/hidden_markov_model.h"
+#include "maikel/hmm/algorithm.h"
+#include "maikel/hmm/io.h"
+#include "maikel/hmm/sequence_generator.h"
+#include "maikel/hmm/umdhmm.h"
+
+// UMDHMM from third_party/umdhmm-v1.02, nrutil.h only has declarations without parameters
+extern "C" {
+#include "hmm.h"
+  double** dmatrix(int nrl, int nrh, int ncl, int nch);
+  double* dvector(int nl, int nh);
+  int* ivector(int nl, int nh);
+  int** imatrix(int nrl, int nrh, int ncl, int nch);
+  void free_dmatrix(double** m, int nrl, int nrh, int ncl, int nch);
+  void free_dvector(double* v, int nl, int nh);
+  void free_ivector(int* v, int nl, int nh);
+  void free_imatrix(int** m, int nrl, int nrh, int ncl, int nch);
+}
+
+enum Exit_Error_Codes {
+  exit_success = 0,
+  exit_not_enough_arguments = 1,
+  exit_io_error = 2,
+  exit_argument_error = 3,
+  exit_mismatch = 4
+};
+
+using float_type = double;
+using model = maikel::hmm::hidden_markov_model<float_type>;
+using matrix = model::matrix;
+using row_vector = model::row_vector;
+using clock_type = std::chrono::steady_clock;
+
+/// A copy of our model in the 1-based arrays of UMDHMM.
+class umdhmm_model {
+  public:
+    explicit umdhmm_model(model const& hmm)
+    {
+      hmm_.N = static_cast<int>(hmm.states());
+      hmm_.M = static_cast<int>(hmm.symbols());
+      hmm_.A = dmatrix(1, hmm_.N, 1, hmm_.N);
+      hmm_.B = dmatrix(1, hmm_.N, 1, hmm_.M);
+      hmm_.pi = dvector(1, hmm_.N);
+      for (int i = 1; i <= hmm_.N; ++i) {
+        hmm_.pi[i] = hmm.initial_distribution()(i-1);
+        for (int j = 1; j <= hmm_.N; ++j)
+          hmm_.A[i][j] = hmm.transition_matrix()(i-1, j-1);
+        for (int k = 1; k <= hmm_.M; ++k)
+          hmm_.B[i][k] = hmm.symbol_probabilities()(i-1, k-1);
+      }
+    }
+
+    ~umdhmm_model() { FreeHMM(&hmm_); }
+
+    umdhmm_model(umdhmm_model const&) = delete;
+    umdhmm_model& operator=(umdhmm_model const&) = delete;
+
+    HMM* get() noexcept { return &hmm_; }
+
+  private:
+    HMM hmm_;
+};
+
+/// The arrays which UMDHMM's algorithms expect from their caller.
+struct umdhmm_buffers {
+    int T, N;
+    int* O;
+    double** alpha;
+    double** beta;
+    double** gamma;
+    double* scale;
+    double** delta;
+    int** psi;
+    int* q;
+    double*** xi = nullptr;
+
+    umdhmm_buffers(std::vector<std::uint32_t> const& sequence, int states, bool with_xi)
+    : T{static_cast<int>(sequence.size())}, N{states}
+    {
+      O = ivector(1, T);
+      for (int t = 1; t <= T; ++t)
+        O[t] = static_cast<int>(sequence[t-1]) + 1;
+      alpha = dmatrix(1, T, 1, N);
+      beta = dmatrix(1, T, 1, N);
+      gamma = dmatrix(1, T, 1, N);
+      scale = dvector(1, T);
+      delta = dmatrix(1, T, 1, N);
+      psi = imatrix(1, T, 1, N);
+      q = ivector(1, T);
+      if (with_xi)
+        xi = AllocXi(T, N);
+    }
+
+    ~umdhmm_buffers()
+    {
+      if (xi)
+        FreeXi(xi, T, N);
+      free_ivector(q, 1, T);
+      free_imatrix(psi, 1, T, 1, N);
+      free_dmatrix(delta, 1, T, 1, N);
+      free_dvector(scale, 1, T);
+      free_dmatrix(gamma, 1, T, 1, N);
+      free_dmatrix(beta, 1, T, 1, N);
+      free_dmatrix(alpha, 1, T, 1, N);
+      free_ivector(O, 1, T);
+    }
+
+    umdhmm_buffers(umdhmm_buffers const&) = delete;
+    umdhmm_buffers& operator=(umdhmm_buffers const&) = delete;
+};
+
+/**
+ * One re-estimation of A and B from gamma and xi, as in BaumWelch() of
+ * baum.c but without its smoothing towards 0.001, which our
+ * update_matrices() does not do.
+ */
+void umdhmm_reestimate(HMM const* phmm, umdhmm_buffers const& b, matrix& A, matrix& B)
+{
+  int N = phmm->N, M = phmm->M, T = b.T;
+  A.resize(N, N);
+  B.resize(N, M);
+  for (int i = 1; i <= N; ++i) {
+    double denominatorA = 0.0;
+    for (int t = 1; t <= T - 1; ++t)
+      denominatorA += b.gamma[t][i];
+    for (int j = 1; j <= N; ++j) {
+      double numeratorA = 0.0;
+      for (int t = 1; t <= T - 1; ++t)
+        numeratorA += b.xi[t][i][j];
+      A(i-1, j-1) = numeratorA / denominatorA;
+    }
+    double denominatorB = denominatorA + b.gamma[T][i];
+    for (int k = 1; k <= M; ++k) {
+      double numeratorB = 0.0;
+      for (int t = 1; t <= T; ++t)
+        if (b.O[t] == k)
+          numeratorB += b.gamma[t][i];
+      B(i-1, k-1) = numeratorB / denominatorB;
+    }
+  }
+}
+
+/// Median of the wall times of `repetitions` runs in nanoseconds per symbol.
+double time_per_symbol(std::function<void()> const& run, unsigned repetitions, std::size_t length)
+{
+  std::vector<double> samples;
+  for (unsigned r = 0; r < repetitions; ++r) {
+    clock_type::time_point start = clock_type::now();
+    run();
+    samples.push_back(static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count())
+        / static_cast<double>(length));
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+struct comparison {
+    std::string stage;
+    double ours_ns;
+    double theirs_ns;
+    std::string quantity;
+    double difference;
+    bool ok;
+};
+
+int compare(model const& hmm, std::vector<std::uint32_t> const& sequence,
+    unsigned repetitions, double tolerance)
+{
+  using namespace maikel::hmm;
+  std::size_t T = sequence.size();
+  std::size_t N = static_cast<std::size_t>(hmm.states());
+  if (T < 2) {
+    std::cerr << "The sequence needs at least two symbols.\n";
+    return exit_argument_error;
+  }
+  for (std::uint32_t o : sequence)
+    if (o >= static_cast<std::uint32_t>(hmm.symbols())) {
+      std::cerr << "The sequence has more symbols than the model.\n";
+      return exit_argument_error;
+    }
+  bool with_xi = T*N*N*sizeof(double) <= (std::size_t{1} << 30);
+  if (!with_xi)
+    std::cerr << "Skipping the Baum-Welch update, xi of UMDHMM would not fit.\n";
+
+  umdhmm_model theirs(hmm);
+  umdhmm_buffers buffers(sequence, static_cast<int>(N), with_xi);
+  std::vector<comparison> results;
+  auto relative = [] (double a, double b) { return std::abs(a - b) / std::max(1.0, std::abs(b)); };
+
+  // forward
+  std::vector<float_type> scaling(T);
+  std::vector<row_vector> alphas(T, row_vector(N)), betas(T, row_vector(N));
+  float_type ours_logprob = 0;
+  double ours_ns = time_per_symbol([&] {
+    std::size_t t = 0;
+    ours_logprob = 0;
+    for (auto&& alpha : forward(sequence.begin(), sequence.end(), hmm)) {
+      scaling[t] = alpha.first;
+      alphas[t++] = alpha.second;
+      ours_logprob -= std::log(alpha.first);
+    }
+  }, repetitions, T);
+  double theirs_logprob = 0;
+  double theirs_ns = time_per_symbol([&] {
+    ForwardWithScale(theirs.get(), buffers.T, buffers.O, buffers.alpha, buffers.scale, &theirs_logprob);
+  }, repetitions, T);
+  double difference = relative(ours_logprob, theirs_logprob);
+  results.push_back({"forward", ours_ns, theirs_ns, "log-likelihood", difference, difference <= tolerance});
+
+  // backward, both scale beta_t with the forward scaling factor of t, so the coefficients agree
+  ours_ns = time_per_symbol([&] {
+    std::size_t t = 0;
+    for (auto&& beta : backward(sequence.rbegin(), sequence.rend(), scaling.rbegin(), hmm))
+      betas[T - 1 - t++] = beta;
+  }, repetitions, T);
+  double theirs_backward_logprob;
+  theirs_ns = time_per_symbol([&] {
+    BackwardWithScale(theirs.get(), buffers.T, buffers.O, buffers.beta, buffers.scale, &theirs_backward_logprob);
+  }, repetitions, T);
+  difference = 0;
+  for (std::size_t t = 0; t < T; ++t)
+    for (std::size_t i = 0; i < N; ++i)
+      difference = std::max(difference, relative(betas[t](i), buffers.beta[t+1][i+1]));
+  results.push_back({"backward", ours_ns, theirs_ns, "betas", difference, difference <= tolerance});
+
+  // one Baum-Welch re-estimation from the coefficients above
+  if (with_xi) {
+    auto update = update_matrices<
+        std::vector<std::uint32_t>::const_iterator,
+        std::vector<row_vector>::const_iterator,
+        std::vector<row_vector>::const_iterator, float_type>(N, static_cast<std::size_t>(hmm.symbols()));
+    matrix ours_A, ours_B, theirs_A, theirs_B;
+    ours_ns = time_per_symbol([&] {
+      std::vector<row_vector> const& a = alphas;
+      std::vector<row_vector> const& b = betas;
+      auto matrices = update(sequence.begin(), sequence.end(), a.begin(), b.begin(), scaling.back(), hmm);
+      ours_A = matrices.first;
+      ours_B = matrices.second;
+    }, repetitions, T);
+    theirs_ns = time_per_symbol([&] {
+      ComputeGamma(theirs.get(), buffers.T, buffers.alpha, buffers.beta, buffers.gamma);
+      ComputeXi(theirs.get(), buffers.T, buffers.O, buffers.alpha, buffers.beta, buffers.xi);
+      umdhmm_reestimate(theirs.get(), buffers, theirs_A, theirs_B);
+    }, repetitions, T);
+    difference = std::max((ours_A - theirs_A).cwiseAbs().maxCoeff(), (ours_B - theirs_B).cwiseAbs().maxCoeff());
+    results.push_back({"baum_welch", ours_ns, theirs_ns, "A and B", difference, difference <= tolerance});
+  }
+
+  // viterbi, ViterbiLog() replaces pi and A by their logarithms, so it gets a fresh copy every time
+  viterbi_result<float_type> path;
+  ours_ns = time_per_symbol([&] {
+    path = viterbi(sequence.begin(), sequence.end(), hmm);
+  }, repetitions, T);
+  double theirs_viterbi = 0;
+  theirs_ns = time_per_symbol([&] {
+    umdhmm_model copy(hmm);
+    ViterbiLog(copy.get(), buffers.T, buffers.O, buffers.delta, buffers.psi, buffers.q, &theirs_viterbi);
+  }, repetitions, T);
+  difference = relative(path.log_probability, theirs_viterbi);
+  std::size_t different_states = 0;
+  for (std::size_t t = 0; t < T; ++t)
+    if (static_cast<int>(path.states[t]) + 1 != buffers.q[t+1])
+      ++different_states;
+  results.push_back({"viterbi", ours_ns, theirs_ns, "log-probability", difference, difference <= tolerance});
+
+  bool all_ok = true;
+  std::cout << "N= " << N << " M= " << hmm.symbols() << " T= " << T << "\n"
+            << "       stage   ours ns/symbol  UMDHMM ns/symbol  speedup  compared          difference\n";
+  for (comparison const& c : results) {
+    std::cout << std::setw(12) << c.stage << std::fixed << std::setprecision(2)
+              << std::setw(17) << c.ours_ns << std::setw(18) << c.theirs_ns
+              << std::setw(8) << c.theirs_ns / c.ours_ns << "x  "
+              << std::left << std::setw(16) << c.quantity << std::right
+              << std::scientific << std::setprecision(3) << std::setw(12) << c.difference
+              << (c.ok ? "" : "  MISMATCH") << '\n';
+    all_ok = all_ok && c.ok;
+  }
+  std::cout << "Viterbi paths differ in " << different_states << " of " << T << " states.\n";
+  return all_ok ? exit_success : exit_mismatch;
+}
+
+void print_usage(char const* program)
+{
+  std::cerr << "Usage: " << program << " [--repetitions <r>] [--tolerance <x>] <model.hmm> <sequence.seq>\n"
+            << "       " << program << " [--repetitions <r>] [--tolerance <x>] --random <N> <M> <T> [seed]\n"
+            << "       " << program << " --from-umdhmm <model.hmm> | --to-umdhmm <model.dat>\n"
+            << "       " << program << " --sequence-from-umdhmm <sequence.seq> <symbols>\n"
+            << "       " << program << " --sequence-to-umdhmm <sequence.dat>\n"
+            << "Runs the forward, backward, Baum-Welch update and Viterbi algorithms of\n"
+            << "UMDHMM and ours on the same model and sequence in UMDHMM's formats, or on\n"
+            << "a random model and sequence. Prints the time per symbol of both and the\n"
+            << "largest difference of their results, and fails if it exceeds the\n"
+            << "tolerance. The other forms convert models and sequences to stdout.\n";
+}
+
+int main(int argc, char *argv[])
+{
+  using namespace maikel::hmm;
+
+  unsigned repetitions = 3;
+  double tolerance = 1e-8;
+  bool random = false;
+  std::string convert;
+  std::vector<std::string> arguments;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+    if (argument == "--repetitions" && i+1 < argc)
+      repetitions = std::max(1u, static_cast<unsigned>(std::stoul(argv[++i])));
+    else if (argument == "--tolerance" && i+1 < argc)
+      tolerance = std::stod(argv[++i]);
+    else if (argument == "--random")
+      random = true;
+    else if (argument == "--from-umdhmm" || argument == "--to-umdhmm"
+          || argument == "--sequence-from-umdhmm" || argument == "--sequence-to-umdhmm")
+      convert = argument;
+    else
+      arguments.push_back(argument);
+  }
+
+  try {
+    if (!convert.empty()) {
+      std::size_t needed = convert == "--sequence-from-umdhmm" ? 2 : 1;
+      if (arguments.size() < needed) {
+        print_usage(argv[0]);
+        return exit_not_enough_arguments;
+      }
+      std::ifstream in(arguments[0]);
+      if (!in) {
+        std::cerr << "Could not open " << arguments[0] << ".\n";
+        return exit_io_error;
+      }
+      if (convert == "--from-umdhmm") {
+        write_hidden_markov_model(std::cout, read_umdhmm_model<float_type>(in));
+      } else if (convert == "--to-umdhmm") {
+        write_umdhmm_model(std::cout, read_hidden_markov_model<float_type>(in));
+      } else if (convert == "--sequence-from-umdhmm") {
+        std::vector<std::uint32_t> sequence = read_umdhmm_sequence(in);
+        write_text_sequence(std::cout, sequence.begin(), sequence.end(), std::stoul(arguments[1]));
+      } else {
+        std::vector<std::uint32_t> sequence = read_sequence<std::uint32_t>(in);
+        write_umdhmm_sequence(std::cout, sequence.begin(), sequence.end());
+      }
+      return exit_success;
+    }
+
+    if (random) {
+      if (arguments.size() < 3) {
+        print_usage(argv[0]);
+        return exit_not_enough_arguments;
+      }
+      auto N = static_cast<model::size_type>(std::stol(arguments[0]));
+      auto M = static_cast<model::size_type>(std::stol(arguments[1]));
+      std::size_t T = static_cast<std::size_t>(std::stod(arguments[2]));
+      std::uint64_t seed = arguments.size() > 3 ? std::stoull(arguments[3]) : 1;
+      model hmm = random_hidden_markov_model<float_type>(N, M, seed);
+      std::vector<std::uint32_t> sequence(T), states(T);
+      make_sequence_generator(hmm, seed).generate_into(T, sequence.data(), states.data(), 1);
+      return compare(hmm, sequence, repetitions, tolerance);
+    }
+
+    if (arguments.size() < 2) {
+      print_usage(argv[0]);
+      return exit_not_enough_arguments;
+    }
+    std::ifstream model_input(arguments[0]);
+    std::ifstream sequence_input(arguments[1]);
+    if (!model_input || !sequence_input) {
+      std::cerr << "Could not open the model or the sequence.\n";
+      return exit_io_error;
+    }
+    model hmm = read_umdhmm_model<float_type>(model_input);
+    std::vector<std::uint32_t> sequence = read_umdhmm_sequence(sequence_input);
+    return compare(hmm, sequence, repetitions, tolerance);
+  } catch (std::runtime_error const& error) {
+    std::cerr << "Could not read the input: " << error.what() << '\n';
+    return exit_io_error;
+  }
+}